@@ -0,0 +1,357 @@
+#include "pch.h"
+#include "AdapterInventory.h"
+#include "LogSpan.h"
+#include "TraceRecorder.h"
+
+#include <iphlpapi.h>    // GetAdaptersAddresses, NotifyIpInterfaceChange
+#include <WinSock2.h>
+#include <WS2tcpip.h>    // InetNtop
+#include <netlistmgr.h>  // INetworkListManager
+#include <map>
+
+#pragma comment(lib, "iphlpapi.lib")
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "ole32.lib")
+
+// ════════════════════════════════════════════════════════════════
+// Cache and change notifications
+// ════════════════════════════════════════════════════════════════
+
+static VOID NETIOAPI_API_ OnInterfaceChange(PVOID context, PMIB_IPINTERFACE_ROW, MIB_NOTIFICATION_TYPE)
+{
+    static_cast<CAdapterInventory*>(context)->Invalidate();
+}
+
+static VOID NETIOAPI_API_ OnAddressChange(PVOID context, PMIB_UNICASTIPADDRESS_ROW, MIB_NOTIFICATION_TYPE)
+{
+    static_cast<CAdapterInventory*>(context)->Invalidate();
+}
+
+CAdapterInventory& CAdapterInventory::Instance()
+{
+    static CAdapterInventory inventory;
+    return inventory;
+}
+
+CAdapterInventory::CAdapterInventory()
+    : m_dirty(true)
+    , m_hInterfaceNotify(nullptr)
+    , m_hAddressNotify(nullptr)
+{
+}
+
+CAdapterInventory::~CAdapterInventory()
+{
+    if (m_hInterfaceNotify)
+        CancelMibChangeNotify2(m_hInterfaceNotify);
+    if (m_hAddressNotify)
+        CancelMibChangeNotify2(m_hAddressNotify);
+}
+
+void CAdapterInventory::StartNotifications()
+{
+    // Without notifications every lookup rebuilds, which is still correct
+    if (!m_hInterfaceNotify)
+        NotifyIpInterfaceChange(AF_UNSPEC, &OnInterfaceChange, this, FALSE, &m_hInterfaceNotify);
+    if (!m_hAddressNotify)
+        NotifyUnicastIpAddressChange(AF_INET, &OnAddressChange, this, FALSE, &m_hAddressNotify);
+}
+
+std::shared_ptr<const AdapterSnapshot> CAdapterInventory::GetSnapshot()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StartNotifications();
+
+    bool stale = !m_hInterfaceNotify || !m_hAddressNotify;
+    if (m_snapshot && !m_dirty && !stale)
+        return m_snapshot;
+
+    // Clear first: a change that lands during the rebuild marks it dirty again
+    m_dirty = false;
+    m_snapshot = BuildSnapshot();
+    return m_snapshot;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Snapshot
+// ════════════════════════════════════════════════════════════════
+
+struct ProfileInfo
+{
+    CString name;
+    CString category;
+};
+
+// Connection profile name and category per adapter GUID (Network List Manager)
+static std::map<GUID, ProfileInfo, bool (*)(const GUID&, const GUID&)> ReadConnectionProfiles()
+{
+    std::map<GUID, ProfileInfo, bool (*)(const GUID&, const GUID&)> profiles(
+        [](const GUID& a, const GUID& b) { return memcmp(&a, &b, sizeof(GUID)) < 0; });
+
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    bool comInit = SUCCEEDED(hr);
+
+    INetworkListManager* pManager = nullptr;
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetworkListManager::GetNetworkConnections"));
+    hr = CoCreateInstance(CLSID_NetworkListManager, nullptr, CLSCTX_ALL,
+                          IID_INetworkListManager, reinterpret_cast<void**>(&pManager));
+    if (SUCCEEDED(hr) && pManager)
+    {
+        IEnumNetworkConnections* pConnections = nullptr;
+        if (SUCCEEDED(pManager->GetNetworkConnections(&pConnections)) && pConnections)
+        {
+            INetworkConnection* pConnection = nullptr;
+            ULONG fetched = 0;
+            while (pConnections->Next(1, &pConnection, &fetched) == S_OK && fetched == 1)
+            {
+                GUID adapterId = {};
+                INetwork* pNetwork = nullptr;
+                if (SUCCEEDED(pConnection->GetAdapterId(&adapterId)) &&
+                    SUCCEEDED(pConnection->GetNetwork(&pNetwork)) && pNetwork)
+                {
+                    ProfileInfo info;
+                    BSTR name = nullptr;
+                    if (SUCCEEDED(pNetwork->GetName(&name)) && name)
+                        info.name = name;
+                    SysFreeString(name);
+
+                    NLM_NETWORK_CATEGORY category = NLM_NETWORK_CATEGORY_PUBLIC;
+                    pNetwork->GetCategory(&category);
+                    switch (category)
+                    {
+                    case NLM_NETWORK_CATEGORY_PRIVATE:              info.category = _T("Private"); break;
+                    case NLM_NETWORK_CATEGORY_DOMAIN_AUTHENTICATED: info.category = _T("DomainAuthenticated"); break;
+                    default:                                        info.category = _T("Public"); break;
+                    }
+
+                    profiles[adapterId] = info;
+                    pNetwork->Release();
+                }
+                pConnection->Release();
+            }
+            pConnections->Release();
+        }
+        pManager->Release();
+    }
+
+    if (comInit) CoUninitialize();
+    return profiles;
+}
+
+// IPv4 adapter list from the IP helper API into buffer; false on failure
+static bool ReadAdapterAddresses(std::vector<BYTE>& buffer)
+{
+    // The buffer size can change between calls; retry a few times
+    ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+    ULONG size = 16 * 1024;
+    ULONG result = ERROR_BUFFER_OVERFLOW;
+    for (int attempt = 0; attempt < 3 && result == ERROR_BUFFER_OVERFLOW; attempt++)
+    {
+        buffer.resize(size);
+        result = GetAdaptersAddresses(AF_INET, flags, nullptr,
+                                      reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()), &size);
+    }
+    return result == NO_ERROR;
+}
+
+std::shared_ptr<AdapterSnapshot> CAdapterInventory::BuildSnapshot()
+{
+    auto snapshot = std::make_shared<AdapterSnapshot>();
+    snapshot->takenTick = GetTickCount64();
+
+    std::vector<BYTE> buffer;
+    if (!ReadAdapterAddresses(buffer))
+        return snapshot;
+
+    auto profiles = ReadConnectionProfiles();
+
+    for (auto p = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); p; p = p->Next)
+    {
+        if (p->IfType == IF_TYPE_SOFTWARE_LOOPBACK)
+            continue;
+
+        AdapterInfo info = {};
+        info.interfaceIndex = static_cast<int>(p->IfIndex);
+        info.alias = p->FriendlyName;
+        info.description = p->Description;
+
+        for (auto addr = p->FirstUnicastAddress; addr; addr = addr->Next)
+        {
+            if (addr->Address.lpSockaddr && addr->Address.lpSockaddr->sa_family == AF_INET)
+            {
+                TCHAR text[INET_ADDRSTRLEN] = {};
+                auto sin = reinterpret_cast<const sockaddr_in*>(addr->Address.lpSockaddr);
+                if (InetNtop(AF_INET, &sin->sin_addr, text, _countof(text)))
+                {
+                    info.ipAddress = text;
+                    break;
+                }
+            }
+        }
+
+        // Only connected adapters have a profile (same set Get-NetConnectionProfile listed)
+        GUID adapterId = {};
+        if (p->OperStatus == IfOperStatusUp &&
+            SUCCEEDED(CLSIDFromString(CString(p->AdapterName), &adapterId)))
+        {
+            auto it = profiles.find(adapterId);
+            if (it != profiles.end())
+            {
+                info.name = it->second.name;
+                info.networkCategory = it->second.category;
+            }
+        }
+
+        snapshot->adapters.push_back(info);
+    }
+
+    return snapshot;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Matching
+// ════════════════════════════════════════════════════════════════
+
+static bool ContainsNoCase(const CString& text, LPCTSTR needle)
+{
+    CString lower(text), lowerNeedle(needle);
+    lower.MakeLower();
+    lowerNeedle.MakeLower();
+    return lower.Find(lowerNeedle) != -1;
+}
+
+AdapterInfo CAdapterInventory::FindTeamViewerVPN(const std::vector<AdapterInfo>& adapters)
+{
+    AdapterInfo none = {};
+    none.interfaceIndex = -1;
+
+    for (const AdapterInfo& a : adapters)
+    {
+        if (a.networkCategory.IsEmpty())
+            continue;
+
+        // TeamViewer VPN adapters typically show as "Local Area Connection" with
+        // LocalNetwork connectivity, or have "TeamViewer" in the name
+        if (ContainsNoCase(a.alias, _T("teamviewer")) ||
+            ContainsNoCase(a.name, _T("teamviewer")) ||
+            ContainsNoCase(a.description, _T("teamviewer")))
+            return a;
+
+        // Also check for VPN-like adapters on the 7.x.x.x subnet
+        if (!a.ipAddress.IsEmpty() && a.ipAddress.Left(2) == _T("7."))
+            return a;
+    }
+
+    // Fallback: look for "Local Area Connection" (common TeamViewer VPN alias)
+    for (const AdapterInfo& a : adapters)
+    {
+        if (!a.networkCategory.IsEmpty() && a.alias.Find(_T("Local Area Connection")) != -1)
+            return a;
+    }
+
+    return none;
+}
+
+bool CAdapterInventory::HasTeamViewerAdapter(const std::vector<AdapterInfo>& adapters)
+{
+    for (const AdapterInfo& a : adapters)
+    {
+        if (ContainsNoCase(a.alias, _T("teamviewer")) || ContainsNoCase(a.description, _T("teamviewer")))
+            return true;
+    }
+    return FindTeamViewerVPN(adapters).interfaceIndex >= 0;
+}
+
+CString CAdapterInventory::FindIPv4WithPrefix(const std::vector<AdapterInfo>& adapters, LPCTSTR prefix)
+{
+    int length = static_cast<int>(_tcslen(prefix));
+    for (const AdapterInfo& a : adapters)
+    {
+        if (!a.ipAddress.IsEmpty() && a.ipAddress.Left(length) == prefix)
+            return a.ipAddress;
+    }
+    return CString();
+}
+
+AdapterInfo CAdapterInventory::FindByIndex(const std::vector<AdapterInfo>& adapters, int interfaceIndex)
+{
+    for (const AdapterInfo& a : adapters)
+    {
+        if (a.interfaceIndex == interfaceIndex)
+            return a;
+    }
+    AdapterInfo none = {};
+    none.interfaceIndex = -1;
+    return none;
+}
+
+std::vector<AdapterInfo> CAdapterInventory::ParseRecorded(const CString& text)
+{
+    std::vector<AdapterInfo> adapters;
+
+    int pos = 0;
+    CString line = text.Tokenize(_T("\r\n"), pos);
+    while (!line.IsEmpty())
+    {
+        line.Trim();
+        if (!line.IsEmpty())
+        {
+            // Fields may be empty, so split by hand rather than with Tokenize
+            std::vector<CString> fields;
+            int start = 0;
+            for (int bar = line.Find(_T('|')); bar != -1; bar = line.Find(_T('|'), start))
+            {
+                fields.push_back(line.Mid(start, bar - start));
+                start = bar + 1;
+            }
+            fields.push_back(line.Mid(start));
+            fields.resize(max(fields.size(), static_cast<size_t>(6)));
+
+            if (!fields[0].IsEmpty())
+            {
+                AdapterInfo ai = {};
+                ai.interfaceIndex = _ttoi(fields[0]);
+                ai.alias = fields[1];
+                ai.name = fields[2];
+                ai.networkCategory = fields[3];
+                ai.ipAddress = fields[4];
+                ai.description = fields[5];
+                adapters.push_back(ai);
+            }
+        }
+        line = text.Tokenize(_T("\r\n"), pos);
+    }
+
+    return adapters;
+}
+
+DWORD CAdapterInventory::QuickFingerprint()
+{
+    std::vector<BYTE> buffer;
+    if (!ReadAdapterAddresses(buffer))
+        return 0;
+
+    // FNV-1a over what the VPN checks look at
+    DWORD hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t length) {
+        const BYTE* bytes = static_cast<const BYTE*>(data);
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+    };
+
+    for (auto p = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); p; p = p->Next)
+    {
+        if (p->FriendlyName)
+            mix(p->FriendlyName, wcslen(p->FriendlyName) * sizeof(WCHAR));
+        if (p->Description)
+            mix(p->Description, wcslen(p->Description) * sizeof(WCHAR));
+        mix(&p->OperStatus, sizeof(p->OperStatus));
+        for (auto u = p->FirstUnicastAddress; u; u = u->Next)
+        {
+            if (u->Address.lpSockaddr && u->Address.lpSockaddr->sa_family == AF_INET)
+                mix(&reinterpret_cast<sockaddr_in*>(u->Address.lpSockaddr)->sin_addr, sizeof(IN_ADDR));
+        }
+    }
+    return hash;
+}
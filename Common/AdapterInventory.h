@@ -0,0 +1,68 @@
+#pragma once
+// AdapterInventory.h - Cached network adapter inventory from the IP helper API
+
+#include <afxwin.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "WinUtils.h"    // AdapterInfo
+
+// Every adapter known to the IP stack at one point in time, including ones
+// that are disconnected. Adapters with a connection profile have a
+// non-empty networkCategory.
+struct AdapterSnapshot
+{
+    std::vector<AdapterInfo> adapters;
+    ULONGLONG takenTick = 0;
+};
+
+// Builds the snapshot in-process (GetAdaptersAddresses plus the Network List
+// Manager for profile names and categories) and keeps it until an interface
+// or address change notification arrives, so repeated lookups are free.
+class CAdapterInventory
+{
+public:
+    static CAdapterInventory& Instance();
+
+    // Current snapshot; rebuilt only after a change notification or Invalidate()
+    std::shared_ptr<const AdapterSnapshot> GetSnapshot();
+
+    // Force a rebuild on next use (e.g. after changing a network category,
+    // which raises no IP helper notification)
+    void Invalidate() { m_dirty = true; }
+
+    // Hash of adapter names, states and IPv4 addresses straight from the IP
+    // helper API (no Network List Manager); changes when the adapter list does
+    static DWORD QuickFingerprint();
+
+    // ── Matching (pure functions over a snapshot) ──
+    // TeamViewer VPN adapter among adapters with a connection profile;
+    // interfaceIndex = -1 when none matches
+    static AdapterInfo FindTeamViewerVPN(const std::vector<AdapterInfo>& adapters);
+    // Any TeamViewer adapter, connected or not (driver installed)
+    static bool HasTeamViewerAdapter(const std::vector<AdapterInfo>& adapters);
+    // First IPv4 address starting with prefix (e.g. "7."), empty if none
+    static CString FindIPv4WithPrefix(const std::vector<AdapterInfo>& adapters, LPCTSTR prefix);
+    static AdapterInfo FindByIndex(const std::vector<AdapterInfo>& adapters, int interfaceIndex);
+
+    // Parse a recorded snapshot, one adapter per line:
+    //   index|alias|name|category|ip[|description]
+    // (the format GetNetworkAdapters used to read back from PowerShell)
+    static std::vector<AdapterInfo> ParseRecorded(const CString& text);
+
+private:
+    CAdapterInventory();
+    ~CAdapterInventory();
+    CAdapterInventory(const CAdapterInventory&) = delete;
+    CAdapterInventory& operator=(const CAdapterInventory&) = delete;
+
+    void StartNotifications();
+    static std::shared_ptr<AdapterSnapshot> BuildSnapshot();
+
+    std::mutex m_mutex;                                  // one rebuild at a time
+    std::shared_ptr<const AdapterSnapshot> m_snapshot;
+    std::atomic<bool> m_dirty;
+    HANDLE m_hInterfaceNotify;
+    HANDLE m_hAddressNotify;
+};
@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "ConnectivityProbe.h"
+#include "WinUtils.h"
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <iphlpapi.h>
+#include <icmpapi.h>     // IcmpSendEcho
+#include <chrono>
+#include <thread>
+
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "iphlpapi.lib")
+
+// Winsock is started once per process instead of once per probe
+static bool EnsureWinsock()
+{
+    struct WinsockInit
+    {
+        bool ok;
+        WinsockInit()  { WSADATA wsaData; ok = (WSAStartup(MAKEWORD(2, 2), &wsaData) == 0); }
+        ~WinsockInit() { if (ok) WSACleanup(); }
+    };
+    static WinsockInit init;
+    return init.ok;
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// ════════════════════════════════════════════════════════════════
+// ICMP
+// ════════════════════════════════════════════════════════════════
+
+static void RunIcmp(ProbeResult& result, int timeoutMs)
+{
+    IN_ADDR addr;
+    if (InetPton(AF_INET, result.target.host, &addr) != 1)
+    {
+        result.status = PROBE_ERROR;
+        result.error = WSAEINVAL;
+        return;
+    }
+
+    HANDLE hIcmp = IcmpCreateFile();
+    if (hIcmp == INVALID_HANDLE_VALUE)
+    {
+        result.status = PROBE_ERROR;
+        result.error = static_cast<int>(GetLastError());
+        return;
+    }
+
+    char sendData[] = "PingTest";
+    BYTE replyBuf[sizeof(ICMP_ECHO_REPLY) + sizeof(sendData) + 8];
+    DWORD count = IcmpSendEcho(hIcmp, addr.S_un.S_addr, sendData, sizeof(sendData), nullptr,
+                               replyBuf, sizeof(replyBuf), static_cast<DWORD>(timeoutMs));
+    if (count > 0)
+    {
+        auto reply = reinterpret_cast<const ICMP_ECHO_REPLY*>(replyBuf);
+        if (reply->Status == IP_SUCCESS)
+        {
+            result.status = PROBE_OPEN;
+            result.rttMs = reply->RoundTripTime;
+        }
+        else
+        {
+            result.status = PROBE_ERROR;
+            result.error = static_cast<int>(reply->Status);
+        }
+    }
+    else
+    {
+        DWORD err = GetLastError();
+        result.status = (err == IP_REQ_TIMED_OUT) ? PROBE_TIMEOUT : PROBE_ERROR;
+        result.error = static_cast<int>(err);
+    }
+
+    IcmpCloseHandle(hIcmp);
+}
+
+// ════════════════════════════════════════════════════════════════
+// TCP
+// ════════════════════════════════════════════════════════════════
+
+struct PendingConnect
+{
+    size_t index;       // into the result vector
+    SOCKET sock;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Starts a non-blocking connect; returns false when the result is already final
+static bool StartConnect(ProbeResult& result, PendingConnect& pending)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<u_short>(result.target.port));
+    if (InetPton(AF_INET, result.target.host, &addr.sin_addr) != 1)
+    {
+        result.status = PROBE_ERROR;
+        result.error = WSAEINVAL;
+        return false;
+    }
+
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+    {
+        result.status = PROBE_ERROR;
+        result.error = WSAGetLastError();
+        return false;
+    }
+
+    u_long nonBlocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonBlocking);
+
+    pending.sock = sock;
+    pending.start = std::chrono::steady_clock::now();
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+    {
+        // Completed immediately (loopback)
+        result.status = PROBE_OPEN;
+        result.rttMs = ElapsedMs(pending.start);
+        closesocket(sock);
+        return false;
+    }
+
+    int err = WSAGetLastError();
+    if (err != WSAEWOULDBLOCK)
+    {
+        result.status = (err == WSAECONNREFUSED) ? PROBE_REFUSED : PROBE_ERROR;
+        result.error = err;
+        closesocket(sock);
+        return false;
+    }
+
+    return true;
+}
+
+// Writable means the handshake finished, but not that it succeeded:
+// SO_ERROR tells a completed connect from a refused or unreachable one.
+static void FinishConnect(ProbeResult& result, const PendingConnect& pending)
+{
+    int err = 0;
+    int len = sizeof(err);
+    if (getsockopt(pending.sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) != 0)
+        err = WSAGetLastError();
+
+    if (err == 0)
+    {
+        result.status = PROBE_OPEN;
+        result.rttMs = ElapsedMs(pending.start);
+    }
+    else
+    {
+        result.status = (err == WSAECONNREFUSED) ? PROBE_REFUSED
+                      : (err == WSAETIMEDOUT)    ? PROBE_TIMEOUT
+                      :                            PROBE_ERROR;
+        result.error = err;
+    }
+}
+
+static void RunTcp(std::vector<ProbeResult>& results, const std::vector<size_t>& indices, int timeoutMs)
+{
+    std::vector<PendingConnect> pending;
+    for (size_t i : indices)
+    {
+        PendingConnect pc = { i, INVALID_SOCKET, {} };
+        if (StartConnect(results[i], pc))
+            pending.push_back(pc);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    // FD_SETSIZE bounds one select; the handful of ports probed here fits easily
+    while (!pending.empty() && !CWinUtils::IsCancelRequested())
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            break;
+
+        fd_set writeSet, exceptSet;
+        FD_ZERO(&writeSet);
+        FD_ZERO(&exceptSet);
+        for (const auto& pc : pending)
+        {
+            FD_SET(pc.sock, &writeSet);
+            FD_SET(pc.sock, &exceptSet);    // Windows reports a failed connect here
+        }
+
+        // Wake up at least every 100 ms to notice Stop
+        long sliceMs = static_cast<long>(min(remaining, 100LL));
+        timeval tv = { sliceMs / 1000, (sliceMs % 1000) * 1000 };
+        if (select(0, nullptr, &writeSet, &exceptSet, &tv) == SOCKET_ERROR)
+            break;
+
+        for (size_t k = 0; k < pending.size(); )
+        {
+            const PendingConnect& pc = pending[k];
+            if (FD_ISSET(pc.sock, &writeSet) || FD_ISSET(pc.sock, &exceptSet))
+            {
+                FinishConnect(results[pc.index], pc);
+                closesocket(pc.sock);
+                pending.erase(pending.begin() + k);
+            }
+            else
+            {
+                k++;
+            }
+        }
+    }
+
+    for (const auto& pc : pending)
+    {
+        results[pc.index].status = PROBE_TIMEOUT;
+        results[pc.index].error = WSAETIMEDOUT;
+        closesocket(pc.sock);
+    }
+}
+
+// ════════════════════════════════════════════════════════════════
+// Public
+// ════════════════════════════════════════════════════════════════
+
+std::vector<ProbeResult> CConnectivityProbe::Run(const std::vector<ProbeTarget>& targets, int timeoutMs)
+{
+    std::vector<ProbeResult> results;
+    for (const auto& t : targets)
+        results.push_back(ProbeResult{ t, PROBE_TIMEOUT, 0.0, 0 });
+
+    if (!EnsureWinsock())
+    {
+        for (auto& r : results)
+        {
+            r.status = PROBE_ERROR;
+            r.error = WSANOTINITIALISED;
+        }
+        return results;
+    }
+
+    // IcmpSendEcho blocks, so each echo gets its own thread while the TCP
+    // connects are multiplexed on this one
+    std::vector<std::thread> icmpThreads;
+    std::vector<size_t> tcpIndices;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].target.port == 0)
+            icmpThreads.emplace_back(RunIcmp, std::ref(results[i]), timeoutMs);
+        else
+            tcpIndices.push_back(i);
+    }
+
+    RunTcp(results, tcpIndices, timeoutMs);
+
+    for (auto& t : icmpThreads)
+        t.join();
+
+    return results;
+}
+
+CString CConnectivityProbe::Describe(const ProbeResult& result)
+{
+    CString text;
+    switch (result.status)
+    {
+    case PROBE_OPEN:    text.Format(_T("open (%.1f ms)"), result.rttMs); break;
+    case PROBE_REFUSED: text = _T("refused"); break;
+    case PROBE_TIMEOUT: text = _T("timed out"); break;
+    default:            text.Format(_T("error %d"), result.error); break;
+    }
+    return text;
+}
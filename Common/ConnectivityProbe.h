@@ -0,0 +1,45 @@
+#pragma once
+// ConnectivityProbe.h - Concurrent ICMP / TCP reachability checks with round-trip times
+
+#include <afxwin.h>
+#include <vector>
+
+enum ProbeStatus
+{
+    PROBE_OPEN,         // TCP connect completed / ICMP echo answered
+    PROBE_REFUSED,      // host answered with a reset: reachable, nothing listening
+    PROBE_TIMEOUT,      // no answer before the deadline
+    PROBE_ERROR         // anything else; see ProbeResult::error
+};
+
+// port = 0 means an ICMP echo instead of a TCP connect
+struct ProbeTarget
+{
+    CString host;       // IPv4 address
+    int     port;
+};
+
+struct ProbeResult
+{
+    ProbeTarget target;
+    ProbeStatus status;
+    double      rttMs;  // connect / echo round trip; 0 unless status is PROBE_OPEN
+    int         error;  // WSA / IP_STATUS code, 0 when open
+};
+
+// Starts every target at once (non-blocking sockets plus one ICMP echo per
+// ICMP target) and waits for all of them together, so a probe takes as long
+// as its slowest target rather than the sum of all of them.
+class CConnectivityProbe
+{
+public:
+    // Results are in the order of targets
+    static std::vector<ProbeResult> Run(const std::vector<ProbeTarget>& targets,
+                                        int timeoutMs = 3000);
+
+    static ProbeTarget Icmp(LPCTSTR host)          { return ProbeTarget{ host, 0 }; }
+    static ProbeTarget Tcp(LPCTSTR host, int port) { return ProbeTarget{ host, port }; }
+
+    // "open (1.8 ms)", "refused", "timed out", "error 10065"
+    static CString Describe(const ProbeResult& result);
+};
@@ -0,0 +1,310 @@
+#include "pch.h"
+#include "DebuggerLocator.h"
+#include "JsonReader.h"
+#include "SettingsUtils.h"
+#include "TraceRecorder.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+static CString GetEnvPath(LPCTSTR name)
+{
+    TCHAR value[MAX_PATH] = {};
+    DWORD len = GetEnvironmentVariable(name, value, MAX_PATH);
+    return (len > 0 && len < MAX_PATH) ? CString(value) : CString();
+}
+
+static LPCTSTR LastComponent(const CString& path)
+{
+    return static_cast<LPCTSTR>(path) + path.ReverseFind(_T('\\')) + 1;
+}
+
+static bool IsDirectory(LPCTSTR path)
+{
+    DWORD attrs = GetFileAttributes(path);
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+LPCTSTR CDebuggerLocator::NativeArch()
+{
+    SYSTEM_INFO si = {};
+    GetNativeSystemInfo(&si);
+    switch (si.wProcessorArchitecture)
+    {
+    case PROCESSOR_ARCHITECTURE_AMD64: return _T("x64");
+    case PROCESSOR_ARCHITECTURE_ARM64: return _T("arm64");
+    default:                           return _T("x86");
+    }
+}
+
+// ════════════════════════════════════════════════════════════════
+// Install roots
+// ════════════════════════════════════════════════════════════════
+
+std::vector<CString> CDebuggerLocator::GetInstallRoots()
+{
+    std::vector<CString> roots;
+    auto add = [&roots](const CString& path) {
+        for (const CString& r : roots)
+            if (r.CompareNoCase(path) == 0)
+                return;
+        if (IsDirectory(path))
+            roots.push_back(path);
+    };
+
+    // Visual Studio 2017 and later register each instance in a state.json
+    CString instances = GetEnvPath(_T("ProgramData")) + _T("\\Microsoft\\VisualStudio\\Packages\\_Instances");
+    WIN32_FIND_DATA fd;
+    HANDLE hFind = FindFirstFileEx(instances + _T("\\*"), FindExInfoBasic, &fd,
+                                   FindExSearchLimitToDirectories, nullptr, 0);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || fd.cFileName[0] == _T('.'))
+                continue;
+
+            JsonValue state;
+            JsonError error;
+            if (!CJsonReader::ParseFile(instances + _T("\\") + fd.cFileName + _T("\\state.json"), state, error))
+                continue;
+            const JsonValue* path = state.Find(_T("installationPath"));
+            if (path && path->type == JSON_STRING)
+                add(path->text);
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+
+    // Remote Tools register no instance; they install to "Microsoft Visual Studio <ver>"
+    for (LPCTSTR var : { _T("ProgramFiles"), _T("ProgramFiles(x86)") })
+    {
+        CString programFiles = GetEnvPath(var);
+        if (programFiles.IsEmpty())
+            continue;
+        hFind = FindFirstFileEx(programFiles + _T("\\Microsoft Visual Studio*"), FindExInfoBasic, &fd,
+                                FindExSearchLimitToDirectories, nullptr, 0);
+        if (hFind == INVALID_HANDLE_VALUE)
+            continue;
+        do
+        {
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                add(programFiles + _T("\\") + fd.cFileName);
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+    return roots;
+}
+
+CString CDebuggerLocator::ProbeRoot(const CString& root, LPCTSTR arch)
+{
+    CString path = root + _T("\\Common7\\IDE\\Remote Debugger\\") + arch + _T("\\msvsmon.exe");
+    return GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES ? path : CString();
+}
+
+// ════════════════════════════════════════════════════════════════
+// Directory walk
+// ════════════════════════════════════════════════════════════════
+
+// Folders that lead to the Remote Debugger are explored before their siblings
+static bool IsLikelyPath(LPCTSTR name)
+{
+    return _tcsnicmp(name, _T("Microsoft Visual Studio"), 23) == 0 ||
+           _tcsicmp(name, _T("Common7")) == 0 ||
+           _tcsicmp(name, _T("IDE")) == 0 ||
+           _tcsicmp(name, _T("Remote Debugger")) == 0 ||
+           (name[0] >= _T('0') && name[0] <= _T('9'));    // 2022, 17.0, ...
+}
+
+CString CDebuggerLocator::Search(const std::vector<CString>& roots, int maxDepth, LPCTSTR arch)
+{
+    CTraceScope trace("fs", _T("msvsmon.exe search"));
+
+    struct WalkItem
+    {
+        CString dir;
+        int     depth;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<WalkItem> queue;
+    int busy = 0;
+    std::atomic<bool> found(false);
+    CString preferred, fallback;
+
+    for (const CString& root : roots)
+        queue.push_back(WalkItem{ root, 0 });
+
+    auto worker = [&] {
+        std::vector<WalkItem> children;
+        for (;;)
+        {
+            WalkItem item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return !queue.empty() || busy == 0 || found; });
+                if (found || queue.empty())
+                    break;
+                // Likely folders sit at the front, so taking from the front goes deep there first
+                item = queue.front();
+                queue.pop_front();
+                busy++;
+            }
+
+            children.clear();
+            WIN32_FIND_DATA fd;
+            HANDLE hFind = FindFirstFileEx(item.dir + _T("\\*"), FindExInfoBasic, &fd,
+                                           FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+            if (hFind != INVALID_HANDLE_VALUE)
+            {
+                do
+                {
+                    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                    {
+                        if (fd.cFileName[0] == _T('.') || (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ||
+                            item.depth + 1 > maxDepth)
+                            continue;
+                        children.push_back(WalkItem{ item.dir + _T("\\") + fd.cFileName, item.depth + 1 });
+                    }
+                    else if (_tcsicmp(fd.cFileName, _T("msvsmon.exe")) == 0)
+                    {
+                        CString path = item.dir + _T("\\") + fd.cFileName;
+                        LPCTSTR folder = LastComponent(item.dir);
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (_tcsicmp(folder, arch) == 0)
+                        {
+                            if (preferred.IsEmpty())
+                                preferred = path;
+                            found = true;
+                        }
+                        else if (fallback.IsEmpty())
+                        {
+                            fallback = path;
+                        }
+                    }
+                } while (!found && FindNextFile(hFind, &fd));
+                FindClose(hFind);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (WalkItem& child : children)
+                {
+                    if (IsLikelyPath(LastComponent(child.dir)))
+                        queue.push_front(std::move(child));
+                    else
+                        queue.push_back(std::move(child));
+                }
+                busy--;
+            }
+            wake.notify_all();
+        }
+        wake.notify_all();
+    };
+
+    unsigned threads = std::thread::hardware_concurrency();
+    threads = threads < 2 ? 2 : (threads > 8 ? 8 : threads);
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; i++)
+        pool.emplace_back(worker);
+    for (std::thread& t : pool)
+        t.join();
+
+    return !preferred.IsEmpty() ? preferred : fallback;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Cached lookup
+// ════════════════════════════════════════════════════════════════
+
+// On-disk form of the last answer
+struct LocatorRecord
+{
+    CString key;
+    CString path;       // empty = not found
+};
+
+static const SettingField<LocatorRecord> s_recordFields[] =
+{
+    { _T("Key"),  &LocatorRecord::key,  SETTING_TEXT, _T("") },
+    { _T("Path"), &LocatorRecord::path, SETTING_TEXT, _T("") },
+};
+
+CString CDebuggerLocator::CacheKey(const std::vector<CString>& roots)
+{
+    // FNV-1a over each directory's path and write time. Installing or removing
+    // Visual Studio, the Remote Tools or any top-level program changes at least one.
+    std::vector<CString> dirs(roots);
+    dirs.push_back(GetEnvPath(_T("ProgramData")) + _T("\\Microsoft\\VisualStudio\\Packages\\_Instances"));
+    dirs.push_back(GetEnvPath(_T("ProgramFiles")));
+    dirs.push_back(GetEnvPath(_T("ProgramFiles(x86)")));
+
+    ULONGLONG hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const BYTE* p = static_cast<const BYTE*>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ p[i]) * 1099511628211ULL;
+    };
+    for (const CString& dir : dirs)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA data = {};
+        GetFileAttributesEx(dir, GetFileExInfoStandard, &data);
+        mix(static_cast<LPCTSTR>(dir), dir.GetLength() * sizeof(TCHAR));
+        mix(&data.ftLastWriteTime, sizeof(data.ftLastWriteTime));
+    }
+
+    CString key;
+    key.Format(_T("%016I64x"), hash);
+    return key;
+}
+
+CString CDebuggerLocator::Find()
+{
+    std::vector<CString> roots = GetInstallRoots();
+    CString cachePath = CSettingsUtils::GetSettingsDir() + _T("\\DebuggerLocator.json");
+    CString key = CacheKey(roots);
+
+    LocatorRecord record;
+    if (CSettingsUtils::Load(cachePath, s_recordFields, record) && record.key == key &&
+        (record.path.IsEmpty() || GetFileAttributes(record.path) != INVALID_FILE_ATTRIBUTES))
+        return record.path;
+
+    LPCTSTR arch = NativeArch();
+    CString path;
+
+    // The registered layout first: <install>\Common7\IDE\Remote Debugger\<arch>
+    for (const CString& root : roots)
+    {
+        path = ProbeRoot(root, arch);
+        if (!path.IsEmpty())
+            break;
+    }
+    for (size_t i = 0; path.IsEmpty() && i < roots.size(); i++)
+    {
+        for (LPCTSTR other : { _T("x64"), _T("arm64"), _T("x86") })
+        {
+            if (_tcsicmp(other, arch) != 0 && !(path = ProbeRoot(roots[i], other)).IsEmpty())
+                break;
+        }
+    }
+
+    // Unregistered copies (xcopy-deployed Remote Tools, moved installs)
+    if (path.IsEmpty())
+    {
+        std::vector<CString> programFiles;
+        for (LPCTSTR var : { _T("ProgramFiles"), _T("ProgramFiles(x86)") })
+        {
+            CString dir = GetEnvPath(var);
+            if (!dir.IsEmpty() && IsDirectory(dir))
+                programFiles.push_back(dir);
+        }
+        path = Search(programFiles, MAX_SEARCH_DEPTH, arch);
+    }
+
+    record.key = key;
+    record.path = path;
+    CSettingsUtils::Save(cachePath, s_recordFields, record);
+    return path;
+}
@@ -0,0 +1,33 @@
+#pragma once
+// DebuggerLocator.h - Finds msvsmon.exe from install registrations, then a bounded disk walk
+
+#include <afxwin.h>
+#include <vector>
+
+class CDebuggerLocator
+{
+public:
+    // Full path to msvsmon.exe for this machine's architecture (another
+    // architecture's only if that is all there is), or empty. The answer is
+    // cached in Settings\DebuggerLocator.json until one of the install
+    // directories changes.
+    static CString Find();
+
+    // Visual Studio installs from their instance registration
+    // (%ProgramData%\Microsoft\VisualStudio\Packages\_Instances\*\state.json)
+    // plus the Remote Tools / "Microsoft Visual Studio*" folders in Program Files
+    static std::vector<CString> GetInstallRoots();
+
+    // Parallel depth-limited walk of roots for msvsmon.exe. Stops as soon
+    // as one is found under a "<arch>" folder; reparse points are not followed.
+    static CString Search(const std::vector<CString>& roots, int maxDepth, LPCTSTR arch);
+
+    // "x64", "arm64" or "x86" - the Remote Debugger subfolder to prefer
+    static LPCTSTR NativeArch();
+
+    static const int MAX_SEARCH_DEPTH = 8;  // Program Files\Microsoft Visual Studio\2022\<edition>\Common7\IDE\Remote Debugger\x64
+
+private:
+    static CString ProbeRoot(const CString& root, LPCTSTR arch);
+    static CString CacheKey(const std::vector<CString>& roots);
+};
@@ -0,0 +1,480 @@
+#include "pch.h"
+#include "FirewallSession.h"
+#include "LogSpan.h"
+#include "TraceRecorder.h"
+#include <netfw.h>       // INetFwPolicy2
+#include <comdef.h>
+
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "oleaut32.lib")
+
+// ════════════════════════════════════════════════════════════════
+// COM backend
+// ════════════════════════════════════════════════════════════════
+
+CComFirewallBackend::CComFirewallBackend()
+    : m_comInit(false)
+    , m_pPolicy(nullptr)
+    , m_pRules(nullptr)
+{
+}
+
+CComFirewallBackend::~CComFirewallBackend()
+{
+    if (m_pRules) m_pRules->Release();
+    if (m_pPolicy) m_pPolicy->Release();
+    if (m_comInit) CoUninitialize();
+}
+
+bool CComFirewallBackend::Open()
+{
+    if (m_pRules)
+        return true;
+
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    m_comInit = SUCCEEDED(hr);
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwPolicy2::get_Rules"));
+
+    hr = CoCreateInstance(__uuidof(NetFwPolicy2), nullptr, CLSCTX_INPROC_SERVER,
+                          __uuidof(INetFwPolicy2), reinterpret_cast<void**>(&m_pPolicy));
+    if (FAILED(hr) || !m_pPolicy)
+        return false;
+
+    return SUCCEEDED(m_pPolicy->get_Rules(&m_pRules)) && m_pRules;
+}
+
+// Read one BSTR property of a rule, e.g. GetRuleText(pRule, &INetFwRule::get_Name)
+static CString GetRuleText(INetFwRule* pRule, HRESULT (STDMETHODCALLTYPE INetFwRule::*getter)(BSTR*))
+{
+    CString result;
+    BSTR value = nullptr;
+    if (SUCCEEDED((pRule->*getter)(&value)) && value)
+        result = value;
+    SysFreeString(value);
+    return result;
+}
+
+bool CComFirewallBackend::EnumerateRules(std::vector<FirewallRule>& rules)
+{
+    rules.clear();
+    if (!m_pRules)
+        return false;
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwRules::_NewEnum"));
+
+    IUnknown* pUnknown = nullptr;
+    if (FAILED(m_pRules->get__NewEnum(&pUnknown)) || !pUnknown)
+        return false;
+
+    IEnumVARIANT* pEnum = nullptr;
+    HRESULT hr = pUnknown->QueryInterface(__uuidof(IEnumVARIANT), reinterpret_cast<void**>(&pEnum));
+    pUnknown->Release();
+    if (FAILED(hr) || !pEnum)
+        return false;
+
+    VARIANT item;
+    VariantInit(&item);
+    ULONG fetched = 0;
+    while (pEnum->Next(1, &item, &fetched) == S_OK && fetched == 1)
+    {
+        INetFwRule* pRule = nullptr;
+        if (item.vt == VT_DISPATCH && item.pdispVal &&
+            SUCCEEDED(item.pdispVal->QueryInterface(__uuidof(INetFwRule),
+                                                    reinterpret_cast<void**>(&pRule))))
+        {
+            FirewallRule rule;
+            rule.name            = GetRuleText(pRule, &INetFwRule::get_Name);
+            rule.description     = GetRuleText(pRule, &INetFwRule::get_Description);
+            rule.grouping        = GetRuleText(pRule, &INetFwRule::get_Grouping);
+            rule.localPorts      = GetRuleText(pRule, &INetFwRule::get_LocalPorts);
+            rule.remoteAddresses = GetRuleText(pRule, &INetFwRule::get_RemoteAddresses);
+
+            NET_FW_RULE_DIRECTION direction = NET_FW_RULE_DIR_IN;
+            NET_FW_ACTION action = NET_FW_ACTION_ALLOW;
+            VARIANT_BOOL enabled = VARIANT_FALSE;
+            pRule->get_Protocol(&rule.protocol);
+            pRule->get_Direction(&direction);
+            pRule->get_Action(&action);
+            pRule->get_Profiles(&rule.profiles);
+            pRule->get_Enabled(&enabled);
+            rule.direction = direction;
+            rule.action = action;
+            rule.enabled = (enabled != VARIANT_FALSE);
+
+            rules.push_back(rule);
+            pRule->Release();
+        }
+        VariantClear(&item);
+    }
+
+    pEnum->Release();
+    return true;
+}
+
+bool CComFirewallBackend::AddRule(const FirewallRule& rule)
+{
+    if (!m_pRules)
+        return false;
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwRules::Add"), rule.name);
+
+    INetFwRule* pRule = nullptr;
+    HRESULT hr = CoCreateInstance(__uuidof(NetFwRule), nullptr, CLSCTX_INPROC_SERVER,
+                                  __uuidof(INetFwRule), reinterpret_cast<void**>(&pRule));
+    if (FAILED(hr) || !pRule)
+        return false;
+
+    pRule->put_Name(_bstr_t(rule.name));
+    pRule->put_Description(_bstr_t(rule.description));
+    if (!rule.grouping.IsEmpty())
+        pRule->put_Grouping(_bstr_t(rule.grouping));
+    pRule->put_Protocol(rule.protocol);
+    if (!rule.localPorts.IsEmpty())
+        pRule->put_LocalPorts(_bstr_t(rule.localPorts));
+    pRule->put_Direction(static_cast<NET_FW_RULE_DIRECTION>(rule.direction));
+    pRule->put_Action(static_cast<NET_FW_ACTION>(rule.action));
+    pRule->put_Profiles(rule.profiles);
+    pRule->put_Enabled(rule.enabled ? VARIANT_TRUE : VARIANT_FALSE);
+    if (!rule.remoteAddresses.IsEmpty())
+        pRule->put_RemoteAddresses(_bstr_t(rule.remoteAddresses));
+
+    hr = m_pRules->Add(pRule);
+    pRule->Release();
+    return SUCCEEDED(hr);
+}
+
+bool CComFirewallBackend::RemoveRule(LPCTSTR name)
+{
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwRules::Remove"), name);
+    return m_pRules && SUCCEEDED(m_pRules->Remove(_bstr_t(name)));
+}
+
+bool CComFirewallBackend::EnableRuleGroup(long profiles, LPCTSTR group, bool enable)
+{
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwPolicy2::EnableRuleGroup"), group);
+    return m_pPolicy &&
+        SUCCEEDED(m_pPolicy->EnableRuleGroup(profiles, _bstr_t(group),
+                                             enable ? VARIANT_TRUE : VARIANT_FALSE));
+}
+
+bool CComFirewallBackend::IsRuleGroupEnabled(long profiles, LPCTSTR group, bool& enabled)
+{
+    enabled = false;
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("INetFwPolicy2::IsRuleGroupEnabled"), group);
+    VARIANT_BOOL result = VARIANT_FALSE;
+    if (!m_pPolicy || FAILED(m_pPolicy->IsRuleGroupEnabled(profiles, _bstr_t(group), &result)))
+        return false;
+    enabled = (result != VARIANT_FALSE);
+    return true;
+}
+
+// ════════════════════════════════════════════════════════════════
+// In-memory backend
+// ════════════════════════════════════════════════════════════════
+
+bool CMemoryFirewallBackend::EnumerateRules(std::vector<FirewallRule>& out)
+{
+    enumerateCalls++;
+    out = rules;
+    return true;
+}
+
+bool CMemoryFirewallBackend::AddRule(const FirewallRule& rule)
+{
+    addCalls++;
+    rules.push_back(rule);
+    return true;
+}
+
+bool CMemoryFirewallBackend::RemoveRule(LPCTSTR name)
+{
+    removeCalls++;
+    for (auto it = rules.begin(); it != rules.end(); ++it)
+    {
+        if (it->name.CompareNoCase(name) == 0)
+        {
+            rules.erase(it);
+            break;
+        }
+    }
+    return true;
+}
+
+bool CMemoryFirewallBackend::EnableRuleGroup(long profiles, LPCTSTR group, bool enable)
+{
+    groupCalls++;
+    bool found = false;
+    for (FirewallRule& rule : rules)
+    {
+        if (rule.grouping == group && (rule.profiles & profiles) != 0)
+        {
+            rule.enabled = enable;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool CMemoryFirewallBackend::IsRuleGroupEnabled(long profiles, LPCTSTR group, bool& enabled)
+{
+    groupCalls++;
+    bool found = false;
+    enabled = true;
+    for (const FirewallRule& rule : rules)
+    {
+        if (rule.grouping == group && (rule.profiles & profiles) != 0)
+        {
+            found = true;
+            enabled = enabled && rule.enabled;
+        }
+    }
+    enabled = enabled && found;
+    return true;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Session
+// ════════════════════════════════════════════════════════════════
+
+static IFirewallBackend* s_defaultBackend = nullptr;
+
+void CFirewallSession::SetDefaultBackend(IFirewallBackend* backend)
+{
+    s_defaultBackend = backend;
+}
+
+CFirewallSession::CFirewallSession(IFirewallBackend* backend)
+    : m_backend(backend ? backend : s_defaultBackend)
+    , m_open(false)
+    , m_indexLoaded(false)
+{
+    if (!m_backend)
+    {
+        m_ownedBackend.reset(new CComFirewallBackend());
+        m_backend = m_ownedBackend.get();
+    }
+    m_open = m_backend->Open();
+}
+
+CFirewallSession::~CFirewallSession()
+{
+}
+
+CString CFirewallSession::Key(LPCTSTR name)
+{
+    // Windows Firewall rule names compare case-insensitively
+    CString key(name);
+    key.MakeUpper();
+    return key;
+}
+
+bool CFirewallSession::LoadIndex()
+{
+    if (m_indexLoaded)
+        return true;
+    if (!m_open)
+        return false;
+
+    std::vector<FirewallRule> rules;
+    if (!m_backend->EnumerateRules(rules))
+        return false;
+
+    m_index.clear();
+    for (const FirewallRule& rule : rules)
+    {
+        auto it = m_index.find(Key(rule.name));
+        if (it == m_index.end())
+            m_index[Key(rule.name)] = IndexEntry{ rule, 1 };
+        else
+            it->second.count++;
+    }
+    m_indexLoaded = true;
+    return true;
+}
+
+bool CFirewallSession::RuleExists(LPCTSTR name)
+{
+    return LoadIndex() && m_index.count(Key(name)) > 0;
+}
+
+bool CFirewallSession::FindRule(LPCTSTR name, FirewallRule& rule)
+{
+    if (!LoadIndex())
+        return false;
+    auto it = m_index.find(Key(name));
+    if (it == m_index.end())
+        return false;
+    rule = it->second.rule;
+    return true;
+}
+
+bool CFirewallSession::ApplyRule(const FirewallRule& rule, bool* pChanged)
+{
+    if (pChanged)
+        *pChanged = false;
+    if (!LoadIndex())
+        return false;
+
+    auto it = m_index.find(Key(rule.name));
+    if (it != m_index.end() && it->second.count == 1 && SameConfiguration(it->second.rule, rule))
+        return true;
+
+    if (pChanged)
+        *pChanged = true;
+    if (!RemoveRule(rule.name))
+        return false;
+    if (!m_backend->AddRule(rule))
+        return false;
+
+    m_index[Key(rule.name)] = IndexEntry{ rule, 1 };
+    return true;
+}
+
+bool CFirewallSession::HasRule(const FirewallRule& rule)
+{
+    if (!LoadIndex())
+        return false;
+    auto it = m_index.find(Key(rule.name));
+    return it != m_index.end() && it->second.count == 1 && SameConfiguration(it->second.rule, rule);
+}
+
+bool CFirewallSession::ApplyRules(const std::vector<FirewallRule>& rules)
+{
+    bool allOk = true;
+    for (const FirewallRule& rule : rules)
+    {
+        if (!ApplyRule(rule))
+            allOk = false;
+    }
+    return allOk;
+}
+
+bool CFirewallSession::RemoveRule(LPCTSTR name)
+{
+    if (!LoadIndex())
+        return false;
+
+    auto it = m_index.find(Key(name));
+    if (it == m_index.end())
+        return true;    // nothing to do, no policy round-trip
+
+    // Rule names are not unique; Remove() deletes one match per call
+    for (int i = 0; i < it->second.count; i++)
+    {
+        if (!m_backend->RemoveRule(name))
+            return false;
+    }
+    m_index.erase(it);
+    return true;
+}
+
+CString CFirewallSession::ResolveGroup(LPCTSTR group)
+{
+    // Display names are localized; the indirect strings of built-in groups are not
+    static const struct { LPCTSTR displayName; LPCTSTR indirect; } knownGroups[] = {
+        { _T("Network Discovery"),        _T("@FirewallAPI.dll,-32752") },
+        { _T("File and Printer Sharing"), _T("@FirewallAPI.dll,-28502") },
+    };
+    for (const auto& known : knownGroups)
+    {
+        if (_tcsicmp(group, known.displayName) == 0)
+            return known.indirect;
+    }
+    return group;
+}
+
+bool CFirewallSession::EnableRuleGroup(LPCTSTR group, bool enable, long profiles)
+{
+    if (!m_open)
+        return false;
+    bool ok = m_backend->EnableRuleGroup(profiles, ResolveGroup(group), enable);
+
+    // Enabled flags of indexed rules may have changed; re-read on next use
+    m_indexLoaded = false;
+    return ok;
+}
+
+bool CFirewallSession::EnableRuleGroups(const std::vector<CString>& groups, bool enable, long profiles)
+{
+    bool allOk = true;
+    for (const CString& group : groups)
+    {
+        if (!EnableRuleGroup(group, enable, profiles))
+            allOk = false;
+    }
+    return allOk;
+}
+
+bool CFirewallSession::IsRuleGroupEnabled(LPCTSTR group, long profiles)
+{
+    bool enabled = false;
+    return m_open && m_backend->IsRuleGroupEnabled(profiles, ResolveGroup(group), enabled) && enabled;
+}
+
+FirewallRule CFirewallSession::InboundTcpRule(LPCTSTR name, LPCTSTR description,
+                                              LPCTSTR ports, LPCTSTR remoteAddresses)
+{
+    FirewallRule rule;
+    rule.name = name;
+    rule.description = description;
+    rule.localPorts = ports;
+    if (remoteAddresses && _tcslen(remoteAddresses) > 0)
+        rule.remoteAddresses = remoteAddresses;
+    return rule;
+}
+
+CString CFirewallSession::NormalizeAddresses(LPCTSTR addresses)
+{
+    // The firewall stores "7.0.0.0/8" as "7.0.0.0/255.0.0.0" and an empty
+    // list as "*"; convert prefix lengths so a re-read rule compares equal.
+    CString input(addresses);
+    input.Trim();
+    if (input.IsEmpty())
+        return _T("*");
+
+    CString result;
+    int pos = 0;
+    CString token = input.Tokenize(_T(","), pos);
+    while (!token.IsEmpty())
+    {
+        token.Trim();
+        int slash = token.Find(_T('/'));
+        if (slash > 0 && token.Find(_T('.')) > 0 && token.Find(_T(':')) < 0)
+        {
+            CString suffix = token.Mid(slash + 1);
+            if (!suffix.IsEmpty() && suffix.SpanIncluding(_T("0123456789")) == suffix)
+            {
+                int bits = _ttoi(suffix);
+                if (bits >= 0 && bits <= 32)
+                {
+                    DWORD mask = bits == 0 ? 0 : (0xFFFFFFFFu << (32 - bits));
+                    suffix.Format(_T("%u.%u.%u.%u"), (mask >> 24) & 0xFF, (mask >> 16) & 0xFF,
+                                  (mask >> 8) & 0xFF, mask & 0xFF);
+                    token = token.Left(slash + 1) + suffix;
+                }
+            }
+        }
+        if (!result.IsEmpty())
+            result += _T(",");
+        result += token;
+        token = input.Tokenize(_T(","), pos);
+    }
+    result.MakeUpper();
+    return result;
+}
+
+bool CFirewallSession::SameConfiguration(const FirewallRule& a, const FirewallRule& b)
+{
+    return a.description == b.description
+        && a.localPorts.CompareNoCase(b.localPorts) == 0
+        && NormalizeAddresses(a.remoteAddresses) == NormalizeAddresses(b.remoteAddresses)
+        && a.protocol == b.protocol
+        && a.direction == b.direction
+        && a.action == b.action
+        && a.profiles == b.profiles
+        && a.enabled == b.enabled;
+}
@@ -0,0 +1,149 @@
+#pragma once
+// FirewallSession.h - Scoped firewall policy session with a name-indexed rule cache
+
+#include <afxwin.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+struct INetFwPolicy2;
+struct INetFwRules;
+
+// One firewall rule as far as this tool cares. Values follow the
+// INetFwRule / NET_FW_* constants but are kept as plain integers so the
+// session logic does not depend on netfw.h.
+struct FirewallRule
+{
+    CString name;
+    CString description;
+    CString grouping;           // rule group (e.g. "@FirewallAPI.dll,-32752"), may be empty
+    CString localPorts;         // e.g. "445" or "4022-4026"
+    CString remoteAddresses;    // e.g. "*" or "7.0.0.0/8"
+    long    protocol  = 6;      // NET_FW_IP_PROTOCOL_TCP
+    int     direction = 1;      // NET_FW_RULE_DIR_IN
+    int     action    = 1;      // NET_FW_ACTION_ALLOW
+    long    profiles  = 0x7FFFFFFF;  // NET_FW_PROFILE2_ALL
+    bool    enabled   = true;
+};
+
+// Where the session reads and writes rules. The COM backend talks to
+// INetFwPolicy2; CMemoryFirewallBackend keeps rules in memory for dry runs.
+class IFirewallBackend
+{
+public:
+    virtual ~IFirewallBackend() {}
+
+    virtual bool Open() = 0;
+    virtual bool EnumerateRules(std::vector<FirewallRule>& rules) = 0;
+    virtual bool AddRule(const FirewallRule& rule) = 0;
+    virtual bool RemoveRule(LPCTSTR name) = 0;    // removes one rule with this name
+
+    // Rule groups; group is a resolved name or indirect string ("@FirewallAPI.dll,-32752")
+    virtual bool EnableRuleGroup(long profiles, LPCTSTR group, bool enable) = 0;
+    virtual bool IsRuleGroupEnabled(long profiles, LPCTSTR group, bool& enabled) = 0;
+};
+
+// Holds one INetFwPolicy2 / INetFwRules pair for its lifetime
+class CComFirewallBackend : public IFirewallBackend
+{
+public:
+    CComFirewallBackend();
+    virtual ~CComFirewallBackend();
+
+    virtual bool Open() override;
+    virtual bool EnumerateRules(std::vector<FirewallRule>& rules) override;
+    virtual bool AddRule(const FirewallRule& rule) override;
+    virtual bool RemoveRule(LPCTSTR name) override;
+    virtual bool EnableRuleGroup(long profiles, LPCTSTR group, bool enable) override;
+    virtual bool IsRuleGroupEnabled(long profiles, LPCTSTR group, bool& enabled) override;
+
+private:
+    bool           m_comInit;
+    INetFwPolicy2* m_pPolicy;
+    INetFwRules*   m_pRules;
+};
+
+// In-memory rule store; counts backend calls so callers can see what a batch did
+class CMemoryFirewallBackend : public IFirewallBackend
+{
+public:
+    virtual bool Open() override { return true; }
+    virtual bool EnumerateRules(std::vector<FirewallRule>& rules) override;
+    virtual bool AddRule(const FirewallRule& rule) override;
+    virtual bool RemoveRule(LPCTSTR name) override;
+    // Groups match FirewallRule::grouping exactly
+    virtual bool EnableRuleGroup(long profiles, LPCTSTR group, bool enable) override;
+    virtual bool IsRuleGroupEnabled(long profiles, LPCTSTR group, bool& enabled) override;
+
+    std::vector<FirewallRule> rules;
+    int enumerateCalls = 0;
+    int addCalls = 0;
+    int removeCalls = 0;
+    int groupCalls = 0;
+};
+
+// Opened once per batch of rule operations: enumerates existing rules once
+// into a name index, answers existence checks from it and only touches the
+// policy for rules that actually differ from what is wanted.
+class CFirewallSession
+{
+public:
+    // backend = nullptr: the default backend (see SetDefaultBackend), else COM
+    explicit CFirewallSession(IFirewallBackend* backend = nullptr);
+    ~CFirewallSession();
+
+    bool IsOpen() const { return m_open; }
+
+    bool RuleExists(LPCTSTR name);
+    bool FindRule(LPCTSTR name, FirewallRule& rule);
+
+    // Make the policy contain exactly one rule named rule.name with this
+    // configuration. An identical existing rule is left alone (pChanged = false).
+    bool ApplyRule(const FirewallRule& rule, bool* pChanged = nullptr);
+    // True if ApplyRule would leave the policy alone
+    bool HasRule(const FirewallRule& rule);
+    bool ApplyRules(const std::vector<FirewallRule>& rules);
+
+    // Remove every rule with this name; true if none is left
+    bool RemoveRule(LPCTSTR name);
+
+    // ── Rule groups ──
+    // Group names are display names ("Network Discovery") or indirect strings.
+    // Well-known groups are translated to their indirect string, so this works
+    // on non-English Windows. Enabled = every rule of the group is enabled for
+    // all of the given profiles.
+    static const long GROUP_PROFILES = 0x2 | 0x4;   // NET_FW_PROFILE2_PRIVATE | PUBLIC
+
+    bool EnableRuleGroup(LPCTSTR group, bool enable, long profiles = GROUP_PROFILES);
+    // Every group is attempted; false if any of them failed
+    bool EnableRuleGroups(const std::vector<CString>& groups, bool enable,
+                          long profiles = GROUP_PROFILES);
+    bool IsRuleGroupEnabled(LPCTSTR group, long profiles = 0x2 /* PRIVATE */);
+
+    // Inbound TCP allow rule for all profiles (what Setup creates)
+    static FirewallRule InboundTcpRule(LPCTSTR name, LPCTSTR description,
+                                       LPCTSTR ports, LPCTSTR remoteAddresses);
+
+    // Backend used by sessions created without one (nullptr = COM)
+    static void SetDefaultBackend(IFirewallBackend* backend);
+
+private:
+    struct IndexEntry
+    {
+        FirewallRule rule;
+        int          count;     // rules sharing this name
+    };
+
+    bool LoadIndex();
+
+    static CString Key(LPCTSTR name);
+    static CString ResolveGroup(LPCTSTR group);
+    static CString NormalizeAddresses(LPCTSTR addresses);
+    static bool    SameConfiguration(const FirewallRule& a, const FirewallRule& b);
+
+    std::unique_ptr<IFirewallBackend> m_ownedBackend;
+    IFirewallBackend*                 m_backend;
+    std::map<CString, IndexEntry>     m_index;    // key: upper-cased rule name
+    bool m_open;
+    bool m_indexLoaded;
+};
@@ -0,0 +1,425 @@
+#include "pch.h"
+#include "FleetRunner.h"
+#include "Headless.h"
+#include "JsonEscape.h"
+#include "JsonReader.h"
+#include "PowerShellHost.h"
+#include "TraceRecorder.h"
+#include "WinUtils.h"
+
+// Runs SetupTest on the target over PowerShell remoting (WinRM). The settings
+// (with the RD password) arrive base64 on stdin, never on a command line; they
+// cross to the target inside the WinRM session and live in a temp file in the
+// remote user's profile only while SetupTest runs. Its NDJSON output comes
+// back through the pipe.
+static const TCHAR DEFAULT_COMMAND[] =
+    _T("powershell.exe -NoLogo -NoProfile -NonInteractive -ExecutionPolicy Bypass -Command \"")
+    _T("[Console]::OutputEncoding = [Text.Encoding]::UTF8; $c = [Console]::In.ReadLine(); ")
+    _T("Invoke-Command -ComputerName {host} -ErrorAction Stop -ArgumentList $c -ScriptBlock { ")
+    _T("param($c) $f = Join-Path $env:TEMP 'SetupTest.fleet.json'; ")
+    _T("[IO.File]::WriteAllBytes($f, [Convert]::FromBase64String($c)); ")
+    _T("try { & {exe} --setup --config $f --json | Write-Output } ")
+    _T("finally { Remove-Item $f -ErrorAction SilentlyContinue } }\"");
+
+CFleetRunner::CFleetRunner(CLogUtils* pLog)
+    : m_pLog(pLog)
+    , m_maxParallel(DEFAULT_MAX_PARALLEL)
+    , m_retries(DEFAULT_RETRIES)
+    , m_timeoutMs(DEFAULT_TIMEOUT_MS)
+    , m_retryDelayMs(DEFAULT_RETRY_DELAY_MS)
+    , m_exePath(_T("SetupTest.exe"))
+{
+}
+
+void CFleetRunner::SetDefault(SettingKey key, LPCTSTR value)
+{
+    SetValue(m_defaults, CSettingsUtils::KeyName(key), value);
+}
+
+void CFleetRunner::SetValue(std::vector<std::pair<CString, CString>>& settings,
+                            const CString& key, const CString& value)
+{
+    for (auto& setting : settings)
+    {
+        if (setting.first == key)
+        {
+            setting.second = value;
+            return;
+        }
+    }
+    settings.emplace_back(key, value);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Fleet File
+// ════════════════════════════════════════════════════════════════
+
+bool CFleetRunner::Load(LPCTSTR filePath, CString& error)
+{
+    m_targets.clear();
+    m_results.clear();
+
+    JsonValue root;
+    JsonError jsonError;
+    if (!CJsonReader::ParseFile(filePath, root, jsonError))
+    {
+        error = jsonError.line > 0 ? jsonError.Format() : jsonError.message;
+        return false;
+    }
+    if (root.type != JSON_OBJECT)
+    {
+        error = _T("expected an object");
+        return false;
+    }
+
+    // Numbers may also be written as strings, as in the settings files
+    auto readNumber = [&root, &error](LPCTSTR key, int low, int high, int& value) {
+        const JsonValue* item = root.Find(key);
+        if (!item)
+            return true;
+        int number = _ttoi(item->text);
+        if ((item->type != JSON_NUMBER && item->type != JSON_STRING) || number < low || number > high)
+        {
+            error.Format(_T("%s must be a number from %d to %d"), key, low, high);
+            return false;
+        }
+        value = number;
+        return true;
+    };
+    auto readSettings = [&error](const JsonValue& object, std::vector<std::pair<CString, CString>>& settings) {
+        for (const auto& member : object.members)
+        {
+            if (member.first == _T("Host"))
+                continue;
+            // SetupTest would drop a misspelt key silently; refuse it here
+            SettingKey key;
+            if (!CSettingsUtils::FindKey(member.first, key))
+            {
+                error = _T("unknown setting ") + member.first;
+                return false;
+            }
+            if (member.second.type != JSON_STRING && member.second.type != JSON_NUMBER)
+            {
+                error = member.first + _T(" must be a string");
+                return false;
+            }
+            SetValue(settings, member.first, member.second.text);
+        }
+        return true;
+    };
+
+    int timeoutSeconds = static_cast<int>(DEFAULT_TIMEOUT_MS / 1000);
+    int retryDelaySeconds = static_cast<int>(DEFAULT_RETRY_DELAY_MS / 1000);
+    if (!readNumber(_T("MaxParallel"), 1, PARALLEL_LIMIT, m_maxParallel) ||
+        !readNumber(_T("Retries"), 0, 10, m_retries) ||
+        !readNumber(_T("TimeoutSeconds"), 10, 24 * 60 * 60, timeoutSeconds) ||
+        !readNumber(_T("RetryDelaySeconds"), 0, 60 * 60, retryDelaySeconds))
+        return false;
+    m_timeoutMs = static_cast<DWORD>(timeoutSeconds) * 1000;
+    m_retryDelayMs = static_cast<DWORD>(retryDelaySeconds) * 1000;
+
+    if (const JsonValue* exe = root.Find(_T("SetupTestPath")))
+        m_exePath = exe->text;
+    if (const JsonValue* command = root.Find(_T("Command")))
+    {
+        m_command = command->text;
+        if (m_command.Find(_T("{config}")) >= 0)
+        {
+            error = _T("Command: the settings are sent on stdin; {config} is not substituted");
+            return false;
+        }
+    }
+
+    std::vector<std::pair<CString, CString>> defaults = m_defaults;
+    if (const JsonValue* section = root.Find(_T("Defaults")))
+    {
+        if (section->type != JSON_OBJECT || !readSettings(*section, defaults))
+        {
+            error = _T("Defaults: ") + (error.IsEmpty() ? CString(_T("expected an object")) : error);
+            return false;
+        }
+    }
+
+    const JsonValue* list = root.Find(_T("Targets"));
+    if (!list || list->type != JSON_ARRAY || list->items.empty())
+    {
+        error = _T("Targets must list at least one Test PC");
+        return false;
+    }
+    for (const JsonValue& item : list->items)
+    {
+        FleetTarget target;
+        target.settings = defaults;
+        if (item.type == JSON_STRING)
+        {
+            target.host = item.text;
+        }
+        else if (item.type == JSON_OBJECT)
+        {
+            const JsonValue* host = item.Find(_T("Host"));
+            if (host)
+                target.host = host->text;
+            if (!readSettings(item, target.settings))
+            {
+                error = target.host + _T(": ") + error;
+                return false;
+            }
+        }
+
+        if (!IsValidHost(target.host))
+        {
+            error = _T("Targets: invalid host name '") + target.host + _T("'");
+            return false;
+        }
+        for (const FleetTarget& other : m_targets)
+        {
+            if (other.host.CompareNoCase(target.host) == 0)
+            {
+                error = _T("Targets: ") + target.host + _T(" is listed twice");
+                return false;
+            }
+        }
+        m_targets.push_back(std::move(target));
+    }
+
+    m_results.assign(m_targets.size(), FleetTargetResult());
+    return true;
+}
+
+bool CFleetRunner::IsValidHost(const CString& host)
+{
+    // Substituted unquoted into the launch command: names and addresses only
+    if (host.IsEmpty() || host.GetLength() > 255)
+        return false;
+    return host.SpanIncluding(_T("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-_:")).GetLength() ==
+           host.GetLength();
+}
+
+// ════════════════════════════════════════════════════════════════
+// Running the Targets
+// ════════════════════════════════════════════════════════════════
+
+std::vector<SetupStep> CFleetRunner::BuildSteps()
+{
+    std::vector<SetupStep> steps;
+    for (int i = 0; i < GetTargetCount(); i++)
+    {
+        steps.push_back(SetupStep{ _T("Setting up ") + m_targets[i].host + _T("..."),
+                                   [this, i] { return RunTarget(i); }, true });
+    }
+    return steps;
+}
+
+CString CFleetRunner::QuoteForPowerShell(const CString& text)
+{
+    CString quoted(text);
+    quoted.Replace(_T("'"), _T("''"));
+    return _T("'") + quoted + _T("'");
+}
+
+std::string CFleetRunner::BuildConfig(const FleetTarget& target)
+{
+    // Settings for --config as one base64 line: no byte of it needs escaping
+    std::string json("{");
+    for (size_t i = 0; i < target.settings.size(); i++)
+    {
+        json += i > 0 ? ",\"" : "\"";
+        CJsonEscape::Append(json, target.settings[i].first);
+        json += "\":\"";
+        CJsonEscape::Append(json, target.settings[i].second);
+        json += "\"";
+    }
+    json += "}";
+    std::string config = CPowerShellHost::Base64Encode(json.data(), static_cast<DWORD>(json.size()));
+
+    // The password is a secret already; its encoded form must not leak either
+    CTraceRecorder::AddSecret(CString(config.c_str()));
+    return config + "\n";
+}
+
+CString CFleetRunner::BuildCommand(const FleetTarget& target) const
+{
+    CString command = m_command.IsEmpty() ? CString(DEFAULT_COMMAND) : m_command;
+    command.Replace(_T("{host}"), target.host);
+    command.Replace(_T("{exe}"), QuoteForPowerShell(m_exePath));
+    return command;
+}
+
+bool CFleetRunner::RunTarget(int index)
+{
+    const FleetTarget& target = m_targets[index];
+    FleetTargetResult& result = m_results[index];
+    CString command = BuildCommand(target);
+    std::string config = BuildConfig(target);
+    HANDLE hCancel = CWinUtils::GetCancelEvent();     // set by CStepRunner for the run
+    ULONGLONG start = GetTickCount64();
+    DWORD delay = m_retryDelayMs;
+
+    for (;;)
+    {
+        result.attempts++;
+        ProcessResult run = CProcessRunner::Run(command, m_timeoutMs, hCancel,
+                                                CProcessRunner::DEFAULT_MAX_OUTPUT, &config);
+        bool retry = JudgeAttempt(run, m_timeoutMs, result);
+        if (result.exitCode == EXIT_SUCCEEDED || !retry || result.attempts > m_retries)
+            break;
+
+        CString msg;
+        msg.Format(_T("%s: attempt %d failed (%s), retrying in %lu s."),
+                   (LPCTSTR)target.host, result.attempts, (LPCTSTR)result.failure, delay / 1000);
+        m_pLog->LogWarning(msg);
+        // The runner's cancel event doubles as the sleep
+        if (WaitForSingleObject(hCancel, delay) == WAIT_OBJECT_0)
+        {
+            result.failure = _T("cancelled");
+            break;
+        }
+        delay *= 2;
+    }
+    result.durationMs = GetTickCount64() - start;
+
+    CString msg;
+    if (result.exitCode == EXIT_SUCCEEDED)
+    {
+        msg.Format(_T("%s set up (%d attempt%s)."), (LPCTSTR)target.host,
+                   result.attempts, result.attempts == 1 ? _T("") : _T("s"));
+        m_pLog->LogSuccess(msg);
+        return true;
+    }
+    msg.Format(_T("%s: %s"), (LPCTSTR)target.host, (LPCTSTR)result.failure);
+    m_pLog->LogError(msg);
+    return false;
+}
+
+bool CFleetRunner::JudgeAttempt(const ProcessResult& run, DWORD timeoutMs, FleetTargetResult& result)
+{
+    result.exitCode = -1;
+    result.failure.Empty();
+    result.resultRecord.clear();
+
+    switch (run.status)
+    {
+    case ProcessStatus::Cancelled:
+        result.failure = _T("cancelled");
+        return false;
+    case ProcessStatus::StartFailed:
+        result.failure = _T("the launch command could not be started");
+        return false;
+    case ProcessStatus::TimedOut:
+        result.failure.Format(_T("no result within %lu s"), timeoutMs / 1000);
+        return true;
+    default:
+        break;
+    }
+
+    // The last RESULT record decides; everything else is progress or launcher output
+    const std::string& output = run.output;
+    CString lastLine;
+    size_t end = output.size();
+    while (end > 0)
+    {
+        size_t newline = output.rfind('\n', end - 1);
+        size_t begin = newline == std::string::npos ? 0 : newline + 1;
+        std::string line = output.substr(begin, end - begin);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+            line.pop_back();
+
+        if (line.find("\"Level\":\"RESULT\"") != std::string::npos)
+        {
+            CString text(CA2W(line.c_str(), CP_UTF8));
+            JsonValue record;
+            JsonError error;
+            const JsonValue* code = nullptr;
+            if (CJsonReader::Parse(text, text.GetLength(), record, error) &&
+                (code = record.Find(_T("ExitCode"))) != nullptr && code->type == JSON_NUMBER)
+            {
+                result.exitCode = static_cast<int>(code->number);
+                result.resultRecord = CW2A(text, CP_UTF8);
+                break;
+            }
+        }
+        if (lastLine.IsEmpty() && !line.empty())
+            lastLine = CA2W(line.c_str(), CP_UTF8);
+
+        if (newline == std::string::npos)
+            break;
+        end = newline;
+    }
+
+    if (result.exitCode < 0)
+    {
+        // Never reached SetupTest (WinRM down, host offline, access denied): worth another try
+        if (lastLine.IsEmpty())
+            lastLine.Format(_T("exit code %lu"), run.exitCode);
+        result.failure = _T("no result from the target: ") + lastLine.Left(200);
+        return true;
+    }
+
+    switch (result.exitCode)
+    {
+    case EXIT_SUCCEEDED:
+        return false;
+    case EXIT_STEPS_FAILED:
+        result.failure = _T("a setup step failed on the target (exit 1)");
+        return false;
+    case EXIT_USAGE:
+        result.failure = _T("the target rejected the settings (exit 2)");
+        return false;
+    case EXIT_NOT_ADMIN:
+        result.failure = _T("SetupTest is not elevated on the target (exit 3)");
+        return false;
+    case EXIT_CANCELLED:
+        result.failure = _T("interrupted on the target (exit 4)");
+        return true;
+    default:
+        result.failure.Format(_T("SetupTest could not run on the target (exit %d)"), result.exitCode);
+        return true;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════
+// Report
+// ════════════════════════════════════════════════════════════════
+
+void CFleetRunner::LogReport() const
+{
+    m_pLog->Log(_T(""));
+    m_pLog->LogSeparator();
+    m_pLog->Log(_T("  FLEET REPORT"));
+    m_pLog->LogSeparator();
+
+    int succeeded = 0;
+    std::string fields(",\"Targets\":[");
+    for (int i = 0; i < GetTargetCount(); i++)
+    {
+        const FleetTarget& target = m_targets[i];
+        const FleetTargetResult& result = m_results[i];
+        bool ok = result.exitCode == EXIT_SUCCEEDED;
+        succeeded += ok ? 1 : 0;
+        CString failure = result.attempts == 0 ? CString(_T("not started")) : result.failure;
+
+        CString line;
+        line.Format(_T("  %-20s %-6s %d attempt%-2s %7.1f s  %s"), (LPCTSTR)target.host,
+                    ok ? _T("ok") : _T("FAILED"), result.attempts, result.attempts == 1 ? _T("") : _T("s"),
+                    result.durationMs / 1000.0, (LPCTSTR)failure);
+        m_pLog->Log(line);
+
+        char number[128];
+        fields += i > 0 ? ",{\"Host\":\"" : "{\"Host\":\"";
+        CJsonEscape::Append(fields, target.host);
+        sprintf_s(number, "\",\"Attempts\":%d,\"ExitCode\":%d,\"DurationMs\":%llu,\"Failure\":\"",
+                  result.attempts, result.exitCode, result.durationMs);
+        fields += number;
+        CJsonEscape::Append(fields, failure);
+        fields += "\",\"Result\":";
+        fields += result.resultRecord.empty() ? "null" : result.resultRecord;
+        fields += "}";
+    }
+    fields += "]";
+
+    CString summary;
+    summary.Format(_T("%d of %d Test PCs set up."), succeeded, GetTargetCount());
+    m_pLog->LogSeparator();
+    m_pLog->Log(_T("  ") + summary);
+    m_pLog->LogFields("FLEET", summary, -1, -1, fields.c_str());
+}
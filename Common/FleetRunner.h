@@ -0,0 +1,95 @@
+#pragma once
+// FleetRunner.h - Runs SetupTest on many Test PCs from the Dev PC, a bounded number at a time
+
+#include <afxwin.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "LogUtils.h"
+#include "ProcessRunner.h"
+#include "SettingsUtils.h"
+#include "StepRunner.h"
+
+// One Test PC from the fleet file
+struct FleetTarget
+{
+    CString host;                                       // name or address the launch command connects to
+    std::vector<std::pair<CString, CString>> settings;  // SetupTest settings (Settings\SetupTest.json keys)
+};
+
+// What happened on one Test PC, over all attempts
+struct FleetTargetResult
+{
+    int         attempts = 0;
+    int         exitCode = -1;        // from the target's RESULT record; -1 = none arrived
+    ULONGLONG   durationMs = 0;       // all attempts, including the waits between them
+    CString     failure;              // why the last attempt failed; empty on success
+    std::string resultRecord;         // the target's RESULT record (one NDJSON line), empty if none
+};
+
+// Each target becomes one step for CStepRunner, so the pool size bounds the
+// parallelism and Ctrl+C / Stop cancel the running launch commands. A target
+// runs "SetupTest --setup --config <its settings> --json" through the launch
+// command (PowerShell remoting by default) and is judged by the RESULT record
+// in its output. Failures that a later attempt can fix (no answer, timeout,
+// interrupted on the target) are retried with a doubling delay.
+class CFleetRunner
+{
+public:
+    static const int   DEFAULT_MAX_PARALLEL   = 4;
+    static const int   PARALLEL_LIMIT         = 32;
+    static const int   DEFAULT_RETRIES        = 2;
+    static const DWORD DEFAULT_TIMEOUT_MS     = 15 * 60 * 1000;
+    static const DWORD DEFAULT_RETRY_DELAY_MS = 10 * 1000;
+
+    explicit CFleetRunner(CLogUtils* pLog);
+
+    // Setting every target gets unless the fleet file overrides it (call before Load)
+    void SetDefault(SettingKey key, LPCTSTR value);
+
+    // Read the fleet file:
+    //   { "MaxParallel": 4, "Retries": 2, "TimeoutSeconds": 900, "RetryDelaySeconds": 10,
+    //     "SetupTestPath": "C:\\Tools\\SetupTest.exe", "Command": "...",
+    //     "Defaults": { "DebuggerPort": "4026" },
+    //     "Targets": [ "LAB-07", { "Host": "LAB-08", "DriveLetter": "Y:" } ] }
+    // Command replaces the PowerShell remoting launcher (e.g. with a local
+    // stand-in agent); {host} and {exe} (as a PowerShell string literal) are
+    // substituted. The target's settings JSON arrives on the command's stdin
+    // as one base64 line.
+    bool Load(LPCTSTR filePath, CString& error);
+
+    int GetTargetCount() const { return static_cast<int>(m_targets.size()); }
+    int GetMaxParallel() const { return m_maxParallel; }
+
+    // One step per target, in file order; none depends on another
+    std::vector<SetupStep> BuildSteps();
+
+    // Table of the outcome per target, then one "FLEET" record with every
+    // target's attempts, timing and its own RESULT record (steps and timings)
+    void LogReport() const;
+
+    const FleetTargetResult& GetResult(int index) const { return m_results[index]; }
+
+    // Fill result from one launch and its output; true = worth retrying.
+    // timeoutMs only words the timeout failure.
+    static bool JudgeAttempt(const ProcessResult& run, DWORD timeoutMs, FleetTargetResult& result);
+
+private:
+    bool RunTarget(int index);
+    CString BuildCommand(const FleetTarget& target) const;
+    static std::string BuildConfig(const FleetTarget& target);     // base64 line for stdin
+    static bool IsValidHost(const CString& host);
+    static CString QuoteForPowerShell(const CString& text);
+    static void SetValue(std::vector<std::pair<CString, CString>>& settings, const CString& key, const CString& value);
+
+    CLogUtils*                     m_pLog;
+    std::vector<std::pair<CString, CString>> m_defaults;
+    std::vector<FleetTarget>       m_targets;
+    std::vector<FleetTargetResult> m_results;   // one writer per element (the target's step)
+    int     m_maxParallel;
+    int     m_retries;
+    DWORD   m_timeoutMs;
+    DWORD   m_retryDelayMs;
+    CString m_exePath;
+    CString m_command;
+};
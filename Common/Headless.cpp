@@ -0,0 +1,174 @@
+#include "pch.h"
+#include "Headless.h"
+#include "JsonEscape.h"
+#include <atomic>
+#include <shellapi.h>    // CommandLineToArgvW
+
+// Runner that the console control handler cancels
+static std::atomic<CStepRunner*> s_pActiveRunner(nullptr);
+
+bool CHeadless::ParseCommandLine(HeadlessOptions& options, CString& error)
+{
+    options.command = HEADLESS_NONE;
+    options.configPath.Empty();
+    options.fleetPath.Empty();
+    options.json = false;
+    error.Empty();
+
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv)
+        return true;
+
+    for (int i = 1; i < argc && error.IsEmpty(); i++)
+    {
+        CString arg(argv[i]);
+        if (arg.Left(2) != _T("--"))
+            continue;
+
+        HeadlessCommand command = HEADLESS_NONE;
+        if (arg.CompareNoCase(_T("--setup")) == 0)
+            command = HEADLESS_SETUP;
+        else if (arg.CompareNoCase(_T("--restore")) == 0)
+            command = HEADLESS_RESTORE;
+        else if (arg.CompareNoCase(_T("--help")) == 0)
+            command = HEADLESS_HELP;
+        else if (arg.CompareNoCase(_T("--json")) == 0)
+            options.json = true;
+        else if (arg.CompareNoCase(_T("--config")) == 0)
+        {
+            if (i + 1 < argc)
+                options.configPath = argv[++i];
+            else
+                error = _T("--config needs a file name.");
+        }
+        else if (arg.CompareNoCase(_T("--fleet")) == 0)
+        {
+            command = HEADLESS_FLEET;
+            if (i + 1 < argc)
+                options.fleetPath = argv[++i];
+            else
+                error = _T("--fleet needs a file name.");
+        }
+        else
+            error = _T("Unknown option ") + arg + _T(".");
+
+        if (command != HEADLESS_NONE)
+        {
+            if (options.command != HEADLESS_NONE && options.command != command)
+                error = _T("Give only one of --setup, --restore, --fleet and --help.");
+            options.command = command;
+        }
+    }
+    LocalFree(argv);
+
+    if (error.IsEmpty() && options.command == HEADLESS_NONE &&
+        (options.json || !options.configPath.IsEmpty()))
+        error = _T("--config and --json need --setup, --restore or --fleet.");
+    return error.IsEmpty();
+}
+
+CString CHeadless::Usage(LPCTSTR appName)
+{
+    CString text;
+    text.Format(_T("Usage: %s [--setup | --restore | --fleet <file>] [--config <file>] [--json] [/trace]\r\n")
+                _T("  --setup           run Setup without opening the window\r\n")
+                _T("  --restore         run Restore without opening the window (no confirmation)\r\n")
+                _T("  --fleet <file>    SetupDevelop only: run SetupTest --setup on every Test PC\r\n")
+                _T("                    listed in the file, a few at a time, with retries\r\n")
+                _T("  --config <file>   settings file (same keys as Settings\\%s.json) applied\r\n")
+                _T("                    on top of the saved settings\r\n")
+                _T("  --json            write NDJSON log records to stdout, ending with a RESULT record\r\n")
+                _T("Exit codes: 0 succeeded, 1 a step failed, 2 bad arguments or configuration,\r\n")
+                _T("            3 not run as Administrator, 4 cancelled, 5 could not start\r\n")
+                _T("From cmd.exe use \"start /wait\" to get the exit code.\r\n"),
+                appName, appName);
+    return text;
+}
+
+HANDLE CHeadless::AttachOutput()
+{
+    // A GUI-subsystem process has no console of its own. A redirected stdout
+    // (pipe or file) is inherited anyway; otherwise write to the parent's console.
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut && hOut != INVALID_HANDLE_VALUE && GetFileType(hOut) != FILE_TYPE_UNKNOWN)
+        return hOut;
+
+    if (!AttachConsole(ATTACH_PARENT_PROCESS))
+        return nullptr;
+    hOut = CreateFile(_T("CONOUT$"), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      nullptr, OPEN_EXISTING, 0, nullptr);
+    return hOut != INVALID_HANDLE_VALUE ? hOut : nullptr;
+}
+
+BOOL WINAPI CHeadless::CtrlHandler(DWORD ctrlType)
+{
+    CStepRunner* pRunner = s_pActiveRunner;
+    if (!pRunner)
+        return FALSE;
+
+    pRunner->Cancel();
+    if (ctrlType == CTRL_CLOSE_EVENT)
+    {
+        // The process is ended when this returns: give the steps a moment to stop
+        for (int i = 0; i < 40 && pRunner->IsRunning(); i++)
+            Sleep(100);
+    }
+    return TRUE;
+}
+
+void CHeadless::WaitForRun(CStepRunner& runner)
+{
+    s_pActiveRunner = &runner;
+    SetConsoleCtrlHandler(&CHeadless::CtrlHandler, TRUE);
+    runner.Wait();
+    SetConsoleCtrlHandler(&CHeadless::CtrlHandler, FALSE);
+    s_pActiveRunner = nullptr;
+}
+
+int CHeadless::Finish(const CStepRunner& runner, CLogUtils& log, LPCTSTR operation)
+{
+    int exitCode = runner.IsCancelled() ? EXIT_CANCELLED
+                 : runner.AllSucceeded() ? EXIT_SUCCEEDED : EXIT_STEPS_FAILED;
+
+    // One self-contained record, so a script never has to piece the outcome
+    // together from the step and span records before it
+    std::string fields;
+    char number[96];
+    sprintf_s(number, ",\"ExitCode\":%d,\"Cancelled\":%s,\"DurationMs\":%.0f,\"Steps\":[",
+              exitCode, runner.IsCancelled() ? "true" : "false", runner.GetElapsedSeconds() * 1000.0);
+    fields += number;
+    for (int step = 1; step <= runner.GetTotalSteps(); step++)
+    {
+        StepResult result = runner.GetStepResult(step);
+        LPCSTR state = result.state == STEP_SUCCEEDED ? "succeeded"
+                     : result.state == STEP_FAILED    ? "failed"
+                     : result.state == STEP_RUNNING   ? "running" : "not run";
+        ULONGLONG ms = result.endTick >= result.startTick ? result.endTick - result.startTick : 0;
+        sprintf_s(number, "%s{\"Step\":%d,\"State\":\"%s\",\"DurationMs\":%llu,\"Title\":\"",
+                  step > 1 ? "," : "", step, state, ms);
+        fields += number;
+        CJsonEscape::Append(fields, runner.GetStepTitle(step));
+        fields += "\"}";
+    }
+    fields += "]";
+
+    CString message;
+    message.Format(_T("%s exit code %d"), operation, exitCode);
+    log.LogFields("RESULT", message, -1, -1, fields.c_str());
+    log.FlushFileLog();
+    return exitCode;
+}
+
+int CHeadless::Abort(CLogUtils& log, LPCTSTR operation, int exitCode, LPCTSTR reason)
+{
+    log.LogError(reason);
+
+    char fields[96];
+    sprintf_s(fields, ",\"ExitCode\":%d,\"Cancelled\":false,\"DurationMs\":0,\"Steps\":[]", exitCode);
+    CString message;
+    message.Format(_T("%s exit code %d"), operation, exitCode);
+    log.LogFields("RESULT", message, -1, -1, fields);
+    log.FlushFileLog();
+    return exitCode;
+}
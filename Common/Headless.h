@@ -0,0 +1,65 @@
+#pragma once
+// Headless.h - Command-line runs without any window: arguments, output, exit codes
+
+#include <afxwin.h>
+#include "LogUtils.h"
+#include "StepRunner.h"
+
+// Process exit code of a headless run
+enum HeadlessExitCode
+{
+    EXIT_SUCCEEDED    = 0,    // every step that affects the result succeeded
+    EXIT_STEPS_FAILED = 1,    // the run finished, but at least one such step failed
+    EXIT_USAGE        = 2,    // bad arguments or configuration file
+    EXIT_NOT_ADMIN    = 3,
+    EXIT_CANCELLED    = 4,    // Ctrl+C / Ctrl+Break; completed steps stay journaled
+    EXIT_START_FAILED = 5,    // the worker thread could not be started
+};
+
+enum HeadlessCommand
+{
+    HEADLESS_NONE,            // no command: show the dialog
+    HEADLESS_SETUP,           // --setup
+    HEADLESS_RESTORE,         // --restore
+    HEADLESS_FLEET,           // --fleet <file>: SetupDevelop drives SetupTest on many Test PCs
+    HEADLESS_HELP,            // --help
+};
+
+struct HeadlessOptions
+{
+    HeadlessCommand command;
+    CString configPath;       // --config <file>: same keys as the saved settings, applied on top of them
+    CString fleetPath;        // --fleet <file>: Test PCs and fleet options, see FleetRunner.h
+    bool    json;             // --json: NDJSON records on stdout instead of the log text
+};
+
+class CHeadless
+{
+public:
+    // Parse the process command line. Returns false with error set for an
+    // unknown or incomplete "--" option; "/" switches (e.g. /trace) are left
+    // to the caller.
+    static bool ParseCommandLine(HeadlessOptions& options, CString& error);
+
+    // Usage text for --help and argument errors
+    static CString Usage(LPCTSTR appName);
+
+    // The caller's stdout when it was redirected, else the console of the
+    // shell that started us; nullptr if there is neither.
+    static HANDLE AttachOutput();
+
+    // Block until a run started without a notify window has finished.
+    // Ctrl+C / Ctrl+Break / closing the console cancel it meanwhile.
+    static void WaitForRun(CStepRunner& runner);
+
+    // Log a "RESULT" record with the outcome and timing of every step and
+    // return the exit code for the finished run.
+    static int Finish(const CStepRunner& runner, CLogUtils& log, LPCTSTR operation);
+
+    // Log the reason a run could not start, then a "RESULT" record without
+    // steps; returns exitCode.
+    static int Abort(CLogUtils& log, LPCTSTR operation, int exitCode, LPCTSTR reason);
+
+private:
+    static BOOL WINAPI CtrlHandler(DWORD ctrlType);
+};
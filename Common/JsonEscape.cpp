@@ -0,0 +1,251 @@
+#include "pch.h"
+#include "JsonEscape.h"
+#if defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#include <intrin.h>
+#define JSON_ESCAPE_SIMD
+#endif
+
+// ════════════════════════════════════════════════════════════════
+// Per-character path
+// ════════════════════════════════════════════════════════════════
+
+static const char HEX[] = "0123456789abcdef";
+
+// Encode text[i] (and its low surrogate, if paired); returns code units consumed
+static size_t EncodeOne(LPCWSTR text, size_t i, size_t length, char*& out)
+{
+    unsigned ch = text[i];
+
+    if (ch < 0x80)
+    {
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+        {
+            *out++ = static_cast<char>(ch);
+            return 1;
+        }
+
+        *out++ = '\\';
+        switch (ch)
+        {
+        case '"':  *out++ = '"';  break;
+        case '\\': *out++ = '\\'; break;
+        case '\n': *out++ = 'n';  break;
+        case '\r': *out++ = 'r';  break;
+        case '\t': *out++ = 't';  break;
+        case '\b': *out++ = 'b';  break;
+        case '\f': *out++ = 'f';  break;
+        default:
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = HEX[ch >> 4];
+            *out++ = HEX[ch & 0xF];
+            break;
+        }
+        return 1;
+    }
+
+    if (ch < 0x800)
+    {
+        *out++ = static_cast<char>(0xC0 | (ch >> 6));
+        *out++ = static_cast<char>(0x80 | (ch & 0x3F));
+        return 1;
+    }
+
+    if (ch >= 0xD800 && ch <= 0xDBFF && i + 1 < length &&
+        text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF)
+    {
+        unsigned cp = 0x10000 + ((ch - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+        *out++ = static_cast<char>(0xF0 | (cp >> 18));
+        *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        return 2;
+    }
+
+    if (ch >= 0xD800 && ch <= 0xDFFF)
+        ch = 0xFFFD;    // unpaired surrogate
+    *out++ = static_cast<char>(0xE0 | (ch >> 12));
+    *out++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (ch & 0x3F));
+    return 1;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Block scanners
+// ════════════════════════════════════════════════════════════════
+// A code unit passes straight through when 0x20 <= ch < 0x80 and it is not
+// '"' or '\\'. The range test is one unsigned compare of (ch - 0x20) < 0x60,
+// done as a signed compare after flipping the sign bit. Each scanner copies
+// whole blocks and stops at the first unit that needs EncodeOne; the block
+// store may write past the safe prefix, which MaxUtf8Size leaves room for.
+
+typedef size_t (*ScanFn)(LPCWSTR text, size_t i, size_t length, char*& out);
+
+// Copy plain ASCII one unit at a time; the fallback and the reference
+static size_t ScanScalar(LPCWSTR text, size_t i, size_t length, char*& out)
+{
+    while (i < length && text[i] >= 0x20 && text[i] < 0x80 && text[i] != L'"' && text[i] != L'\\')
+        *out++ = static_cast<char>(text[i++]);
+    return i;
+}
+
+#ifdef JSON_ESCAPE_SIMD
+
+static size_t ScanSSE2(LPCWSTR text, size_t i, size_t length, char*& out)
+{
+    const __m128i bias  = _mm_set1_epi16(static_cast<short>(0x8000 - 0x20));
+    const __m128i limit = _mm_set1_epi16(static_cast<short>(0x8000 + 0x60));
+    const __m128i quote = _mm_set1_epi16('"');
+    const __m128i slash = _mm_set1_epi16('\\');
+
+    while (i + 8 <= length)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i plain = _mm_andnot_si128(
+            _mm_or_si128(_mm_cmpeq_epi16(v, quote), _mm_cmpeq_epi16(v, slash)),
+            _mm_cmplt_epi16(_mm_add_epi16(v, bias), limit));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(v, v));
+
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(plain));
+        if (mask != 0xFFFF)
+        {
+            unsigned long first;
+            _BitScanForward(&first, ~mask & 0xFFFF);
+            out += first / 2;
+            return i + first / 2;
+        }
+        out += 8;
+        i += 8;
+    }
+    return i;
+}
+
+static size_t ScanAVX2(LPCWSTR text, size_t i, size_t length, char*& out)
+{
+    const __m256i bias  = _mm256_set1_epi16(static_cast<short>(0x8000 - 0x20));
+    const __m256i limit = _mm256_set1_epi16(static_cast<short>(0x8000 + 0x60));
+    const __m256i quote = _mm256_set1_epi16('"');
+    const __m256i slash = _mm256_set1_epi16('\\');
+
+    while (i + 16 <= length)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i plain = _mm256_andnot_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi16(v, quote), _mm256_cmpeq_epi16(v, slash)),
+            _mm256_cmpgt_epi16(limit, _mm256_add_epi16(v, bias)));
+
+        // packus works per 128-bit lane; gather qwords 0 and 2 for the 16 bytes in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(plain));
+        if (mask != 0xFFFFFFFF)
+        {
+            unsigned long first;
+            _BitScanForward(&first, ~mask);
+            out += first / 2;
+            return i + first / 2;
+        }
+        out += 16;
+        i += 16;
+    }
+    _mm256_zeroupper();
+    return ScanSSE2(text, i, length, out);
+}
+
+static bool CpuHasAVX2()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)    // OS saves YMM state
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+static bool HasAVX2()
+{
+    static const bool has = CpuHasAVX2();
+    return has;
+}
+
+#endif
+
+// nullptr if this build or CPU lacks the kernel
+static ScanFn GetScanner(JsonEscapeKernel kernel)
+{
+    switch (kernel)
+    {
+    case JsonEscapeKernel::Scalar:
+        return &ScanScalar;
+#ifdef JSON_ESCAPE_SIMD
+    case JsonEscapeKernel::SSE2:
+        return &ScanSSE2;
+    case JsonEscapeKernel::AVX2:
+        return HasAVX2() ? &ScanAVX2 : nullptr;
+    case JsonEscapeKernel::Auto:
+        return HasAVX2() ? &ScanAVX2 : &ScanSSE2;
+#else
+    case JsonEscapeKernel::Auto:
+        return &ScanScalar;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════
+// Entry points
+// ════════════════════════════════════════════════════════════════
+
+size_t CJsonEscape::ToUtf8(LPCWSTR text, size_t length, char* out)
+{
+    return ToUtf8(text, length, out, JsonEscapeKernel::Auto);
+}
+
+bool CJsonEscape::HasKernel(JsonEscapeKernel kernel)
+{
+    return GetScanner(kernel) != nullptr;
+}
+
+size_t CJsonEscape::ToUtf8(LPCWSTR text, size_t length, char* out, JsonEscapeKernel kernel)
+{
+    char* start = out;
+    ScanFn scan = GetScanner(kernel);
+    ASSERT(scan);
+
+    size_t i = 0;
+    while (i < length)
+    {
+        i = scan(text, i, length, out);
+        if (i < length)
+            i += EncodeOne(text, i, length, out);
+    }
+    return static_cast<size_t>(out - start);
+}
+
+void CJsonEscape::Append(std::string& out, LPCWSTR text, size_t length)
+{
+    if (!text || length == 0)
+        return;
+
+    size_t used = out.size();
+    out.resize(used + MaxUtf8Size(length));
+    out.resize(used + ToUtf8(text, length, &out[used]));
+}
+
+void CJsonEscape::Append(std::string& out, LPCWSTR text)
+{
+    if (text)
+        Append(out, text, wcslen(text));
+}
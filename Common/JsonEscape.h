@@ -0,0 +1,39 @@
+#pragma once
+// JsonEscape.h - UTF-16 to UTF-8 transcoding with JSON string escaping
+
+#include <afxwin.h>
+#include <string>
+
+// Scanner for the plain-ASCII runs; Auto picks the widest the CPU supports
+enum class JsonEscapeKernel
+{
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// One kernel for every JSON string this code writes (log records, settings).
+// Runs of plain ASCII are found and narrowed 16 (AVX2) or 8 (SSE2) code
+// units at a time; only '"', '\\', control characters and non-ASCII text
+// take the per-character path. Output is valid UTF-8 even for unpaired
+// surrogates, which become U+FFFD.
+class CJsonEscape
+{
+public:
+    // Worst case output size: a control character becomes "\u00XX"
+    static size_t MaxUtf8Size(size_t length) { return length * 6; }
+
+    // Write the escaped UTF-8 form of text (without quotes) to out, which must
+    // hold MaxUtf8Size(length) bytes. Returns the number of bytes written.
+    static size_t ToUtf8(LPCWSTR text, size_t length, char* out);
+
+    // Same with a given scanner, so tests can hold each one to the scalar
+    // result. Call only with a kernel HasKernel reports.
+    static size_t ToUtf8(LPCWSTR text, size_t length, char* out, JsonEscapeKernel kernel);
+    static bool   HasKernel(JsonEscapeKernel kernel);
+
+    // Append the escaped UTF-8 form of text to out
+    static void Append(std::string& out, LPCWSTR text, size_t length);
+    static void Append(std::string& out, LPCWSTR text);
+};
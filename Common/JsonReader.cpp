@@ -0,0 +1,377 @@
+#include "pch.h"
+#include "JsonReader.h"
+
+const JsonValue* JsonValue::Find(LPCTSTR key) const
+{
+    for (auto it = members.rbegin(); it != members.rend(); ++it)
+    {
+        if (it->first == key)
+            return &it->second;
+    }
+    return nullptr;
+}
+
+CString JsonError::Format() const
+{
+    CString text;
+    text.Format(_T("line %d, column %d: %s"), line, column, (LPCTSTR)message);
+    return text;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Entry points
+// ════════════════════════════════════════════════════════════════
+
+CJsonReader::CJsonReader(LPCWSTR text, size_t length)
+    : m_p(text)
+    , m_end(text + length)
+    , m_lineStart(text)
+    , m_line(1)
+{
+}
+
+bool CJsonReader::Parse(LPCWSTR text, size_t length, JsonValue& root, JsonError& error)
+{
+    CJsonReader reader(text, length);
+    root = JsonValue();
+
+    reader.SkipWhitespace();
+    bool ok = reader.ParseValue(root, 0);
+    if (ok)
+    {
+        reader.SkipWhitespace();
+        if (reader.m_p != reader.m_end)
+            ok = reader.Fail(_T("unexpected text after the end of the document"));
+    }
+
+    if (!ok)
+        error = reader.m_error;
+    return ok;
+}
+
+bool CJsonReader::ParseFile(LPCTSTR filePath, JsonValue& root, JsonError& error)
+{
+    error = JsonError();
+
+    HANDLE hFile = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        error.message = _T("cannot open file");
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    std::vector<BYTE> data;
+    bool readOk = GetFileSizeEx(hFile, &size) && size.QuadPart < 64 * 1024 * 1024;
+    if (readOk)
+    {
+        data.resize(static_cast<size_t>(size.QuadPart));
+        DWORD read = 0;
+        readOk = data.empty() ||
+                 (ReadFile(hFile, data.data(), static_cast<DWORD>(data.size()), &read, nullptr) && read == data.size());
+    }
+    CloseHandle(hFile);
+    if (!readOk)
+    {
+        error.message = _T("cannot read file");
+        return false;
+    }
+
+    // One conversion of the whole buffer; the parser then works in place
+    if (data.size() >= 2 && data[0] == 0xFF && data[1] == 0xFE)
+    {
+        size_t count = (data.size() - 2) / sizeof(WCHAR);
+        return Parse(reinterpret_cast<LPCWSTR>(data.data() + 2), count, root, error);
+    }
+
+    size_t offset = (data.size() >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
+    LPCSTR bytes = reinterpret_cast<LPCSTR>(data.data() + offset);
+    int byteCount = static_cast<int>(data.size() - offset);
+
+    // Valid UTF-8 is taken as UTF-8, anything else as the ANSI code page
+    UINT codePage = CP_UTF8;
+    int wideCount = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, bytes, byteCount, nullptr, 0);
+    if (wideCount == 0 && byteCount > 0)
+    {
+        codePage = CP_ACP;
+        wideCount = MultiByteToWideChar(CP_ACP, 0, bytes, byteCount, nullptr, 0);
+    }
+
+    std::vector<WCHAR> text(static_cast<size_t>(wideCount) + 1);
+    if (wideCount > 0)
+        MultiByteToWideChar(codePage, 0, bytes, byteCount, text.data(), wideCount);
+    return Parse(text.data(), static_cast<size_t>(wideCount), root, error);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Grammar
+// ════════════════════════════════════════════════════════════════
+
+bool CJsonReader::Fail(LPCTSTR message)
+{
+    m_error.line = m_line;
+    m_error.column = static_cast<int>(m_p - m_lineStart) + 1;
+    m_error.message = message;
+    return false;
+}
+
+void CJsonReader::SkipWhitespace()
+{
+    while (m_p < m_end)
+    {
+        WCHAR ch = *m_p;
+        if (ch == L'\n')
+        {
+            m_line++;
+            m_lineStart = m_p + 1;
+        }
+        else if (ch != L' ' && ch != L'\t' && ch != L'\r')
+        {
+            break;
+        }
+        m_p++;
+    }
+}
+
+bool CJsonReader::ParseValue(JsonValue& value, int depth)
+{
+    if (m_p >= m_end)
+        return Fail(_T("unexpected end of document"));
+
+    switch (*m_p)
+    {
+    case L'{': return ParseObject(value, depth);
+    case L'[': return ParseArray(value, depth);
+    case L'"':
+        value.type = JSON_STRING;
+        return ParseString(value.text);
+    case L't':
+        value.type = JSON_BOOL;
+        value.boolean = true;
+        return ParseLiteral(L"true", 4);
+    case L'f':
+        value.type = JSON_BOOL;
+        value.boolean = false;
+        return ParseLiteral(L"false", 5);
+    case L'n':
+        value.type = JSON_NULL;
+        return ParseLiteral(L"null", 4);
+    default:
+        if (*m_p == L'-' || (*m_p >= L'0' && *m_p <= L'9'))
+            return ParseNumber(value);
+        return Fail(_T("expected a value"));
+    }
+}
+
+bool CJsonReader::ParseObject(JsonValue& value, int depth)
+{
+    if (depth >= MAX_DEPTH)
+        return Fail(_T("nested too deeply"));
+
+    value.type = JSON_OBJECT;
+    m_p++;  // '{'
+    SkipWhitespace();
+    if (m_p < m_end && *m_p == L'}')
+    {
+        m_p++;
+        return true;
+    }
+
+    for (;;)
+    {
+        if (m_p >= m_end || *m_p != L'"')
+            return Fail(_T("expected a member name"));
+
+        value.members.emplace_back();
+        auto& member = value.members.back();
+        if (!ParseString(member.first))
+            return false;
+
+        SkipWhitespace();
+        if (m_p >= m_end || *m_p != L':')
+            return Fail(_T("expected ':'"));
+        m_p++;
+        SkipWhitespace();
+
+        if (!ParseValue(member.second, depth + 1))
+            return false;
+
+        SkipWhitespace();
+        if (m_p < m_end && *m_p == L',')
+        {
+            m_p++;
+            SkipWhitespace();
+            continue;
+        }
+        if (m_p < m_end && *m_p == L'}')
+        {
+            m_p++;
+            return true;
+        }
+        return Fail(_T("expected ',' or '}'"));
+    }
+}
+
+bool CJsonReader::ParseArray(JsonValue& value, int depth)
+{
+    if (depth >= MAX_DEPTH)
+        return Fail(_T("nested too deeply"));
+
+    value.type = JSON_ARRAY;
+    m_p++;  // '['
+    SkipWhitespace();
+    if (m_p < m_end && *m_p == L']')
+    {
+        m_p++;
+        return true;
+    }
+
+    for (;;)
+    {
+        value.items.emplace_back();
+        if (!ParseValue(value.items.back(), depth + 1))
+            return false;
+
+        SkipWhitespace();
+        if (m_p < m_end && *m_p == L',')
+        {
+            m_p++;
+            SkipWhitespace();
+            continue;
+        }
+        if (m_p < m_end && *m_p == L']')
+        {
+            m_p++;
+            return true;
+        }
+        return Fail(_T("expected ',' or ']'"));
+    }
+}
+
+static int HexDigit(WCHAR ch)
+{
+    if (ch >= L'0' && ch <= L'9') return ch - L'0';
+    if (ch >= L'a' && ch <= L'f') return ch - L'a' + 10;
+    if (ch >= L'A' && ch <= L'F') return ch - L'A' + 10;
+    return -1;
+}
+
+bool CJsonReader::ParseString(CString& out)
+{
+    m_p++;  // opening quote
+
+    // Find the closing quote first: the unescaped text is never longer, so
+    // it can be written into the destination in one pass
+    LPCWSTR scan = m_p;
+    while (scan < m_end && *scan != L'"')
+        scan += (*scan == L'\\') ? 2 : 1;
+    if (scan >= m_end)
+        return Fail(_T("unterminated string"));
+
+    int capacity = static_cast<int>(scan - m_p);
+    LPWSTR dst = out.GetBuffer(capacity);
+    int count = 0;
+
+    while (*m_p != L'"')
+    {
+        WCHAR ch = *m_p;
+        if (ch < 0x20)
+        {
+            out.ReleaseBuffer(count);
+            return Fail(_T("control character in string"));
+        }
+        if (ch != L'\\')
+        {
+            dst[count++] = ch;
+            m_p++;
+            continue;
+        }
+
+        WCHAR esc = m_p[1];
+        m_p += 2;
+        switch (esc)
+        {
+        case L'"':  dst[count++] = L'"';  break;
+        case L'\\': dst[count++] = L'\\'; break;
+        case L'/':  dst[count++] = L'/';  break;
+        case L'b':  dst[count++] = L'\b'; break;
+        case L'f':  dst[count++] = L'\f'; break;
+        case L'n':  dst[count++] = L'\n'; break;
+        case L'r':  dst[count++] = L'\r'; break;
+        case L't':  dst[count++] = L'\t'; break;
+        case L'u':
+        {
+            int code = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                int digit = (m_p + i < scan) ? HexDigit(m_p[i]) : -1;
+                if (digit < 0)
+                {
+                    out.ReleaseBuffer(count);
+                    return Fail(_T("invalid \\u escape"));
+                }
+                code = code * 16 + digit;
+            }
+            // UTF-16 code unit as is; surrogate pairs arrive as two escapes
+            dst[count++] = static_cast<WCHAR>(code);
+            m_p += 4;
+            break;
+        }
+        default:
+            m_p -= 2;
+            out.ReleaseBuffer(count);
+            return Fail(_T("invalid escape sequence"));
+        }
+    }
+
+    out.ReleaseBuffer(count);
+    m_p++;  // closing quote
+    return true;
+}
+
+bool CJsonReader::ParseNumber(JsonValue& value)
+{
+    LPCWSTR start = m_p;
+    auto digits = [this] {
+        LPCWSTR from = m_p;
+        while (m_p < m_end && *m_p >= L'0' && *m_p <= L'9')
+            m_p++;
+        return m_p > from;
+    };
+
+    if (*m_p == L'-')
+        m_p++;
+    if (m_p < m_end && *m_p == L'0')
+        m_p++;
+    else if (!digits())
+        return Fail(_T("invalid number"));
+
+    if (m_p < m_end && *m_p == L'.')
+    {
+        m_p++;
+        if (!digits())
+            return Fail(_T("invalid number"));
+    }
+    if (m_p < m_end && (*m_p == L'e' || *m_p == L'E'))
+    {
+        m_p++;
+        if (m_p < m_end && (*m_p == L'+' || *m_p == L'-'))
+            m_p++;
+        if (!digits())
+            return Fail(_T("invalid number"));
+    }
+
+    value.type = JSON_NUMBER;
+    value.text.SetString(start, static_cast<int>(m_p - start));
+    value.number = _wtof(value.text);
+    return true;
+}
+
+bool CJsonReader::ParseLiteral(LPCWSTR word, size_t length)
+{
+    if (static_cast<size_t>(m_end - m_p) < length || wcsncmp(m_p, word, length) != 0)
+        return Fail(_T("expected a value"));
+    m_p += length;
+    return true;
+}
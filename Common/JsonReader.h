@@ -0,0 +1,70 @@
+#pragma once
+// JsonReader.h - Single-pass JSON parser producing typed values
+
+#include <afxwin.h>
+#include <utility>
+#include <vector>
+
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+struct JsonValue
+{
+    JsonType type = JSON_NULL;
+    bool     boolean = false;
+    double   number = 0.0;
+    CString  text;                                      // string value, or a number as written
+    std::vector<JsonValue> items;                       // array elements
+    std::vector<std::pair<CString, JsonValue>> members; // object members in file order
+
+    // Object member by name (last one wins, as in most JSON readers); nullptr if absent
+    const JsonValue* Find(LPCTSTR key) const;
+};
+
+struct JsonError
+{
+    int     line = 0;       // 1-based
+    int     column = 0;     // 1-based, in characters
+    CString message;
+
+    CString Format() const; // "line 3, column 14: expected ':'"
+};
+
+// Recursive-descent parser over one in-memory buffer. Strings are unescaped
+// straight into their final CString; nothing else is allocated per token.
+class CJsonReader
+{
+public:
+    static bool Parse(LPCWSTR text, size_t length, JsonValue& root, JsonError& error);
+
+    // Read a whole file (UTF-8 with or without BOM, UTF-16 LE with BOM, or
+    // the ANSI code page the old settings writer used) and parse it
+    static bool ParseFile(LPCTSTR filePath, JsonValue& root, JsonError& error);
+
+private:
+    static const int MAX_DEPTH = 64;
+
+    CJsonReader(LPCWSTR text, size_t length);
+
+    bool ParseValue(JsonValue& value, int depth);
+    bool ParseObject(JsonValue& value, int depth);
+    bool ParseArray(JsonValue& value, int depth);
+    bool ParseString(CString& out);
+    bool ParseNumber(JsonValue& value);
+    bool ParseLiteral(LPCWSTR word, size_t length);
+    void SkipWhitespace();
+    bool Fail(LPCTSTR message);
+
+    LPCWSTR   m_p;
+    LPCWSTR   m_end;
+    LPCWSTR   m_lineStart;
+    int       m_line;
+    JsonError m_error;
+};
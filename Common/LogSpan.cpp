@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "LogSpan.h"
+#include "LogUtils.h"
+#include "TraceRecorder.h"
+
+static thread_local CLogSpan* t_currentSpan = nullptr;
+
+static LONGLONG GetQpcFrequency()
+{
+    static const LONGLONG frequency = [] {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return f.QuadPart;
+    }();
+    return frequency;
+}
+
+CLogSpan::CLogSpan(CLogUtils* pLog, LPCTSTR name, int step, int total)
+    : m_pLog(pLog)
+    , m_name(name)
+    , m_step(step)
+    , m_total(total)
+    , m_ended(false)
+    , m_parent(t_currentSpan)
+    , m_counters()
+{
+    t_currentSpan = this;
+    if (m_pLog)
+        m_pLog->LogFields("SPAN", m_name, m_step, m_total, ",\"Span\":\"begin\"");
+    QueryPerformanceCounter(&m_start);
+}
+
+CLogSpan::~CLogSpan()
+{
+    End("abandoned");
+}
+
+double CLogSpan::GetElapsedMs() const
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - m_start.QuadPart) * 1000.0 / GetQpcFrequency();
+}
+
+void CLogSpan::End(LPCSTR outcome)
+{
+    if (m_ended)
+        return;
+    m_ended = true;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double ms = (now.QuadPart - m_start.QuadPart) * 1000.0 / GetQpcFrequency();
+    if (CTraceRecorder::IsEnabled())
+        CTraceRecorder::Record("step", m_name, nullptr, m_start.QuadPart, now.QuadPart,
+                               -1, m_counters[SPAN_BYTES_READ]);
+
+    // Spans close in reverse order of opening on their thread
+    if (t_currentSpan == this)
+        t_currentSpan = m_parent;
+    if (m_parent)
+    {
+        for (int i = 0; i < SPAN_COUNTER_COUNT; i++)
+            m_parent->m_counters[i] += m_counters[i];
+    }
+
+    if (m_pLog)
+    {
+        char fields[256];
+        sprintf_s(fields,
+                  ",\"Span\":\"end\",\"DurationMs\":%.3f,\"Outcome\":\"%s\""
+                  ",\"Processes\":%llu,\"PowerShell\":%llu,\"ComCalls\":%llu,\"BytesRead\":%llu",
+                  ms, outcome,
+                  m_counters[SPAN_PROCESSES], m_counters[SPAN_POWERSHELL],
+                  m_counters[SPAN_COM_CALLS], m_counters[SPAN_BYTES_READ]);
+        m_pLog->LogFields("SPAN", m_name, m_step, m_total, fields);
+    }
+}
+
+void CLogSpan::Count(SpanCounter counter, ULONGLONG amount)
+{
+    if (t_currentSpan)
+        t_currentSpan->m_counters[counter] += amount;
+}
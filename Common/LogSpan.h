@@ -0,0 +1,49 @@
+#pragma once
+// LogSpan.h - Timed spans with counters, written as NDJSON begin / end records
+
+#include <afxwin.h>
+
+class CLogUtils;
+
+// What a span counts; helpers add to these wherever the work happens
+enum SpanCounter
+{
+    SPAN_PROCESSES,     // child processes started
+    SPAN_POWERSHELL,    // PowerShell commands (persistent host or one-shot process)
+    SPAN_COM_CALLS,     // COM operations (firewall, task scheduler, network list)
+    SPAN_BYTES_READ,    // output read back from child processes
+    SPAN_COUNTER_COUNT
+};
+
+// Scoped span. The constructor writes a "begin" record; End (or the
+// destructor, as "abandoned") writes an "end" record with the duration from
+// QueryPerformanceCounter, the outcome and the counters. Spans nest per
+// thread: Count adds to the innermost open span, and a closing span adds its
+// counters to the one it is nested in. Records go to the log file only.
+class CLogSpan
+{
+public:
+    CLogSpan(CLogUtils* pLog, LPCTSTR name, int step = -1, int total = -1);
+    ~CLogSpan();
+
+    // outcome: e.g. "ok", "failed", "cancelled"; only the first call writes
+    void End(LPCSTR outcome);
+
+    double GetElapsedMs() const;
+
+    // Add to a counter of the calling thread's innermost span (no-op if none)
+    static void Count(SpanCounter counter, ULONGLONG amount = 1);
+
+private:
+    CLogSpan(const CLogSpan&) = delete;
+    CLogSpan& operator=(const CLogSpan&) = delete;
+
+    CLogUtils*    m_pLog;
+    CString       m_name;
+    int           m_step;
+    int           m_total;
+    LARGE_INTEGER m_start;
+    bool          m_ended;
+    CLogSpan*     m_parent;
+    ULONGLONG     m_counters[SPAN_COUNTER_COUNT];
+};
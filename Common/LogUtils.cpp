@@ -3,21 +3,39 @@
 #include <ShlObj.h>
 #include <Richedit.h>
 
+static thread_local int t_step = 0;
+static thread_local int t_totalSteps = 0;
+
 CLogUtils::CLogUtils()
     : m_pEdit(nullptr)
+    , m_hConsole(nullptr)
+    , m_consoleJson(false)
     , m_fileLogEnabled(false)
 {
 }
 
 CLogUtils::~CLogUtils()
 {
+    if (m_pEdit && ::IsWindow(m_pEdit->GetSafeHwnd()))
+        ::KillTimer(m_pEdit->GetSafeHwnd(), reinterpret_cast<UINT_PTR>(this));
+
+    // Drains the writer queue so no record is lost on exit
+    m_writer.Close();
 }
 
 void CLogUtils::SetLogControl(CRichEditCtrl* pEdit)
 {
+    if (m_pEdit && ::IsWindow(m_pEdit->GetSafeHwnd()))
+        ::KillTimer(m_pEdit->GetSafeHwnd(), reinterpret_cast<UINT_PTR>(this));
+
     m_pEdit = pEdit;
     if (m_pEdit && ::IsWindow(m_pEdit->GetSafeHwnd()))
     {
+        // Periodic batch flush. The timer id is this object, so the static
+        // callback can find its way back without a lookup table.
+        ::SetTimer(m_pEdit->GetSafeHwnd(), reinterpret_cast<UINT_PTR>(this),
+                   FLUSH_INTERVAL_MS, &CLogUtils::FlushTimerProc);
+
         m_pEdit->SetBackgroundColor(FALSE, RGB(255, 255, 255));
 
         // Inherit the dialog font so the rich-edit looks identical to a CEdit
@@ -45,15 +63,13 @@ void CLogUtils::SetLogControl(CRichEditCtrl* pEdit)
     }
 }
 
-void CLogUtils::InitFileLog(LPCTSTR appName)
+void CLogUtils::InitFileLog(LPCTSTR appName, const LogFlushPolicy& policy)
 {
-    m_appName = appName;
-
-    // Get hostname once
+    // Get hostname once; Logger and Hostname are encoded here for the whole run
     TCHAR computerName[MAX_COMPUTERNAME_LENGTH + 1] = {};
     DWORD size = MAX_COMPUTERNAME_LENGTH + 1;
     GetComputerName(computerName, &size);
-    m_hostname = computerName;
+    m_encoder.SetSource(appName, computerName);
 
     // Build "Log" folder path next to the executable
     TCHAR exePath[MAX_PATH];
@@ -74,7 +90,7 @@ void CLogUtils::InitFileLog(LPCTSTR appName)
                     st.wHour, st.wMinute, st.wSecond);
 
     m_logFilePath = logDir + _T("\\") + fileName;
-    m_fileLogEnabled = true;
+    m_fileLogEnabled = m_writer.Open(m_logFilePath, policy);
 
     // Write opening system info entry
     CString osInfo;
@@ -89,14 +105,65 @@ void CLogUtils::InitFileLog(LPCTSTR appName)
 
     CString sysMsg;
     sysMsg.Format(_T("Log started. Host: %s, OS: %s, Admin: %s"),
-                  (LPCTSTR)m_hostname, (LPCTSTR)osInfo,
+                  computerName, (LPCTSTR)osInfo,
                   IsUserAnAdmin() ? _T("yes") : _T("no"));
-    WriteJsonLine(_T("SYSTEM"), sysMsg);
+    WriteJsonLine("SYSTEM", sysMsg);
+}
+
+void CLogUtils::FlushFileLog()
+{
+    m_writer.Flush();
+}
+
+void CLogUtils::SetConsoleOutput(HANDLE hOut, bool json)
+{
+    std::lock_guard<std::mutex> lock(m_consoleMutex);
+    m_hConsole = hOut;
+    m_consoleJson = json;
+}
+
+void CLogUtils::WriteOutput(HANDLE hOut, LPCTSTR text)
+{
+    CStringA utf8 = CW2A(text, CP_UTF8);
+    WriteOutput(hOut, utf8, utf8.GetLength());
+}
+
+void CLogUtils::WriteOutput(HANDLE hOut, LPCSTR utf8, size_t length)
+{
+    if (!hOut || length == 0)
+        return;
+
+    // A console shows UTF-8 bytes in its own code page; give it UTF-16
+    DWORD mode = 0;
+    if (GetConsoleMode(hOut, &mode))
+    {
+        int chars = MultiByteToWideChar(CP_UTF8, 0, utf8, static_cast<int>(length), nullptr, 0);
+        std::vector<wchar_t> wide(chars);
+        MultiByteToWideChar(CP_UTF8, 0, utf8, static_cast<int>(length), wide.data(), chars);
+        DWORD written = 0;
+        WriteConsoleW(hOut, wide.data(), chars, &written, nullptr);
+        return;
+    }
+
+    while (length > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(hOut, utf8, static_cast<DWORD>(length), &written, nullptr) || written == 0)
+            return;
+        utf8 += written;
+        length -= written;
+    }
 }
 
 void CLogUtils::SetOperation(LPCTSTR operation)
 {
-    m_operation = operation;
+    m_encoder.SetOperation(operation);
+}
+
+void CLogUtils::SetThreadStep(int step, int total)
+{
+    t_step = step;
+    t_totalSteps = total;
 }
 
 void CLogUtils::Log(LPCTSTR message)
@@ -105,13 +172,12 @@ void CLogUtils::Log(LPCTSTR message)
     text.Format(_T("%s\r\n"), message);
     AppendToEdit(text);
 
-    // Skip separator-only and blank lines for JSON
-    CString trimmed(message);
-    trimmed.Trim();
-    if (!trimmed.IsEmpty() && trimmed[0] != _T('='))
-    {
-        WriteJsonLine(_T("INFO"), trimmed);
-    }
+    // Skip separator-only lines for JSON
+    LPCTSTR start = message;
+    while (_istspace(*start))
+        start++;
+    if (*start != _T('='))
+        WriteJsonLineTrimmed("INFO", message);
 }
 
 void CLogUtils::LogStep(int step, int total, LPCTSTR message)
@@ -119,7 +185,7 @@ void CLogUtils::LogStep(int step, int total, LPCTSTR message)
     CString text;
     text.Format(_T("[%d/%d] %s\r\n"), step, total, message);
     AppendToEdit(text, RGB(0, 100, 200));  // blue
-    WriteJsonLine(_T("STEP"), message, step, total);
+    WriteJsonLine("STEP", message, step, total);
 }
 
 void CLogUtils::LogSuccess(LPCTSTR message)
@@ -127,7 +193,7 @@ void CLogUtils::LogSuccess(LPCTSTR message)
     CString text;
     text.Format(_T("  OK: %s\r\n"), message);
     AppendToEdit(text, RGB(0, 140, 0));  // green
-    WriteJsonLine(_T("SUCCESS"), message);
+    WriteJsonLine("SUCCESS", message);
 }
 
 void CLogUtils::LogWarning(LPCTSTR message)
@@ -135,7 +201,7 @@ void CLogUtils::LogWarning(LPCTSTR message)
     CString text;
     text.Format(_T("  WARNING: %s\r\n"), message);
     AppendToEdit(text, RGB(220, 120, 0));  // orange
-    WriteJsonLine(_T("WARNING"), message);
+    WriteJsonLine("WARNING", message);
 }
 
 void CLogUtils::LogError(LPCTSTR message)
@@ -143,7 +209,7 @@ void CLogUtils::LogError(LPCTSTR message)
     CString text;
     text.Format(_T("  ERROR: %s\r\n"), message);
     AppendToEdit(text, RGB(200, 0, 0));  // red
-    WriteJsonLine(_T("ERROR"), message);
+    WriteJsonLine("ERROR", message);
 }
 
 void CLogUtils::LogInfo(LPCTSTR message)
@@ -151,13 +217,7 @@ void CLogUtils::LogInfo(LPCTSTR message)
     CString text;
     text.Format(_T("  %s\r\n"), message);
     AppendToEdit(text, RGB(128, 128, 128));  // grey
-
-    CString trimmed(message);
-    trimmed.Trim();
-    if (!trimmed.IsEmpty())
-    {
-        WriteJsonLine(_T("INFO"), trimmed);
-    }
+    WriteJsonLineTrimmed("INFO", message);
 }
 
 void CLogUtils::LogSeparator()
@@ -167,8 +227,19 @@ void CLogUtils::LogSeparator()
     // Separators are visual-only, not written to JSON
 }
 
+void CLogUtils::LogFields(LPCSTR level, LPCTSTR message, int step, int total, LPCSTR extraFields)
+{
+    if (message)
+        WriteRecord(level, message, _tcslen(message), step, total, extraFields);
+}
+
 void CLogUtils::Clear()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_paneMutex);
+        m_pending.clear();
+    }
+
     if (m_pEdit && ::IsWindow(m_pEdit->GetSafeHwnd()))
     {
         m_pEdit->SetWindowText(_T(""));
@@ -177,108 +248,153 @@ void CLogUtils::Clear()
 
 void CLogUtils::AppendToEdit(LPCTSTR text, COLORREF color)
 {
+    // Inside a step the indent gives way to the step number
+    CString prefixed;
+    if (t_step > 0)
+    {
+        while (*text == _T(' '))
+            text++;
+        prefixed.Format(_T("[%d] %s"), t_step, text);
+        text = prefixed;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_consoleMutex);
+        if (m_hConsole && !m_consoleJson)
+            WriteOutput(m_hConsole, text);
+    }
+
+    if (!m_pEdit)
+        return;
+
+    // Queue only; the control is updated by FlushToControl on the UI thread.
+    // Consecutive text in the same colour is merged into one run.
+    std::lock_guard<std::mutex> lock(m_paneMutex);
+    if (!m_pending.empty() && m_pending.back().color == color)
+    {
+        m_pending.back().text += text;
+    }
+    else
+    {
+        m_pending.push_back(PendingRun{ CString(text), color });
+    }
+}
+
+void CALLBACK CLogUtils::FlushTimerProc(HWND, UINT, UINT_PTR idEvent, DWORD)
+{
+    reinterpret_cast<CLogUtils*>(idEvent)->FlushToControl();
+}
+
+void CLogUtils::FlushToControl()
+{
+    std::vector<PendingRun> runs;
+    {
+        std::lock_guard<std::mutex> lock(m_paneMutex);
+        if (m_pending.empty())
+            return;
+        runs.swap(m_pending);
+    }
+
     if (!m_pEdit || !::IsWindow(m_pEdit->GetSafeHwnd()))
         return;
 
-    // Move caret to end
-    long len = m_pEdit->GetTextLength();
-    m_pEdit->SetSel(len, len);
+    // One insertion per colour run, with painting suspended for the whole batch
+    m_pEdit->SetRedraw(FALSE);
 
-    // Set text color for the insertion
     CHARFORMAT2 cf = {};
     cf.cbSize = sizeof(cf);
     cf.dwMask = CFM_COLOR;
-    cf.crTextColor = color;
     cf.dwEffects = 0;  // clear CFE_AUTOCOLOR
-    m_pEdit->SetSelectionCharFormat(cf);
 
-    // Insert the text
-    m_pEdit->ReplaceSel(text);
+    for (const PendingRun& run : runs)
+    {
+        long len = m_pEdit->GetTextLength();
+        m_pEdit->SetSel(len, len);
+        cf.crTextColor = run.color;
+        m_pEdit->SetSelectionCharFormat(cf);
+        m_pEdit->ReplaceSel(run.text);
+    }
+
+    TrimControl();
+
+    m_pEdit->SetRedraw(TRUE);
+    m_pEdit->Invalidate();
 
     // Auto-scroll to bottom
     m_pEdit->SendMessage(WM_VSCROLL, SB_BOTTOM, 0);
-
-    // Process pending messages so the UI updates
-    MSG msg;
-    while (::PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
-    {
-        ::TranslateMessage(&msg);
-        ::DispatchMessage(&msg);
-    }
 }
 
-void CLogUtils::WriteJsonLine(LPCTSTR level, LPCTSTR message, int step, int total)
+void CLogUtils::TrimControl()
 {
-    if (!m_fileLogEnabled || m_logFilePath.IsEmpty())
+    // Keep the pane bounded so appends stay cheap on long verbose runs.
+    // The full history is in the NDJSON file.
+    int lineCount = m_pEdit->GetLineCount();
+    if (lineCount <= MAX_PANE_LINES + TRIM_SLACK_LINES)
         return;
 
-    CString timestamp = GetISOTimestamp();
-    CString escapedMsg = JsonEscape(message);
-    CString escapedOp  = JsonEscape(m_operation);
-
-    // Build JSON line
-    CString json;
-    json.Format(
-        _T("{\"Timestamp\":\"%s\",\"Level\":\"%s\",\"Message\":\"%s\"")
-        _T(",\"Logger\":\"%s\",\"Hostname\":\"%s\""),
-        (LPCTSTR)timestamp, level, (LPCTSTR)escapedMsg,
-        (LPCTSTR)m_appName, (LPCTSTR)m_hostname);
+    int cutChar = m_pEdit->LineIndex(lineCount - MAX_PANE_LINES);
+    if (cutChar <= 0)
+        return;
 
-    if (!m_operation.IsEmpty())
-    {
-        CString opField;
-        opField.Format(_T(",\"Operation\":\"%s\""), (LPCTSTR)escapedOp);
-        json += opField;
-    }
+    m_pEdit->SetSel(0, cutChar);
+    m_pEdit->ReplaceSel(_T(""));
+}
 
-    if (step >= 0 && total > 0)
-    {
-        CString stepField;
-        stepField.Format(_T(",\"Step\":%d,\"TotalSteps\":%d"), step, total);
-        json += stepField;
-    }
+void CLogUtils::WriteJsonLine(LPCSTR level, LPCTSTR message, int step, int total)
+{
+    if (message)
+        WriteRecord(level, message, _tcslen(message), step, total);
+}
 
-    json += _T("}\n");
+void CLogUtils::WriteJsonLineTrimmed(LPCSTR level, LPCTSTR message)
+{
+    if (!message)
+        return;
 
-    // Write as UTF-8
-    FILE* f = nullptr;
-    _tfopen_s(&f, m_logFilePath, _T("a, ccs=UTF-8"));
-    if (f)
-    {
-        _fputts(json, f);
-        fclose(f);
-    }
+    // Trim by pointer instead of copying into a CString
+    LPCTSTR start = message;
+    while (_istspace(*start))
+        start++;
+    LPCTSTR end = start + _tcslen(start);
+    while (end > start && _istspace(end[-1]))
+        end--;
+    if (end > start)
+        WriteRecord(level, start, static_cast<size_t>(end - start), -1, -1);
 }
 
-CString CLogUtils::JsonEscape(LPCTSTR input)
+void CLogUtils::WriteRecord(LPCSTR level, LPCTSTR message, size_t length, int step, int total,
+                            LPCSTR extraFields)
 {
-    if (!input)
-        return CString();
+    bool toConsole = false;
+    {
+        std::lock_guard<std::mutex> lock(m_consoleMutex);
+        toConsole = m_hConsole && m_consoleJson;
+    }
+    if (!m_fileLogEnabled && !toConsole)
+        return;
 
-    CString result;
-    for (int i = 0; input[i] != _T('\0'); i++)
+    if (step < 0 && t_step > 0)
     {
-        switch (input[i])
-        {
-        case _T('"'):   result += _T("\\\""); break;
-        case _T('\\'):  result += _T("\\\\"); break;
-        case _T('\n'):  result += _T("\\n");  break;
-        case _T('\r'):  result += _T("\\r");  break;
-        case _T('\t'):  result += _T("\\t");  break;
-        default:        result += input[i];    break;
-        }
+        step = t_step;
+        total = t_totalSteps;
     }
-    return result;
-}
 
-CString CLogUtils::GetISOTimestamp()
-{
+    // Encoded in a per-thread buffer that keeps its capacity, then copied into
+    // the writer's pending batch: no heap allocation once both have grown
+    thread_local std::string t_record;
     SYSTEMTIME st;
     GetLocalTime(&st);
+    m_encoder.Encode(t_record, st, level, message, length, step, total, extraFields);
+
+    // Errors are forced to disk
+    if (m_fileLogEnabled)
+        m_writer.Write(t_record, strcmp(level, "ERROR") == 0);
 
-    CString ts;
-    ts.Format(_T("%04d-%02d-%02dT%02d:%02d:%02d.%03d"),
-              st.wYear, st.wMonth, st.wDay,
-              st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
-    return ts;
+    if (toConsole)
+    {
+        // SetConsoleOutput may have detached the handle since the check above
+        std::lock_guard<std::mutex> lock(m_consoleMutex);
+        if (m_hConsole && m_consoleJson)
+            WriteOutput(m_hConsole, t_record.data(), t_record.size());
+    }
 }
@@ -1,8 +1,11 @@
 #pragma once
-// LogUtils.h - Logging to CRichEditCtrl control and NDJSON file
+// LogUtils.h - Logging to CRichEditCtrl control, NDJSON file and console
 
 #include <afxwin.h>
 #include <afxcmn.h>
+#include <mutex>
+#include <vector>
+#include "LogWriter.h"
 
 class CLogUtils
 {
@@ -10,17 +13,38 @@ public:
     CLogUtils();
     ~CLogUtils();
 
-    // Set the rich-edit control to receive log messages
+    // Set the rich-edit control to receive log messages.
+    // Must be called on the thread that owns the control; text logged from any
+    // thread is queued and appended to the control in timer-driven batches.
     void SetLogControl(CRichEditCtrl* pEdit);
 
     // Initialize NDJSON file logging.
     // Creates a "Log" folder next to the executable and opens a timestamped file.
     // appName: e.g. "SetupDevelop" or "SetupTest"
-    void InitFileLog(LPCTSTR appName);
+    // Records are written by a background thread according to the flush policy.
+    void InitFileLog(LPCTSTR appName, const LogFlushPolicy& policy = LogFlushPolicy());
+
+    // Block until every record logged so far has been written to the file
+    void FlushFileLog();
+
+    // Echo everything logged to a console or redirected stdout (headless runs):
+    // the pane text, or with json the NDJSON records also written to the file.
+    // nullptr stops the echo.
+    void SetConsoleOutput(HANDLE hOut, bool json);
+
+    // Write text to a console, or as UTF-8 to a redirected handle
+    static void WriteOutput(HANDLE hOut, LPCTSTR text);
+    static void WriteOutput(HANDLE hOut, LPCSTR utf8, size_t length);
 
     // Set the current operation context (e.g. "setup", "restore")
     void SetOperation(LPCTSTR operation);
 
+    // Step the calling thread is running (1-based; 0 = none), set by
+    // CStepRunner around each step. Records logged on the thread carry it as
+    // Step / TotalSteps and pane lines start with "[n] ", so the output of
+    // steps running in parallel can be told apart.
+    static void SetThreadStep(int step, int total);
+
     // Log a message with a prefix
     void Log(LPCTSTR message);
     void LogStep(int step, int total, LPCTSTR message);
@@ -29,22 +53,47 @@ public:
     void LogError(LPCTSTR message);
     void LogInfo(LPCTSTR message);
     void LogSeparator();
-    void Clear();
+
+    // Write a record to the file only, with extra pre-encoded JSON fields
+    // (",\"Name\":value..."); used for span records, see LogSpan.h
+    void LogFields(LPCSTR level, LPCTSTR message, int step, int total, LPCSTR extraFields);
+    void Clear();                 // UI thread only
+
+    // Append all queued text to the control now (UI thread only)
+    void FlushToControl();
 
     // Get the current log file path (empty if file logging not active)
     CString GetLogFilePath() const { return m_logFilePath; }
 
 private:
-    void AppendToEdit(LPCTSTR text, COLORREF color = RGB(0, 0, 0));
-    void WriteJsonLine(LPCTSTR level, LPCTSTR message, int step = -1, int total = -1);
+    // A run of consecutive log text sharing one colour
+    struct PendingRun
+    {
+        CString  text;
+        COLORREF color;
+    };
+
+    static const UINT FLUSH_INTERVAL_MS = 50;     // pane refresh period
+    static const int  MAX_PANE_LINES    = 5000;   // older lines are dropped from the pane
+    static const int  TRIM_SLACK_LINES  = 500;    // trim in chunks, not on every batch
 
-    static CString JsonEscape(LPCTSTR input);
-    static CString GetISOTimestamp();
+    static void CALLBACK FlushTimerProc(HWND hWnd, UINT msg, UINT_PTR idEvent, DWORD time);
+
+    void AppendToEdit(LPCTSTR text, COLORREF color = RGB(0, 0, 0));
+    void TrimControl();
+    void WriteJsonLine(LPCSTR level, LPCTSTR message, int step = -1, int total = -1);
+    void WriteJsonLineTrimmed(LPCSTR level, LPCTSTR message);  // skips blank messages
+    void WriteRecord(LPCSTR level, LPCTSTR message, size_t length, int step, int total,
+                     LPCSTR extraFields = nullptr);
 
     CRichEditCtrl* m_pEdit;
+    std::vector<PendingRun> m_pending;   // guarded by m_paneMutex
+    std::mutex m_paneMutex;
+    HANDLE     m_hConsole;               // echo target, nullptr = none; guarded by m_consoleMutex
+    bool       m_consoleJson;            // guarded by m_consoleMutex
+    std::mutex m_consoleMutex;           // also keeps lines from different threads whole
     CString m_logFilePath;
     bool    m_fileLogEnabled;
-    CString m_appName;
-    CString m_hostname;
-    CString m_operation;
+    CAsyncLogWriter   m_writer;
+    CLogRecordEncoder m_encoder;
 };
@@ -0,0 +1,289 @@
+#include "pch.h"
+#include "LogWriter.h"
+#include "JsonEscape.h"
+#include <chrono>
+
+// ════════════════════════════════════════════════════════════════
+// Record encoder
+// ════════════════════════════════════════════════════════════════
+
+void CLogRecordEncoder::SetSource(LPCTSTR logger, LPCTSTR hostname)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_source = ",\"Logger\":\"";
+    CJsonEscape::Append(m_source, logger);
+    m_source += "\",\"Hostname\":\"";
+    CJsonEscape::Append(m_source, hostname);
+    m_source += '"';
+    RebuildFields();
+}
+
+void CLogRecordEncoder::SetOperation(LPCTSTR operation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_operation.clear();
+    if (operation && *operation)
+    {
+        m_operation = ",\"Operation\":\"";
+        CJsonEscape::Append(m_operation, operation);
+        m_operation += '"';
+    }
+    RebuildFields();
+}
+
+void CLogRecordEncoder::RebuildFields()
+{
+    m_fields = m_source + m_operation;
+}
+
+static char* PutDigits(char* p, unsigned value, int width)
+{
+    for (int i = width - 1; i >= 0; i--)
+    {
+        p[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return p + width;
+}
+
+void CLogRecordEncoder::AppendTimestamp(std::string& out, const SYSTEMTIME& time)
+{
+    // "YYYY-MM-DDT" is formatted once per day and thread
+    thread_local WORD t_year = 0, t_month = 0, t_day = 0;
+    thread_local char t_date[11];
+    if (time.wDay != t_day || time.wMonth != t_month || time.wYear != t_year)
+    {
+        char* p = PutDigits(t_date, time.wYear, 4);
+        *p++ = '-';
+        p = PutDigits(p, time.wMonth, 2);
+        *p++ = '-';
+        p = PutDigits(p, time.wDay, 2);
+        *p = 'T';
+        t_year = time.wYear;
+        t_month = time.wMonth;
+        t_day = time.wDay;
+    }
+
+    char clock[12];     // HH:mm:ss.fff
+    char* p = PutDigits(clock, time.wHour, 2);
+    *p++ = ':';
+    p = PutDigits(p, time.wMinute, 2);
+    *p++ = ':';
+    p = PutDigits(p, time.wSecond, 2);
+    *p++ = '.';
+    PutDigits(p, time.wMilliseconds, 3);
+
+    out.append(t_date, sizeof(t_date));
+    out.append(clock, sizeof(clock));
+}
+
+void CLogRecordEncoder::Encode(std::string& out, const SYSTEMTIME& time, LPCSTR level,
+                               LPCTSTR message, size_t messageLength, int step, int total,
+                               LPCSTR extraFields)
+{
+    out.clear();
+    out += "{\"Timestamp\":\"";
+    AppendTimestamp(out, time);
+    out += "\",\"Level\":\"";
+    out += level;
+    out += "\",\"Message\":\"";
+    CJsonEscape::Append(out, message, messageLength);
+    out += '"';
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out += m_fields;
+    }
+
+    if (step >= 0 && total > 0)
+    {
+        char stepField[48];
+        int n = sprintf_s(stepField, ",\"Step\":%d,\"TotalSteps\":%d", step, total);
+        out.append(stepField, static_cast<size_t>(n));
+    }
+
+    if (extraFields)
+        out += extraFields;
+
+    out += "}\n";
+}
+
+// ════════════════════════════════════════════════════════════════
+// Background writer
+// ════════════════════════════════════════════════════════════════
+
+CAsyncLogWriter::CAsyncLogWriter()
+    : m_hFile(INVALID_HANDLE_VALUE)
+    , m_capacity(0)
+    , m_pendingCount(0)
+    , m_pendingSync(false)
+    , m_oldestPendingTick(0)
+    , m_queuedSeq(0)
+    , m_writtenSeq(0)
+    , m_flushRequested(false)
+    , m_stop(false)
+{
+}
+
+CAsyncLogWriter::~CAsyncLogWriter()
+{
+    Close();
+}
+
+bool CAsyncLogWriter::Open(LPCTSTR filePath, const LogFlushPolicy& policy, size_t queueCapacity)
+{
+    Close();
+
+    // FILE_APPEND_DATA: every write lands at the current end of file.
+    // Readers (e.g. a tail in another window) may keep the file open.
+    m_hFile = CreateFile(filePath, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                         nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    m_policy = policy;
+    m_capacity = queueCapacity > 0 ? queueCapacity : 1;
+    m_queuedSeq = m_writtenSeq = 0;
+    m_pending.clear();
+    m_pendingCount = 0;
+    m_pendingSync = false;
+    m_flushRequested = false;
+    m_stop = false;
+    m_thread = std::thread(&CAsyncLogWriter::WriterThread, this);
+    return true;
+}
+
+void CAsyncLogWriter::Close()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeWriter.notify_all();
+        m_wakeProducer.notify_all();
+        m_thread.join();
+    }
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        FlushFileBuffers(m_hFile);
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+void CAsyncLogWriter::Write(const char* line, size_t length, bool sync)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_thread.joinable() || m_stop)
+        return;
+
+    // Back-pressure: producers wait rather than dropping records
+    m_wakeProducer.wait(lock, [this] { return m_pendingCount < m_capacity || m_stop; });
+    if (m_stop)
+        return;
+
+    bool first = m_pendingCount == 0;
+    if (first)
+        m_oldestPendingTick = GetTickCount64();
+    m_pending.append(line, length);
+    m_pendingCount++;
+    m_pendingSync = m_pendingSync || sync;
+    m_queuedSeq++;
+
+    // The first record of a batch wakes the writer so it starts the maxDelayMs
+    // clock; later ones only when the batch is due before that
+    bool due = first || sync || (m_policy.maxRecords > 0 && m_pendingCount >= m_policy.maxRecords);
+    lock.unlock();
+
+    if (due)
+        m_wakeWriter.notify_one();
+}
+
+void CAsyncLogWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_thread.joinable())
+        return;
+
+    unsigned target = m_queuedSeq;
+    m_flushRequested = true;
+    m_wakeWriter.notify_one();
+    m_wakeProducer.wait(lock, [this, target] {
+        return static_cast<int>(m_writtenSeq - target) >= 0 || m_stop;
+    });
+}
+
+void CAsyncLogWriter::WriterThread()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        // Sleep until the pending batch is due under the flush policy
+        while (!m_stop && !m_flushRequested)
+        {
+            if (m_pendingCount == 0)
+            {
+                m_wakeWriter.wait(lock);
+                continue;
+            }
+
+            if (m_pendingSync || (m_policy.maxRecords > 0 && m_pendingCount >= m_policy.maxRecords))
+                break;
+
+            ULONGLONG age = GetTickCount64() - m_oldestPendingTick;
+            if (age >= m_policy.maxDelayMs)
+                break;
+            m_wakeWriter.wait_for(lock, std::chrono::milliseconds(m_policy.maxDelayMs - age));
+        }
+
+        if (m_pendingCount == 0)
+        {
+            m_flushRequested = false;
+            m_wakeProducer.notify_all();
+            if (m_stop)
+                break;
+            continue;
+        }
+
+        // Group commit: take everything queued so far as one write. Swapping
+        // the buffers hands the producers an empty one that keeps its capacity.
+        batch.clear();
+        batch.swap(m_pending);
+        bool sync = m_pendingSync;
+        unsigned taken = static_cast<unsigned>(m_pendingCount);
+        m_pendingCount = 0;
+        m_pendingSync = false;
+        m_flushRequested = false;
+        m_wakeProducer.notify_all();
+
+        lock.unlock();
+        WriteBatch(batch, sync);
+        lock.lock();
+
+        m_writtenSeq += taken;
+        m_wakeProducer.notify_all();
+    }
+}
+
+void CAsyncLogWriter::WriteBatch(const std::string& batch, bool sync)
+{
+    const char* p = batch.data();
+    size_t remaining = batch.size();
+    while (remaining > 0)
+    {
+        DWORD written = 0;
+        DWORD chunk = static_cast<DWORD>(min(remaining, static_cast<size_t>(1 << 20)));
+        if (!WriteFile(m_hFile, p, chunk, &written, nullptr) || written == 0)
+            break;
+        p += written;
+        remaining -= written;
+    }
+
+    if (sync && m_policy.syncOnError)
+        FlushFileBuffers(m_hFile);
+}
@@ -0,0 +1,92 @@
+#pragma once
+// LogWriter.h - NDJSON record encoder and background file writer with a bounded multi-producer queue
+
+#include <afxwin.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// When buffered records are handed to the OS. Records are always written in
+// batches (one WriteFile per batch); these limits decide how long a batch may grow.
+struct LogFlushPolicy
+{
+    size_t maxRecords  = 64;     // write once this many records are pending (0 = no limit)
+    DWORD  maxDelayMs  = 200;    // write once the oldest pending record is this old
+    bool   syncOnError = true;   // FlushFileBuffers after a record queued with sync = true
+};
+
+// Encodes one log record as a UTF-8 JSON line. Logger, Hostname and
+// Operation are the same for a whole run, so they are escaped once (when
+// they change) and copied into each record as one block. The timestamp
+// reuses the date part while the day stays the same. Records are built in
+// the caller's buffer, which keeps its capacity from record to record.
+class CLogRecordEncoder
+{
+public:
+    void SetSource(LPCTSTR logger, LPCTSTR hostname);
+    void SetOperation(LPCTSTR operation);
+
+    // Replace out with the record; step fields are written when step >= 0 and
+    // total > 0. extraFields: pre-encoded ",\"Name\":value" pairs appended last.
+    void Encode(std::string& out, const SYSTEMTIME& time, LPCSTR level,
+                LPCTSTR message, size_t messageLength, int step = -1, int total = -1,
+                LPCSTR extraFields = nullptr);
+
+private:
+    void RebuildFields();                       // m_mutex held
+    void AppendTimestamp(std::string& out, const SYSTEMTIME& time);
+
+    std::mutex  m_mutex;                        // fields change on the UI thread, records come from any thread
+    std::string m_source;                       // ,"Logger":"..","Hostname":".."
+    std::string m_operation;                    // ,"Operation":".." or empty
+    std::string m_fields;                       // m_source + m_operation
+};
+
+class CAsyncLogWriter
+{
+public:
+    CAsyncLogWriter();
+    ~CAsyncLogWriter();
+
+    // Open (append) the file and start the writer thread
+    bool Open(LPCTSTR filePath, const LogFlushPolicy& policy = LogFlushPolicy(),
+              size_t queueCapacity = 4096);
+
+    // Drain the queue, flush to disk and stop the writer thread.
+    // Called from the destructor, so every queued record reaches the file on exit.
+    void Close();
+
+    // Queue one UTF-8 line (terminated by '\n'). Blocks while the queue is full.
+    // sync = true forces an immediate write and, per policy, a flush to disk.
+    // The line is copied into the pending batch, whose buffer is reused, so
+    // steady-state writes do not allocate.
+    void Write(const char* line, size_t length, bool sync = false);
+    void Write(const std::string& line, bool sync = false) { Write(line.data(), line.size(), sync); }
+
+    // Block until everything queued before this call has been written
+    void Flush();
+
+    bool IsOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+private:
+    void WriterThread();
+    void WriteBatch(const std::string& batch, bool sync);
+
+    HANDLE         m_hFile;
+    LogFlushPolicy m_policy;
+    size_t         m_capacity;
+
+    std::string             m_pending;       // queued lines, swapped with the writer's batch buffer
+    size_t                  m_pendingCount;  // lines in m_pending
+    bool                    m_pendingSync;   // some pending line was queued with sync = true
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeWriter;    // records queued / flush or stop requested
+    std::condition_variable m_wakeProducer;  // queue space freed / batch written
+    ULONGLONG m_oldestPendingTick;           // GetTickCount64 of the oldest queued record
+    unsigned  m_queuedSeq;                   // records ever queued
+    unsigned  m_writtenSeq;                  // records ever written
+    bool      m_flushRequested;
+    bool      m_stop;
+    std::thread m_thread;
+};
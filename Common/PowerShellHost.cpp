@@ -0,0 +1,325 @@
+#include "pch.h"
+#include "PowerShellHost.h"
+#include "WinUtils.h"
+#include "LogSpan.h"
+#include "ProcessRunner.h"
+#include <wincrypt.h>    // CryptBinaryToStringA
+
+#pragma comment(lib, "crypt32.lib")
+
+const TCHAR CPowerShellHost::DEFAULT_INTERPRETER[] =
+    _T("powershell.exe -NoLogo -NoProfile -NonInteractive -ExecutionPolicy Bypass");
+const TCHAR CPowerShellHost::EXIT_REFUSED[] = _T("RDS-HOST: exit is not allowed in a host command");
+
+// Loop executed inside the host process. Reads one request per line, runs it
+// as a script block and writes the output followed by the end-of-frame marker.
+// "exit" inside the script block would end the loop and the process with it,
+// so a command containing one is answered with EXIT_REFUSED instead.
+static const wchar_t HOST_SCRIPT[] =
+    L"$ErrorActionPreference = 'Continue'\n"
+    L"$ProgressPreference = 'SilentlyContinue'\n"
+    L"[Console]::OutputEncoding = New-Object System.Text.UTF8Encoding $false\n"
+    L"$stdin = [Console]::In\n"
+    L"while ($true) {\n"
+    L"    $line = $stdin.ReadLine()\n"
+    L"    if ($line -eq $null) { break }\n"
+    L"    $sep = $line.IndexOf(' ')\n"
+    L"    if ($sep -lt 1) { continue }\n"
+    L"    $id = $line.Substring(0, $sep)\n"
+    L"    $cmd = [Text.Encoding]::UTF8.GetString([Convert]::FromBase64String($line.Substring($sep + 1)))\n"
+    L"    $ast = [Management.Automation.Language.Parser]::ParseInput($cmd, [ref]$null, [ref]$null)\n"
+    L"    if ($ast.Find({ param($a) $a -is [Management.Automation.Language.ExitStatementAst] }, $true)) {\n"
+    L"        $out = 'RDS-HOST: exit is not allowed in a host command'\n"
+    L"    } else {\n"
+    L"        try { $out = & ([ScriptBlock]::Create($cmd)) 2>&1 | Out-String -Width 4096 }\n"
+    L"        catch { $out = $_ | Out-String -Width 4096 }\n"
+    L"    }\n"
+    L"    [Console]::Out.Write($out)\n"
+    L"    [Console]::Out.Write(\"`n<<RDS-END:$id>>`n\")\n"
+    L"    [Console]::Out.Flush()\n"
+    L"}\n";
+
+CPowerShellHost::CPowerShellHost()
+    : m_interpreter(DEFAULT_INTERPRETER)
+    , m_hProcess(nullptr)
+    , m_hJob(nullptr)
+    , m_hStdinWrite(nullptr)
+    , m_hStdoutRead(nullptr)
+    , m_hReadEvent(nullptr)
+    , m_nextId(1)
+{
+}
+
+CPowerShellHost::~CPowerShellHost()
+{
+    Shutdown();
+}
+
+CPowerShellHost& CPowerShellHost::Instance()
+{
+    static CPowerShellHost host;
+    return host;
+}
+
+void CPowerShellHost::SetInterpreter(LPCTSTR interpreterCmdLine)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StopHost(false);
+    m_interpreter = interpreterCmdLine;
+}
+
+bool CPowerShellHost::IsRunning() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hProcess && WaitForSingleObject(m_hProcess, 0) == WAIT_TIMEOUT;
+}
+
+bool CPowerShellHost::Warmup()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hProcess && WaitForSingleObject(m_hProcess, 0) == WAIT_TIMEOUT)
+        return true;
+    StopHost(false);
+    return StartHost();
+}
+
+void CPowerShellHost::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StopHost(false);
+}
+
+PowerShellStatus CPowerShellHost::Execute(LPCTSTR command, CString& output, DWORD timeoutMs)
+{
+    output.Empty();
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Frame the request: "<id> <base64(utf-8 command)>\n"
+    CStringA utf8 = CW2A(command, CP_UTF8);
+    CStringA id;
+    id.Format("%u", m_nextId++);
+    std::string request(id);
+    request += ' ';
+    request += Base64Encode(utf8.GetString(), static_cast<DWORD>(utf8.GetLength()));
+    request += '\n';
+
+    // A dead host is only detected when we try to use it. If the request could
+    // not be delivered the command never ran, so one restart-and-retry is safe.
+    bool sent = false;
+    for (int attempt = 0; attempt < 2 && !sent; attempt++)
+    {
+        if (!m_hProcess || WaitForSingleObject(m_hProcess, 0) != WAIT_TIMEOUT)
+        {
+            StopHost(true);
+            if (!StartHost())
+                return PowerShellStatus::StartFailed;
+        }
+        sent = SendRequest(request);
+        if (!sent)
+            StopHost(true);
+    }
+    if (!sent)
+        return PowerShellStatus::StartFailed;
+
+    std::string marker("\n<<RDS-END:");
+    marker += id.GetString();
+    marker += ">>\n";
+
+    std::string reply;
+    PowerShellStatus status = ReadReply(marker, reply, timeoutMs);
+    if (status != PowerShellStatus::Ok)
+    {
+        // The host is in an unknown state (still running the command or dead)
+        StopHost(true);
+        return status;
+    }
+
+    output = CA2W(reply.c_str(), CP_UTF8);
+    output.TrimRight(_T("\r\n"));
+    return PowerShellStatus::Ok;
+}
+
+bool CPowerShellHost::StartHost()
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE hStdinRead = nullptr, hStdinWrite = nullptr;
+    HANDLE hStdoutRead = nullptr, hStdoutWrite = nullptr;
+
+    // Released by StopHost with the rest, like the handles below
+    m_hReadEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (!m_hReadEvent)
+        return false;
+    if (!CreatePipe(&hStdinRead, &hStdinWrite, &sa, 0))
+        return false;
+    // Stdout is a named pipe so ReadReply can wait on it overlapped
+    if (!CProcessRunner::CreateOutputPipe(hStdoutRead, hStdoutWrite))
+    {
+        CloseHandle(hStdinRead);
+        CloseHandle(hStdinWrite);
+        return false;
+    }
+
+    // Our stdin end must not leak into the child (the stdout read end is created non-inheritable)
+    SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
+
+    std::string encoded = Base64Encode(HOST_SCRIPT, static_cast<DWORD>(wcslen(HOST_SCRIPT) * sizeof(wchar_t)));
+    CString cmdLine;
+    cmdLine.Format(_T("%s -EncodedCommand %S"), (LPCTSTR)m_interpreter, encoded.c_str());
+
+    // Inherits the two pipe ends and nothing else: a host (re)started while
+    // parallel steps run must not hold their output pipes open
+    PROCESS_INFORMATION pi = {};
+    bool created = CProcessRunner::StartHidden(cmdLine, hStdinRead, hStdoutWrite, pi);
+
+    CloseHandle(hStdinRead);
+    CloseHandle(hStdoutWrite);
+
+    if (!created)
+    {
+        CloseHandle(hStdinWrite);
+        CloseHandle(hStdoutRead);
+        return false;
+    }
+
+    // Tie the host's lifetime to ours so a crash here never leaves it orphaned
+    m_hJob = CreateJobObject(nullptr, nullptr);
+    if (m_hJob)
+    {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        SetInformationJobObject(m_hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+        AssignProcessToJobObject(m_hJob, pi.hProcess);
+    }
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+
+    m_hProcess = pi.hProcess;
+    m_hStdinWrite = hStdinWrite;
+    m_hStdoutRead = hStdoutRead;
+    m_buffer.clear();
+    return true;
+}
+
+void CPowerShellHost::StopHost(bool kill)
+{
+    if (m_hStdinWrite)
+    {
+        // EOF on stdin ends the host loop
+        CloseHandle(m_hStdinWrite);
+        m_hStdinWrite = nullptr;
+    }
+
+    if (m_hProcess)
+    {
+        if (kill || WaitForSingleObject(m_hProcess, 2000) != WAIT_OBJECT_0)
+            TerminateProcess(m_hProcess, 1);
+        CloseHandle(m_hProcess);
+        m_hProcess = nullptr;
+    }
+
+    if (m_hStdoutRead)
+    {
+        CloseHandle(m_hStdoutRead);
+        m_hStdoutRead = nullptr;
+    }
+
+    if (m_hReadEvent)
+    {
+        CloseHandle(m_hReadEvent);
+        m_hReadEvent = nullptr;
+    }
+
+    if (m_hJob)
+    {
+        CloseHandle(m_hJob);
+        m_hJob = nullptr;
+    }
+
+    m_buffer.clear();
+}
+
+bool CPowerShellHost::SendRequest(const std::string& line)
+{
+    const char* p = line.data();
+    DWORD remaining = static_cast<DWORD>(line.size());
+    while (remaining > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(m_hStdinWrite, p, remaining, &written, nullptr))
+            return false;
+        p += written;
+        remaining -= written;
+    }
+    return true;
+}
+
+PowerShellStatus CPowerShellHost::ReadReply(const std::string& marker, std::string& reply, DWORD timeoutMs)
+{
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    HANDLE hCancel = CWinUtils::GetCancelEvent();
+    char chunk[4096];
+
+    for (;;)
+    {
+        size_t pos = m_buffer.find(marker);
+        if (pos != std::string::npos)
+        {
+            reply.assign(m_buffer, 0, pos);
+            m_buffer.erase(0, pos + marker.size());
+            return PowerShellStatus::Ok;
+        }
+
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline)
+            return PowerShellStatus::TimedOut;
+
+        // Block until data arrives, the host dies or the run is cancelled
+        OVERLAPPED ov = {};
+        ov.hEvent = m_hReadEvent;
+        DWORD read = 0;
+        if (!ReadFile(m_hStdoutRead, chunk, sizeof(chunk), &read, &ov))
+        {
+            if (GetLastError() != ERROR_IO_PENDING)
+                return PowerShellStatus::HostDied;      // ERROR_BROKEN_PIPE: host gone
+
+            HANDLE waits[3] = { ov.hEvent, m_hProcess, hCancel };
+            DWORD waitResult = WaitForMultipleObjects(hCancel ? 3 : 2, waits, FALSE,
+                                                      static_cast<DWORD>(deadline - now));
+            if (waitResult != WAIT_OBJECT_0)
+            {
+                // A read that completed while we were woken still counts;
+                // after a host exit that may be the rest of the reply
+                CancelIoEx(m_hStdoutRead, &ov);
+                bool gotData = GetOverlappedResult(m_hStdoutRead, &ov, &read, TRUE) && read > 0;
+                if (waitResult == WAIT_OBJECT_0 + 2)
+                    return PowerShellStatus::Cancelled;
+                if (waitResult != WAIT_OBJECT_0 + 1)
+                    return PowerShellStatus::TimedOut;
+                if (!gotData)
+                    return PowerShellStatus::HostDied;
+            }
+            else if (!GetOverlappedResult(m_hStdoutRead, &ov, &read, FALSE))
+            {
+                return PowerShellStatus::HostDied;
+            }
+        }
+
+        m_buffer.append(chunk, read);
+        CLogSpan::Count(SPAN_BYTES_READ, read);
+    }
+}
+
+std::string CPowerShellHost::Base64Encode(const void* data, DWORD size)
+{
+    const BYTE* bytes = static_cast<const BYTE*>(data);
+    DWORD flags = CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF;
+    DWORD length = 0;
+    if (!CryptBinaryToStringA(bytes, size, flags, nullptr, &length))
+        return std::string();
+
+    std::string encoded(length, '\0');
+    if (!CryptBinaryToStringA(bytes, size, flags, &encoded[0], &length))
+        return std::string();
+    encoded.resize(length);
+    return encoded;
+}
@@ -0,0 +1,82 @@
+#pragma once
+// PowerShellHost.h - Long-lived PowerShell process that executes commands over pipes
+
+#include <afxwin.h>
+#include <mutex>
+#include <string>
+
+enum class PowerShellStatus
+{
+    Ok,          // command ran, output captured
+    TimedOut,    // command did not finish in time; host was killed
+    StartFailed, // host could not be started or took no request: the command never ran
+    HostDied,    // host exited while running the command
+    Cancelled    // CWinUtils cancel event was signalled; host was killed
+};
+
+// Abstract command runner. CWinUtils talks to this interface so the persistent
+// host can be replaced by a one-shot runner or a scripted stub.
+class IPowerShellRunner
+{
+public:
+    virtual ~IPowerShellRunner() {}
+
+    // Execute a PowerShell command and capture its combined output.
+    virtual PowerShellStatus Execute(LPCTSTR command, CString& output, DWORD timeoutMs) = 0;
+};
+
+// Keeps one powershell.exe alive for the whole session.
+//
+// Protocol (one request at a time):
+//   request:  "<id> <base64 of UTF-8 command>\n"            on the host's stdin
+//   reply:    "<output>\n<<RDS-END:<id>>>\n"  (UTF-8)        on the host's stdout
+//
+// A command that exceeds its timeout kills the host; a host that crashed or was
+// killed is restarted transparently on the next call. Commands run in a child
+// scope; one containing an exit statement is refused, as it would end the host.
+class CPowerShellHost : public IPowerShellRunner
+{
+public:
+    CPowerShellHost();
+    virtual ~CPowerShellHost();
+
+    // Process-wide instance used by CWinUtils::RunPowerShellCommand
+    static CPowerShellHost& Instance();
+
+    // Override the interpreter command line (e.g. "pwsh.exe" or a stub process).
+    // The host loop script is appended as -EncodedCommand.
+    void SetInterpreter(LPCTSTR interpreterCmdLine);
+    static const TCHAR DEFAULT_INTERPRETER[];
+
+    // Reply to a command that contains an exit statement
+    static const TCHAR EXIT_REFUSED[];
+
+    virtual PowerShellStatus Execute(LPCTSTR command, CString& output, DWORD timeoutMs) override;
+
+    // Start the host ahead of the first command so the cold start is off the critical path
+    bool Warmup();
+
+    // Close stdin so the host exits, then release all handles
+    void Shutdown();
+
+    bool IsRunning() const;
+
+    // Base64 of raw bytes, no line breaks
+    static std::string Base64Encode(const void* data, DWORD size);
+
+private:
+    bool StartHost();
+    void StopHost(bool kill);
+    bool SendRequest(const std::string& line);
+    PowerShellStatus ReadReply(const std::string& marker, std::string& reply, DWORD timeoutMs);
+
+    CString m_interpreter;
+    HANDLE  m_hProcess;
+    HANDLE  m_hJob;
+    HANDLE  m_hStdinWrite;
+    HANDLE  m_hStdoutRead;    // overlapped (named pipe)
+    HANDLE  m_hReadEvent;     // completion event for reads on m_hStdoutRead
+    std::string m_buffer;     // bytes received but not yet consumed by a reply
+    unsigned    m_nextId;
+    mutable std::mutex m_mutex;
+};
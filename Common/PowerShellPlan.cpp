@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "PowerShellPlan.h"
+#include "JsonReader.h"
+#include "WinUtils.h"
+
+int CPowerShellPlan::Add(LPCTSTR description, LPCTSTR command)
+{
+    m_items.push_back(Item{ description, command, PowerShellItemResult() });
+    return static_cast<int>(m_items.size()) - 1;
+}
+
+CString CPowerShellPlan::Compile() const
+{
+    // Own scope (& { }) so the preference does not leak into the persistent host.
+    // No double quotes: the one-shot fallback passes the script inside -Command "...".
+    CString script(_T("& { $ErrorActionPreference = 'Stop'; $r = New-Object System.Collections.ArrayList; "));
+    for (const Item& item : m_items)
+    {
+        script += _T("try { $o = & { ");
+        script += item.command;
+        script += _T(" } 2>&1 | Out-String; [void]$r.Add(@{ ok = $true; out = $o }) } ")
+                  _T("catch { [void]$r.Add(@{ ok = $false; err = $_.ToString() }) }; ");
+    }
+    script += _T("ConvertTo-Json -InputObject @($r) -Compress }");
+    return script;
+}
+
+bool CPowerShellPlan::Run()
+{
+    for (Item& item : m_items)
+        item.result = PowerShellItemResult();
+    if (m_items.empty())
+        return true;
+
+    CString output = CWinUtils::RunPowerShellCommand(Compile());
+    if (ParseResults(output))
+        return true;
+
+    for (Item& item : m_items)
+        item.result.error = _T("PowerShell plan did not return results");
+    return false;
+}
+
+bool CPowerShellPlan::ParseResults(const CString& output)
+{
+    // The JSON array is the last line; anything before it was written to the host directly
+    int start = output.ReverseFind(_T('\n')) + 1;
+    LPCTSTR text = static_cast<LPCTSTR>(output) + start;
+
+    JsonValue root;
+    JsonError error;
+    if (!CJsonReader::Parse(text, output.GetLength() - start, root, error) ||
+        root.type != JSON_ARRAY || root.items.size() != m_items.size())
+        return false;
+
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        const JsonValue& entry = root.items[i];
+        const JsonValue* ok = entry.Find(_T("ok"));
+        const JsonValue* out = entry.Find(_T("out"));
+        const JsonValue* err = entry.Find(_T("err"));
+
+        PowerShellItemResult& result = m_items[i].result;
+        result.ok = ok && ok->type == JSON_BOOL && ok->boolean;
+        if (out && out->type == JSON_STRING)
+            result.output = out->text;
+        if (err && err->type == JSON_STRING)
+            result.error = err->text;
+        result.output.TrimRight(_T("\r\n"));
+        result.error.TrimRight(_T("\r\n"));
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+// PowerShellPlan.h - Runs several PowerShell commands as one script with per-command results
+
+#include <afxwin.h>
+#include <vector>
+
+struct PowerShellItemResult
+{
+    bool    ok = false;     // ran without a terminating (or, with Stop, any) error
+    CString output;         // combined output, trailing newlines trimmed
+    CString error;          // error message when !ok
+};
+
+// Commands are added first and run together in one round trip to the
+// PowerShell host. Each runs in its own try/catch with ErrorActionPreference
+// = Stop, so one failure does not stop the rest; the script returns a
+// compressed JSON array with one {ok, out, err} object per command.
+class CPowerShellPlan
+{
+public:
+    // Returns the item's index in the results
+    int Add(LPCTSTR description, LPCTSTR command);
+
+    bool IsEmpty() const { return m_items.empty(); }
+    int  GetCount() const { return static_cast<int>(m_items.size()); }
+    const CString& GetDescription(int index) const { return m_items[index].description; }
+
+    // Run every item. False if the script itself failed (host error or no
+    // parsable result); the items then all report !ok.
+    bool Run();
+
+    const PowerShellItemResult& GetResult(int index) const { return m_items[index].result; }
+
+    // The generated script (for logging)
+    CString Compile() const;
+
+    // Take the results from the script's output. False unless its last line
+    // is a JSON array with one entry per item.
+    bool ParseResults(const CString& output);
+
+private:
+    struct Item
+    {
+        CString description;
+        CString command;
+        PowerShellItemResult result;
+    };
+
+    std::vector<Item> m_items;
+};
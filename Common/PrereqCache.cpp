@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "PrereqCache.h"
+#include "AdapterInventory.h"
+#include "SettingsUtils.h"
+#include "TeamViewerUtils.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// ════════════════════════════════════════════════════════════════
+// Detection
+// ════════════════════════════════════════════════════════════════
+
+PrereqStatus CPrereqCache::Detect(DWORD checks)
+{
+    PrereqStatus status;
+    if (checks & PREREQ_VPN)
+    {
+        status.vpnDriverInstalled = CTeamViewerUtils::IsVPNDriverInstalled();
+        status.vpnIP = CTeamViewerUtils::GetVPNIPAddress();
+        status.teamViewerInstalled = CTeamViewerUtils::IsTeamViewerInstalled();
+    }
+    if (checks & PREREQ_DEBUGGER)
+        status.debuggerPath = CTeamViewerUtils::GetRemoteDebuggerPath();
+    return status;
+}
+
+// One detection thread at a time. Requests made while it runs are merged and
+// run by the same thread when the current pass ends, so reopening the dialog
+// or pressing a re-check button never piles up searches.
+static std::mutex s_asyncMutex;
+static HWND       s_asyncNotify = nullptr;      // latest window to receive results
+static DWORD      s_asyncPending = 0;           // checks requested, not yet started
+static bool       s_asyncRunning = false;
+
+void CPrereqCache::DetectAsync(HWND hNotify, DWORD checks)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_asyncMutex);
+        s_asyncNotify = hNotify;
+        s_asyncPending |= checks;
+        if (s_asyncRunning)
+            return;
+        s_asyncRunning = true;
+    }
+
+    // Detached: closing the dialog must not wait for a slow search. If the
+    // window is gone by the time the check ends, the post fails and the
+    // result is freed here.
+    std::thread([] {
+        HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+        for (;;)
+        {
+            DWORD checks = 0;
+            {
+                std::lock_guard<std::mutex> lock(s_asyncMutex);
+                checks = s_asyncPending;
+                s_asyncPending = 0;
+                if (!checks)
+                {
+                    s_asyncRunning = false;
+                    break;
+                }
+            }
+
+            std::unique_ptr<PrereqStatus> status(new PrereqStatus(Detect(checks)));
+            HWND hNotify = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(s_asyncMutex);
+                hNotify = s_asyncNotify;
+            }
+            if (::IsWindow(hNotify) &&
+                ::PostMessage(hNotify, WM_PREREQ_STATUS, checks, reinterpret_cast<LPARAM>(status.get())))
+                status.release();
+        }
+        if (SUCCEEDED(hr))
+            CoUninitialize();
+    }).detach();
+}
+
+// ════════════════════════════════════════════════════════════════
+// Fingerprint
+// ════════════════════════════════════════════════════════════════
+
+static ULONGLONG ToUInt64(const FILETIME& ft)
+{
+    return (static_cast<ULONGLONG>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+static ULONGLONG GetWriteTime(LPCTSTR path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data))
+        return 0;
+    return ToUInt64(data.ftLastWriteTime);
+}
+
+static ULONGLONG GetRegistryWriteTime(LPCTSTR subKey, REGSAM view)
+{
+    HKEY hKey = nullptr;
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, subKey, 0, KEY_READ | view, &hKey) != ERROR_SUCCESS)
+        return 0;
+    FILETIME ft = {};
+    RegQueryInfoKey(hKey, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+                    nullptr, nullptr, nullptr, nullptr, &ft);
+    RegCloseKey(hKey);
+    return ToUInt64(ft);
+}
+
+CString CPrereqCache::Fingerprint(const CString& debuggerPath)
+{
+    // A new install or uninstall touches the file itself or the folder that holds the installs
+    ULONGLONG debugger = debuggerPath.IsEmpty()
+        ? GetWriteTime(_T("C:\\Program Files\\Microsoft Visual Studio")) ^
+          GetWriteTime(_T("C:\\Program Files (x86)\\Microsoft Visual Studio"))
+        : GetWriteTime(debuggerPath);
+
+    CString text;
+    text.Format(_T("tv:%I64x;net:%08lx;dbg:%I64x"),
+                GetRegistryWriteTime(_T("SOFTWARE\\TeamViewer"), KEY_WOW64_64KEY) ^
+                    GetRegistryWriteTime(_T("SOFTWARE\\TeamViewer"), KEY_WOW64_32KEY),
+                CAdapterInventory::QuickFingerprint(), debugger);
+    return text;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Persistence
+// ════════════════════════════════════════════════════════════════
+
+// On-disk form; every field is text, as in the dialog settings files
+struct PrereqRecord
+{
+    CString savedAt;                // FILETIME (UTC) in 100 ns units
+    CString fingerprint;
+    CString teamViewer;             // "1" / "0"
+    CString vpnDriver;
+    CString vpnIP;
+    CString debugger;
+};
+
+static const SettingField<PrereqRecord> s_recordFields[] =
+{
+    { _T("SavedAt"),     &PrereqRecord::savedAt,     SETTING_TEXT, _T("") },
+    { _T("Fingerprint"), &PrereqRecord::fingerprint, SETTING_TEXT, _T("") },
+    { _T("TeamViewer"),  &PrereqRecord::teamViewer,  SETTING_TEXT, _T("") },
+    { _T("VPNDriver"),   &PrereqRecord::vpnDriver,   SETTING_TEXT, _T("") },
+    { _T("VPNIP"),       &PrereqRecord::vpnIP,       SETTING_IPV4, _T("") },
+    { _T("Debugger"),    &PrereqRecord::debugger,    SETTING_TEXT, _T("") },
+};
+
+static ULONGLONG Now()
+{
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return ToUInt64(ft);
+}
+
+bool CPrereqCache::Load(LPCTSTR filePath, PrereqStatus& status)
+{
+    PrereqRecord record;
+    CString error;
+    if (!CSettingsUtils::Load(filePath, s_recordFields, record, &error) || !error.IsEmpty())
+        return false;
+
+    ULONGLONG savedAt = _tcstoui64(record.savedAt, nullptr, 10);
+    ULONGLONG now = Now();
+    if (savedAt == 0 || savedAt > now || (now - savedAt) / 10000000 > TTL_SECONDS)
+        return false;
+
+    // A debugger that was found must still be there
+    if (!record.debugger.IsEmpty() && GetFileAttributes(record.debugger) == INVALID_FILE_ATTRIBUTES)
+        return false;
+    if (record.fingerprint != Fingerprint(record.debugger))
+        return false;
+
+    status.teamViewerInstalled = record.teamViewer == _T("1");
+    status.vpnDriverInstalled = record.vpnDriver == _T("1");
+    status.vpnIP = record.vpnIP;
+    status.debuggerPath = record.debugger;
+    return true;
+}
+
+bool CPrereqCache::Save(LPCTSTR filePath, const PrereqStatus& status)
+{
+    PrereqRecord record;
+    record.savedAt.Format(_T("%I64u"), Now());
+    record.fingerprint = Fingerprint(status.debuggerPath);
+    record.teamViewer = status.teamViewerInstalled ? _T("1") : _T("0");
+    record.vpnDriver = status.vpnDriverInstalled ? _T("1") : _T("0");
+    record.vpnIP = status.vpnIP;
+    record.debugger = status.debuggerPath;
+    return CSettingsUtils::Save(filePath, s_recordFields, record);
+}
+
+CString CPrereqCache::GetCachePath(LPCTSTR name)
+{
+    return CSettingsUtils::GetSettingsDir() + _T("\\") + name + _T(".prereq.json");
+}
@@ -0,0 +1,49 @@
+#pragma once
+// PrereqCache.h - Last known prerequisite status, shown while a fresh check runs
+
+#include <afxwin.h>
+
+// Posted by CPrereqCache::DetectAsync; wParam = checks run, lParam = PrereqStatus* (receiver deletes)
+#define WM_PREREQ_STATUS    (WM_APP + 3)
+
+// Which checks Detect runs
+enum PrereqChecks
+{
+    PREREQ_VPN      = 0x1,      // TeamViewer, VPN driver, VPN IP
+    PREREQ_DEBUGGER = 0x2       // msvsmon.exe (may search Program Files)
+};
+
+struct PrereqStatus
+{
+    bool    teamViewerInstalled = false;
+    bool    vpnDriverInstalled = false;
+    CString vpnIP;                  // empty = not connected
+    CString debuggerPath;           // empty = msvsmon.exe not found
+};
+
+// The status is saved with the time of the check and a fingerprint of what
+// it depends on: the TeamViewer registry keys' write time, the adapter list
+// (CAdapterInventory::QuickFingerprint) and the msvsmon.exe / Visual Studio
+// folder times. Load returns it only while it is younger than the TTL and
+// the fingerprint, which takes milliseconds to compute, still matches.
+class CPrereqCache
+{
+public:
+    static const ULONGLONG TTL_SECONDS = 24 * 60 * 60;
+
+    // Run the checks now (slow; any thread)
+    static PrereqStatus Detect(DWORD checks);
+
+    // Run the checks on a background thread and post WM_PREREQ_STATUS to hNotify.
+    // While a detection runs, further requests are queued behind it, not started.
+    static void DetectAsync(HWND hNotify, DWORD checks);
+
+    static bool Load(LPCTSTR filePath, PrereqStatus& status);
+    static bool Save(LPCTSTR filePath, const PrereqStatus& status);
+
+    // Settings\<name>.prereq.json
+    static CString GetCachePath(LPCTSTR name);
+
+private:
+    static CString Fingerprint(const CString& debuggerPath);
+};
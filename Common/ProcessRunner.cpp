@@ -0,0 +1,308 @@
+#include "pch.h"
+#include "ProcessRunner.h"
+#include "LogSpan.h"
+#include <sddl.h>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+CString ProcessResult::Text(UINT codePage) const
+{
+    if (output.empty())
+        return CString();
+
+    int length = MultiByteToWideChar(codePage, 0, output.data(), static_cast<int>(output.size()), nullptr, 0);
+    CString text;
+    if (length > 0)
+    {
+        MultiByteToWideChar(codePage, 0, output.data(), static_cast<int>(output.size()),
+                            text.GetBuffer(length), length);
+        text.ReleaseBuffer(length);
+    }
+    text.TrimRight(_T("\r\n"));
+    return text;
+}
+
+// Protected DACL granting access to the user of this process's token and no
+// one else. Built once and never freed; nullptr if it could not be built.
+static PSECURITY_DESCRIPTOR CurrentUserDescriptor()
+{
+    static PSECURITY_DESCRIPTOR s_descriptor = []() -> PSECURITY_DESCRIPTOR {
+        HANDLE hToken = nullptr;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken))
+            return nullptr;
+
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        DWORD size = 0;
+        GetTokenInformation(hToken, TokenUser, nullptr, 0, &size);
+        std::vector<BYTE> buffer(size);
+        LPTSTR sid = nullptr;
+        if (size > 0 && GetTokenInformation(hToken, TokenUser, buffer.data(), size, &size) &&
+            ConvertSidToStringSid(reinterpret_cast<TOKEN_USER*>(buffer.data())->User.Sid, &sid))
+        {
+            CString sddl;
+            sddl.Format(_T("D:P(A;;GA;;;%s)"), sid);
+            if (!ConvertStringSecurityDescriptorToSecurityDescriptor(sddl, SDDL_REVISION_1, &descriptor, nullptr))
+                descriptor = nullptr;
+            LocalFree(sid);
+        }
+        CloseHandle(hToken);
+        return descriptor;
+    }();
+    return s_descriptor;
+}
+
+bool CProcessRunner::CreateOutputPipe(HANDLE& hRead, HANDLE& hWrite)
+{
+    hRead = hWrite = nullptr;
+
+    // The default DACL also admits SYSTEM and the administrators, and the
+    // name is guessable; a pipe we cannot lock down is not used at all
+    SECURITY_ATTRIBUTES pipeSa = { sizeof(pipeSa), CurrentUserDescriptor(), FALSE };
+    if (!pipeSa.lpSecurityDescriptor)
+        return false;
+
+    // Anonymous pipes cannot do overlapped I/O; a uniquely named pipe can.
+    // FILE_FLAG_FIRST_PIPE_INSTANCE fails if someone created the name first.
+    static std::atomic<unsigned> s_serial(0);
+    CString name;
+    name.Format(_T("\\\\.\\pipe\\rds-out-%lu-%u"), GetCurrentProcessId(), ++s_serial);
+
+    hRead = CreateNamedPipe(name, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                            PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            1, 0, 64 * 1024, 0, &pipeSa);
+    if (hRead == INVALID_HANDLE_VALUE)
+    {
+        hRead = nullptr;
+        return false;
+    }
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    hWrite = CreateFile(name, GENERIC_WRITE, 0, &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hWrite == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hRead);
+        hRead = hWrite = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool CProcessRunner::CreateInputPipe(HANDLE& hRead, HANDLE& hWrite)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    if (!CreatePipe(&hRead, &hWrite, &sa, 0))
+    {
+        hRead = hWrite = nullptr;
+        return false;
+    }
+    SetHandleInformation(hWrite, HANDLE_FLAG_INHERIT, 0);
+    return true;
+}
+
+bool CProcessRunner::StartHidden(LPCTSTR commandLine, HANDLE hStdInput, HANDLE hStdOutput,
+                                 PROCESS_INFORMATION& pi)
+{
+    // The handle list limits inheritance to these two, whatever else is
+    // inheritable in this process at the moment
+    HANDLE inherit[2];
+    DWORD count = 0;
+    if (hStdInput)
+        inherit[count++] = hStdInput;
+    if (hStdOutput && hStdOutput != hStdInput)
+        inherit[count++] = hStdOutput;
+
+    SIZE_T attrSize = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attrSize);
+    std::vector<BYTE> attrBuffer(attrSize);
+    auto attrs = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attrBuffer.data());
+    if (!InitializeProcThreadAttributeList(attrs, 1, 0, &attrSize))
+        return false;
+
+    bool created = false;
+    if (count == 0 || UpdateProcThreadAttribute(attrs, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                                inherit, count * sizeof(HANDLE), nullptr, nullptr))
+    {
+        STARTUPINFOEX si = {};
+        si.StartupInfo.cb = sizeof(si);
+        si.StartupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+        si.StartupInfo.wShowWindow = SW_HIDE;
+        si.StartupInfo.hStdInput = hStdInput;
+        si.StartupInfo.hStdOutput = hStdOutput;
+        si.StartupInfo.hStdError = hStdOutput;
+        si.lpAttributeList = attrs;
+
+        CString cmd(commandLine);
+        created = CreateProcess(nullptr, cmd.GetBuffer(), nullptr, nullptr, count > 0,
+                                CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT,
+                                nullptr, nullptr, &si.StartupInfo, &pi) != FALSE;
+        cmd.ReleaseBuffer();
+        if (created)
+            CLogSpan::Count(SPAN_PROCESSES);
+    }
+    DeleteProcThreadAttributeList(attrs);
+    return created;
+}
+
+// Write input to the child's stdin, then close our end so it sees EOF. Runs
+// alongside the read loop: a child that writes output before it has read all
+// of its input would otherwise wait on us while we wait on it.
+static void WriteInput(HANDLE hWrite, const std::string& input)
+{
+    const char* data = input.data();
+    size_t remaining = input.size();
+    while (remaining > 0)
+    {
+        DWORD written = 0;
+        DWORD chunk = static_cast<DWORD>(min(remaining, static_cast<size_t>(64 * 1024)));
+        if (!WriteFile(hWrite, data, chunk, &written, nullptr) || written == 0)
+            break;      // the child closed stdin or was killed
+        data += written;
+        remaining -= written;
+    }
+    CloseHandle(hWrite);
+}
+
+ProcessResult CProcessRunner::Run(LPCTSTR commandLine, DWORD timeoutMs, HANDLE hCancel, size_t maxOutput,
+                                  const std::string* pInput)
+{
+    ProcessResult result;
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+
+    HANDLE hRead = nullptr, hWrite = nullptr;
+    if (!CreateOutputPipe(hRead, hWrite))
+        return result;
+
+    // Created before the child so that a failure here cannot lose its output
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    HANDLE hInput = nullptr, hInputWrite = nullptr;
+    if (!ov.hEvent || (pInput && !CreateInputPipe(hInput, hInputWrite)))
+    {
+        if (ov.hEvent)
+            CloseHandle(ov.hEvent);
+        CloseHandle(hRead);
+        CloseHandle(hWrite);
+        return result;
+    }
+
+    PROCESS_INFORMATION pi = {};
+    bool created = StartHidden(commandLine, hInput, hWrite, pi);
+
+    // Only the child (and what it starts) may hold the write end, so EOF means it is done writing
+    CloseHandle(hWrite);
+    if (hInput)
+        CloseHandle(hInput);
+
+    std::thread writer;
+    if (created && hInputWrite)
+    {
+        try
+        {
+            writer = std::thread(WriteInput, hInputWrite, std::cref(*pInput));
+            hInputWrite = nullptr;      // the writer closes it
+        }
+        catch (const std::system_error&)
+        {
+            TerminateProcess(pi.hProcess, ERROR_NOT_ENOUGH_MEMORY);
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+            created = false;
+        }
+    }
+    if (!created)
+    {
+        if (hInputWrite)
+            CloseHandle(hInputWrite);
+        CloseHandle(ov.hEvent);
+        CloseHandle(hRead);
+        return result;
+    }
+
+    HANDLE hJob = CreateJobObject(nullptr, nullptr);
+    if (hJob)
+    {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+        AssignProcessToJobObject(hJob, pi.hProcess);
+    }
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+
+    // Read until every writer has closed the pipe
+    char chunk[16 * 1024];
+    result.status = ProcessStatus::Ok;
+
+    for (;;)
+    {
+        DWORD read = 0;
+        if (!ReadFile(hRead, chunk, sizeof(chunk), &read, &ov))
+        {
+            DWORD error = GetLastError();
+            if (error != ERROR_IO_PENDING)
+                break;      // ERROR_BROKEN_PIPE: all writers gone
+
+            ULONGLONG now = GetTickCount64();
+            DWORD remaining = now < deadline ? static_cast<DWORD>(deadline - now) : 0;
+            HANDLE waits[2] = { ov.hEvent, hCancel };
+            DWORD waitResult = WaitForMultipleObjects(hCancel ? 2 : 1, waits, FALSE, remaining);
+            if (waitResult != WAIT_OBJECT_0)
+            {
+                result.status = (waitResult == WAIT_OBJECT_0 + 1) ? ProcessStatus::Cancelled
+                                                                  : ProcessStatus::TimedOut;
+                CancelIoEx(hRead, &ov);
+                GetOverlappedResult(hRead, &ov, &read, TRUE);
+                break;
+            }
+            if (!GetOverlappedResult(hRead, &ov, &read, FALSE))
+                break;
+        }
+
+        CLogSpan::Count(SPAN_BYTES_READ, read);
+        size_t room = maxOutput - result.output.size();
+        if (read > room)
+            result.truncated = true;
+        result.output.append(chunk, min(static_cast<size_t>(read), room));
+    }
+
+    if (result.status == ProcessStatus::Ok)
+    {
+        // Output is complete; the process may still be tearing down
+        ULONGLONG now = GetTickCount64();
+        DWORD remaining = now < deadline ? static_cast<DWORD>(deadline - now) : 0;
+        HANDLE waits[2] = { pi.hProcess, hCancel };
+        DWORD waitResult = WaitForMultipleObjects(hCancel ? 2 : 1, waits, FALSE, remaining);
+        if (waitResult == WAIT_OBJECT_0 + 1)
+            result.status = ProcessStatus::Cancelled;
+        else if (waitResult != WAIT_OBJECT_0)
+            result.status = ProcessStatus::TimedOut;
+    }
+
+    if (result.status != ProcessStatus::Ok)
+    {
+        DWORD code = (result.status == ProcessStatus::Cancelled) ? ERROR_CANCELLED : WAIT_TIMEOUT;
+        if (!hJob || !TerminateJobObject(hJob, code))
+            TerminateProcess(pi.hProcess, code);
+        WaitForSingleObject(pi.hProcess, 1000);
+    }
+    GetExitCodeProcess(pi.hProcess, &result.exitCode);
+
+    if (writer.joinable())
+    {
+        // Normally done already: the child read its input or its exit broke
+        // the pipe. A grandchild still holding stdin leaves it blocked, so
+        // cancel the write (again, in case the first landed before WriteFile).
+        while (WaitForSingleObject(writer.native_handle(), 10) == WAIT_TIMEOUT)
+            CancelSynchronousIo(writer.native_handle());
+        writer.join();
+    }
+
+    CloseHandle(ov.hEvent);
+    CloseHandle(hRead);
+    CloseHandle(pi.hProcess);
+    if (hJob)
+        CloseHandle(hJob);
+    return result;
+}
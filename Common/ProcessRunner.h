@@ -0,0 +1,57 @@
+#pragma once
+// ProcessRunner.h - Runs a hidden child process and captures its output through a pipe
+
+#include <afxwin.h>
+#include <string>
+
+enum class ProcessStatus
+{
+    Ok,           // process exited; exitCode and output are valid
+    TimedOut,     // deadline passed; the process and its children were killed
+    StartFailed,  // CreateProcess, a pipe or the read event could not be created
+    Cancelled     // cancel event was signalled; the process and its children were killed
+};
+
+struct ProcessResult
+{
+    ProcessStatus status = ProcessStatus::StartFailed;
+    DWORD         exitCode = static_cast<DWORD>(-1);
+    std::string   output;             // stdout and stderr interleaved, raw bytes
+    bool          truncated = false;  // output hit the cap; the rest was read and discarded
+
+    // Output decoded from codePage (console programs write the OEM code page)
+    CString Text(UINT codePage = CP_OEMCP) const;
+};
+
+// stdout and stderr share one overlapped named pipe read into a growable
+// buffer; nothing touches the disk. The child runs in a job object, so a
+// timeout or cancel also ends anything it started.
+class CProcessRunner
+{
+public:
+    static const size_t DEFAULT_MAX_OUTPUT = 4 * 1024 * 1024;
+
+    // hCancel may be nullptr. Output beyond maxOutput is drained and dropped
+    // so the child never blocks on a full pipe. pInput (if given) is the
+    // child's whole stdin, for data that must not appear on a command line;
+    // a separate thread writes it while the output is read, so any size works.
+    // It must stay valid until Run returns.
+    static ProcessResult Run(LPCTSTR commandLine, DWORD timeoutMs, HANDLE hCancel = nullptr,
+                             size_t maxOutput = DEFAULT_MAX_OUTPUT, const std::string* pInput = nullptr);
+
+    // Start a hidden, suspended child whose stdin (may be nullptr) and
+    // stdout/stderr are the given handles, and which inherits nothing else.
+    // Every child with redirected I/O (this runner, the PowerShell host) is
+    // started here, so one started on another thread never picks up a pipe
+    // end of a run in flight and keeps that run from seeing EOF.
+    static bool StartHidden(LPCTSTR commandLine, HANDLE hStdInput, HANDLE hStdOutput,
+                            PROCESS_INFORMATION& pi);
+
+    // Local pipe that only the current user can open: hRead for overlapped
+    // reads, hWrite inheritable for the child
+    static bool CreateOutputPipe(HANDLE& hRead, HANDLE& hWrite);
+
+private:
+    // Anonymous pipe for the child's stdin: hRead inheritable, hWrite not
+    static bool CreateInputPipe(HANDLE& hRead, HANDLE& hWrite);
+};
@@ -1,8 +1,12 @@
 #include "pch.h"
 #include "RegistryBackup.h"
 #include <ShlObj.h>
+#include <algorithm>
+#include <vector>
 
 CRegistryBackup::CRegistryBackup()
+    : m_loaded(false)
+    , m_dirty(false)
 {
 }
 
@@ -10,26 +14,216 @@ CRegistryBackup::~CRegistryBackup()
 {
 }
 
+static std::wstring MapKey(LPCTSTR key)
+{
+    CString upper(key);
+    upper.MakeUpper();
+    return std::wstring(upper);
+}
+
+// ════════════════════════════════════════════════════════════════
+// File format
+// ════════════════════════════════════════════════════════════════
+
+// Decode an INI file as written by WritePrivateProfileString (ANSI, or
+// UTF-16 when the file starts with a BOM) or by Commit (UTF-16 LE)
+static CString DecodeFile(const std::vector<BYTE>& data)
+{
+    if (data.size() >= 2 && data[0] == 0xFF && data[1] == 0xFE)
+        return CString(reinterpret_cast<LPCWSTR>(data.data() + 2), static_cast<int>((data.size() - 2) / 2));
+
+    UINT codePage = CP_ACP;
+    size_t offset = 0;
+    if (data.size() >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF)
+    {
+        codePage = CP_UTF8;
+        offset = 3;
+    }
+
+    int length = static_cast<int>(data.size() - offset);
+    if (length <= 0)
+        return CString();
+    LPCSTR bytes = reinterpret_cast<LPCSTR>(data.data() + offset);
+    int wide = MultiByteToWideChar(codePage, 0, bytes, length, nullptr, 0);
+    CString text;
+    MultiByteToWideChar(codePage, 0, bytes, length, text.GetBuffer(wide), wide);
+    text.ReleaseBuffer(wide);
+    return text;
+}
+
+static bool ReadWholeFile(LPCTSTR path, std::vector<BYTE>& data)
+{
+    HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {};
+    bool ok = GetFileSizeEx(hFile, &size) && size.QuadPart < 16 * 1024 * 1024;
+    if (ok)
+    {
+        data.resize(static_cast<size_t>(size.QuadPart));
+        DWORD read = 0;
+        ok = data.empty() ||
+             (ReadFile(hFile, data.data(), static_cast<DWORD>(data.size()), &read, nullptr) && read == data.size());
+    }
+    CloseHandle(hFile);
+    return ok;
+}
+
+void CRegistryBackup::EnsureLoaded()
+{
+    if (m_loaded)
+        return;
+    m_loaded = true;
+
+    // Originals in the journal win: a step killed before its Commit still
+    // recorded them there
+    for (const auto& kv : m_journal.GetOriginals())
+    {
+        Entry entry = { kv.first, kv.second };
+        m_entries[MapKey(kv.first)] = entry;
+    }
+
+    std::vector<BYTE> data;
+    if (m_stateFilePath.IsEmpty() || !ReadWholeFile(m_stateFilePath, data))
+        return;
+
+    CString text = DecodeFile(data);
+    bool inSection = false;
+    int pos = 0;
+    while (pos < text.GetLength())
+    {
+        int end = text.Find(_T('\n'), pos);
+        if (end == -1)
+            end = text.GetLength();
+        CString line = text.Mid(pos, end - pos);
+        pos = end + 1;
+
+        line.Trim();
+        if (line.IsEmpty() || line[0] == _T(';'))
+            continue;
+
+        if (line[0] == _T('['))
+        {
+            int close = line.Find(_T(']'));
+            CString section = line.Mid(1, close == -1 ? line.GetLength() - 1 : close - 1);
+            inSection = (section.Trim().CompareNoCase(SECTION_NAME) == 0);
+            continue;
+        }
+
+        int eq = line.Find(_T('='));
+        if (!inSection || eq <= 0)
+            continue;
+
+        Entry entry;
+        entry.key = line.Left(eq).Trim();
+        entry.value = line.Mid(eq + 1).Trim();
+        // GetPrivateProfileString strips one pair of surrounding quotes
+        if (entry.value.GetLength() >= 2 &&
+            (entry.value[0] == _T('"') || entry.value[0] == _T('\'')) &&
+            entry.value[entry.value.GetLength() - 1] == entry.value[0])
+            entry.value = entry.value.Mid(1, entry.value.GetLength() - 2);
+
+        // First occurrence wins, as with GetPrivateProfileString
+        m_entries.emplace(MapKey(entry.key), entry);
+    }
+}
+
+bool CRegistryBackup::Commit()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_dirty || m_stateFilePath.IsEmpty())
+        return true;
+
+    // Sorted so the file is stable between runs
+    std::vector<const Entry*> sorted;
+    for (const auto& kv : m_entries)
+        sorted.push_back(&kv.second);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Entry* a, const Entry* b) { return a->key.CompareNoCase(b->key) < 0; });
+
+    // UTF-16 LE with BOM: still readable by GetPrivateProfileString
+    CString text;
+    text.Format(_T("\xFEFF[%s]\r\n"), SECTION_NAME);
+    for (const Entry* e : sorted)
+        text += e->key + _T("=") + e->value + _T("\r\n");
+
+    CString tempPath = m_stateFilePath + _T(".tmp");
+    HANDLE hFile = CreateFile(tempPath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD bytes = static_cast<DWORD>(text.GetLength() * sizeof(WCHAR));
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, static_cast<LPCTSTR>(text), bytes, &written, nullptr) && written == bytes &&
+              FlushFileBuffers(hFile);
+    CloseHandle(hFile);
+
+    if (ok)
+        ok = MoveFileEx(tempPath, m_stateFilePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+    if (!ok)
+    {
+        ::DeleteFile(tempPath);
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
 void CRegistryBackup::Initialize(LPCTSTR stateFileName)
 {
     // Build path: %APPDATA%\RemoteDebugSetup\<stateFileName>.ini
     TCHAR appDataPath[MAX_PATH];
     if (SUCCEEDED(SHGetFolderPath(nullptr, CSIDL_APPDATA, nullptr, 0, appDataPath)))
     {
-        m_stateFilePath.Format(_T("%s\\RemoteDebugSetup\\%s.ini"), appDataPath, stateFileName);
-
         // Ensure directory exists
         CString dir;
         dir.Format(_T("%s\\RemoteDebugSetup"), appDataPath);
         ::CreateDirectory(dir, nullptr);
+
+        CString path;
+        path.Format(_T("%s\\%s.ini"), (LPCTSTR)dir, stateFileName);
+        InitializeFile(path);
     }
 }
 
+void CRegistryBackup::InitializeFile(LPCTSTR stateFilePath)
+{
+    // The journal sits next to the state file: <name>.ini -> <name>.journal
+    m_stateFilePath = stateFilePath;
+    int dot = m_stateFilePath.ReverseFind(_T('.'));
+    m_journal.Open((dot > m_stateFilePath.ReverseFind(_T('\\')) ? m_stateFilePath.Left(dot) : m_stateFilePath) +
+                   _T(".journal"));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_loaded = false;
+    m_dirty = false;
+}
+
 void CRegistryBackup::SaveState(LPCTSTR key, LPCTSTR value)
 {
     if (m_stateFilePath.IsEmpty())
         return;
-    ::WritePrivateProfileString(SECTION_NAME, key, value, m_stateFilePath);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    EnsureLoaded();
+
+    // Inside a setup step: keep the first original, journal a new one
+    CString keep(value);
+    int step = CSetupJournal::GetCurrentStep();
+    if (step >= 0 && !m_journal.FindOriginal(key, keep))
+        m_journal.RecordOriginal(step, key, value);
+
+    Entry& entry = m_entries[MapKey(key)];
+    if (entry.key.IsEmpty())
+        entry.key = key;
+    if (entry.value != keep)
+    {
+        entry.value = keep;
+        m_dirty = true;
+    }
 }
 
 void CRegistryBackup::SaveState(LPCTSTR key, bool value)
@@ -49,9 +243,10 @@ CString CRegistryBackup::LoadState(LPCTSTR key, LPCTSTR defaultValue)
     if (m_stateFilePath.IsEmpty())
         return defaultValue;
 
-    TCHAR buffer[1024];
-    ::GetPrivateProfileString(SECTION_NAME, key, defaultValue, buffer, _countof(buffer), m_stateFilePath);
-    return CString(buffer);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    EnsureLoaded();
+    auto it = m_entries.find(MapKey(key));
+    return (it != m_entries.end()) ? it->second.value : CString(defaultValue);
 }
 
 bool CRegistryBackup::LoadStateBool(LPCTSTR key, bool defaultValue)
@@ -72,6 +267,9 @@ bool CRegistryBackup::HasSavedState()
 {
     if (m_stateFilePath.IsEmpty())
         return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_dirty && !m_entries.empty())
+        return true;
     return (::GetFileAttributes(m_stateFilePath) != INVALID_FILE_ATTRIBUTES);
 }
 
@@ -79,7 +277,12 @@ void CRegistryBackup::ClearState()
 {
     if (!m_stateFilePath.IsEmpty())
     {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_loaded = true;
+        m_dirty = false;
         ::DeleteFile(m_stateFilePath);
+        m_journal.Reset();
     }
 }
 
@@ -2,8 +2,18 @@
 // RegistryBackup.h - Save/restore system state using INI file
 
 #include <afxwin.h>
-#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "SetupJournal.h"
 
+// The state file is read once into memory. SaveState only changes the
+// in-memory copy; Commit() writes all of it in one go (temp file + rename),
+// so a crash leaves either the previous or the new file, never half of one.
+// Alongside the state file a CSetupJournal records which steps ran; values
+// saved from inside a journaled step are its original values, and the first
+// one recorded for a key wins, so re-running a step cannot overwrite them.
+// Safe to call from several step threads at once: all access is serialized.
 class CRegistryBackup
 {
 public:
@@ -12,8 +22,10 @@ public:
 
     // Initialize with a specific state file name (e.g., "state_develop" or "state_test")
     void Initialize(LPCTSTR stateFileName);
+    // Same, with the full path of the state file; its folder must exist
+    void InitializeFile(LPCTSTR stateFilePath);
 
-    // Save a key-value pair to the state file
+    // Save a key-value pair (buffered until Commit)
     void SaveState(LPCTSTR key, LPCTSTR value);
     void SaveState(LPCTSTR key, bool value);
     void SaveState(LPCTSTR key, int value);
@@ -23,16 +35,34 @@ public:
     bool    LoadStateBool(LPCTSTR key, bool defaultValue = false);
     int     LoadStateInt(LPCTSTR key, int defaultValue = 0);
 
-    // Check if a saved state exists
+    // Write buffered changes to the state file; no-op when nothing changed
+    bool Commit();
+
+    // Check if a saved state exists (on disk or not yet committed)
     bool HasSavedState();
 
-    // Delete the state file
+    // Drop all state and delete the state file and journal
     void ClearState();
 
+    CSetupJournal& Journal() { return m_journal; }
+
     // Get the full path to the state file
     CString GetStateFilePath() const;
 
 private:
+    struct Entry
+    {
+        CString key;              // as first written, for the file
+        CString value;
+    };
+
+    void EnsureLoaded();          // m_mutex held
+
     CString m_stateFilePath;
+    CSetupJournal m_journal;
+    std::mutex m_mutex;
+    std::unordered_map<std::wstring, Entry> m_entries;   // key: upper-cased (INI keys are case-insensitive)
+    bool m_loaded;
+    bool m_dirty;
     static constexpr LPCTSTR SECTION_NAME = _T("State");
 };
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "SettingsUtils.h"
+#include "JsonEscape.h"
 #include <ShlObj.h>
 
 CString CSettingsUtils::GetSettingsDir()
@@ -11,118 +12,157 @@ CString CSettingsUtils::GetSettingsDir()
     return dir + _T("\\Settings");
 }
 
-static CString JsonEscape(const CString& input)
+// ════════════════════════════════════════════════════════════════
+// Keys
+// ════════════════════════════════════════════════════════════════
+
+LPCTSTR CSettingsUtils::KeyName(SettingKey key)
 {
-    CString result;
-    for (int i = 0; i < input.GetLength(); i++)
-    {
-        TCHAR ch = input[i];
-        if (ch == _T('"'))       result += _T("\\\"");
-        else if (ch == _T('\\')) result += _T("\\\\");
-        else if (ch == _T('\n')) result += _T("\\n");
-        else if (ch == _T('\r')) result += _T("\\r");
-        else if (ch == _T('\t')) result += _T("\\t");
-        else                     result += ch;
-    }
-    return result;
+    return (key >= 0 && key < SETTING_KEY_COUNT) ? SETTING_KEY_NAMES[key] : _T("");
 }
 
-static CString JsonUnescape(const CString& input)
+bool CSettingsUtils::FindKey(const CString& name, SettingKey& key)
 {
-    CString result;
-    for (int i = 0; i < input.GetLength(); i++)
+    // Names are matched exactly, as the JSON file spells them
+    for (int i = 0; i < SETTING_KEY_COUNT; i++)
     {
-        if (input[i] == _T('\\') && i + 1 < input.GetLength())
-        {
-            TCHAR next = input[i + 1];
-            if (next == _T('"'))       { result += _T('"');  i++; }
-            else if (next == _T('\\')) { result += _T('\\'); i++; }
-            else if (next == _T('n'))  { result += _T('\n'); i++; }
-            else if (next == _T('r'))  { result += _T('\r'); i++; }
-            else if (next == _T('t'))  { result += _T('\t'); i++; }
-            else                       result += input[i];
-        }
-        else
+        if (name == SETTING_KEY_NAMES[i])
         {
-            result += input[i];
+            key = static_cast<SettingKey>(i);
+            return true;
         }
     }
-    return result;
+    return false;
 }
 
-// Find the closing quote, skipping escaped quotes. Returns index or -1.
-static int FindClosingQuote(const CString& line, int startAfterQuote)
+// ════════════════════════════════════════════════════════════════
+// Reading
+// ════════════════════════════════════════════════════════════════
+
+bool CSettingsUtils::ReadDocument(LPCTSTR filePath, JsonValue& root, CString* pError)
 {
-    for (int i = startAfterQuote; i < line.GetLength(); i++)
+    if (pError)
+        pError->Empty();
+
+    if (GetFileAttributes(filePath) == INVALID_FILE_ATTRIBUTES)
+        return false;
+
+    JsonError error;
+    if (!CJsonReader::ParseFile(filePath, root, error))
     {
-        if (line[i] == _T('\\')) { i++; continue; }
-        if (line[i] == _T('"'))  return i;
+        if (pError)
+            *pError = error.Format();
+        return false;
     }
-    return -1;
+    if (root.type != JSON_OBJECT)
+    {
+        if (pError)
+            *pError = _T("line 1, column 1: settings must be a JSON object");
+        return false;
+    }
+    return true;
 }
 
-bool CSettingsUtils::Save(LPCTSTR filePath, const std::map<CString, CString>& settings)
+bool CSettingsUtils::ReadText(const JsonValue& value, CString& text)
+{
+    if (value.type != JSON_STRING && value.type != JSON_NUMBER)
+        return false;
+    text = value.text;
+    return true;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Writing
+// ════════════════════════════════════════════════════════════════
+
+void CSettingsUtils::AppendQuoted(std::string& out, LPCTSTR text)
+{
+    out += '"';
+    CJsonEscape::Append(out, text);
+    out += '"';
+}
+
+void CSettingsUtils::AppendValue(std::string& out, SettingType type, const CString& text)
+{
+    // A valid port is digits only, so it can go in unquoted
+    if (type == SETTING_PORT && IsPortNumber(text))
+        out += CT2A(text);
+    else
+        AppendQuoted(out, text);
+}
+
+bool CSettingsUtils::WriteDocument(LPCTSTR filePath, const std::string& utf8)
 {
     // Ensure directory exists
     CString dir(filePath);
     dir = dir.Left(dir.ReverseFind(_T('\\')));
     SHCreateDirectoryEx(nullptr, dir, nullptr);
 
-    CStdioFile file;
-    if (!file.Open(filePath, CFile::modeCreate | CFile::modeWrite | CFile::typeText))
+    HANDLE hFile = CreateFile(filePath, GENERIC_WRITE, 0, nullptr,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
         return false;
 
-    file.WriteString(_T("{\n"));
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, utf8.data(), static_cast<DWORD>(utf8.size()), &written, nullptr) &&
+              written == utf8.size();
+    CloseHandle(hFile);
+    return ok;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Validators
+// ════════════════════════════════════════════════════════════════
 
-    int index = 0;
-    int total = (int)settings.size();
-    for (auto it = settings.begin(); it != settings.end(); ++it, ++index)
+bool CSettingsUtils::IsValid(SettingType type, const CString& value)
+{
+    switch (type)
     {
-        CString line;
-        line.Format(_T("  \"%s\": \"%s\"%s\n"),
-                    (LPCTSTR)JsonEscape(it->first),
-                    (LPCTSTR)JsonEscape(it->second),
-                    (index < total - 1) ? _T(",") : _T(""));
-        file.WriteString(line);
+    case SETTING_PORT:          return IsPortNumber(value);
+    case SETTING_IPV4:          return IsIPv4Address(value);
+    case SETTING_DRIVE_LETTER:  return IsDriveLetter(value);
+    default:                    return true;
     }
-
-    file.WriteString(_T("}\n"));
-    file.Close();
-    return true;
 }
 
-bool CSettingsUtils::Load(LPCTSTR filePath, std::map<CString, CString>& settings)
+bool CSettingsUtils::IsPortNumber(const CString& value)
 {
-    CStdioFile file;
-    if (!file.Open(filePath, CFile::modeRead | CFile::typeText))
+    if (value.IsEmpty() || value.GetLength() > 5 || value.SpanIncluding(_T("0123456789")) != value)
         return false;
+    int port = _ttoi(value);
+    return port >= 1024 && port <= 65535;
+}
+
+bool CSettingsUtils::IsIPv4Address(const CString& value)
+{
+    if (value.IsEmpty())
+        return true;
 
-    settings.clear();
-    CString line;
-    while (file.ReadString(line))
+    int parts = 0, digits = 0, octet = 0;
+    for (int i = 0; i <= value.GetLength(); i++)
     {
-        line.Trim();
-        if (line.IsEmpty() || line == _T("{") || line == _T("}"))
-            continue;
-
-        // Parse "key": "value" [,]
-        int q1 = line.Find(_T('"'));
-        if (q1 < 0) continue;
-        int q2 = FindClosingQuote(line, q1 + 1);
-        if (q2 < 0) continue;
-        CString key = JsonUnescape(line.Mid(q1 + 1, q2 - q1 - 1));
-
-        int colon = line.Find(_T(':'), q2);
-        if (colon < 0) continue;
-        int q3 = line.Find(_T('"'), colon);
-        if (q3 < 0) continue;
-        int q4 = FindClosingQuote(line, q3 + 1);
-        if (q4 < 0) continue;
-        CString value = JsonUnescape(line.Mid(q3 + 1, q4 - q3 - 1));
-
-        settings[key] = value;
+        TCHAR ch = (i < value.GetLength()) ? value[i] : _T('.');
+        if (ch >= _T('0') && ch <= _T('9'))
+        {
+            octet = octet * 10 + (ch - _T('0'));
+            if (++digits > 3 || octet > 255)
+                return false;
+        }
+        else if (ch == _T('.') && digits > 0)
+        {
+            parts++;
+            digits = 0;
+            octet = 0;
+        }
+        else
+        {
+            return false;
+        }
     }
+    return parts == 4;
+}
 
-    file.Close();
-    return true;
+bool CSettingsUtils::IsDriveLetter(const CString& value)
+{
+    return value.GetLength() == 2 && _istalpha(value[0]) && value[1] == _T(':');
 }
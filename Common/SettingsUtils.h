@@ -1,18 +1,159 @@
 #pragma once
-// SettingsUtils.h - Simple JSON settings persistence
+// SettingsUtils.h - JSON settings persistence driven by a per-dialog schema
 
 #include <afxwin.h>
-#include <map>
+#include <string>
+#include "JsonReader.h"
+
+// Every persisted setting of both tools. Schema tables and the fleet defaults
+// name settings through this enum, so a misspelt key does not compile.
+enum SettingKey
+{
+    KEY_TEAMVIEWER_ID,          // SetupDevelop
+    KEY_PASSWORD,               // both
+    KEY_SHARE_PATH,             // SetupDevelop
+    KEY_SHARE_NAME,             // both
+    KEY_VPN_SUBNET,             // SetupDevelop
+    KEY_DEV_HOSTNAME,           // SetupTest
+    KEY_DEV_VPN_IP,             // SetupTest
+    KEY_DEBUGGER_PORT,          // SetupTest
+    KEY_DRIVE_LETTER,           // SetupTest
+    SETTING_KEY_COUNT
+};
+
+// JSON name of each SettingKey, in enum order
+constexpr LPCTSTR SETTING_KEY_NAMES[] =
+{
+    _T("TeamViewerID"),
+    _T("Password"),
+    _T("SharePath"),
+    _T("ShareName"),
+    _T("VPNSubnet"),
+    _T("DevHostname"),
+    _T("DevVPNIP"),
+    _T("DebuggerPort"),
+    _T("DriveLetter"),
+};
+static_assert(_countof(SETTING_KEY_NAMES) == SETTING_KEY_COUNT, "one JSON name per SettingKey");
+
+constexpr LPCTSTR SettingName(SettingKey key) { return SETTING_KEY_NAMES[key]; }
+
+// What a setting holds: decides how a loaded value is checked and how it is written
+enum SettingType
+{
+    SETTING_TEXT,               // any string
+    SETTING_PORT,               // 1024-65535, written as a JSON number
+    SETTING_IPV4,               // dotted quad, or empty (not set yet)
+    SETTING_DRIVE_LETTER,       // "Z:"
+};
+
+// One persisted setting. The member pointer fixes where it is stored (a
+// misspelt member does not compile). Tables of the dialogs' settings take
+// their names from SettingName(); private records such as caches spell theirs.
+template <class T>
+struct SettingField
+{
+    LPCTSTR      name;
+    CString T::* member;
+    SettingType  type;
+    LPCTSTR      defaultValue;      // set by CSettingsUtils::ApplyDefaults
+};
 
 class CSettingsUtils
 {
 public:
-    // Load key-value pairs from a JSON file. Returns true if file was read.
-    static bool Load(LPCTSTR filePath, std::map<CString, CString>& settings);
+    // Load the schema's fields from a JSON file into target in one pass over
+    // the document. Returns true if the file was read. Unknown keys are
+    // ignored; invalid values leave the default in place. pError (if given)
+    // gets "line L, column C: reason" for a syntax error or the rejected keys;
+    // it stays empty when the file simply does not exist.
+    template <class T, size_t N>
+    static bool Load(LPCTSTR filePath, const SettingField<T> (&schema)[N], T& target,
+                     CString* pError = nullptr);
+
+    // Set every field of the schema to its default.
+    template <class T, size_t N>
+    static void ApplyDefaults(const SettingField<T> (&schema)[N], T& target);
 
-    // Save key-value pairs to a JSON file. Creates directories as needed.
-    static bool Save(LPCTSTR filePath, const std::map<CString, CString>& settings);
+    // Save the schema's fields to a JSON file (UTF-8). Creates directories as needed.
+    template <class T, size_t N>
+    static bool Save(LPCTSTR filePath, const SettingField<T> (&schema)[N], const T& source);
 
     // Get the Settings directory next to the executable.
     static CString GetSettingsDir();
+
+    // JSON name of a key, and the key for a JSON name (false if no setting has it)
+    static LPCTSTR KeyName(SettingKey key);
+    static bool    FindKey(const CString& name, SettingKey& key);
+
+    // ── Validators ──
+    static bool IsValid(SettingType type, const CString& value);
+    static bool IsPortNumber(const CString& value);         // 1024-65535
+    static bool IsIPv4Address(const CString& value);        // dotted quad, or empty (not set yet)
+    static bool IsDriveLetter(const CString& value);        // "Z:"
+
+private:
+    static bool    ReadDocument(LPCTSTR filePath, JsonValue& root, CString* pError);
+    static bool    ReadText(const JsonValue& value, CString& text);   // strings, and numbers as written
+    static void    AppendQuoted(std::string& out, LPCTSTR text);
+    static void    AppendValue(std::string& out, SettingType type, const CString& text);
+    static bool    WriteDocument(LPCTSTR filePath, const std::string& utf8);
 };
+
+// ════════════════════════════════════════════════════════════════
+// Template implementation
+// ════════════════════════════════════════════════════════════════
+
+template <class T, size_t N>
+bool CSettingsUtils::Load(LPCTSTR filePath, const SettingField<T> (&schema)[N], T& target,
+                          CString* pError)
+{
+    JsonValue root;
+    if (!ReadDocument(filePath, root, pError))
+        return false;
+
+    // A schema has a handful of fields: a linear match per member is cheapest
+    CString rejected;
+    for (const auto& member : root.members)
+    {
+        for (const SettingField<T>& field : schema)
+        {
+            if (member.first != field.name)
+                continue;
+
+            CString text;
+            if (ReadText(member.second, text) && IsValid(field.type, text))
+                target.*field.member = text;
+            else
+                rejected += (rejected.IsEmpty() ? _T("") : _T(", ")) + member.first;
+            break;
+        }
+    }
+
+    if (pError && !rejected.IsEmpty())
+        *pError = _T("invalid value for ") + rejected;
+    return true;
+}
+
+template <class T, size_t N>
+void CSettingsUtils::ApplyDefaults(const SettingField<T> (&schema)[N], T& target)
+{
+    for (const SettingField<T>& field : schema)
+        target.*field.member = field.defaultValue;
+}
+
+template <class T, size_t N>
+bool CSettingsUtils::Save(LPCTSTR filePath, const SettingField<T> (&schema)[N], const T& source)
+{
+    std::string text("{\n");
+    for (size_t i = 0; i < N; i++)
+    {
+        text += "  ";
+        AppendQuoted(text, schema[i].name);
+        text += ": ";
+        AppendValue(text, schema[i].type, source.*schema[i].member);
+        text += (i + 1 < N) ? ",\n" : "\n";
+    }
+    text += "}\n";
+    return WriteDocument(filePath, text);
+}
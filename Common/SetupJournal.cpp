@@ -0,0 +1,419 @@
+#include "pch.h"
+#include "SetupJournal.h"
+
+static thread_local int t_currentStep = -1;
+
+// Frame: [DWORD payload length][DWORD CRC-32 of payload][payload]
+static const DWORD FRAME_HEADER = 2 * sizeof(DWORD);
+static const DWORD MAX_PAYLOAD  = 64 * 1024;
+
+CSetupJournal::CSetupJournal()
+    : m_hFile(INVALID_HANDLE_VALUE)
+{
+    ClearView();
+}
+
+CSetupJournal::~CSetupJournal()
+{
+    Close();
+}
+
+// ════════════════════════════════════════════════════════════════
+// File
+// ════════════════════════════════════════════════════════════════
+
+bool CSetupJournal::Open(LPCTSTR path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(m_hFile);
+
+    m_path = path;
+    ClearView();
+    m_hFile = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    Replay();
+    return true;
+}
+
+void CSetupJournal::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        FlushFileBuffers(m_hFile);
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+void CSetupJournal::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    if (!m_path.IsEmpty())
+        ::DeleteFile(m_path);
+    ClearView();
+}
+
+void CSetupJournal::Replay()
+{
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart > 64 * 1024 * 1024)
+        return;
+
+    std::vector<BYTE> data(static_cast<size_t>(size.QuadPart));
+    DWORD read = 0;
+    LARGE_INTEGER zero = {};
+    SetFilePointerEx(m_hFile, zero, nullptr, FILE_BEGIN);
+    if (!data.empty() && (!ReadFile(m_hFile, data.data(), static_cast<DWORD>(data.size()), &read, nullptr) ||
+                          read != data.size()))
+        return;
+
+    size_t offset = 0;
+    while (offset + FRAME_HEADER <= data.size())
+    {
+        DWORD length = *reinterpret_cast<const DWORD*>(&data[offset]);
+        DWORD crc = *reinterpret_cast<const DWORD*>(&data[offset + sizeof(DWORD)]);
+        if (length > MAX_PAYLOAD || offset + FRAME_HEADER + length > data.size())
+            break;
+
+        const BYTE* payload = &data[offset + FRAME_HEADER];
+        JournalRecord record;
+        if (Crc32(payload, length) != crc || !Decode(payload, length, record))
+            break;
+
+        Apply(record);
+        offset += FRAME_HEADER + length;
+    }
+
+    // Cut a torn tail so new records follow the last good one
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(offset);
+    SetFilePointerEx(m_hFile, end, nullptr, FILE_BEGIN);
+    if (offset != data.size())
+        SetEndOfFile(m_hFile);
+
+    // Whatever run the file ends in was killed; nothing is open in this process
+    m_runOpen = false;
+}
+
+bool CSetupJournal::Append(const JournalRecord& record)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        if (m_path.IsEmpty())
+            return false;
+        m_hFile = CreateFile(m_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_hFile == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER zero = {};
+        SetFilePointerEx(m_hFile, zero, nullptr, FILE_END);
+    }
+
+    // One WriteFile per record; it lands in the file cache, which survives
+    // the process being killed. Flushed to disk at the end of a run.
+    Encode(record, m_buffer);
+    LARGE_INTEGER zero = {}, frameStart = {};
+    SetFilePointerEx(m_hFile, zero, &frameStart, FILE_CURRENT);
+    DWORD written = 0;
+    if (!WriteFile(m_hFile, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), &written, nullptr) ||
+        written != m_buffer.size())
+    {
+        // Cut a partial frame, so the next record follows the last good one
+        SetFilePointerEx(m_hFile, frameStart, nullptr, FILE_BEGIN);
+        SetEndOfFile(m_hFile);
+        return false;
+    }
+
+    // The view only ever shows what is in the file
+    Apply(record);
+    return true;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Record encoding
+// ════════════════════════════════════════════════════════════════
+
+// Payload: BYTE type, BYTE ok, INT32 step, WORD key length, key chars,
+//          WORD value length, value chars (UTF-16, no terminators)
+void CSetupJournal::Encode(const JournalRecord& record, std::vector<BYTE>& out)
+{
+    WORD keyLength = static_cast<WORD>(min(record.key.GetLength(), 0x7FFF));
+    WORD valueLength = static_cast<WORD>(min(record.value.GetLength(), 0x7FFF));
+    DWORD length = 2 + sizeof(INT32) + 2 * sizeof(WORD) + (keyLength + valueLength) * sizeof(WCHAR);
+
+    out.resize(FRAME_HEADER + length);
+    BYTE* p = out.data() + FRAME_HEADER;
+    *p++ = static_cast<BYTE>(record.type);
+    *p++ = record.ok ? 1 : 0;
+    INT32 step = record.step;
+    memcpy(p, &step, sizeof(step));                                   p += sizeof(step);
+    memcpy(p, &keyLength, sizeof(WORD));                              p += sizeof(WORD);
+    memcpy(p, static_cast<LPCWSTR>(record.key), keyLength * sizeof(WCHAR));       p += keyLength * sizeof(WCHAR);
+    memcpy(p, &valueLength, sizeof(WORD));                            p += sizeof(WORD);
+    memcpy(p, static_cast<LPCWSTR>(record.value), valueLength * sizeof(WCHAR));
+
+    DWORD crc = Crc32(out.data() + FRAME_HEADER, length);
+    memcpy(out.data(), &length, sizeof(DWORD));
+    memcpy(out.data() + sizeof(DWORD), &crc, sizeof(DWORD));
+}
+
+bool CSetupJournal::Decode(const BYTE* payload, size_t length, JournalRecord& record)
+{
+    const BYTE* p = payload;
+    const BYTE* end = payload + length;
+    if (end - p < static_cast<ptrdiff_t>(2 + sizeof(INT32) + sizeof(WORD)))
+        return false;
+
+    BYTE type = *p++;
+    if (type < JOURNAL_RUN_BEGIN || type > JOURNAL_RUN_END)
+        return false;
+    record.type = static_cast<JournalRecordType>(type);
+    record.ok = (*p++ != 0);
+    INT32 step;
+    memcpy(&step, p, sizeof(step));
+    p += sizeof(step);
+    record.step = step;
+
+    CString* fields[] = { &record.key, &record.value };
+    for (CString* field : fields)
+    {
+        WORD count;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(WORD)))
+            return false;
+        memcpy(&count, p, sizeof(WORD));
+        p += sizeof(WORD);
+        if (end - p < static_cast<ptrdiff_t>(count * sizeof(WCHAR)))
+            return false;
+        field->SetString(reinterpret_cast<LPCWSTR>(p), count);
+        p += count * sizeof(WCHAR);
+    }
+    return p == end;
+}
+
+DWORD CSetupJournal::Crc32(const BYTE* data, size_t length)
+{
+    // Reflected CRC-32 (polynomial 0xEDB88320), table built on first use
+    static const auto table = [] {
+        std::vector<DWORD> t(256);
+        for (DWORD i = 0; i < 256; i++)
+        {
+            DWORD c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : (c >> 1);
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    DWORD crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+CString CSetupJournal::Fingerprint(LPCTSTR inputs)
+{
+    CString text;
+    text.Format(_T("%08X"), Crc32(reinterpret_cast<const BYTE*>(inputs), _tcslen(inputs) * sizeof(TCHAR)));
+    return text;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Writers
+// ════════════════════════════════════════════════════════════════
+
+bool CSetupJournal::BeginRun(bool restore, LPCTSTR inputs)
+{
+    return Append({ JOURNAL_RUN_BEGIN, -1, false, restore ? _T("restore") : _T("setup"), inputs });
+}
+
+bool CSetupJournal::BeginStep(int step)
+{
+    return Append({ JOURNAL_STEP_BEGIN, step, false, _T(""), _T("") });
+}
+
+bool CSetupJournal::RecordOriginal(int step, LPCTSTR key, LPCTSTR value)
+{
+    return Append({ JOURNAL_ORIGINAL, step, false, key, value });
+}
+
+bool CSetupJournal::CommitStep(int step, bool ok)
+{
+    return Append({ JOURNAL_STEP_COMMIT, step, ok, _T(""), _T("") });
+}
+
+bool CSetupJournal::MarkUndone(int step)
+{
+    return Append({ JOURNAL_STEP_UNDONE, step, true, _T(""), _T("") });
+}
+
+bool CSetupJournal::EndRun(bool completed)
+{
+    {
+        // A restore that reset the journal has nothing left to close
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_runOpen)
+            return true;
+    }
+    bool ok = Append({ JOURNAL_RUN_END, -1, completed, _T(""), _T("") });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+        FlushFileBuffers(m_hFile);
+    return ok;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Replayed view
+// ════════════════════════════════════════════════════════════════
+
+void CSetupJournal::ClearView()
+{
+    m_runOpen = false;
+    m_restoreRun = false;
+    m_setupInterrupted = false;
+    m_hasSetupHistory = false;
+    m_setupInputs.Empty();
+    m_done.clear();
+    m_started.clear();
+    m_needsUndo.clear();
+    m_originals.clear();
+}
+
+void CSetupJournal::Apply(const JournalRecord& record)
+{
+    switch (record.type)
+    {
+    case JOURNAL_RUN_BEGIN:
+        m_runOpen = true;
+        m_restoreRun = (record.key == _T("restore"));
+        if (m_restoreRun)
+        {
+            // Undoing anything ends the chance to resume the setup before it
+            m_setupInterrupted = false;
+            m_done.clear();
+        }
+        else
+        {
+            // A setup after an interrupted one continues it, unless it
+            // applies different settings
+            if (!m_setupInterrupted || record.value != m_setupInputs)
+                m_done.clear();
+            m_setupInterrupted = true;
+            m_setupInputs = record.value;
+        }
+        break;
+
+    case JOURNAL_STEP_BEGIN:
+        m_started.insert(record.step);
+        m_hasSetupHistory = true;
+        break;
+
+    case JOURNAL_ORIGINAL:
+    {
+        CString upper(record.key);
+        upper.MakeUpper();
+        m_originals.emplace(upper, std::make_pair(record.key, record.value));
+        break;
+    }
+
+    case JOURNAL_STEP_COMMIT:
+        m_started.erase(record.step);
+        m_needsUndo.insert(record.step);
+        if (record.ok)
+            m_done.insert(record.step);
+        else
+            m_done.erase(record.step);
+        break;
+
+    case JOURNAL_STEP_UNDONE:
+        m_started.erase(record.step);
+        m_needsUndo.erase(record.step);
+        m_done.erase(record.step);
+        break;
+
+    case JOURNAL_RUN_END:
+        m_runOpen = false;
+        if (!m_restoreRun && record.ok)
+            m_setupInterrupted = false;
+        break;
+    }
+}
+
+bool CSetupJournal::HasInterruptedSetup() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_setupInterrupted && !m_runOpen;
+}
+
+CString CSetupJournal::GetSetupInputs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_setupInputs;
+}
+
+bool CSetupJournal::IsStepDone(int step) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done.count(step) != 0;
+}
+
+bool CSetupJournal::NeedsUndo(int step) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_needsUndo.count(step) != 0;
+}
+
+std::vector<int> CSetupJournal::GetUnfinishedSteps() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::vector<int>(m_started.begin(), m_started.end());
+}
+
+bool CSetupJournal::HasSetupHistory() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hasSetupHistory;
+}
+
+bool CSetupJournal::FindOriginal(LPCTSTR key, CString& value) const
+{
+    CString upper(key);
+    upper.MakeUpper();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_originals.find(upper);
+    if (it == m_originals.end())
+        return false;
+    value = it->second.second;
+    return true;
+}
+
+std::map<CString, CString> CSetupJournal::GetOriginals() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<CString, CString> originals;
+    for (const auto& kv : m_originals)
+        originals[kv.second.first] = kv.second.second;
+    return originals;
+}
+
+void CSetupJournal::SetCurrentStep(int step)
+{
+    t_currentStep = step;
+}
+
+int CSetupJournal::GetCurrentStep()
+{
+    return t_currentStep;
+}
@@ -0,0 +1,111 @@
+#pragma once
+// SetupJournal.h - Append-only, checksummed journal of setup / restore progress
+
+#include <afxwin.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+enum JournalRecordType
+{
+    JOURNAL_RUN_BEGIN   = 1,    // key = "setup" or "restore", value = Fingerprint of the run's inputs
+    JOURNAL_STEP_BEGIN  = 2,    // setup step started
+    JOURNAL_ORIGINAL    = 3,    // key / value recorded by a setup step before it changed anything
+    JOURNAL_STEP_COMMIT = 4,    // setup step finished; ok = it succeeded
+    JOURNAL_STEP_UNDONE = 5,    // restore undid this setup step
+    JOURNAL_RUN_END     = 6     // ok = ran to the end (not stopped)
+};
+
+struct JournalRecord
+{
+    JournalRecordType type;
+    int     step;               // 0-based setup step index, -1 when not step related
+    bool    ok;
+    CString key;
+    CString value;
+};
+
+// Every record is appended as [length][CRC-32][payload] to a file kept open
+// for the whole session, so an append is one WriteFile into the cache. At
+// Open the file is replayed up to the first torn or corrupt record (what a
+// kill mid-write leaves) and cut there.
+//
+// The replayed view answers what Setup and Restore need after a crash:
+// which steps of the last setup run already succeeded (resume), which setup
+// steps ever finished and are not undone yet (what Restore must undo), and
+// the first original value recorded for each state key.
+class CSetupJournal
+{
+public:
+    CSetupJournal();
+    ~CSetupJournal();
+
+    bool Open(LPCTSTR path);
+    void Close();
+    // Delete the journal and forget everything (after a completed restore)
+    void Reset();
+
+    // ── Writers (any thread) ──
+    // A setup resumes the interrupted one only when inputs matches its
+    // fingerprint; otherwise every step runs again
+    bool BeginRun(bool restore, LPCTSTR inputs = _T(""));
+    bool BeginStep(int step);
+    bool RecordOriginal(int step, LPCTSTR key, LPCTSTR value);
+    bool CommitStep(int step, bool ok);
+    bool MarkUndone(int step);
+    bool EndRun(bool completed);
+
+    // ── Replayed view ──
+    // A setup was started, has not run to the end and was not undone since
+    bool HasInterruptedSetup() const;
+    // Fingerprint the last setup run began with
+    CString GetSetupInputs() const;
+    // Succeeded in the current setup (including the interrupted run it resumes)
+    bool IsStepDone(int step) const;
+    // Finished (successfully or not) in some setup run and not undone since
+    bool NeedsUndo(int step) const;
+    // Started but never finished: what a kill left half done
+    std::vector<int> GetUnfinishedSteps() const;
+    // False when no setup step was ever journaled (e.g. state from an older version)
+    bool HasSetupHistory() const;
+    // First value recorded for key since the last Reset
+    bool FindOriginal(LPCTSTR key, CString& value) const;
+    std::map<CString, CString> GetOriginals() const;    // key: as recorded
+
+    // Setup step the calling thread is running (-1 = none), so state saved
+    // from inside a step can be journaled as that step's original value
+    static void SetCurrentStep(int step);
+    static int  GetCurrentStep();
+
+    static DWORD Crc32(const BYTE* data, size_t length);
+
+    // Short hash of the settings a setup applies, for BeginRun: enough to
+    // notice a change, without keeping the values in the journal
+    static CString Fingerprint(LPCTSTR inputs);
+
+private:
+    bool Append(const JournalRecord& record);
+    void Apply(const JournalRecord& record);     // m_mutex held
+    void Replay();                               // m_mutex held
+    void ClearView();                            // m_mutex held
+
+    static void Encode(const JournalRecord& record, std::vector<BYTE>& out);
+    static bool Decode(const BYTE* payload, size_t length, JournalRecord& record);
+
+    mutable std::mutex m_mutex;
+    CString           m_path;
+    HANDLE            m_hFile;
+    std::vector<BYTE> m_buffer;                  // reused for every append
+
+    // Replayed view
+    bool            m_runOpen;
+    bool            m_restoreRun;
+    bool            m_setupInterrupted;
+    bool            m_hasSetupHistory;
+    CString         m_setupInputs;
+    std::set<int>   m_done;                      // succeeded in the current setup
+    std::set<int>   m_started;                   // began, not yet committed
+    std::set<int>   m_needsUndo;
+    std::map<CString, std::pair<CString, CString>> m_originals;  // upper key -> (key, value)
+};
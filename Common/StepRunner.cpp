@@ -0,0 +1,445 @@
+#include "pch.h"
+#include "StepRunner.h"
+#include "WinUtils.h"
+#include "LogSpan.h"
+#include <exception>
+#include <system_error>
+
+CStepRunner::CStepRunner()
+    : m_pLog(nullptr)
+    , m_maxParallel(MAX_PARALLEL_STEPS)
+    , m_checkersLeft(0)
+    , m_checksDone(false)
+    , m_finished(0)
+    , m_allOk(true)
+    , m_nextCheck(0)
+    , m_checkStartTick(0)
+    , m_running(false)
+    , m_cancelled(false)
+    , m_runStartTick(0)
+    , m_runEndTick(0)
+{
+    m_hCancelEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+}
+
+CStepRunner::~CStepRunner()
+{
+    Cancel();
+    Wait();
+    if (m_hCancelEvent)
+        CloseHandle(m_hCancelEvent);
+}
+
+std::vector<int> CStepRunner::AllBefore(int index)
+{
+    std::vector<int> deps;
+    for (int i = 0; i < index; i++)
+        deps.push_back(i);
+    return deps;
+}
+
+bool CStepRunner::Start(HWND hNotify, CLogUtils* pLog, std::vector<SetupStep> steps)
+{
+    StepObserver observer;
+    if (hNotify)
+    {
+        observer.onProgress = [hNotify](int step, StepState state) {
+            ::PostMessage(hNotify, WM_STEP_PROGRESS, step, state);
+        };
+        observer.onComplete = [hNotify](bool allOk, bool cancelled) {
+            ::PostMessage(hNotify, WM_STEP_COMPLETE, allOk ? 1 : 0, cancelled ? 1 : 0);
+        };
+    }
+    return Start(observer, pLog, std::move(steps));
+}
+
+bool CStepRunner::Start(const StepObserver& observer, CLogUtils* pLog, std::vector<SetupStep> steps)
+{
+    if (m_running)
+        return false;
+    Wait();  // reap the previous worker, if any
+
+    int total = static_cast<int>(steps.size());
+    m_steps = std::move(steps);
+    m_dependents.assign(total, std::vector<int>());
+    m_waitingOn.assign(total, 0);
+    m_results.assign(total, StepResult{ STEP_PENDING, 0, 0 });
+    m_inPlace.assign(total, 0);
+    m_corrected.assign(total, 0);
+    m_ready.clear();
+    for (int i = 0; i < total; i++)
+    {
+        for (int dep : m_steps[i].dependsOn)
+        {
+            // Only earlier steps may be named, so the graph can never contain a cycle
+            ASSERT(dep >= 0 && dep < i);
+            if (dep < 0 || dep >= i)
+                continue;
+            m_dependents[dep].push_back(i);
+            m_waitingOn[i]++;
+        }
+        if (m_waitingOn[i] == 0)
+            m_ready.insert(i);
+    }
+    m_finished = 0;
+    m_allOk = true;
+
+    m_observer = observer;
+    m_pLog = pLog;
+    m_cancelled = false;
+    m_runStartTick = GetTickCount64();
+    m_runEndTick = 0;
+    ResetEvent(m_hCancelEvent);
+
+    // Child processes started through CWinUtils watch this event
+    CWinUtils::SetCancelEvent(m_hCancelEvent);
+
+    m_running = true;
+    try
+    {
+        m_thread = std::thread(&CStepRunner::Run, this);
+    }
+    catch (const std::system_error&)
+    {
+        m_running = false;
+        CWinUtils::SetCancelEvent(nullptr);
+        return false;
+    }
+    return true;
+}
+
+void CStepRunner::Cancel()
+{
+    if (!m_running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelled = true;
+    }
+    SetEvent(m_hCancelEvent);
+    m_wakeWorkers.notify_all();
+}
+
+void CStepRunner::Wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool CStepRunner::AllSucceeded() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allOk;
+}
+
+int CStepRunner::GetFinishedSteps() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_finished;
+}
+
+StepResult CStepRunner::GetStepResult(int step) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (step < 1 || step > static_cast<int>(m_results.size()))
+        return StepResult{ STEP_PENDING, 0, 0 };
+    return m_results[step - 1];
+}
+
+CString CStepRunner::GetStepTitle(int step) const
+{
+    if (step < 1 || step > static_cast<int>(m_steps.size()))
+        return CString();
+    return m_steps[step - 1].title;
+}
+
+double CStepRunner::GetElapsedSeconds() const
+{
+    ULONGLONG end = m_running ? GetTickCount64() : m_runEndTick.load();
+    return (end - m_runStartTick) / 1000.0;
+}
+
+CString CStepRunner::FormatProgress(LPCTSTR operation) const
+{
+    CString text;
+    if (m_steps.empty())
+        return text;
+
+    if (!m_running)
+    {
+        text.Format(_T("%s %s after %.1f s"), operation,
+                    m_cancelled ? _T("stopped") : _T("finished"), GetElapsedSeconds());
+        return text;
+    }
+
+    // Oldest running step first, then how many others run alongside it
+    ULONGLONG now = GetTickCount64();
+    int finished = 0, running = 0, oldest = -1;
+    ULONGLONG oldestStart = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished = m_finished;
+        for (int i = 0; i < static_cast<int>(m_results.size()); i++)
+        {
+            if (m_results[i].state != STEP_RUNNING)
+                continue;
+            if (oldest < 0 || m_results[i].startTick < oldestStart)
+            {
+                oldest = i;
+                oldestStart = m_results[i].startTick;
+            }
+            running++;
+        }
+    }
+
+    text.Format(_T("%s: %d/%d done"), operation, finished, GetTotalSteps());
+    if (oldest >= 0)
+    {
+        CString current;
+        current.Format(_T(" - %s (%.1f s)"), (LPCTSTR)m_steps[oldest].title,
+                       (now - oldestStart) / 1000.0);
+        text += current;
+        if (running > 1)
+        {
+            current.Format(_T(" +%d more"), running - 1);
+            text += current;
+        }
+    }
+    CString elapsed;
+    elapsed.Format(_T(" - %.1f s"), GetElapsedSeconds());
+    return text + elapsed;
+}
+
+void CStepRunner::Run()
+{
+    int total = static_cast<int>(m_steps.size());
+    int poolSize = min(total, m_maxParallel);
+
+    // The pool runs the isInPlace checks first, then the steps
+    m_checks.clear();
+    for (int i = 0; i < total; i++)
+    {
+        if (m_steps[i].isInPlace)
+            m_checks.push_back(i);
+    }
+    m_nextCheck = 0;
+    m_checkersLeft = poolSize;
+    m_checksDone = false;
+    m_checkStartTick = GetTickCount64();
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < poolSize; i++)
+        pool.emplace_back(&CStepRunner::PoolWorker, this);
+    for (std::thread& t : pool)
+        t.join();
+
+    m_runEndTick = GetTickCount64();
+
+    if (m_cancelled)
+    {
+        m_pLog->LogWarning(_T("Cancelled by user."));
+    }
+    else if (total > 0)
+    {
+        // Wall clock vs. summed step time shows what running in parallel saved
+        ULONGLONG summed = 0;
+        for (const StepResult& r : m_results)
+            summed += r.endTick - r.startTick;
+        CString msg;
+        msg.Format(_T("%d steps finished in %.1f s (%.1f s of step time)."),
+                   total, (m_runEndTick - m_runStartTick) / 1000.0, summed / 1000.0);
+        m_pLog->LogInfo(msg);
+
+        // What a re-run actually changed
+        CString corrected;
+        bool anyChecks = false;
+        for (int i = 0; i < total; i++)
+        {
+            anyChecks = anyChecks || m_steps[i].isInPlace;
+            if (m_corrected[i])
+                corrected += (corrected.IsEmpty() ? _T("") : _T("; ")) + CString(m_steps[i].title).TrimRight(_T("."));
+        }
+        if (anyChecks)
+            m_pLog->LogInfo(corrected.IsEmpty() ? CString(_T("Nothing had drifted.")) : _T("Corrected: ") + corrected);
+    }
+
+    CWinUtils::SetCancelEvent(nullptr);
+    m_running = false;
+    if (m_observer.onComplete)
+        m_observer.onComplete(m_allOk, m_cancelled);
+}
+
+void CStepRunner::CheckInPlace()
+{
+    // The checks only read state, so every pool thread takes them in turn
+    for (size_t k; !m_cancelled && (k = m_nextCheck++) < m_checks.size(); )
+    {
+        int index = m_checks[k];
+        bool inPlace = false;
+        try
+        {
+            inPlace = m_steps[index].isInPlace();
+        }
+        catch (CException* e)
+        {
+            e->Delete();    // a check that cannot tell counts as drifted
+        }
+        catch (...)
+        {
+        }
+        m_inPlace[index] = inPlace ? 1 : 0;    // one writer per element
+    }
+
+    // No step starts before every check has answered; the last thread to
+    // finish its checks reports them and releases the others
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (--m_checkersLeft > 0)
+        {
+            m_wakeWorkers.wait(lock, [this] { return m_checksDone; });
+            return;
+        }
+    }
+
+    if (!m_checks.empty())
+    {
+        int inPlace = 0;
+        for (int index : m_checks)
+            inPlace += m_inPlace[index];
+        CString msg;
+        msg.Format(_T("State check: %d of %d checked steps already in place (%.2f s)."),
+                   inPlace, static_cast<int>(m_checks.size()), (GetTickCount64() - m_checkStartTick) / 1000.0);
+        m_pLog->LogInfo(msg);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_checksDone = true;
+    }
+    m_wakeWorkers.notify_all();
+}
+
+void CStepRunner::PoolWorker()
+{
+    // Firewall and WMI helpers use COM on this thread
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+
+    CheckInPlace();
+
+    int total = static_cast<int>(m_steps.size());
+    for (;;)
+    {
+        int index = -1;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeWorkers.wait(lock, [this, total] {
+                return m_cancelled || !m_ready.empty() || m_finished == total;
+            });
+            if (m_cancelled || m_ready.empty())
+                break;
+            index = *m_ready.begin();
+            m_ready.erase(m_ready.begin());
+            m_results[index].state = STEP_RUNNING;
+            m_results[index].startTick = GetTickCount64();
+        }
+
+        RunStep(index);
+    }
+
+    if (SUCCEEDED(hr))
+        CoUninitialize();
+}
+
+void CStepRunner::RunStep(int index)
+{
+    const SetupStep& step = m_steps[index];
+    int number = index + 1;
+    int total = static_cast<int>(m_steps.size());
+
+    if (m_observer.onProgress)
+        m_observer.onProgress(number, STEP_RUNNING);
+    m_pLog->LogStep(number, total, step.title);
+
+    bool skip = m_inPlace[index] != 0;
+    if (skip)
+    {
+        // Redo it anyway if something it builds on was just changed
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int dep : step.dependsOn)
+            skip = skip && !m_corrected[dep];
+    }
+    if (skip)
+    {
+        m_pLog->LogInfo(_T("Already in place, skipped."));
+        FinishStep(index, true, false);
+        return;
+    }
+
+    // Everything the step logs is attributed to it, whatever runs alongside
+    CLogUtils::SetThreadStep(number, total);
+    CLogSpan span(m_pLog, step.title, number, total);
+
+    bool ok = false;
+    try
+    {
+        ok = step.run();
+    }
+    catch (CException* e)
+    {
+        TCHAR msg[512] = {};
+        e->GetErrorMessage(msg, _countof(msg));
+        e->Delete();
+        m_pLog->LogError(CString(_T("Unexpected error: ")) + msg);
+    }
+    catch (const std::exception& e)
+    {
+        // An exception must not end the pool thread: the run would never complete
+        m_pLog->LogError(CString(_T("Unexpected error: ")) + CString(e.what()));
+    }
+    catch (...)
+    {
+        m_pLog->LogError(_T("Unexpected error."));
+    }
+
+    span.End(ok ? "ok" : (m_cancelled ? "cancelled" : "failed"));
+    CLogUtils::SetThreadStep(0, 0);
+    FinishStep(index, ok, true);
+}
+
+void CStepRunner::FinishStep(int index, bool ok, bool ran)
+{
+    const SetupStep& step = m_steps[index];
+    int number = index + 1;
+    int total = static_cast<int>(m_steps.size());
+
+    ULONGLONG endTick = GetTickCount64();
+    double seconds = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        StepResult& result = m_results[index];
+        result.state = ok ? STEP_SUCCEEDED : STEP_FAILED;
+        result.endTick = endTick;
+        seconds = (endTick - result.startTick) / 1000.0;
+        if (!ok && step.affectsResult)
+            m_allOk = false;
+        if (ran && ok && step.isInPlace)
+            m_corrected[index] = 1;
+
+        // A failed step still releases its dependents; the sequential
+        // runner also carried on after a failure and reported it at the end.
+        for (int dependent : m_dependents[index])
+        {
+            if (--m_waitingOn[dependent] == 0)
+                m_ready.insert(dependent);
+        }
+        m_finished++;
+    }
+    m_wakeWorkers.notify_all();
+
+    CString msg;
+    msg.Format(_T("[%d/%d] %s in %.2f s"), number, total,
+               !ran ? _T("skipped") : (ok ? _T("finished") : _T("failed")), seconds);
+    m_pLog->LogInfo(msg);
+    if (m_observer.onProgress)
+        m_observer.onProgress(number, ok ? STEP_SUCCEEDED : STEP_FAILED);
+}
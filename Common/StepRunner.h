@@ -0,0 +1,135 @@
+#pragma once
+// StepRunner.h - Runs a setup/restore step graph on a small worker-thread pool
+
+#include <afxwin.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "LogUtils.h"
+
+// Posted to the notify window while a run is in progress
+#define WM_STEP_PROGRESS    (WM_APP + 1)   // wParam = 1-based step number, lParam = StepState
+#define WM_STEP_COMPLETE    (WM_APP + 2)   // wParam = 1 if all steps succeeded, lParam = 1 if cancelled
+
+enum StepState
+{
+    STEP_PENDING,
+    STEP_RUNNING,
+    STEP_SUCCEEDED,
+    STEP_FAILED
+};
+
+struct SetupStep
+{
+    CString title;                  // logged as "[n/total] title", n = position in the table
+    std::function<bool()> run;      // returns false when the step failed
+    bool affectsResult;             // informational steps never fail the run
+    std::vector<int> dependsOn;     // 0-based indices of earlier steps that must finish first
+    std::vector<int> undoes;        // restore steps: 0-based setup steps this reverts (journal)
+    std::function<bool()> isInPlace;    // optional cheap check: true = already in the desired state, skip
+};
+
+// Run progress for code without a window (headless runs, tests). Called on
+// the runner's threads; onComplete is the last call of a run and must not
+// call Start or Wait.
+struct StepObserver
+{
+    std::function<void(int step, StepState state)>  onProgress;    // 1-based step
+    std::function<void(bool allOk, bool cancelled)> onComplete;
+};
+
+// Per-step outcome, filled in as the run progresses
+struct StepResult
+{
+    StepState state;
+    ULONGLONG startTick;
+    ULONGLONG endTick;
+};
+
+class CStepRunner
+{
+public:
+    static const int MAX_PARALLEL_STEPS = 4;
+
+    CStepRunner();
+    ~CStepRunner();
+
+    // Run the steps on a worker pool, starting each one once the steps it
+    // depends on have finished (a failed dependency does not block it).
+    // First the pool runs every isInPlace check; a step whose check passed
+    // is skipped unless one of its dependencies had to be corrected.
+    // Logs each step through pLog and reports progress to observer.
+    // Returns false if a run is already in progress.
+    bool Start(const StepObserver& observer, CLogUtils* pLog, std::vector<SetupStep> steps);
+
+    // Same, posting WM_STEP_PROGRESS / WM_STEP_COMPLETE to hNotify; with no
+    // window (headless run) the caller uses Wait instead.
+    bool Start(HWND hNotify, CLogUtils* pLog, std::vector<SetupStep> steps);
+
+    // Worker threads for the following runs (default MAX_PARALLEL_STEPS)
+    void SetMaxParallel(int count) { m_maxParallel = max(count, 1); }
+
+    // Start no further steps and terminate child processes the running ones wait on
+    void Cancel();
+
+    // Block until the worker threads have exited
+    void Wait();
+
+    bool IsRunning() const { return m_running; }
+    bool IsCancelled() const { return m_cancelled; }
+    bool AllSucceeded() const;                    // no step that affects the result failed
+
+    // Progress and live timings (safe to call from the UI thread)
+    int        GetTotalSteps() const { return static_cast<int>(m_steps.size()); }
+    int        GetFinishedSteps() const;
+    StepResult GetStepResult(int step) const;     // 1-based
+    CString    GetStepTitle(int step) const;      // 1-based
+    double     GetElapsedSeconds() const;
+    // e.g. "Setup: 4/12 done - Creating network share... (1.2 s) +1 more - 5.3 s"
+    CString    FormatProgress(LPCTSTR operation) const;
+
+    // Dependency list for a step that must run after every earlier step
+    static std::vector<int> AllBefore(int index);
+
+private:
+    void Run();
+    void CheckInPlace();
+    void PoolWorker();
+    void RunStep(int index);
+    void FinishStep(int index, bool ok, bool ran);
+
+    std::vector<SetupStep>        m_steps;
+    std::vector<std::vector<int>> m_dependents;   // reverse edges of SetupStep::dependsOn
+    StepObserver m_observer;
+    CLogUtils*   m_pLog;
+    int          m_maxParallel;
+    std::thread  m_thread;
+    HANDLE       m_hCancelEvent;
+
+    // Scheduler state, guarded by m_mutex
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_wakeWorkers;
+    std::set<int>           m_ready;              // runnable steps; lowest index starts first
+    std::vector<int>        m_waitingOn;          // unfinished dependencies per step
+    std::vector<StepResult> m_results;
+    std::vector<char>       m_inPlace;            // isInPlace passed before the run
+    std::vector<char>       m_corrected;          // had a check that failed, then ran and succeeded
+    int                     m_checkersLeft;       // pool threads still running checks
+    bool                    m_checksDone;         // every check answered: steps may start
+    int                     m_finished;
+    bool                    m_allOk;
+
+    // isInPlace checks of the current run; set before the pool starts
+    std::vector<int>       m_checks;
+    std::atomic<size_t>    m_nextCheck;
+    ULONGLONG              m_checkStartTick;
+
+    std::atomic<bool>      m_running;
+    std::atomic<bool>      m_cancelled;
+    std::atomic<ULONGLONG> m_runStartTick;
+    std::atomic<ULONGLONG> m_runEndTick;
+};
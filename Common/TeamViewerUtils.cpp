@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "TeamViewerUtils.h"
-#include "WinUtils.h"
+#include "AdapterInventory.h"
+#include "DebuggerLocator.h"
 
 bool CTeamViewerUtils::IsTeamViewerInstalled()
 {
@@ -36,37 +37,21 @@ bool CTeamViewerUtils::IsTeamViewerInstalled()
 
 bool CTeamViewerUtils::IsVPNDriverInstalled()
 {
-    // Check if a TeamViewer VPN network adapter exists
-    AdapterInfo vpn = CWinUtils::FindTeamViewerVPNAdapter();
-    if (vpn.interfaceIndex >= 0)
-        return true;
-
-    // Also check via PowerShell for the adapter even if disconnected
-    CString result = CWinUtils::RunPowerShellCommand(
-        _T("Get-NetAdapter -Name '*TeamViewer*' -ErrorAction SilentlyContinue | Select-Object -ExpandProperty Name"));
-    result.Trim();
-    if (!result.IsEmpty())
-        return true;
-
-    // Check for the VPN adapter in Device Manager
-    result = CWinUtils::RunPowerShellCommand(
-        _T("Get-WmiObject Win32_NetworkAdapter | Where-Object { $_.Name -like '*TeamViewer*' } | Select-Object -ExpandProperty Name"));
-    result.Trim();
-    return !result.IsEmpty();
+    // The inventory lists disconnected adapters too, so an installed but
+    // unconnected VPN driver is found without asking PowerShell or WMI
+    auto snapshot = CAdapterInventory::Instance().GetSnapshot();
+    return CAdapterInventory::HasTeamViewerAdapter(snapshot->adapters);
 }
 
 CString CTeamViewerUtils::GetVPNIPAddress()
 {
-    AdapterInfo vpn = CWinUtils::FindTeamViewerVPNAdapter();
+    auto snapshot = CAdapterInventory::Instance().GetSnapshot();
+    AdapterInfo vpn = CAdapterInventory::FindTeamViewerVPN(snapshot->adapters);
     if (vpn.interfaceIndex >= 0 && !vpn.ipAddress.IsEmpty())
         return vpn.ipAddress;
 
     // Fallback: look for any adapter on the 7.x.x.x subnet
-    CString result = CWinUtils::RunPowerShellCommand(
-        _T("Get-NetIPAddress -AddressFamily IPv4 | Where-Object { $_.IPAddress -like '7.*' } | ")
-        _T("Select-Object -First 1 -ExpandProperty IPAddress"));
-    result.Trim();
-    return result;
+    return CAdapterInventory::FindIPv4WithPrefix(snapshot->adapters, _T("7."));
 }
 
 CString CTeamViewerUtils::GetTeamViewerPath()
@@ -180,37 +165,9 @@ bool CTeamViewerUtils::IsRemoteDebuggerInstalled()
 
 CString CTeamViewerUtils::GetRemoteDebuggerPath()
 {
-    // Search common paths for msvsmon.exe
-    LPCTSTR searchPaths[] = {
-        // VS 2026 (hypothetical)
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2026\\Enterprise\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2026\\Professional\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2026\\Community\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        // VS 2022
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2022\\Enterprise\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2022\\Professional\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files\\Microsoft Visual Studio\\2022\\Community\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files (x86)\\Microsoft Visual Studio\\2022\\BuildTools\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        // Standalone Remote Tools
-        _T("C:\\Program Files\\Microsoft Visual Studio 18.0\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-        _T("C:\\Program Files\\Microsoft Visual Studio 17.0\\Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"),
-    };
-
-    for (auto& p : searchPaths)
-    {
-        if (GetFileAttributes(p) != INVALID_FILE_ATTRIBUTES)
-            return CString(p);
-    }
-
-    // Fallback: search with PowerShell
-    CString result = CWinUtils::RunPowerShellCommand(
-        _T("Get-ChildItem -Path '${env:ProgramFiles}' -Filter 'msvsmon.exe' -Recurse -ErrorAction SilentlyContinue | ")
-        _T("Select-Object -First 1 -ExpandProperty FullName"));
-    result.Trim();
-    if (!result.IsEmpty() && GetFileAttributes(result) != INVALID_FILE_ATTRIBUTES)
-        return result;
-
-    return _T("");
+    // Registered installs first, then a bounded walk of Program Files; cached
+    // until an install directory changes
+    return CDebuggerLocator::Find();
 }
 
 void CTeamViewerUtils::OpenRemoteToolsDownloadPage()
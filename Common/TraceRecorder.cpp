@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "TraceRecorder.h"
+#include "JsonEscape.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CTraceRecorder::Event
+{
+    std::atomic<bool> ready;
+    LPCSTR    category;
+    DWORD     threadId;
+    LONGLONG  start;
+    LONGLONG  end;
+    LONGLONG  exitCode;
+    ULONGLONG outputBytes;
+    bool      truncated;        // detail was cut at MAX_DETAIL
+    WCHAR     detail[MAX_DETAIL + 1];
+};
+
+std::atomic<bool>       CTraceRecorder::s_enabled(false);
+std::atomic<size_t>     CTraceRecorder::s_next(0);
+std::atomic<size_t>     CTraceRecorder::s_dropped(0);
+CTraceRecorder::Event*  CTraceRecorder::s_events = nullptr;
+LONGLONG                CTraceRecorder::s_originQpc = 0;
+
+// Only touched when a secret is added and when a trace is written
+static std::mutex           s_secretMutex;
+static std::vector<CString> s_secrets;
+
+// ════════════════════════════════════════════════════════════════
+// Recording
+// ════════════════════════════════════════════════════════════════
+
+void CTraceRecorder::Enable()
+{
+    if (s_enabled.load())
+        return;
+
+    // Never freed: scopes on other threads may still hold the pointer at exit
+    s_events = new Event[CAPACITY]();
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    s_originQpc = now.QuadPart;
+    s_enabled.store(true, std::memory_order_release);
+}
+
+void CTraceRecorder::Reset()
+{
+    if (!s_events)
+        return;
+
+    size_t used = min(s_next.load(), CAPACITY);
+    for (size_t i = 0; i < used; i++)
+        s_events[i].ready.store(false, std::memory_order_relaxed);
+    s_dropped.store(0);
+    s_next.store(0);
+}
+
+void CTraceRecorder::AddSecret(LPCTSTR secret)
+{
+    if (!secret || !*secret)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_secretMutex);
+    for (const CString& known : s_secrets)
+    {
+        if (known == secret)
+            return;
+    }
+    s_secrets.push_back(secret);
+}
+
+void CTraceRecorder::Record(LPCSTR category, LPCTSTR detail, LPCTSTR detail2,
+                            LONGLONG startQpc, LONGLONG endQpc,
+                            LONGLONG exitCode, ULONGLONG outputBytes)
+{
+    if (!s_events)
+        return;
+
+    size_t slot = s_next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= CAPACITY)
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& e = s_events[slot];
+    e.category = category;
+    e.threadId = GetCurrentThreadId();
+    e.start = startQpc;
+    e.end = endQpc;
+    e.exitCode = exitCode;
+    e.outputBytes = outputBytes;
+
+    size_t n = 0;
+    LPCTSTR p = detail;
+    for (; p && *p && n < MAX_DETAIL; p++)
+        e.detail[n++] = *p;
+    bool truncated = p && *p;
+    if (detail2 && *detail2)
+    {
+        if (n < MAX_DETAIL)
+            e.detail[n++] = L' ';
+        for (p = detail2; *p && n < MAX_DETAIL; p++)
+            e.detail[n++] = *p;
+        truncated = truncated || *p;
+    }
+    e.detail[n] = L'\0';
+    e.truncated = truncated;
+
+    e.ready.store(true, std::memory_order_release);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Export
+// ════════════════════════════════════════════════════════════════
+
+static bool IsWordChar(TCHAR ch)
+{
+    return _istalnum(ch) || ch == _T('_');
+}
+
+// Replace the secret where it stands as a token of its own, so a short
+// password does not mangle every word that happens to contain it
+static void RedactToken(CString& text, const CString& secret)
+{
+    int pos = 0;
+    while ((pos = text.Find(secret, pos)) >= 0)
+    {
+        int end = pos + secret.GetLength();
+        bool startsToken = pos == 0 || !IsWordChar(text[pos - 1]) || !IsWordChar(secret[0]);
+        bool endsToken = end >= text.GetLength() || !IsWordChar(text[end]) ||
+                         !IsWordChar(secret[secret.GetLength() - 1]);
+        if (startsToken && endsToken)
+        {
+            text = text.Left(pos) + _T("***") + text.Mid(end);
+            pos += 3;
+        }
+        else
+        {
+            pos = end;
+        }
+    }
+}
+
+// A detail cut at MAX_DETAIL may end in the first characters of a secret,
+// which RedactToken cannot recognise; mask the longest such tail
+static void RedactTrailingPrefix(CString& text, const CString& secret)
+{
+    for (int length = min(secret.GetLength() - 1, text.GetLength()); length > 0; length--)
+    {
+        int pos = text.GetLength() - length;
+        bool startsToken = pos == 0 || !IsWordChar(text[pos - 1]) || !IsWordChar(secret[0]);
+        if (startsToken && text.Mid(pos) == secret.Left(length))
+        {
+            text = text.Left(pos) + _T("***");
+            return;
+        }
+    }
+}
+
+// Slice label: the program or cmdlet, without its directory
+static CString EventName(const CString& detail)
+{
+    CString first = detail;
+    first.TrimLeft(_T("\" "));
+    int stop = first.FindOneOf(_T("\" "));
+    if (stop >= 0)
+        first = first.Left(stop);
+    int slash = first.ReverseFind(_T('\\'));
+    return slash >= 0 ? first.Mid(slash + 1) : first;
+}
+
+bool CTraceRecorder::WriteChromeTrace(LPCTSTR path)
+{
+    if (!s_events)
+        return false;
+
+    std::vector<CString> secrets;
+    {
+        std::lock_guard<std::mutex> lock(s_secretMutex);
+        secrets = s_secrets;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    double usPerTick = 1e6 / frequency.QuadPart;
+    DWORD pid = GetCurrentProcessId();
+
+    std::string json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    size_t used = min(s_next.load(std::memory_order_acquire), CAPACITY);
+    bool first = true;
+    for (size_t i = 0; i < used; i++)
+    {
+        const Event& e = s_events[i];
+        if (!e.ready.load(std::memory_order_acquire))
+            continue;   // still being filled in
+
+        CString detail(e.detail);
+        for (const CString& secret : secrets)
+        {
+            RedactToken(detail, secret);
+            if (e.truncated)
+                RedactTrailingPrefix(detail, secret);
+        }
+        CString name = (strcmp(e.category, "step") == 0) ? detail : EventName(detail);
+
+        char timing[160];
+        sprintf_s(timing, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu",
+                  e.category, (e.start - s_originQpc) * usPerTick, (e.end - e.start) * usPerTick,
+                  pid, e.threadId);
+
+        json += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+        first = false;
+        CJsonEscape::Append(json, name, name.GetLength());
+        json += timing;
+        json += ",\"args\":{\"detail\":\"";
+        CJsonEscape::Append(json, detail, detail.GetLength());
+        json += '"';
+
+        char results[96];
+        if (e.exitCode >= 0)
+        {
+            sprintf_s(results, ",\"exitCode\":%lld", e.exitCode);
+            json += results;
+        }
+        sprintf_s(results, ",\"outputBytes\":%llu}}", e.outputBytes);
+        json += results;
+    }
+
+    char footer[96];
+    sprintf_s(footer, "\n],\"otherData\":{\"droppedEvents\":%llu}}\n",
+              static_cast<ULONGLONG>(s_dropped.load()));
+    json += footer;
+
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, json.data(), static_cast<DWORD>(json.size()), &written, nullptr) &&
+              written == json.size();
+    CloseHandle(hFile);
+    return ok;
+}
+
+CString CTraceRecorder::WriteNextTo(LPCTSTR logFilePath, LPCTSTR operation)
+{
+    CString base(logFilePath);
+    if (!IsEnabled() || base.IsEmpty())
+        return CString();
+
+    int dot = base.ReverseFind(_T('.'));
+    if (dot > base.ReverseFind(_T('\\')))
+        base = base.Left(dot);
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    CString path;
+    path.Format(_T("%s_%s_%02d%02d%02d.trace.json"), (LPCTSTR)base, operation,
+                st.wHour, st.wMinute, st.wSecond);
+    return WriteChromeTrace(path) ? path : CString();
+}
@@ -0,0 +1,97 @@
+#pragma once
+// TraceRecorder.h - Timeline of external calls, exported as a Chrome trace
+
+#include <afxwin.h>
+#include <atomic>
+
+// Records one complete event per child process, PowerShell command, COM
+// operation and setup step into a fixed array of slots. A writer claims a
+// slot with one atomic increment and publishes it with a release store, so
+// recording never takes a lock. While disabled (the default) a scope costs
+// one relaxed load. Events past the capacity are counted and dropped.
+//
+// The export is Chrome trace-event JSON ("ph":"X" complete events), which
+// chrome://tracing and ui.perfetto.dev open directly. Registered secrets are
+// replaced by "***" in the exported text, as is the start of one that a
+// truncated detail ends with.
+class CTraceRecorder
+{
+public:
+    static const size_t CAPACITY = 4096;
+    static const size_t MAX_DETAIL = 256;       // characters kept of a command line
+
+    // Allocate the slots and start recording (e.g. for the /trace switch)
+    static void Enable();
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Forget recorded events; call between runs
+    static void Reset();
+
+    // Text that must never reach the trace file (passwords entered in the dialog)
+    static void AddSecret(LPCTSTR secret);
+
+    // detail (+ " " + detail2) is truncated to MAX_DETAIL; exitCode < 0 = none
+    static void Record(LPCSTR category, LPCTSTR detail, LPCTSTR detail2,
+                       LONGLONG startQpc, LONGLONG endQpc,
+                       LONGLONG exitCode, ULONGLONG outputBytes);
+
+    // Write the events as a Chrome trace next to the log file
+    // (<log>_<operation>_HHmmss.trace.json). Returns the path, empty on failure.
+    static CString WriteNextTo(LPCTSTR logFilePath, LPCTSTR operation);
+
+    static bool WriteChromeTrace(LPCTSTR path);
+
+private:
+    struct Event;
+
+    static std::atomic<bool>   s_enabled;
+    static std::atomic<size_t> s_next;          // next free slot
+    static std::atomic<size_t> s_dropped;
+    static Event*              s_events;
+    static LONGLONG            s_originQpc;
+};
+
+// Times the enclosing block and records it when the scope ends. The detail
+// strings are read at that point, so they must outlive the scope.
+class CTraceScope
+{
+public:
+    CTraceScope(LPCSTR category, LPCTSTR detail, LPCTSTR detail2 = nullptr)
+        : m_active(CTraceRecorder::IsEnabled())
+        , m_category(category)
+        , m_detail(detail)
+        , m_detail2(detail2)
+        , m_exitCode(-1)
+        , m_outputBytes(0)
+        , m_start()
+    {
+        if (m_active)
+            QueryPerformanceCounter(&m_start);
+    }
+
+    ~CTraceScope()
+    {
+        if (m_active)
+        {
+            LARGE_INTEGER end;
+            QueryPerformanceCounter(&end);
+            CTraceRecorder::Record(m_category, m_detail, m_detail2, m_start.QuadPart, end.QuadPart,
+                                   m_exitCode, m_outputBytes);
+        }
+    }
+
+    void SetExitCode(LONGLONG exitCode)      { m_exitCode = exitCode; }
+    void SetOutputBytes(ULONGLONG bytes)     { m_outputBytes = bytes; }
+
+private:
+    CTraceScope(const CTraceScope&) = delete;
+    CTraceScope& operator=(const CTraceScope&) = delete;
+
+    bool          m_active;
+    LPCSTR        m_category;
+    LPCTSTR       m_detail;
+    LPCTSTR       m_detail2;
+    LONGLONG      m_exitCode;
+    ULONGLONG     m_outputBytes;
+    LARGE_INTEGER m_start;
+};
@@ -1,27 +1,29 @@
 #include "pch.h"
 #include "WinUtils.h"
+#include "PowerShellHost.h"
+#include "ProcessRunner.h"
+#include "FirewallSession.h"
+#include "AdapterInventory.h"
+#include "ConnectivityProbe.h"
+#include "LogSpan.h"
+#include "TraceRecorder.h"
 
 #include <lm.h>          // NetUserAdd, NetShareAdd, etc.
 #include <lmaccess.h>
 #include <lmshare.h>
 #include <lmerr.h>
-#include <netfw.h>       // INetFwPolicy2
 #include <comdef.h>
 #include <Winnetwk.h>    // WNetAddConnection2
-#include <iphlpapi.h>    // GetAdaptersAddresses
-#include <icmpapi.h>     // IcmpSendEcho
-#include <WinSock2.h>
-#include <WS2tcpip.h>
 #include <AclAPI.h>      // SetEntriesInAcl
 #include <sddl.h>
+#include <taskschd.h>     // ITaskService
 
 #pragma comment(lib, "netapi32.lib")
 #pragma comment(lib, "mpr.lib")
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "oleaut32.lib")
-#pragma comment(lib, "iphlpapi.lib")
-#pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "advapi32.lib")
+#pragma comment(lib, "taskschd.lib")
 
 // ════════════════════════════════════════════════════════════════
 // Admin Check
@@ -152,108 +154,27 @@ bool CWinUtils::RemoveUserFromGroup(LPCTSTR userName, LPCTSTR groupName)
 // Firewall Management (COM)
 // ════════════════════════════════════════════════════════════════
 
+// One-off helpers; a step that checks and then changes rules should hold a
+// CFirewallSession for both so the policy is opened and enumerated once.
+
 bool CWinUtils::FirewallRuleExists(LPCTSTR ruleName)
 {
-    bool exists = false;
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
-    bool comInit = SUCCEEDED(hr) || hr == S_FALSE;
-
-    INetFwPolicy2* pPolicy = nullptr;
-    hr = CoCreateInstance(__uuidof(NetFwPolicy2), nullptr, CLSCTX_INPROC_SERVER,
-                          __uuidof(INetFwPolicy2), reinterpret_cast<void**>(&pPolicy));
-    if (SUCCEEDED(hr) && pPolicy)
-    {
-        INetFwRules* pRules = nullptr;
-        if (SUCCEEDED(pPolicy->get_Rules(&pRules)) && pRules)
-        {
-            INetFwRule* pRule = nullptr;
-            _bstr_t bstrName(ruleName);
-            hr = pRules->Item(bstrName, &pRule);
-            if (SUCCEEDED(hr) && pRule)
-            {
-                exists = true;
-                pRule->Release();
-            }
-            pRules->Release();
-        }
-        pPolicy->Release();
-    }
-
-    if (comInit) CoUninitialize();
-    return exists;
+    CFirewallSession session;
+    return session.RuleExists(ruleName);
 }
 
 bool CWinUtils::CreateFirewallRule(LPCTSTR ruleName, LPCTSTR description,
                                     LPCTSTR ports, LPCTSTR remoteAddresses)
 {
-    // First delete any existing rule with the same name
-    DeleteFirewallRule(ruleName);
-
-    bool success = false;
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
-    bool comInit = SUCCEEDED(hr) || hr == S_FALSE;
-
-    INetFwPolicy2* pPolicy = nullptr;
-    hr = CoCreateInstance(__uuidof(NetFwPolicy2), nullptr, CLSCTX_INPROC_SERVER,
-                          __uuidof(INetFwPolicy2), reinterpret_cast<void**>(&pPolicy));
-    if (SUCCEEDED(hr) && pPolicy)
-    {
-        INetFwRules* pRules = nullptr;
-        if (SUCCEEDED(pPolicy->get_Rules(&pRules)) && pRules)
-        {
-            INetFwRule* pRule = nullptr;
-            hr = CoCreateInstance(__uuidof(NetFwRule), nullptr, CLSCTX_INPROC_SERVER,
-                                  __uuidof(INetFwRule), reinterpret_cast<void**>(&pRule));
-            if (SUCCEEDED(hr) && pRule)
-            {
-                pRule->put_Name(_bstr_t(ruleName));
-                pRule->put_Description(_bstr_t(description));
-                pRule->put_Protocol(NET_FW_IP_PROTOCOL_TCP);
-                pRule->put_LocalPorts(_bstr_t(ports));
-                pRule->put_Direction(NET_FW_RULE_DIR_IN);
-                pRule->put_Action(NET_FW_ACTION_ALLOW);
-                pRule->put_Profiles(NET_FW_PROFILE2_ALL);
-                pRule->put_Enabled(VARIANT_TRUE);
-
-                if (remoteAddresses && _tcslen(remoteAddresses) > 0)
-                    pRule->put_RemoteAddresses(_bstr_t(remoteAddresses));
-
-                hr = pRules->Add(pRule);
-                success = SUCCEEDED(hr);
-                pRule->Release();
-            }
-            pRules->Release();
-        }
-        pPolicy->Release();
-    }
-
-    if (comInit) CoUninitialize();
-    return success;
+    CFirewallSession session;
+    return session.ApplyRule(
+        CFirewallSession::InboundTcpRule(ruleName, description, ports, remoteAddresses));
 }
 
 bool CWinUtils::DeleteFirewallRule(LPCTSTR ruleName)
 {
-    bool success = false;
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
-    bool comInit = SUCCEEDED(hr) || hr == S_FALSE;
-
-    INetFwPolicy2* pPolicy = nullptr;
-    hr = CoCreateInstance(__uuidof(NetFwPolicy2), nullptr, CLSCTX_INPROC_SERVER,
-                          __uuidof(INetFwPolicy2), reinterpret_cast<void**>(&pPolicy));
-    if (SUCCEEDED(hr) && pPolicy)
-    {
-        INetFwRules* pRules = nullptr;
-        if (SUCCEEDED(pPolicy->get_Rules(&pRules)) && pRules)
-        {
-            hr = pRules->Remove(_bstr_t(ruleName));
-            success = SUCCEEDED(hr);
-            pRules->Release();
-        }
-        pPolicy->Release();
-    }
-
-    if (comInit) CoUninitialize();
-    return success;
+    CFirewallSession session;
+    return session.RemoveRule(ruleName);
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -262,35 +183,20 @@ bool CWinUtils::DeleteFirewallRule(LPCTSTR ruleName)
 
 bool CWinUtils::EnableFirewallRuleGroup(LPCTSTR groupName, bool enable)
 {
-    // Use PowerShell to enable/disable firewall rule groups
-    CString cmd;
-    if (enable)
-    {
-        cmd.Format(_T("Get-NetFirewallRule -DisplayGroup '%s' | ")
-                   _T("Where-Object { $_.Profile -match 'Private|Public' } | ")
-                   _T("Set-NetFirewallRule -Enabled True"),
-                   groupName);
-    }
-    else
-    {
-        cmd.Format(_T("Get-NetFirewallRule -DisplayGroup '%s' | ")
-                   _T("Where-Object { $_.Profile -match 'Private|Public' } | ")
-                   _T("Set-NetFirewallRule -Enabled False"),
-                   groupName);
-    }
-    CString result = RunPowerShellCommand(cmd);
-    return true;  // PowerShell doesn't return a clean error code for this
+    CFirewallSession session;
+    return session.EnableRuleGroup(groupName, enable);
+}
+
+bool CWinUtils::EnableFirewallRuleGroups(const std::vector<CString>& groupNames, bool enable)
+{
+    CFirewallSession session;
+    return session.EnableRuleGroups(groupNames, enable);
 }
 
 bool CWinUtils::IsFirewallRuleGroupEnabled(LPCTSTR groupName)
 {
-    CString cmd;
-    cmd.Format(_T("(Get-NetFirewallRule -DisplayGroup '%s' | ")
-               _T("Where-Object { $_.Profile -match 'Private' -and $_.Enabled -eq 'True' }).Count"),
-               groupName);
-    CString result = RunPowerShellCommand(cmd);
-    result.Trim();
-    return (_ttoi(result) > 0);
+    CFirewallSession session;
+    return session.IsRuleGroupEnabled(groupName);
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -299,87 +205,21 @@ bool CWinUtils::IsFirewallRuleGroupEnabled(LPCTSTR groupName)
 
 std::vector<AdapterInfo> CWinUtils::GetNetworkAdapters()
 {
+    // Adapters with a connection profile, as Get-NetConnectionProfile listed them
     std::vector<AdapterInfo> adapters;
-
-    // Use PowerShell to get adapter info with network category
-    CString cmd(_T("Get-NetConnectionProfile | ForEach-Object { ")
-                _T("$ip = (Get-NetIPAddress -InterfaceIndex $_.InterfaceIndex -AddressFamily IPv4 -ErrorAction SilentlyContinue | Select-Object -First 1).IPAddress; ")
-                _T("\"$($_.InterfaceIndex)|$($_.InterfaceAlias)|$($_.Name)|$($_.NetworkCategory)|$ip\" }"));
-    CString result = RunPowerShellCommand(cmd);
-
-    int pos = 0;
-    CString line = result.Tokenize(_T("\r\n"), pos);
-    while (!line.IsEmpty())
+    auto snapshot = CAdapterInventory::Instance().GetSnapshot();
+    for (const auto& a : snapshot->adapters)
     {
-        line.Trim();
-        if (!line.IsEmpty())
-        {
-            // Parse: index|alias|name|category|ip
-            int p = 0;
-            CString idx = line.Tokenize(_T("|"), p);
-            CString alias = line.Tokenize(_T("|"), p);
-            CString name = line.Tokenize(_T("|"), p);
-            CString category = line.Tokenize(_T("|"), p);
-            CString ip = line.Tokenize(_T("|"), p);
-
-            if (!idx.IsEmpty())
-            {
-                AdapterInfo ai;
-                ai.interfaceIndex = _ttoi(idx);
-                ai.alias = alias;
-                ai.name = name;
-                ai.networkCategory = category;
-                ai.ipAddress = ip;
-                adapters.push_back(ai);
-            }
-        }
-        line = result.Tokenize(_T("\r\n"), pos);
+        if (!a.networkCategory.IsEmpty())
+            adapters.push_back(a);
     }
-
     return adapters;
 }
 
 AdapterInfo CWinUtils::FindTeamViewerVPNAdapter()
 {
-    AdapterInfo vpnAdapter = {};
-    vpnAdapter.interfaceIndex = -1;
-
-    auto adapters = GetNetworkAdapters();
-    for (const auto& a : adapters)
-    {
-        // TeamViewer VPN adapters typically show as "Local Area Connection" with
-        // LocalNetwork connectivity, or have "TeamViewer" in the name
-        CString aliasLower = a.alias;
-        aliasLower.MakeLower();
-        CString nameLower = a.name;
-        nameLower.MakeLower();
-
-        if (aliasLower.Find(_T("teamviewer")) != -1 ||
-            nameLower.Find(_T("teamviewer")) != -1)
-        {
-            vpnAdapter = a;
-            return vpnAdapter;
-        }
-
-        // Also check for VPN-like adapters on the 7.x.x.x subnet
-        if (!a.ipAddress.IsEmpty() && a.ipAddress.Left(2) == _T("7."))
-        {
-            vpnAdapter = a;
-            return vpnAdapter;
-        }
-    }
-
-    // Fallback: look for "Local Area Connection" (common TeamViewer VPN alias)
-    for (const auto& a : adapters)
-    {
-        if (a.alias.Find(_T("Local Area Connection")) != -1)
-        {
-            vpnAdapter = a;
-            return vpnAdapter;
-        }
-    }
-
-    return vpnAdapter;
+    auto snapshot = CAdapterInventory::Instance().GetSnapshot();
+    return CAdapterInventory::FindTeamViewerVPN(snapshot->adapters);
 }
 
 bool CWinUtils::SetNetworkProfilePrivate(int interfaceIndex)
@@ -387,6 +227,8 @@ bool CWinUtils::SetNetworkProfilePrivate(int interfaceIndex)
     CString cmd;
     cmd.Format(_T("Set-NetConnectionProfile -InterfaceIndex %d -NetworkCategory Private"), interfaceIndex);
     RunPowerShellCommand(cmd);
+    // A category change raises no IP helper notification
+    CAdapterInventory::Instance().Invalidate();
     // Verify
     CString cat = GetAdapterNetworkCategory(interfaceIndex);
     return (cat.Find(_T("Private")) != -1);
@@ -394,11 +236,8 @@ bool CWinUtils::SetNetworkProfilePrivate(int interfaceIndex)
 
 CString CWinUtils::GetAdapterNetworkCategory(int interfaceIndex)
 {
-    CString cmd;
-    cmd.Format(_T("(Get-NetConnectionProfile -InterfaceIndex %d).NetworkCategory"), interfaceIndex);
-    CString result = RunPowerShellCommand(cmd);
-    result.Trim();
-    return result;
+    auto snapshot = CAdapterInventory::Instance().GetSnapshot();
+    return CAdapterInventory::FindByIndex(snapshot->adapters, interfaceIndex).networkCategory;
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -434,6 +273,9 @@ bool CWinUtils::CreateSMBShare(LPCTSTR shareName, LPCTSTR path, LPCTSTR userName
 
     if (status == NERR_Success || status == NERR_DuplicateShare)
     {
+        if (!userName)
+            return true;
+
         // Grant share-level permissions to the user via PowerShell
         CString cmd;
         cmd.Format(_T("Grant-SmbShareAccess -Name '%s' -AccountName '%s' -AccessRight Full -Force"),
@@ -451,6 +293,78 @@ bool CWinUtils::DeleteSMBShare(LPCTSTR shareName)
     return (status == NERR_Success || status == NERR_NetNameNotFound);
 }
 
+CString CWinUtils::GetSharePath(LPCTSTR shareName)
+{
+    LPBYTE buf = nullptr;
+    CString path;
+    if (NetShareGetInfo(nullptr, const_cast<LPWSTR>(shareName), 2, &buf) == NERR_Success && buf)
+        path = reinterpret_cast<SHARE_INFO_2*>(buf)->shi2_path;
+    if (buf) NetApiBufferFree(buf);
+    return path;
+}
+
+// SID for an account name. "Everyone" is resolved by its well-known SID, since
+// the display name is localized.
+static bool ResolveAccountSid(LPCTSTR accountName, std::vector<BYTE>& sid)
+{
+    if (_tcsicmp(accountName, _T("Everyone")) == 0)
+    {
+        DWORD size = SECURITY_MAX_SID_SIZE;
+        sid.resize(size);
+        return CreateWellKnownSid(WinWorldSid, nullptr, sid.data(), &size) != FALSE;
+    }
+
+    DWORD sidSize = 0, domainSize = 0;
+    SID_NAME_USE use;
+    LookupAccountName(nullptr, accountName, nullptr, &sidSize, nullptr, &domainSize, &use);
+    if (sidSize == 0)
+        return false;
+    sid.resize(sidSize);
+    std::vector<TCHAR> domain(domainSize + 1);
+    return LookupAccountName(nullptr, accountName, sid.data(), &sidSize, domain.data(), &domainSize, &use) != FALSE;
+}
+
+// True if the DACL has an allow ACE for sid with every bit of mask (and of aceFlags)
+static bool DaclAllows(PACL pDacl, PSID sid, ACCESS_MASK mask, BYTE aceFlags)
+{
+    if (!pDacl)
+        return false;
+    for (DWORD i = 0; i < pDacl->AceCount; i++)
+    {
+        LPVOID pAce = nullptr;
+        if (!GetAce(pDacl, i, &pAce))
+            continue;
+        auto header = static_cast<ACE_HEADER*>(pAce);
+        if (header->AceType != ACCESS_ALLOWED_ACE_TYPE || (header->AceFlags & aceFlags) != aceFlags)
+            continue;
+        auto allowed = static_cast<ACCESS_ALLOWED_ACE*>(pAce);
+        if ((allowed->Mask & mask) == mask && EqualSid(&allowed->SidStart, sid))
+            return true;
+    }
+    return false;
+}
+
+bool CWinUtils::ShareGrantsFullAccess(LPCTSTR shareName, LPCTSTR accountName)
+{
+    std::vector<BYTE> sid;
+    if (!ResolveAccountSid(accountName, sid))
+        return false;
+
+    LPBYTE buf = nullptr;
+    bool granted = false;
+    if (NetShareGetInfo(nullptr, const_cast<LPWSTR>(shareName), 502, &buf) == NERR_Success && buf)
+    {
+        // No descriptor: the share was added without one and has not been granted yet
+        PSECURITY_DESCRIPTOR pSD = reinterpret_cast<SHARE_INFO_502*>(buf)->shi502_security_descriptor;
+        BOOL present = FALSE, defaulted = FALSE;
+        PACL pDacl = nullptr;
+        if (pSD && GetSecurityDescriptorDacl(pSD, &present, &pDacl, &defaulted) && present)
+            granted = DaclAllows(pDacl, sid.data(), 0x1F01FF /* Full */, 0);
+    }
+    if (buf) NetApiBufferFree(buf);
+    return granted;
+}
+
 // ════════════════════════════════════════════════════════════════
 // NTFS Permissions
 // ════════════════════════════════════════════════════════════════
@@ -467,6 +381,25 @@ bool CWinUtils::GrantNTFSPermissions(LPCTSTR path, LPCTSTR userName)
     return (exitCode == 0);
 }
 
+bool CWinUtils::HasNTFSPermissions(LPCTSTR path, LPCTSTR userName)
+{
+    std::vector<BYTE> sid;
+    if (!ResolveAccountSid(userName, sid))
+        return false;
+
+    PACL pDacl = nullptr;
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    if (GetNamedSecurityInfo(path, SE_FILE_OBJECT, DACL_SECURITY_INFORMATION,
+                             nullptr, nullptr, &pDacl, nullptr, &pSD) != ERROR_SUCCESS)
+        return false;
+
+    // icacls "M" = read, write, execute and delete; (OI)(CI) = inherited by files and folders
+    const ACCESS_MASK modify = FILE_GENERIC_READ | FILE_GENERIC_WRITE | FILE_GENERIC_EXECUTE | DELETE;
+    bool granted = DaclAllows(pDacl, sid.data(), modify, OBJECT_INHERIT_ACE | CONTAINER_INHERIT_ACE);
+    LocalFree(pSD);
+    return granted;
+}
+
 bool CWinUtils::RemoveNTFSPermissions(LPCTSTR path, LPCTSTR userName)
 {
     // Use icacls to remove the user's ACE (including inherited entries).
@@ -478,32 +411,15 @@ bool CWinUtils::RemoveNTFSPermissions(LPCTSTR path, LPCTSTR userName)
 
 // ════════════════════════════════════════════════════════════════
 // ── Run a command hidden and wait for it to finish ──
-static DWORD RunHiddenCmd(LPCTSTR commandLine)
+DWORD CWinUtils::RunHiddenCommand(LPCTSTR commandLine, CString* pOutput)
 {
-    return CWinUtils::RunHiddenCommand(commandLine);
-}
-
-DWORD CWinUtils::RunHiddenCommand(LPCTSTR commandLine)
-{
-    CString cmd(commandLine);
-    STARTUPINFO si = { sizeof(si) };
-    si.dwFlags = STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-    PROCESS_INFORMATION pi = {};
-
-    if (CreateProcess(nullptr, cmd.GetBuffer(), nullptr, nullptr, FALSE,
-                      CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
-    {
-        cmd.ReleaseBuffer();
-        WaitForSingleObject(pi.hProcess, 30000);
-        DWORD exitCode = 0;
-        GetExitCodeProcess(pi.hProcess, &exitCode);
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
-        return exitCode;
-    }
-    cmd.ReleaseBuffer();
-    return (DWORD)-1;
+    CTraceScope trace("process", commandLine);
+    ProcessResult result = CProcessRunner::Run(commandLine, 30000, GetCancelEvent());
+    trace.SetExitCode(result.exitCode);
+    trace.SetOutputBytes(result.output.size());
+    if (pOutput)
+        *pOutput = result.Text();
+    return result.status == ProcessStatus::StartFailed ? (DWORD)-1 : result.exitCode;
 }
 
 // ── Enable shared drive mappings between elevated and non-elevated sessions ──
@@ -561,26 +477,27 @@ bool CWinUtils::MapNetworkDrive(TCHAR driveLetter, LPCTSTR uncPath,
     return true;
 }
 
-bool CWinUtils::UnmapNetworkDrive(TCHAR driveLetter)
+bool CWinUtils::UnmapNetworkDrive(TCHAR driveLetter, DWORD* pTaskWaitMs, bool* pTaskDone)
 {
     CString localName;
     localName.Format(_T("%c:"), driveLetter);
 
     DWORD result = WNetCancelConnection2(localName, CONNECT_UPDATE_PROFILE, TRUE);
 
+    if (pTaskWaitMs)
+        *pTaskWaitMs = 0;
+
     // Also unmap in non-elevated (Explorer) session when running as admin.
     // Uses schtasks with /rl limited /it to run in the interactive session.
+    bool taskDone = true;
     if (IsRunningAsAdmin())
     {
         CString cmd;
-        cmd.Format(
-            _T("schtasks.exe /create /tn \"RDS_UnmapDrive\" /tr \"net.exe use %c: /del /y\" /sc once /st 00:00 /f /rl limited /it"),
-            driveLetter);
-        RunHiddenCmd(cmd);
-        RunHiddenCmd(_T("schtasks.exe /run /tn \"RDS_UnmapDrive\""));
-        Sleep(2000);
-        RunHiddenCmd(_T("schtasks.exe /delete /tn \"RDS_UnmapDrive\" /f"));
+        cmd.Format(_T("net.exe use %c: /del /y"), driveLetter);
+        taskDone = RunInteractiveTask(_T("RDS_UnmapDrive"), cmd, 10000, nullptr, pTaskWaitMs);
     }
+    if (pTaskDone)
+        *pTaskDone = taskDone;
 
     return (result == NO_ERROR || result == ERROR_NOT_CONNECTED);
 }
@@ -596,78 +513,72 @@ bool CWinUtils::IsDriveMapped(TCHAR driveLetter)
     return (result == NO_ERROR);
 }
 
-// ════════════════════════════════════════════════════════════════
-// Connectivity
-// ════════════════════════════════════════════════════════════════
-
-bool CWinUtils::PingHost(LPCTSTR ipAddress)
+bool CWinUtils::IsDriveMapped(TCHAR driveLetter, LPCTSTR uncPath)
 {
-    // Convert IP string to address
-    IN_ADDR addr;
-    CStringA ipA(ipAddress);
-    if (inet_pton(AF_INET, ipA, &addr) != 1)
-        return false;
-
-    HANDLE hIcmp = IcmpCreateFile();
-    if (hIcmp == INVALID_HANDLE_VALUE)
-        return false;
-
-    char sendData[] = "PingTest";
-    DWORD replySize = sizeof(ICMP_ECHO_REPLY) + sizeof(sendData) + 8;
-    LPVOID replyBuf = malloc(replySize);
-    if (!replyBuf)
-    {
-        IcmpCloseHandle(hIcmp);
-        return false;
-    }
-
-    DWORD retVal = IcmpSendEcho(hIcmp, addr.S_un.S_addr, sendData,
-                                 sizeof(sendData), nullptr, replyBuf, replySize, 2000);
+    CString localName;
+    localName.Format(_T("%c:"), driveLetter);
 
-    bool success = (retVal > 0);
-    free(replyBuf);
-    IcmpCloseHandle(hIcmp);
-    return success;
+    TCHAR remoteName[MAX_PATH];
+    DWORD bufSize = MAX_PATH;
+    return WNetGetConnection(localName, remoteName, &bufSize) == NO_ERROR &&
+           _tcsicmp(remoteName, uncPath) == 0;
 }
 
-bool CWinUtils::TestTcpPort(LPCTSTR ipAddress, int port, int timeoutMs)
+bool CWinUtils::IsServerConnected(LPCTSTR server)
 {
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
-        return false;
+    CString prefix;
+    prefix.Format(_T("\\\\%s\\"), server);
+    CString exact;
+    exact.Format(_T("\\\\%s"), server);
 
-    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == INVALID_SOCKET)
-    {
-        WSACleanup();
+    HANDLE hEnum = nullptr;
+    if (WNetOpenEnum(RESOURCE_CONNECTED, RESOURCETYPE_ANY, 0, nullptr, &hEnum) != NO_ERROR)
         return false;
-    }
-
-    // Set non-blocking
-    u_long mode = 1;
-    ioctlsocket(sock, FIONBIO, &mode);
 
-    sockaddr_in addr = {};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(static_cast<u_short>(port));
-    CStringA ipA(ipAddress);
-    inet_pton(AF_INET, ipA, &addr.sin_addr);
+    bool found = false;
+    std::vector<BYTE> buffer(16 * 1024);
+    for (;;)
+    {
+        DWORD count = static_cast<DWORD>(-1);
+        DWORD size = static_cast<DWORD>(buffer.size());
+        DWORD result = WNetEnumResource(hEnum, &count, buffer.data(), &size);
+        if (result == ERROR_MORE_DATA && count == 0)
+        {
+            buffer.resize(size);
+            continue;
+        }
+        if (result != NO_ERROR && result != ERROR_MORE_DATA)
+            break;
 
-    connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        auto resources = reinterpret_cast<const NETRESOURCE*>(buffer.data());
+        for (DWORD i = 0; i < count && !found; i++)
+        {
+            CString remote(resources[i].lpRemoteName);
+            found = (remote.CompareNoCase(exact) == 0 ||
+                     remote.Left(prefix.GetLength()).CompareNoCase(prefix) == 0);
+        }
+        if (found)
+            break;
+    }
 
-    fd_set writeSet;
-    FD_ZERO(&writeSet);
-    FD_SET(sock, &writeSet);
+    WNetCloseEnum(hEnum);
+    return found;
+}
 
-    timeval tv;
-    tv.tv_sec = timeoutMs / 1000;
-    tv.tv_usec = (timeoutMs % 1000) * 1000;
+// ════════════════════════════════════════════════════════════════
+// Connectivity
+// ════════════════════════════════════════════════════════════════
 
-    bool connected = (select(0, nullptr, &writeSet, nullptr, &tv) > 0);
+bool CWinUtils::PingHost(LPCTSTR ipAddress)
+{
+    auto results = CConnectivityProbe::Run({ CConnectivityProbe::Icmp(ipAddress) }, 2000);
+    return results[0].status == PROBE_OPEN;
+}
 
-    closesocket(sock);
-    WSACleanup();
-    return connected;
+bool CWinUtils::TestTcpPort(LPCTSTR ipAddress, int port, int timeoutMs)
+{
+    auto results = CConnectivityProbe::Run({ CConnectivityProbe::Tcp(ipAddress, port) }, timeoutMs);
+    return results[0].status == PROBE_OPEN;
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -683,56 +594,199 @@ CString CWinUtils::GetComputerHostName()
     return _T("UNKNOWN");
 }
 
-CString CWinUtils::RunPowerShellCommand(LPCTSTR command)
+// Runner used by RunPowerShellCommand; nullptr means the persistent session host
+static IPowerShellRunner* s_psRunner = nullptr;
+
+void CWinUtils::SetPowerShellRunner(IPowerShellRunner* runner)
 {
-    CString result;
+    s_psRunner = runner;
+}
 
-    // Create a temp file for output
-    TCHAR tempPath[MAX_PATH], tempFile[MAX_PATH];
-    GetTempPath(MAX_PATH, tempPath);
-    GetTempFileName(tempPath, _T("rds"), 0, tempFile);
+// Spawn a dedicated powershell.exe for one command. Only used when the
+// persistent host cannot be started.
+static CString RunPowerShellOneShot(LPCTSTR command)
+{
+    CTraceScope trace("process", _T("powershell.exe -Command"), command);
 
-    // Build PowerShell command line
+    // Output comes back through a pipe; UTF-8 so non-ASCII names survive
     CString cmdLine;
     cmdLine.Format(
-        _T("powershell.exe -NoProfile -ExecutionPolicy Bypass -Command \"& { %s } 2>&1 | Out-File -FilePath '%s' -Encoding ascii\""),
-        command, tempFile);
+        _T("powershell.exe -NoProfile -NonInteractive -ExecutionPolicy Bypass -Command \"")
+        _T("[Console]::OutputEncoding = [Text.Encoding]::UTF8; & { %s } 2>&1 | Out-String -Stream\""),
+        command);
 
-    // Execute
-    STARTUPINFO si = { sizeof(si) };
-    si.dwFlags = STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
+    ProcessResult result = CProcessRunner::Run(cmdLine, 30000, CWinUtils::GetCancelEvent());
+    trace.SetExitCode(result.exitCode);
+    trace.SetOutputBytes(result.output.size());
+    return result.Text(CP_UTF8);
+}
 
-    PROCESS_INFORMATION pi = {};
-    if (CreateProcess(nullptr, cmdLine.GetBuffer(), nullptr, nullptr, FALSE,
-                      CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
+CString CWinUtils::RunPowerShellCommand(LPCTSTR command)
+{
+    IPowerShellRunner* runner = s_psRunner ? s_psRunner : &CPowerShellHost::Instance();
+    CLogSpan::Count(SPAN_POWERSHELL);
+    CTraceScope trace("powershell", command);
+
+    CString result;
+    PowerShellStatus status = runner->Execute(command, result, 30000);
+    trace.SetExitCode(static_cast<LONGLONG>(status));     // 0 = Ok, see PowerShellStatus
+    trace.SetOutputBytes(static_cast<ULONGLONG>(result.GetLength()));
+    if (status == PowerShellStatus::StartFailed && !s_psRunner)
     {
-        cmdLine.ReleaseBuffer();
-        WaitForSingleObject(pi.hProcess, 30000);
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
-
-        // Read output
-        CStdioFile file;
-        if (file.Open(tempFile, CFile::modeRead | CFile::typeText))
+        // Host unavailable (e.g. blocked by policy): fall back to one process per command.
+        // A host that died mid-command may have run part of it, so that is not retried.
+        return RunPowerShellOneShot(command);
+    }
+    if (status != PowerShellStatus::Ok)
+        return CString();
+    return result;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Scheduled Tasks
+// ════════════════════════════════════════════════════════════════
+
+bool CWinUtils::GetScheduledTaskState(LPCTSTR taskName, bool& finished, DWORD& lastResult)
+{
+    finished = false;
+    lastResult = 0;
+
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    bool comInit = SUCCEEDED(hr);
+    bool ok = false;
+
+    ITaskService* pService = nullptr;
+    CLogSpan::Count(SPAN_COM_CALLS);
+    CTraceScope trace("com", _T("ITaskService::GetTask"), taskName);
+    hr = CoCreateInstance(CLSID_TaskScheduler, nullptr, CLSCTX_INPROC_SERVER,
+                          IID_ITaskService, reinterpret_cast<void**>(&pService));
+    if (SUCCEEDED(hr) && pService &&
+        SUCCEEDED(pService->Connect(_variant_t(), _variant_t(), _variant_t(), _variant_t())))
+    {
+        ITaskFolder* pRoot = nullptr;
+        if (SUCCEEDED(pService->GetFolder(_bstr_t(L"\\"), &pRoot)) && pRoot)
         {
-            CString line;
-            while (file.ReadString(line))
+            IRegisteredTask* pTask = nullptr;
+            if (SUCCEEDED(pRoot->GetTask(_bstr_t(taskName), &pTask)) && pTask)
             {
-                if (!result.IsEmpty())
-                    result += _T("\r\n");
-                result += line;
+                TASK_STATE state = TASK_STATE_UNKNOWN;
+                LONG result = 0;
+                if (SUCCEEDED(pTask->get_State(&state)) &&
+                    SUCCEEDED(pTask->get_LastTaskResult(&result)))
+                {
+                    // A freshly created task reports "has not run" until /run has started it
+                    lastResult = static_cast<DWORD>(result);
+                    finished = state != TASK_STATE_RUNNING && state != TASK_STATE_QUEUED &&
+                               result != SCHED_S_TASK_HAS_NOT_RUN && result != SCHED_S_TASK_RUNNING;
+                    ok = true;
+                }
+                pTask->Release();
             }
-            file.Close();
+            pRoot->Release();
         }
     }
-    else
+    if (pService) pService->Release();
+
+    if (comInit) CoUninitialize();
+    return ok;
+}
+
+bool CWinUtils::RunInteractiveTask(LPCTSTR taskName, LPCTSTR commandLine, DWORD timeoutMs,
+                                   DWORD* pExitCode, DWORD* pWaitMs)
+{
+    if (pExitCode) *pExitCode = 0;
+    if (pWaitMs)   *pWaitMs = 0;
+
+    CString cmd;
+    cmd.Format(_T("schtasks.exe /create /tn \"%s\" /tr \"%s\" /sc once /st 00:00 /f /rl limited /it"),
+               taskName, commandLine);
+    if (RunHiddenCommand(cmd) != 0)
+        return false;
+
+    // A task that was not started never finishes: do not wait out the timeout for it
+    cmd.Format(_T("schtasks.exe /run /tn \"%s\""), taskName);
+    bool started = RunHiddenCommand(cmd) == 0;
+
+    bool finished = false;
+    DWORD lastResult = 0;
+    bool done = started && WaitUntil([&] {
+        return GetScheduledTaskState(taskName, finished, lastResult) && finished;
+    }, timeoutMs, pWaitMs);
+
+    cmd.Format(_T("schtasks.exe /delete /tn \"%s\" /f"), taskName);
+    RunHiddenCommand(cmd);
+
+    if (pExitCode) *pExitCode = lastResult;
+    return done;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Cancellation
+// ════════════════════════════════════════════════════════════════
+
+static HANDLE s_hCancelEvent = nullptr;
+
+void CWinUtils::SetCancelEvent(HANDLE hEvent)
+{
+    s_hCancelEvent = hEvent;
+}
+
+HANDLE CWinUtils::GetCancelEvent()
+{
+    return s_hCancelEvent;
+}
+
+bool CWinUtils::IsCancelRequested()
+{
+    HANDLE hEvent = s_hCancelEvent;
+    return hEvent && WaitForSingleObject(hEvent, 0) == WAIT_OBJECT_0;
+}
+
+bool CWinUtils::CancellableSleep(DWORD milliseconds)
+{
+    HANDLE hEvent = s_hCancelEvent;
+    if (!hEvent)
+    {
+        Sleep(milliseconds);
+        return true;
+    }
+    return WaitForSingleObject(hEvent, milliseconds) != WAIT_OBJECT_0;
+}
+
+bool CWinUtils::WaitUntil(const std::function<bool()>& done, DWORD timeoutMs, DWORD* pWaitMs)
+{
+    ULONGLONG start = GetTickCount64();
+    DWORD interval = 10;
+    bool ok = false;
+
+    for (;;)
     {
-        cmdLine.ReleaseBuffer();
+        if (done())
+        {
+            ok = true;
+            break;
+        }
+
+        ULONGLONG elapsed = GetTickCount64() - start;
+        if (elapsed >= timeoutMs)
+            break;
+
+        DWORD remaining = static_cast<DWORD>(timeoutMs - elapsed);
+        if (!CancellableSleep(min(interval, remaining)))
+            break;
+        interval = min(interval * 2, static_cast<DWORD>(250));
     }
 
-    DeleteFile(tempFile);
-    return result;
+    if (pWaitMs)
+        *pWaitMs = static_cast<DWORD>(GetTickCount64() - start);
+    return ok;
+}
+
+bool CWinUtils::RegistryDwordEquals(LPCTSTR subKey, LPCTSTR valueName, DWORD expected)
+{
+    DWORD value = 0, size = sizeof(value);
+    return RegGetValue(HKEY_LOCAL_MACHINE, subKey, valueName, RRF_RT_REG_DWORD,
+                       nullptr, &value, &size) == ERROR_SUCCESS && value == expected;
 }
 
 CString CWinUtils::GetLastErrorMessage(DWORD errorCode)
@@ -2,15 +2,19 @@
 // WinUtils.h - Windows configuration helpers for firewall, user accounts, shares, network
 
 #include <afxwin.h>
+#include <functional>
 #include <vector>
 
+class IPowerShellRunner;
+
 struct AdapterInfo
 {
-    CString name;
-    CString alias;
-    CString ipAddress;
+    CString name;             // connection profile (network) name
+    CString alias;            // interface alias, e.g. "Ethernet 2"
+    CString ipAddress;        // first IPv4 address
     int     interfaceIndex;
-    CString networkCategory;  // "Public", "Private", "DomainAuthenticated"
+    CString networkCategory;  // "Public", "Private", "DomainAuthenticated"; empty = no connection profile
+    CString description;      // driver description, e.g. "TeamViewer VPN Adapter"
 };
 
 class CWinUtils
@@ -28,14 +32,15 @@ public:
     static bool AddUserToGroup(LPCTSTR userName, LPCTSTR groupName);
     static bool RemoveUserFromGroup(LPCTSTR userName, LPCTSTR groupName);
 
-    // ── Firewall Management (COM INetFwPolicy2) ──
+    // ── Firewall Management (one CFirewallSession per call) ──
     static bool FirewallRuleExists(LPCTSTR ruleName);
     static bool CreateFirewallRule(LPCTSTR ruleName, LPCTSTR description,
                                    LPCTSTR ports, LPCTSTR remoteAddresses);
     static bool DeleteFirewallRule(LPCTSTR ruleName);
 
-    // ── Network Discovery & File Sharing ──
+    // ── Network Discovery & File Sharing (Private and Public profiles) ──
     static bool EnableFirewallRuleGroup(LPCTSTR groupName, bool enable);
+    static bool EnableFirewallRuleGroups(const std::vector<CString>& groupNames, bool enable);
     static bool IsFirewallRuleGroupEnabled(LPCTSTR groupName);
 
     // ── Network Adapter / Profile ──
@@ -46,18 +51,27 @@ public:
 
     // ── SMB Share Management (NetAPI32) ──
     static bool ShareExists(LPCTSTR shareName);
-    static bool CreateSMBShare(LPCTSTR shareName, LPCTSTR path, LPCTSTR userName);
+    static bool CreateSMBShare(LPCTSTR shareName, LPCTSTR path, LPCTSTR userName);  // userName nullptr = no share-level grant
     static bool DeleteSMBShare(LPCTSTR shareName);
+    static CString GetSharePath(LPCTSTR shareName);                            // empty = no such share
+    static bool ShareGrantsFullAccess(LPCTSTR shareName, LPCTSTR accountName);  // share-level ACL
 
     // ── NTFS Permissions ──
     static bool GrantNTFSPermissions(LPCTSTR path, LPCTSTR userName);
     static bool RemoveNTFSPermissions(LPCTSTR path, LPCTSTR userName);
+    static bool HasNTFSPermissions(LPCTSTR path, LPCTSTR userName);   // inheritable Modify, as Grant sets it
 
     // ── Drive Mapping (WNet) ──
     static bool MapNetworkDrive(TCHAR driveLetter, LPCTSTR uncPath,
                                 LPCTSTR userName, LPCTSTR password);
-    static bool UnmapNetworkDrive(TCHAR driveLetter);
+    // pTaskWaitMs: time spent waiting for the Explorer-session unmap task (admin only);
+    // pTaskDone: false if that task could not be started or did not finish in time
+    static bool UnmapNetworkDrive(TCHAR driveLetter, DWORD* pTaskWaitMs = nullptr, bool* pTaskDone = nullptr);
     static bool IsDriveMapped(TCHAR driveLetter);
+    // Mapped to uncPath (case-insensitive) in this logon session
+    static bool IsDriveMapped(TCHAR driveLetter, LPCTSTR uncPath);
+    // Any connection (drive or UNC) to \\server in this logon session
+    static bool IsServerConnected(LPCTSTR server);
 
     // ── Connectivity ──
     static bool PingHost(LPCTSTR ipAddress);
@@ -66,6 +80,30 @@ public:
     // ── Utility ──
     static CString GetComputerHostName();
     static CString RunPowerShellCommand(LPCTSTR command);
-    static DWORD   RunHiddenCommand(LPCTSTR commandLine);
+    static void    SetPowerShellRunner(IPowerShellRunner* runner);  // nullptr = session host
+    static DWORD   RunHiddenCommand(LPCTSTR commandLine, CString* pOutput = nullptr);  // -1 = not started
     static CString GetLastErrorMessage(DWORD errorCode = 0);
+    static bool    RegistryDwordEquals(LPCTSTR subKey, LPCTSTR valueName, DWORD expected);  // HKLM
+
+    // ── Scheduled Tasks ──
+    // Runs commandLine once as a limited-rights task in the interactive session
+    // (schtasks /rl limited /it), waits until Task Scheduler reports it finished,
+    // then deletes it. False on timeout, cancel or when the task could not be
+    // created or started; pExitCode gets the task's last result, pWaitMs the time waited.
+    static bool RunInteractiveTask(LPCTSTR taskName, LPCTSTR commandLine, DWORD timeoutMs,
+                                   DWORD* pExitCode = nullptr, DWORD* pWaitMs = nullptr);
+    // False if the task cannot be queried; finished = has run and is not running
+    static bool GetScheduledTaskState(LPCTSTR taskName, bool& finished, DWORD& lastResult);
+
+    // ── Cancellation ──
+    // While set, child processes and waits started here end early when the
+    // event is signalled (used by CStepRunner for the Stop button).
+    static void   SetCancelEvent(HANDLE hEvent);
+    static HANDLE GetCancelEvent();
+    static bool   IsCancelRequested();
+    // Sleep that returns false as soon as cancellation is requested
+    static bool   CancellableSleep(DWORD milliseconds);
+    // Polls done() at growing intervals (10 ms doubling up to 250 ms) until it
+    // returns true; false on timeout or cancel. pWaitMs gets the time waited.
+    static bool   WaitUntil(const std::function<bool()>& done, DWORD timeoutMs, DWORD* pWaitMs = nullptr);
 };
@@ -18,6 +18,10 @@ public:
 // Overrides
 public:
     virtual BOOL InitInstance();
+    virtual int ExitInstance();
+
+private:
+    int m_exitCode;               // process exit code; set by a headless run
 
     DECLARE_MESSAGE_MAP()
 };
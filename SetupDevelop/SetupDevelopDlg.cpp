@@ -1,9 +1,13 @@
 #include "pch.h"
 #include "SetupDevelop.h"
 #include "SetupDevelopDlg.h"
-#include "../Common/SettingsUtils.h"
 #include "../Common/WinUtils.h"
 #include "../Common/TeamViewerUtils.h"
+#include "../Common/FirewallSession.h"
+#include "../Common/TraceRecorder.h"
+#include "../Common/AdapterInventory.h"
+#include "../Common/FleetRunner.h"
+#include <memory>
 #include <ShlObj.h>
 
 #ifdef _DEBUG
@@ -14,14 +18,24 @@
 // Construction
 // ════════════════════════════════════════════════════════════════
 
+// Defined before the constructor, which applies the defaults
+const SettingField<CSetupDevelopDlg> CSetupDevelopDlg::s_settings[] =
+{
+    { SettingName(KEY_TEAMVIEWER_ID), &CSetupDevelopDlg::m_strTVID,      SETTING_TEXT, _T("") },
+    { SettingName(KEY_PASSWORD),      &CSetupDevelopDlg::m_strPassword,  SETTING_TEXT, _T("a") },
+    { SettingName(KEY_SHARE_PATH),    &CSetupDevelopDlg::m_strSharePath, SETTING_TEXT, _T("C:\\CTrack-software") },
+    { SettingName(KEY_SHARE_NAME),    &CSetupDevelopDlg::m_strShareName, SETTING_TEXT, _T("CTrack-software") },
+    { SettingName(KEY_VPN_SUBNET),    &CSetupDevelopDlg::m_strVPNSubnet, SETTING_TEXT, _T("7.0.0.0/8") },
+};
+
 CSetupDevelopDlg::CSetupDevelopDlg(CWnd* pParent)
     : CDialogEx(IDD_SETUPDEVELOP_DIALOG, pParent)
-    , m_strPassword(_T("a"))
-    , m_strSharePath(_T("C:\\CTrack-software"))
-    , m_strShareName(_T("CTrack-software"))
-    , m_strVPNSubnet(_T("7.0.0.0/8"))
+    , m_restoreRun(false)
+    , m_checkedPrivateItem(-1)
+    , m_planChecked(false)
 {
     m_hIcon = AfxGetApp()->LoadIcon(IDR_MAINFRAME);
+    CSettingsUtils::ApplyDefaults(s_settings, *this);
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -52,6 +66,11 @@ BEGIN_MESSAGE_MAP(CSetupDevelopDlg, CDialogEx)
     ON_BN_CLICKED(IDC_BUTTON_BROWSE, &CSetupDevelopDlg::OnBnClickedBrowse)
     ON_BN_CLICKED(IDC_BUTTON_SETUP, &CSetupDevelopDlg::OnBnClickedSetup)
     ON_BN_CLICKED(IDC_BUTTON_RESTORE, &CSetupDevelopDlg::OnBnClickedRestore)
+    ON_BN_CLICKED(IDC_BUTTON_STOP, &CSetupDevelopDlg::OnBnClickedStop)
+    ON_WM_TIMER()
+    ON_MESSAGE(WM_STEP_PROGRESS, &CSetupDevelopDlg::OnStepProgress)
+    ON_MESSAGE(WM_STEP_COMPLETE, &CSetupDevelopDlg::OnStepComplete)
+    ON_MESSAGE(WM_PREREQ_STATUS, &CSetupDevelopDlg::OnPrereqStatus)
 END_MESSAGE_MAP()
 
 // ════════════════════════════════════════════════════════════════
@@ -80,23 +99,24 @@ BOOL CSetupDevelopDlg::OnInitDialog()
         GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
     }
 
-    // Detect VPN status
-    DetectVPNStatus();
+    // Show the last known VPN status, then refresh it in the background
+    if (CPrereqCache::Load(CPrereqCache::GetCachePath(_T("SetupDevelop")), m_prereq))
+        ShowVPNStatus();
+    else
+        m_staticVPNStatus.SetWindowText(_T("Checking..."));
+    CPrereqCache::DetectAsync(GetSafeHwnd(), PREREQ_VPN);
 
     // Enable/disable Restore button based on saved state
     GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(m_backup.HasSavedState());
 
     // Load saved settings
     CString settingsPath = CSettingsUtils::GetSettingsDir() + _T("\\SetupDevelop.json");
-    std::map<CString, CString> settings;
-    if (CSettingsUtils::Load(settingsPath, settings))
-    {
-        if (settings.count(_T("TeamViewerID")))  m_strTVID = settings[_T("TeamViewerID")];
-        if (settings.count(_T("Password")))      m_strPassword = settings[_T("Password")];
-        if (settings.count(_T("SharePath")))     m_strSharePath = settings[_T("SharePath")];
-        if (settings.count(_T("ShareName")))     m_strShareName = settings[_T("ShareName")];
-        if (settings.count(_T("VPNSubnet")))     m_strVPNSubnet = settings[_T("VPNSubnet")];
+    CString settingsError;
+    if (CSettingsUtils::Load(settingsPath, s_settings, *this, &settingsError))
         UpdateData(FALSE);
+    if (!settingsError.IsEmpty())
+    {
+        m_log.LogWarning(_T("Saved settings ignored (") + settingsPath + _T(", ") + settingsError + _T(")."));
     }
 
     m_log.LogSeparator();
@@ -135,24 +155,129 @@ HCURSOR CSetupDevelopDlg::OnQueryDragIcon()
     return static_cast<HCURSOR>(m_hIcon);
 }
 
+// ════════════════════════════════════════════════════════════════
+// Headless Run
+// ════════════════════════════════════════════════════════════════
+
+int CSetupDevelopDlg::RunHeadless(const HeadlessOptions& options, HANDLE hOut)
+{
+    bool restore = options.command == HEADLESS_RESTORE;
+    bool fleet = options.command == HEADLESS_FLEET;
+    LPCTSTR operation = restore ? _T("Restore") : (fleet ? _T("Fleet") : _T("Setup"));
+
+    // What OnInitDialog does, minus the controls and the VPN status display
+    m_log.SetConsoleOutput(hOut, options.json);
+    m_log.InitFileLog(_T("SetupDevelop"));
+    m_log.SetOperation(restore ? _T("restore") : (fleet ? _T("fleet") : _T("setup")));
+    m_backup.Initialize(_T("state_develop"));
+
+    if (!CWinUtils::IsRunningAsAdmin())
+        return CHeadless::Abort(m_log, operation, EXIT_NOT_ADMIN, _T("This program must be run as Administrator!"));
+
+    // Saved settings first; the configuration file overrides them key by key
+    CSettingsUtils::Load(CSettingsUtils::GetSettingsDir() + _T("\\SetupDevelop.json"), s_settings, *this);
+    if (!options.configPath.IsEmpty())
+    {
+        CString error;
+        if (!CSettingsUtils::Load(options.configPath, s_settings, *this, &error) || !error.IsEmpty())
+        {
+            return CHeadless::Abort(m_log, operation, EXIT_USAGE, _T("Configuration ") + options.configPath + _T(": ") +
+                                    (error.IsEmpty() ? CString(_T("cannot be read")) : error));
+        }
+    }
+
+    if (fleet)
+        return RunFleet(options.fleetPath);
+
+    if (!restore)
+    {
+        CString error = GetInputError();
+        if (!error.IsEmpty())
+            return CHeadless::Abort(m_log, operation, EXIT_USAGE, error);
+
+        // Nobody to ask: a missing share folder is created, as the dialog offers to
+        if (GetFileAttributes(m_strSharePath) == INVALID_FILE_ATTRIBUTES)
+        {
+            if (SHCreateDirectoryEx(nullptr, m_strSharePath, nullptr) != ERROR_SUCCESS)
+                return CHeadless::Abort(m_log, operation, EXIT_USAGE, _T("Failed to create the folder ") + m_strSharePath);
+            m_log.LogInfo(_T("Created the folder ") + m_strSharePath);
+        }
+    }
+
+    if (!StartRun(restore, restore ? BuildRestoreSteps() : BuildSetupSteps(), nullptr))
+        return CHeadless::Abort(m_log, operation, EXIT_START_FAILED, _T("Nothing was changed."));
+    CHeadless::WaitForRun(m_runner);
+    FinishRun(m_runner.AllSucceeded(), m_runner.IsCancelled());
+    return CHeadless::Finish(m_runner, m_log, operation);
+}
+
+int CSetupDevelopDlg::RunFleet(LPCTSTR fleetPath)
+{
+    // What every Test PC needs from this side; the fleet file can override it
+    CFleetRunner fleet(&m_log);
+    fleet.SetDefault(KEY_DEV_HOSTNAME, CWinUtils::GetComputerHostName());
+    fleet.SetDefault(KEY_DEV_VPN_IP, CTeamViewerUtils::GetVPNIPAddress());
+    fleet.SetDefault(KEY_SHARE_NAME, m_strShareName);
+    fleet.SetDefault(KEY_PASSWORD, m_strPassword);
+
+    CString error;
+    if (!fleet.Load(fleetPath, error))
+        return CHeadless::Abort(m_log, _T("Fleet"), EXIT_USAGE, CString(_T("Fleet file ")) + fleetPath + _T(": ") + error);
+
+    CString header;
+    header.Format(_T("  Setting up %d Test PCs, %d at a time..."), fleet.GetTargetCount(), fleet.GetMaxParallel());
+    m_log.LogSeparator();
+    m_log.Log(header);
+    m_log.LogSeparator();
+
+    // Nothing changes on this PC, so the run is not journaled
+    CTraceRecorder::Reset();
+    CTraceRecorder::AddSecret(m_strPassword);
+    m_runner.SetMaxParallel(fleet.GetMaxParallel());
+    if (!m_runner.Start(nullptr, &m_log, fleet.BuildSteps()))
+        return CHeadless::Abort(m_log, _T("Fleet"), EXIT_START_FAILED, _T("Could not start the worker thread."));
+    CHeadless::WaitForRun(m_runner);
+
+    CString tracePath = CTraceRecorder::WriteNextTo(m_log.GetLogFilePath(), _T("fleet"));
+    if (!tracePath.IsEmpty())
+        m_log.LogInfo(_T("Trace written to ") + tracePath);
+    fleet.LogReport();
+    return CHeadless::Finish(m_runner, m_log, _T("Fleet"));
+}
+
 // ════════════════════════════════════════════════════════════════
 // VPN Detection
 // ════════════════════════════════════════════════════════════════
 
 void CSetupDevelopDlg::DetectVPNStatus()
 {
-    CString vpnIP = CTeamViewerUtils::GetVPNIPAddress();
-    if (!vpnIP.IsEmpty())
+    m_prereq = CPrereqCache::Detect(PREREQ_VPN);
+    ShowVPNStatus();
+    CPrereqCache::Save(CPrereqCache::GetCachePath(_T("SetupDevelop")), m_prereq);
+}
+
+LRESULT CSetupDevelopDlg::OnPrereqStatus(WPARAM, LPARAM lParam)
+{
+    std::unique_ptr<PrereqStatus> status(reinterpret_cast<PrereqStatus*>(lParam));
+    m_prereq = *status;
+    ShowVPNStatus();
+    CPrereqCache::Save(CPrereqCache::GetCachePath(_T("SetupDevelop")), m_prereq);
+    return 0;
+}
+
+void CSetupDevelopDlg::ShowVPNStatus()
+{
+    if (!m_prereq.vpnIP.IsEmpty())
     {
         CString status;
-        status.Format(_T("Connected - IP: %s"), (LPCTSTR)vpnIP);
+        status.Format(_T("Connected - IP: %s"), (LPCTSTR)m_prereq.vpnIP);
         m_staticVPNStatus.SetWindowText(status);
     }
-    else if (CTeamViewerUtils::IsVPNDriverInstalled())
+    else if (m_prereq.vpnDriverInstalled)
     {
         m_staticVPNStatus.SetWindowText(_T("VPN driver installed but not connected"));
     }
-    else if (CTeamViewerUtils::IsTeamViewerInstalled())
+    else if (m_prereq.teamViewerInstalled)
     {
         m_staticVPNStatus.SetWindowText(_T("TeamViewer installed, VPN driver not found"));
     }
@@ -243,17 +368,13 @@ bool CSetupDevelopDlg::ValidateInputs()
 {
     UpdateData(TRUE);
 
-    if (m_strPassword.IsEmpty())
+    CWnd* pField = nullptr;
+    CString error = GetInputError(&pField);
+    if (!error.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter a password for the RD account."), MB_OK | MB_ICONWARNING);
-        m_editPassword.SetFocus();
-        return false;
-    }
-
-    if (m_strSharePath.IsEmpty())
-    {
-        AfxMessageBox(_T("Please specify a folder to share."), MB_OK | MB_ICONWARNING);
-        m_editSharePath.SetFocus();
+        AfxMessageBox(error, MB_OK | MB_ICONWARNING);
+        if (pField)
+            pField->SetFocus();
         return false;
     }
 
@@ -275,21 +396,39 @@ bool CSetupDevelopDlg::ValidateInputs()
         }
     }
 
+    return true;
+}
+
+CString CSetupDevelopDlg::GetInputError(CWnd** ppField)
+{
+    CWnd* pDummy = nullptr;
+    CWnd*& pField = ppField ? *ppField : pDummy;
+
+    if (m_strPassword.IsEmpty())
+    {
+        pField = &m_editPassword;
+        return _T("Please enter a password for the RD account.");
+    }
+
+    if (m_strSharePath.IsEmpty())
+    {
+        pField = &m_editSharePath;
+        return _T("Please specify a folder to share.");
+    }
+
     if (m_strShareName.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter a share name."), MB_OK | MB_ICONWARNING);
-        m_editShareName.SetFocus();
-        return false;
+        pField = &m_editShareName;
+        return _T("Please enter a share name.");
     }
 
     if (m_strVPNSubnet.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the VPN subnet."), MB_OK | MB_ICONWARNING);
-        m_editVPNSubnet.SetFocus();
-        return false;
+        pField = &m_editVPNSubnet;
+        return _T("Please enter the VPN subnet.");
     }
 
-    return true;
+    return CString();
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -302,22 +441,13 @@ void CSetupDevelopDlg::OnBnClickedSetup()
         return;
 
     // Save settings for next launch
-    {
-        std::map<CString, CString> settings;
-        settings[_T("TeamViewerID")] = m_strTVID;
-        settings[_T("Password")] = m_strPassword;
-        settings[_T("SharePath")] = m_strSharePath;
-        settings[_T("ShareName")] = m_strShareName;
-        settings[_T("VPNSubnet")] = m_strVPNSubnet;
-        CSettingsUtils::Save(
-            CSettingsUtils::GetSettingsDir() + _T("\\SetupDevelop.json"), settings);
-    }
+    CSettingsUtils::Save(CSettingsUtils::GetSettingsDir() + _T("\\SetupDevelop.json"), s_settings, *this);
 
-    // Disable buttons during operation
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    BeginRun(false, BuildSetupSteps());
+}
 
-    CWaitCursor wait;
+std::vector<SetupStep> CSetupDevelopDlg::BuildSetupSteps()
+{
     m_log.Clear();
     m_log.SetOperation(_T("setup"));
     {
@@ -342,75 +472,247 @@ void CSetupDevelopDlg::OnBnClickedSetup()
     m_backup.SaveState(_T("share_name"), m_strShareName);
     m_backup.SaveState(_T("share_path"), m_strSharePath);
     m_backup.SaveState(_T("vpn_subnet"), m_strVPNSubnet);
+    m_backup.Commit();
+
+    // Independent steps run in parallel; dependsOn lists 0-based table indices.
+    // The summary is informational, never fails the run, and waits for everything.
+    std::vector<SetupStep> steps = {
+        /* 0 */ { _T("Creating local RD account..."),                                [this] { return StepCreateRDAccount(); },            true },
+        /* 1 */ { _T("Adding RD to Administrators group..."),                        [this] { return StepAddRDToAdmins(); },              true, { 0 } },
+        /* 2 */ { _T("Configuring VPN adapter network profile..."),                  [this] { return StepSetVPNAdapterPrivate(); },       true },
+        /* 3 */ { _T("Enabling Network Discovery..."),                               [this] { return StepEnableNetworkDiscovery(); },     true },
+        /* 4 */ { _T("Enabling File and Printer Sharing..."),                        [this] { return StepEnableFileSharing(); },          true },
+        /* 5 */ { _T("Setting NTLMv2 authentication level..."),                      [this] { return StepSetNTLMv2(); },                  true },
+        /* 6 */ { _T("Configuring password protected sharing..."),                   [this] { return StepDisablePasswordSharing(); },     true },
+        /* 7 */ { _T("Creating SMB firewall rule (port 445)..."),                    [this] { return StepCreateSMBFirewallRule(); },      true },
+        /* 8 */ { _T("Creating Remote Debugger firewall rule (ports 4022-4026)..."), [this] { return StepCreateDebuggerFirewallRule(); }, true },
+        /* 9 */ { _T("Creating network share..."),                                   [this] { return StepCreateShare(); },                true },
+        /*10 */ { _T("Setting NTFS permissions..."),                                 [this] { return StepSetNTFSPermissions(); },         true, { 9 } },
+        /*11 */ { _T("Applying PowerShell changes (one script)..."),                 [this] { return StepApplyPowerShellPlan(); },        true, { 2, 9 } },
+        /*12 */ { _T("Setup complete."),                                             [this] { StepDisplaySummary(); return true; },       false, CStepRunner::AllBefore(12) },
+    };
+
+    // Cheap read-only checks, all run before the first step: a step already
+    // in the desired state is skipped, so a re-run only corrects what drifted.
+    // Creating RD always runs (the password can't be checked without a logon).
+    steps[1].isInPlace  = [] { return CWinUtils::IsUserInGroup(_T("RD"), _T("Administrators")); };
+    steps[2].isInPlace  = [this] { return IsVPNAdapterPrivateInPlace(); };
+    steps[3].isInPlace  = [] { return CWinUtils::IsFirewallRuleGroupEnabled(_T("Network Discovery")); };
+    steps[4].isInPlace  = [] { return CWinUtils::IsFirewallRuleGroupEnabled(_T("File and Printer Sharing")); };
+    steps[5].isInPlace  = [] { return CWinUtils::RegistryDwordEquals(_T("SYSTEM\\CurrentControlSet\\Control\\Lsa"),
+                                                                     _T("LmCompatibilityLevel"), 3); };
+    steps[6].isInPlace  = [] {
+        return CWinUtils::RegistryDwordEquals(_T("SYSTEM\\CurrentControlSet\\Control\\Lsa"),
+                                              _T("everyoneincludesanonymous"), 1) &&
+               CWinUtils::RegistryDwordEquals(_T("SYSTEM\\CurrentControlSet\\Services\\LanmanServer\\Parameters"),
+                                              _T("restrictnullsessaccess"), 0);
+    };
+    steps[7].isInPlace  = [this] { CFirewallSession firewall; return firewall.HasRule(SMBFirewallRule()); };
+    steps[8].isInPlace  = [this] { CFirewallSession firewall; return firewall.HasRule(DebuggerFirewallRule()); };
+    steps[9].isInPlace  = [this] { return CWinUtils::GetSharePath(m_strShareName).CompareNoCase(m_strSharePath) == 0; };
+    steps[10].isInPlace = [this] { return CWinUtils::HasNTFSPermissions(m_strSharePath, _T("Everyone")); };
+    m_planChecked = false;
+    steps[11].isInPlace = [this] {
+        m_checkedPlan = CPowerShellPlan();
+        m_checkedPrivateItem = CompilePowerShellPlan(m_checkedPlan, m_checkedVPN);
+        m_planChecked = true;
+        return m_checkedPlan.IsEmpty();
+    };
+    return steps;
+}
 
-    int step = 0;
-    bool allOk = true;
+// ════════════════════════════════════════════════════════════════
+// Worker-Thread Run Control
+// ════════════════════════════════════════════════════════════════
 
-    // Step 1: Create RD account
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating local RD account..."));
-    if (!StepCreateRDAccount()) allOk = false;
+CString CSetupDevelopDlg::GetRunInputs() const
+{
+    return m_strShareName + _T("\n") + m_strSharePath + _T("\n") + m_strVPNSubnet;
+}
 
-    // Step 2: Add RD to Administrators
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Adding RD to Administrators group..."));
-    if (!StepAddRDToAdmins()) allOk = false;
+void CSetupDevelopDlg::BeginRun(bool restore, std::vector<SetupStep> steps)
+{
+    if (!StartRun(restore, std::move(steps), GetSafeHwnd()))
+        return;
 
-    // Step 3: Set VPN adapter to Private
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Configuring VPN adapter network profile..."));
-    if (!StepSetVPNAdapterPrivate()) allOk = false;
+    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
+    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(TRUE);
+    SetTimer(PROGRESS_TIMER_ID, 200, nullptr);
+    UpdateProgressText();
+}
 
-    // Step 4: Enable Network Discovery
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Enabling Network Discovery..."));
-    if (!StepEnableNetworkDiscovery()) allOk = false;
+bool CSetupDevelopDlg::StartRun(bool restore, std::vector<SetupStep> steps, HWND hNotify)
+{
+    CSetupJournal& journal = m_backup.Journal();
+
+    // A setup that was killed or stopped continues where it left off, as
+    // long as it applies the same settings
+    CString inputs = restore ? CString() : CSetupJournal::Fingerprint(GetRunInputs());
+    bool interrupted = !restore && journal.HasInterruptedSetup();
+    bool resume = interrupted && journal.GetSetupInputs() == inputs;
+    if (resume)
+        m_log.LogInfo(_T("Resuming the interrupted setup: steps that already succeeded are skipped."));
+    else if (interrupted)
+        m_log.LogInfo(_T("Settings changed since the interrupted setup: every step runs again."));
+
+    // State written by a version without the journal: undo everything, as before
+    bool undoAll = restore && !journal.HasSetupHistory();
+    if (restore)
+    {
+        for (int step : journal.GetUnfinishedSteps())
+        {
+            CString msg;
+            msg.Format(_T("Setup step %d was interrupted before it finished; its changes are not undone."), step + 1);
+            m_log.LogWarning(msg);
+        }
+    }
 
-    // Step 5: Enable File and Printer Sharing
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Enabling File and Printer Sharing..."));
-    if (!StepEnableFileSharing()) allOk = false;
+    for (int i = 0; i < static_cast<int>(steps.size()); i++)
+    {
+        auto run = std::move(steps[i].run);
+        std::vector<int> undoes = steps[i].undoes;
+        steps[i].run = [this, run, i, restore, resume, undoAll, undoes] {
+            CSetupJournal& journal = m_backup.Journal();
+            bool ok;
+            if (!restore)
+            {
+                if (resume && journal.IsStepDone(i))
+                {
+                    m_log.LogInfo(_T("Already done before the interruption, skipped."));
+                    return true;
+                }
+                journal.BeginStep(i);
+                CSetupJournal::SetCurrentStep(i);
+                ok = run();
+                CSetupJournal::SetCurrentStep(-1);
+            }
+            else
+            {
+                bool needed = undoAll || undoes.empty();
+                for (int s : undoes)
+                    needed = needed || journal.NeedsUndo(s);
+                if (!needed)
+                {
+                    m_log.LogInfo(_T("Setup never completed this change, nothing to undo."));
+                    return true;
+                }
+                ok = run();
+            }
 
-    // Step 6: Set NTLMv2 authentication
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Setting NTLMv2 authentication level..."));
-    if (!StepSetNTLMv2()) allOk = false;
+            // Commit the state the step recorded in one write, then mark it in the journal
+            if (!m_backup.Commit())
+                m_log.LogWarning(_T("Could not write the state file ") + m_backup.GetStateFilePath());
+            if (!restore)
+                journal.CommitStep(i, ok);
+            else
+                for (int s : undoes)
+                    journal.MarkUndone(s);
+            return ok;
+        };
+    }
 
-    // Step 7: Disable password protected sharing
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Configuring password protected sharing..."));
-    if (!StepDisablePasswordSharing()) allOk = false;
+    CTraceRecorder::Reset();
+    CTraceRecorder::AddSecret(m_strPassword);
 
-    // Step 8: Create SMB firewall rule
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating SMB firewall rule (port 445)..."));
-    if (!StepCreateSMBFirewallRule()) allOk = false;
+    m_restoreRun = restore;
+    journal.BeginRun(restore, inputs);
+    if (!m_runner.Start(hNotify, &m_log, std::move(steps)))
+    {
+        journal.EndRun(false);
+        m_log.LogError(_T("Could not start the worker thread."));
+        return false;
+    }
+    return true;
+}
 
-    // Step 9: Create Remote Debugger firewall rule
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating Remote Debugger firewall rule (ports 4022-4026)..."));
-    if (!StepCreateDebuggerFirewallRule()) allOk = false;
+void CSetupDevelopDlg::OnBnClickedStop()
+{
+    if (!m_runner.IsRunning())
+        return;
+    m_log.LogWarning(_T("Stopping - no further steps will be started..."));
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(FALSE);
+    m_runner.Cancel();
+}
 
-    // Step 10: Create the share
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating network share..."));
-    if (!StepCreateShare()) allOk = false;
+void CSetupDevelopDlg::OnCancel()
+{
+    // Closing mid-run: stop the worker before the dialog (and its log) goes away
+    if (m_runner.IsRunning())
+    {
+        CWaitCursor wait;
+        m_runner.Cancel();
+        m_runner.Wait();
+    }
+    CDialogEx::OnCancel();
+}
 
-    // Step 11: Set NTFS permissions
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Setting NTFS permissions..."));
-    if (!StepSetNTFSPermissions()) allOk = false;
+void CSetupDevelopDlg::OnTimer(UINT_PTR nIDEvent)
+{
+    if (nIDEvent == PROGRESS_TIMER_ID)
+    {
+        UpdateProgressText();
+        return;
+    }
+    CDialogEx::OnTimer(nIDEvent);
+}
+
+void CSetupDevelopDlg::UpdateProgressText()
+{
+    SetDlgItemText(IDC_STATIC_PROGRESS,
+                   m_runner.FormatProgress(m_restoreRun ? _T("Restore") : _T("Setup")));
+}
 
-    // Step 12: Display summary
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Setup complete."));
-    StepDisplaySummary();
+LRESULT CSetupDevelopDlg::OnStepProgress(WPARAM /*wParam*/, LPARAM /*lParam*/)
+{
+    UpdateProgressText();
+    return 0;
+}
+
+LRESULT CSetupDevelopDlg::OnStepComplete(WPARAM wParam, LPARAM lParam)
+{
+    KillTimer(PROGRESS_TIMER_ID);
+    FinishRun(wParam != 0, lParam != 0);
+    UpdateProgressText();
+
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(FALSE);
+    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(TRUE);
+    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(m_backup.HasSavedState());
+    return 0;
+}
+
+void CSetupDevelopDlg::FinishRun(bool allOk, bool cancelled)
+{
+    m_runner.Wait();
+    m_backup.Journal().EndRun(!cancelled);
+
+    CString tracePath = CTraceRecorder::WriteNextTo(m_log.GetLogFilePath(),
+                                                    m_restoreRun ? _T("restore") : _T("setup"));
+    if (!tracePath.IsEmpty())
+        m_log.LogInfo(_T("Trace written to ") + tracePath);
 
     m_log.Log(_T(""));
-    if (allOk)
+    m_log.LogSeparator();
+    if (m_restoreRun)
     {
-        m_log.LogSeparator();
-        m_log.Log(_T("  ALL STEPS COMPLETED SUCCESSFULLY"));
-        m_log.LogSeparator();
+        if (cancelled)
+        {
+            // Keep the saved state so Restore can be run again
+            m_log.Log(_T("  RESTORE STOPPED - run Restore again to finish"));
+        }
+        else
+        {
+            m_backup.ClearState();
+            m_log.Log(_T("  RESTORE COMPLETE"));
+        }
     }
+    else if (cancelled)
+        m_log.Log(_T("  SETUP STOPPED - run Restore to undo completed steps"));
+    else if (allOk)
+        m_log.Log(_T("  ALL STEPS COMPLETED SUCCESSFULLY"));
     else
-    {
-        m_log.LogSeparator();
         m_log.Log(_T("  SETUP COMPLETED WITH WARNINGS (see above)"));
-        m_log.LogSeparator();
-    }
-
-    // Re-enable buttons
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(TRUE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(m_backup.HasSavedState());
+    m_log.LogSeparator();
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -483,10 +785,11 @@ bool CSetupDevelopDlg::StepSetVPNAdapterPrivate()
         return false;
     }
 
-    // Save original state
+    // Save original state, once: a re-run after the plan step would see Private
     CString originalCategory = CWinUtils::GetAdapterNetworkCategory(vpn.interfaceIndex);
-    m_backup.SaveState(_T("vpn_adapter_was_private"),
-                       originalCategory.Find(_T("Private")) != -1);
+    bool isPrivate = originalCategory.Find(_T("Private")) != -1;
+    if (m_backup.LoadState(_T("vpn_adapter_was_private")).IsEmpty())
+        m_backup.SaveState(_T("vpn_adapter_was_private"), isPrivate);
     m_backup.SaveState(_T("vpn_adapter_interface_index"), vpn.interfaceIndex);
 
     CString aliasInfo;
@@ -494,28 +797,28 @@ bool CSetupDevelopDlg::StepSetVPNAdapterPrivate()
                      (LPCTSTR)vpn.alias, vpn.interfaceIndex, (LPCTSTR)originalCategory);
     m_log.LogInfo(aliasInfo);
 
-    if (originalCategory.Find(_T("Private")) != -1)
+    if (isPrivate)
     {
         m_log.LogSuccess(_T("VPN adapter is already Private."));
-        return true;
-    }
-
-    if (CWinUtils::SetNetworkProfilePrivate(vpn.interfaceIndex))
-    {
-        CString msg;
-        msg.Format(_T("'%s' changed from %s to Private."),
-                   (LPCTSTR)vpn.alias, (LPCTSTR)originalCategory);
-        m_log.LogSuccess(msg);
     }
     else
     {
-        m_log.LogError(_T("Failed to set VPN adapter to Private."));
-        return false;
+        // The category itself is switched by the PowerShell plan step, together
+        // with the other PowerShell-backed changes
+        m_log.LogInfo(_T("Adapter will be switched to Private with the other PowerShell changes."));
     }
 
     // Create a scheduled task to re-set the VPN adapter to Private at every logon.
     // Windows resets the VPN adapter network profile to Public after reboot,
-    // which disables Network Discovery and File Sharing.
+    // which disables Network Discovery and File Sharing. Needed even when the
+    // adapter is Private now.
+    bool finished = false;
+    DWORD lastResult = 0;
+    if (CWinUtils::GetScheduledTaskState(_T("RDS_VPNPrivate"), finished, lastResult))
+    {
+        m_log.LogSuccess(_T("Logon task 'RDS_VPNPrivate' already exists."));
+        return true;
+    }
 
     // Write a small .ps1 script next to the executable
     TCHAR exePath[MAX_PATH];
@@ -558,22 +861,34 @@ bool CSetupDevelopDlg::StepSetVPNAdapterPrivate()
 
 bool CSetupDevelopDlg::StepEnableNetworkDiscovery()
 {
-    bool wasEnabled = CWinUtils::IsFirewallRuleGroupEnabled(_T("Network Discovery"));
+    CFirewallSession firewall;
+    bool wasEnabled = firewall.IsRuleGroupEnabled(_T("Network Discovery"));
     m_backup.SaveState(_T("network_discovery_was_enabled"), wasEnabled);
 
-    CWinUtils::EnableFirewallRuleGroup(_T("Network Discovery"), true);
-    m_log.LogSuccess(_T("Network Discovery enabled."));
-    return true;
+    if (firewall.EnableRuleGroup(_T("Network Discovery"), true))
+    {
+        m_log.LogSuccess(_T("Network Discovery enabled."));
+        return true;
+    }
+
+    m_log.LogError(_T("Failed to enable the Network Discovery firewall rules."));
+    return false;
 }
 
 bool CSetupDevelopDlg::StepEnableFileSharing()
 {
-    bool wasEnabled = CWinUtils::IsFirewallRuleGroupEnabled(_T("File and Printer Sharing"));
+    CFirewallSession firewall;
+    bool wasEnabled = firewall.IsRuleGroupEnabled(_T("File and Printer Sharing"));
     m_backup.SaveState(_T("file_sharing_was_enabled"), wasEnabled);
 
-    CWinUtils::EnableFirewallRuleGroup(_T("File and Printer Sharing"), true);
-    m_log.LogSuccess(_T("File and Printer Sharing enabled."));
-    return true;
+    if (firewall.EnableRuleGroup(_T("File and Printer Sharing"), true))
+    {
+        m_log.LogSuccess(_T("File and Printer Sharing enabled."));
+        return true;
+    }
+
+    m_log.LogError(_T("Failed to enable the File and Printer Sharing firewall rules."));
+    return false;
 }
 
 bool CSetupDevelopDlg::StepSetNTLMv2()
@@ -702,17 +1017,16 @@ bool CSetupDevelopDlg::StepDisablePasswordSharing()
 
 bool CSetupDevelopDlg::StepCreateSMBFirewallRule()
 {
-    LPCTSTR ruleName = _T("SMB over TeamViewer VPN");
-    bool existed = CWinUtils::FirewallRuleExists(ruleName);
+    FirewallRule rule = SMBFirewallRule();
+    CFirewallSession firewall;
+    bool existed = firewall.RuleExists(rule.name);
     m_backup.SaveState(_T("smb_firewall_rule_existed"), existed);
 
-    if (CWinUtils::CreateFirewallRule(ruleName,
-            _T("Allow SMB file sharing from TeamViewer VPN clients"),
-            _T("445"), m_strVPNSubnet))
+    if (firewall.ApplyRule(rule))
     {
         CString msg;
         msg.Format(_T("Firewall rule '%s' created (port 445, subnet %s)."),
-                   ruleName, (LPCTSTR)m_strVPNSubnet);
+                   (LPCTSTR)rule.name, (LPCTSTR)m_strVPNSubnet);
         m_log.LogSuccess(msg);
         return true;
     }
@@ -723,13 +1037,12 @@ bool CSetupDevelopDlg::StepCreateSMBFirewallRule()
 
 bool CSetupDevelopDlg::StepCreateDebuggerFirewallRule()
 {
-    LPCTSTR ruleName = _T("VS Remote Debugger (TeamViewer VPN)");
-    bool existed = CWinUtils::FirewallRuleExists(ruleName);
+    FirewallRule rule = DebuggerFirewallRule();
+    CFirewallSession firewall;
+    bool existed = firewall.RuleExists(rule.name);
     m_backup.SaveState(_T("debugger_firewall_rule_existed"), existed);
 
-    if (CWinUtils::CreateFirewallRule(ruleName,
-            _T("Allow Visual Studio Remote Debugger from TeamViewer VPN clients"),
-            _T("4022-4026"), m_strVPNSubnet))
+    if (firewall.ApplyRule(rule))
     {
         m_log.LogSuccess(_T("Firewall rule created (ports 4022-4026)."));
         return true;
@@ -746,18 +1059,14 @@ bool CSetupDevelopDlg::StepCreateShare()
 
     if (existed)
     {
-        m_log.LogInfo(_T("Share already exists. Updating permissions..."));
-        // Grant Everyone full access (auth is handled by disabling password-protected sharing)
-        CString cmd;
-        cmd.Format(_T("Grant-SmbShareAccess -Name '%s' -AccountName 'Everyone' -AccessRight Full -Force"),
-                   (LPCTSTR)m_strShareName);
-        CWinUtils::RunPowerShellCommand(cmd);
-        m_log.LogSuccess(_T("Share permissions updated for Everyone."));
+        // Share access for Everyone is granted by the PowerShell plan step
+        m_log.LogSuccess(_T("Share already exists. Permissions are updated with the PowerShell changes."));
         return true;
     }
 
-    if (CWinUtils::CreateSMBShare(m_strShareName, m_strSharePath, _T("Everyone")))
+    if (CWinUtils::CreateSMBShare(m_strShareName, m_strSharePath, nullptr))
     {
+        m_planChecked = false;    // the checked plan had no share to grant access to
         CString msg;
         msg.Format(_T("Share '%s' created -> %s"),
                    (LPCTSTR)m_strShareName, (LPCTSTR)m_strSharePath);
@@ -781,6 +1090,108 @@ bool CSetupDevelopDlg::StepSetNTFSPermissions()
     return false;
 }
 
+int CSetupDevelopDlg::CompilePowerShellPlan(CPowerShellPlan& plan, AdapterInfo& vpn)
+{
+    // Compiled from the current system state rather than from what earlier
+    // steps did, so a resumed run that skips them still gets the same plan.
+    // Returns the index of the adapter item, -1 if there is none.
+    int privateItem = -1;
+    vpn = CWinUtils::FindTeamViewerVPNAdapter();
+    if (vpn.interfaceIndex >= 0 && vpn.networkCategory.Find(_T("Private")) == -1)
+    {
+        CString cmd;
+        cmd.Format(_T("Set-NetConnectionProfile -InterfaceIndex %d -NetworkCategory Private"), vpn.interfaceIndex);
+        privateItem = plan.Add(_T("VPN adapter '") + vpn.alias + _T("' set to Private."), cmd);
+    }
+    if (CWinUtils::ShareExists(m_strShareName) && !CWinUtils::ShareGrantsFullAccess(m_strShareName, _T("Everyone")))
+    {
+        // Grant Everyone full access (auth is handled by disabling password-protected sharing)
+        CString cmd;
+        cmd.Format(_T("Grant-SmbShareAccess -Name '%s' -AccountName 'Everyone' -AccessRight Full -Force"),
+                   (LPCTSTR)m_strShareName);
+        plan.Add(_T("Share permissions updated for Everyone."), cmd);
+    }
+    return privateItem;
+}
+
+bool CSetupDevelopDlg::IsVPNAdapterPrivateInPlace()
+{
+    // Private now, and the logon task that keeps it Private after a reboot exists
+    AdapterInfo vpn = CWinUtils::FindTeamViewerVPNAdapter();
+    bool finished = false;
+    DWORD lastResult = 0;
+    return vpn.interfaceIndex >= 0 && vpn.networkCategory.Find(_T("Private")) != -1 &&
+           CWinUtils::GetScheduledTaskState(_T("RDS_VPNPrivate"), finished, lastResult);
+}
+
+FirewallRule CSetupDevelopDlg::SMBFirewallRule() const
+{
+    return CFirewallSession::InboundTcpRule(_T("SMB over TeamViewer VPN"),
+        _T("Allow SMB file sharing from TeamViewer VPN clients"),
+        _T("445"), m_strVPNSubnet);
+}
+
+FirewallRule CSetupDevelopDlg::DebuggerFirewallRule() const
+{
+    return CFirewallSession::InboundTcpRule(_T("VS Remote Debugger (TeamViewer VPN)"),
+        _T("Allow Visual Studio Remote Debugger from TeamViewer VPN clients"),
+        _T("4022-4026"), m_strVPNSubnet);
+}
+
+bool CSetupDevelopDlg::StepApplyPowerShellPlan()
+{
+    // The isInPlace check compiled it moments ago; only a new share changes it
+    CPowerShellPlan plan;
+    AdapterInfo vpn;
+    int privateItem;
+    if (m_planChecked)
+    {
+        plan = m_checkedPlan;
+        vpn = m_checkedVPN;
+        privateItem = m_checkedPrivateItem;
+        m_planChecked = false;
+    }
+    else
+    {
+        privateItem = CompilePowerShellPlan(plan, vpn);
+    }
+
+    if (plan.IsEmpty())
+    {
+        m_log.LogSuccess(_T("No PowerShell changes needed."));
+        return true;
+    }
+
+    plan.Run();
+
+    bool ok = true;
+    for (int i = 0; i < plan.GetCount(); i++)
+    {
+        const PowerShellItemResult& result = plan.GetResult(i);
+        if (result.ok)
+        {
+            m_log.LogSuccess(plan.GetDescription(i));
+        }
+        else
+        {
+            m_log.LogError(_T("Failed: ") + plan.GetDescription(i) + _T(" ") + result.error);
+            ok = false;
+        }
+    }
+
+    if (privateItem >= 0 && plan.GetResult(privateItem).ok)
+    {
+        // A category change raises no IP helper notification
+        CAdapterInventory::Instance().Invalidate();
+        if (CWinUtils::GetAdapterNetworkCategory(vpn.interfaceIndex).Find(_T("Private")) == -1)
+        {
+            m_log.LogError(_T("VPN adapter is still not Private."));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
 void CSetupDevelopDlg::StepDisplaySummary()
 {
     CString hostname = CWinUtils::GetComputerHostName();
@@ -832,10 +1243,11 @@ void CSetupDevelopDlg::OnBnClickedRestore()
                       MB_YESNO | MB_ICONQUESTION) != IDYES)
         return;
 
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    BeginRun(true, BuildRestoreSteps());
+}
 
-    CWaitCursor wait;
+std::vector<SetupStep> CSetupDevelopDlg::BuildRestoreSteps()
+{
     m_log.Clear();
     m_log.SetOperation(_T("restore"));
     {
@@ -848,49 +1260,23 @@ void CSetupDevelopDlg::OnBnClickedRestore()
     m_log.LogSeparator();
     m_log.Log(_T(""));
 
-    int step = 0;
-
-    // Restore in reverse order
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing NTFS permissions for RD..."));
-    RestoreNTFSPermissions();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing network share..."));
-    RestoreShare();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing Remote Debugger firewall rule..."));
-    RestoreDebuggerFirewallRule();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing SMB firewall rule..."));
-    RestoreSMBFirewallRule();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring File and Printer Sharing..."));
-    RestoreFileSharing();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring Network Discovery..."));
-    RestoreNetworkDiscovery();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring password protected sharing..."));
-    RestorePasswordSharing();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring NTLMv2 authentication level..."));
-    RestoreNTLMv2();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring VPN adapter profile..."));
-    RestoreVPNAdapterProfile();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring RD account..."));
-    RestoreRDAccount();
-
-    // Clear saved state
-    m_backup.ClearState();
-
-    m_log.Log(_T(""));
-    m_log.LogSeparator();
-    m_log.Log(_T("  RESTORE COMPLETE"));
-    m_log.LogSeparator();
-
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(TRUE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    // Reverse of the setup graph: an undo waits for the undo of every setup step
+    // that depended on it. The last list is the setup steps each row reverts; a
+    // row is skipped when the journal shows none of them finished.
+    // Saved state is cleared once the run completes.
+    std::vector<SetupStep> steps = {
+        /* 0 */ { _T("Removing NTFS permissions for RD..."),       [this] { RestoreNTFSPermissions(); return true; },      true, {},    { 10 } },
+        /* 1 */ { _T("Removing network share..."),                 [this] { RestoreShare(); return true; },                true, { 0 }, { 9 } },
+        /* 2 */ { _T("Removing Remote Debugger firewall rule..."), [this] { RestoreDebuggerFirewallRule(); return true; }, true, {},    { 8 } },
+        /* 3 */ { _T("Removing SMB firewall rule..."),             [this] { RestoreSMBFirewallRule(); return true; },      true, {},    { 7 } },
+        /* 4 */ { _T("Restoring File and Printer Sharing..."),     [this] { RestoreFileSharing(); return true; },          true, {},    { 4 } },
+        /* 5 */ { _T("Restoring Network Discovery..."),            [this] { RestoreNetworkDiscovery(); return true; },     true, {},    { 3 } },
+        /* 6 */ { _T("Restoring password protected sharing..."),   [this] { RestorePasswordSharing(); return true; },      true, {},    { 6 } },
+        /* 7 */ { _T("Restoring NTLMv2 authentication level..."),  [this] { RestoreNTLMv2(); return true; },               true, {},    { 5 } },
+        /* 8 */ { _T("Restoring VPN adapter profile..."),          [this] { RestoreVPNAdapterProfile(); return true; },    true, {},    { 2, 11 } },
+        /* 9 */ { _T("Restoring RD account..."),                   [this] { RestoreRDAccount(); return true; },            true, {},    { 0, 1 } },
+    };
+    return steps;
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -964,8 +1350,10 @@ void CSetupDevelopDlg::RestoreFileSharing()
     bool wasEnabled = m_backup.LoadStateBool(_T("file_sharing_was_enabled"));
     if (!wasEnabled)
     {
-        CWinUtils::EnableFirewallRuleGroup(_T("File and Printer Sharing"), false);
-        m_log.LogSuccess(_T("File and Printer Sharing disabled."));
+        if (CWinUtils::EnableFirewallRuleGroup(_T("File and Printer Sharing"), false))
+            m_log.LogSuccess(_T("File and Printer Sharing disabled."));
+        else
+            m_log.LogWarning(_T("Could not disable the File and Printer Sharing firewall rules."));
     }
     else
     {
@@ -978,8 +1366,10 @@ void CSetupDevelopDlg::RestoreNetworkDiscovery()
     bool wasEnabled = m_backup.LoadStateBool(_T("network_discovery_was_enabled"));
     if (!wasEnabled)
     {
-        CWinUtils::EnableFirewallRuleGroup(_T("Network Discovery"), false);
-        m_log.LogSuccess(_T("Network Discovery disabled."));
+        if (CWinUtils::EnableFirewallRuleGroup(_T("Network Discovery"), false))
+            m_log.LogSuccess(_T("Network Discovery disabled."));
+        else
+            m_log.LogWarning(_T("Could not disable the Network Discovery firewall rules."));
     }
     else
     {
@@ -1,13 +1,24 @@
 #pragma once
 
+#include "../Common/FirewallSession.h"
+#include "../Common/Headless.h"
 #include "../Common/LogUtils.h"
+#include "../Common/PowerShellPlan.h"
+#include "../Common/PrereqCache.h"
 #include "../Common/RegistryBackup.h"
+#include "../Common/SettingsUtils.h"
+#include "../Common/StepRunner.h"
+#include "../Common/WinUtils.h"
 
 class CSetupDevelopDlg : public CDialogEx
 {
 public:
     CSetupDevelopDlg(CWnd* pParent = nullptr);
 
+    // Run Setup or Restore without creating the window (command line, see
+    // Headless.h). Log output is echoed to hOut; returns the exit code.
+    int RunHeadless(const HeadlessOptions& options, HANDLE hOut);
+
 #ifdef AFX_DESIGN_TIME
     enum { IDD = IDD_SETUPDEVELOP_DIALOG };
 #endif
@@ -15,6 +26,7 @@ public:
 protected:
     virtual void DoDataExchange(CDataExchange* pDX);
     virtual BOOL OnInitDialog();
+    virtual void OnCancel();
 
     HICON m_hIcon;
 
@@ -34,13 +46,25 @@ protected:
     CString m_strShareName;
     CString m_strVPNSubnet;
 
+    // Persisted settings: one entry per field, see the .cpp
+    static const SettingField<CSetupDevelopDlg> s_settings[];
+
     // Utility objects
     CLogUtils       m_log;
     CRegistryBackup m_backup;
+    CStepRunner     m_runner;     // declared after m_log: stopped before the log goes away
 
     // Internal state
-    static const int TOTAL_SETUP_STEPS = 12;
-    static const int TOTAL_RESTORE_STEPS = 10;
+    static const UINT_PTR PROGRESS_TIMER_ID = 1;
+    bool m_restoreRun;            // true while the runner is executing the restore sequence
+    PrereqStatus m_prereq;        // last shown VPN status (cached, then refreshed)
+
+    // Plan compiled by the PowerShell step's isInPlace check; the step runs
+    // it instead of querying adapter and share again (see StepCreateShare)
+    CPowerShellPlan m_checkedPlan;
+    AdapterInfo     m_checkedVPN;
+    int             m_checkedPrivateItem;
+    bool            m_planChecked;
 
     // Event handlers
     afx_msg void OnPaint();
@@ -49,10 +73,29 @@ protected:
     afx_msg void OnBnClickedBrowse();
     afx_msg void OnBnClickedSetup();
     afx_msg void OnBnClickedRestore();
+    afx_msg void OnBnClickedStop();
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
+    afx_msg LRESULT OnStepProgress(WPARAM wParam, LPARAM lParam);
+    afx_msg LRESULT OnStepComplete(WPARAM wParam, LPARAM lParam);
+    afx_msg LRESULT OnPrereqStatus(WPARAM wParam, LPARAM lParam);
+
+    // Headless run of SetupTest on the Test PCs listed in the fleet file
+    int RunFleet(LPCTSTR fleetPath);
+
+    // Worker-thread run control
+    std::vector<SetupStep> BuildSetupSteps();       // logs the run header and records the configuration
+    std::vector<SetupStep> BuildRestoreSteps();
+    void BeginRun(bool restore, std::vector<SetupStep> steps);
+    bool StartRun(bool restore, std::vector<SetupStep> steps, HWND hNotify);
+    CString GetRunInputs() const;                   // settings a setup applies; resume needs the same ones
+    void FinishRun(bool allOk, bool cancelled);     // after the worker finished: journal, trace, banner
+    void UpdateProgressText();
 
     // Setup step methods
     void DetectVPNStatus();
+    void ShowVPNStatus();
     bool ValidateInputs();
+    CString GetInputError(CWnd** ppField = nullptr);   // empty when the inputs are usable (folder not checked)
 
     // Setup steps
     bool StepCreateRDAccount();
@@ -66,8 +109,15 @@ protected:
     bool StepCreateDebuggerFirewallRule();
     bool StepCreateShare();
     bool StepSetNTFSPermissions();
+    bool StepApplyPowerShellPlan();
     void StepDisplaySummary();
 
+    // Desired state shared by the steps and their isInPlace checks
+    FirewallRule SMBFirewallRule() const;
+    FirewallRule DebuggerFirewallRule() const;
+    bool IsVPNAdapterPrivateInPlace();
+    int  CompilePowerShellPlan(CPowerShellPlan& plan, AdapterInfo& vpn);
+
     // Restore steps
     void RestoreNTFSPermissions();
     void RestoreShare();
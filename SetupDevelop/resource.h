@@ -15,6 +15,8 @@
 #define IDC_BUTTON_RESTORE              1008
 #define IDC_EDIT_TV_ID                  1009
 #define IDC_BUTTON_CONNECT_VPN          1010
+#define IDC_BUTTON_STOP                 1011
+#define IDC_STATIC_PROGRESS             1012
 
 // Next default values for new objects
 //
@@ -22,7 +24,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        130
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1011
+#define _APS_NEXT_CONTROL_VALUE         1013
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "SetupTest.h"
 #include "SetupTestDlg.h"
+#include "../Common/Headless.h"
+#include "../Common/PowerShellHost.h"
+#include "../Common/TraceRecorder.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -12,6 +15,7 @@ END_MESSAGE_MAP()
 CSetupTestApp theApp;
 
 CSetupTestApp::CSetupTestApp()
+    : m_exitCode(EXIT_SUCCEEDED)
 {
     m_dwRestartManagerSupportFlags = AFX_RESTART_MANAGER_SUPPORT_RESTART;
 }
@@ -36,13 +40,44 @@ BOOL CSetupTestApp::InitInstance()
 
     SetRegistryKey(_T("RemoteDebugSetup"));
 
-    CSetupTestDlg dlg;
-    m_pMainWnd = &dlg;
-    INT_PTR nResponse = dlg.DoModal();
+    // /trace: record every external call and write a Chrome trace after each run
+    if (_tcsstr(m_lpCmdLine, _T("/trace")) != nullptr)
+        CTraceRecorder::Enable();
+
+    // Start the PowerShell host now so its cold start overlaps dialog creation
+    CPowerShellHost::Instance().Warmup();
+
+    // --setup / --restore: run the same steps without any window
+    HeadlessOptions options;
+    CString argError;
+    if (!CHeadless::ParseCommandLine(options, argError) || options.command != HEADLESS_NONE)
+    {
+        HANDLE hOut = CHeadless::AttachOutput();
+        if (!argError.IsEmpty() || options.command == HEADLESS_HELP)
+        {
+            if (!argError.IsEmpty())
+                CLogUtils::WriteOutput(hOut, argError + _T("\r\n"));
+            CLogUtils::WriteOutput(hOut, CHeadless::Usage(_T("SetupTest")));
+            m_exitCode = argError.IsEmpty() ? EXIT_SUCCEEDED : EXIT_USAGE;
+        }
+        else
+        {
+            CSetupTestDlg dlg;
+            m_exitCode = dlg.RunHeadless(options, hOut);
+        }
+    }
+    else
+    {
+        CSetupTestDlg dlg;
+        m_pMainWnd = &dlg;
+        dlg.DoModal();
+    }
 
     if (pShellManager != nullptr)
         delete pShellManager;
 
+    CPowerShellHost::Instance().Shutdown();
+
     CoUninitialize();
 
 #if !defined(_AFXDLL) && !defined(_AFX_NO_MFC_CONTROLS_IN_DIALOGS)
@@ -51,3 +86,9 @@ BOOL CSetupTestApp::InitInstance()
 
     return FALSE;
 }
+
+int CSetupTestApp::ExitInstance()
+{
+    CWinApp::ExitInstance();
+    return m_exitCode;
+}
@@ -3,7 +3,10 @@
 #include "SetupTestDlg.h"
 #include "../Common/WinUtils.h"
 #include "../Common/TeamViewerUtils.h"
-#include "../Common/SettingsUtils.h"
+#include "../Common/FirewallSession.h"
+#include "../Common/TraceRecorder.h"
+#include "../Common/ConnectivityProbe.h"
+#include <memory>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -13,15 +16,24 @@
 // Construction
 // ════════════════════════════════════════════════════════════════
 
+// Defined before the constructor, which applies the defaults
+const SettingField<CSetupTestDlg> CSetupTestDlg::s_settings[] =
+{
+    { SettingName(KEY_DEV_HOSTNAME),  &CSetupTestDlg::m_strDevHostname,  SETTING_TEXT,         _T("DELL") },
+    { SettingName(KEY_DEV_VPN_IP),    &CSetupTestDlg::m_strDevVPNIP,     SETTING_IPV4,         _T("") },
+    { SettingName(KEY_SHARE_NAME),    &CSetupTestDlg::m_strShareName,    SETTING_TEXT,         _T("CTrack-software") },
+    { SettingName(KEY_PASSWORD),      &CSetupTestDlg::m_strPassword,     SETTING_TEXT,         _T("a") },
+    { SettingName(KEY_DEBUGGER_PORT), &CSetupTestDlg::m_strDebuggerPort, SETTING_PORT,         _T("4026") },
+    { SettingName(KEY_DRIVE_LETTER),  &CSetupTestDlg::m_strDriveLetter,  SETTING_DRIVE_LETTER, _T("Z:") },
+};
+
 CSetupTestDlg::CSetupTestDlg(CWnd* pParent)
     : CDialogEx(IDD_SETUPTEST_DIALOG, pParent)
-    , m_strDevHostname(_T("DELL"))
-    , m_strDevVPNIP(_T(""))
-    , m_strShareName(_T("CTrack-software"))
-    , m_strPassword(_T("a"))
-    , m_strDebuggerPort(_T("4026"))
+    , m_restoreRun(false)
+    , m_driveLetter(_T('Z'))
 {
     m_hIcon = AfxGetApp()->LoadIcon(IDR_MAINFRAME);
+    CSettingsUtils::ApplyDefaults(s_settings, *this);
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -54,6 +66,11 @@ BEGIN_MESSAGE_MAP(CSetupTestDlg, CDialogEx)
     ON_BN_CLICKED(IDC_BUTTON_INSTALL_DEBUGGER, &CSetupTestDlg::OnBnClickedInstallDebugger)
     ON_BN_CLICKED(IDC_BUTTON_SETUP, &CSetupTestDlg::OnBnClickedSetup)
     ON_BN_CLICKED(IDC_BUTTON_RESTORE, &CSetupTestDlg::OnBnClickedRestore)
+    ON_BN_CLICKED(IDC_BUTTON_STOP, &CSetupTestDlg::OnBnClickedStop)
+    ON_WM_TIMER()
+    ON_MESSAGE(WM_STEP_PROGRESS, &CSetupTestDlg::OnStepProgress)
+    ON_MESSAGE(WM_STEP_COMPLETE, &CSetupTestDlg::OnStepComplete)
+    ON_MESSAGE(WM_PREREQ_STATUS, &CSetupTestDlg::OnPrereqStatus)
 END_MESSAGE_MAP()
 
 // ════════════════════════════════════════════════════════════════
@@ -99,22 +116,18 @@ BOOL CSetupTestDlg::OnInitDialog()
 
     // Load saved settings
     CString settingsPath = CSettingsUtils::GetSettingsDir() + _T("\\SetupTest.json");
-    std::map<CString, CString> settings;
-    if (CSettingsUtils::Load(settingsPath, settings))
-    {
-        if (settings.count(_T("DevHostname")))   m_strDevHostname = settings[_T("DevHostname")];
-        if (settings.count(_T("DevVPNIP")))      m_strDevVPNIP = settings[_T("DevVPNIP")];
-        if (settings.count(_T("ShareName")))     m_strShareName = settings[_T("ShareName")];
-        if (settings.count(_T("Password")))      m_strPassword = settings[_T("Password")];
-        if (settings.count(_T("DebuggerPort")))  m_strDebuggerPort = settings[_T("DebuggerPort")];
-        if (settings.count(_T("DriveLetter")))
-        {
-            int idx = m_comboDriveLetter.FindStringExact(-1, settings[_T("DriveLetter")]);
-            if (idx >= 0)
-                m_comboDriveLetter.SetCurSel(idx);
-        }
+    CString settingsError;
+    if (CSettingsUtils::Load(settingsPath, s_settings, *this, &settingsError))
+    {
+        int idx = m_comboDriveLetter.FindStringExact(-1, m_strDriveLetter);
+        if (idx >= 0)
+            m_comboDriveLetter.SetCurSel(idx);
         UpdateData(FALSE);
     }
+    if (!settingsError.IsEmpty())
+    {
+        m_log.LogWarning(_T("Saved settings ignored (") + settingsPath + _T(", ") + settingsError + _T(")."));
+    }
 
     m_log.LogSeparator();
     CString buildInfo;
@@ -155,25 +168,103 @@ HCURSOR CSetupTestDlg::OnQueryDragIcon()
     return static_cast<HCURSOR>(m_hIcon);
 }
 
+// ════════════════════════════════════════════════════════════════
+// Headless Run
+// ════════════════════════════════════════════════════════════════
+
+int CSetupTestDlg::RunHeadless(const HeadlessOptions& options, HANDLE hOut)
+{
+    bool restore = options.command == HEADLESS_RESTORE;
+    LPCTSTR operation = restore ? _T("Restore") : _T("Setup");
+
+    // What OnInitDialog does, minus the controls and the VPN IP prompt
+    m_log.SetConsoleOutput(hOut, options.json);
+    m_log.InitFileLog(_T("SetupTest"));
+    m_log.SetOperation(restore ? _T("restore") : _T("setup"));
+    m_backup.Initialize(_T("state_test"));
+
+    if (options.command == HEADLESS_FLEET)
+        return CHeadless::Abort(m_log, _T("Fleet"), EXIT_USAGE, _T("--fleet is run by SetupDevelop on the Dev PC."));
+
+    if (!CWinUtils::IsRunningAsAdmin())
+        return CHeadless::Abort(m_log, operation, EXIT_NOT_ADMIN, _T("This program must be run as Administrator!"));
+
+    // Saved settings first; the configuration file overrides them key by key
+    CSettingsUtils::Load(CSettingsUtils::GetSettingsDir() + _T("\\SetupTest.json"), s_settings, *this);
+    if (!options.configPath.IsEmpty())
+    {
+        CString error;
+        if (!CSettingsUtils::Load(options.configPath, s_settings, *this, &error) || !error.IsEmpty())
+        {
+            return CHeadless::Abort(m_log, operation, EXIT_USAGE, _T("Configuration ") + options.configPath + _T(": ") +
+                                    (error.IsEmpty() ? CString(_T("cannot be read")) : error));
+        }
+    }
+
+    if (!restore)
+    {
+        CString error = GetInputError();
+        if (!error.IsEmpty())
+            return CHeadless::Abort(m_log, operation, EXIT_USAGE, error);
+    }
+
+    if (!StartRun(restore, restore ? BuildRestoreSteps() : BuildSetupSteps(), nullptr))
+        return CHeadless::Abort(m_log, operation, EXIT_START_FAILED, _T("Nothing was changed."));
+    CHeadless::WaitForRun(m_runner);
+    FinishRun(m_runner.AllSucceeded(), m_runner.IsCancelled());
+    return CHeadless::Finish(m_runner, m_log, operation);
+}
+
 // ════════════════════════════════════════════════════════════════
 // Prerequisite Checks
 // ════════════════════════════════════════════════════════════════
 
 void CSetupTestDlg::CheckPrerequisites()
 {
-    DetectVPNStatus();
-    DetectDebuggerStatus();
+    // Show the last known status at once; the search for msvsmon.exe can take
+    // seconds on a cold disk, so the real check runs in the background
+    if (CPrereqCache::Load(CPrereqCache::GetCachePath(_T("SetupTest")), m_prereq))
+    {
+        ShowVPNStatus();
+        ShowDebuggerStatus();
+    }
+    else
+    {
+        m_staticVPNStatus.SetWindowText(_T("Checking..."));
+        m_staticDebuggerStatus.SetWindowText(_T("Checking..."));
+    }
+
+    CPrereqCache::DetectAsync(GetSafeHwnd(), PREREQ_VPN | PREREQ_DEBUGGER);
+}
+
+LRESULT CSetupTestDlg::OnPrereqStatus(WPARAM wParam, LPARAM lParam)
+{
+    std::unique_ptr<PrereqStatus> status(reinterpret_cast<PrereqStatus*>(lParam));
+    if (wParam & PREREQ_VPN)
+    {
+        m_prereq.teamViewerInstalled = status->teamViewerInstalled;
+        m_prereq.vpnDriverInstalled = status->vpnDriverInstalled;
+        m_prereq.vpnIP = status->vpnIP;
+        ShowVPNStatus();
+    }
+    if (wParam & PREREQ_DEBUGGER)
+    {
+        m_prereq.debuggerPath = status->debuggerPath;
+        ShowDebuggerStatus();
+    }
+
+    CPrereqCache::Save(CPrereqCache::GetCachePath(_T("SetupTest")), m_prereq);
+    return 0;
 }
 
-void CSetupTestDlg::DetectVPNStatus()
+void CSetupTestDlg::ShowVPNStatus()
 {
-    if (CTeamViewerUtils::IsVPNDriverInstalled())
+    if (m_prereq.vpnDriverInstalled)
     {
-        CString vpnIP = CTeamViewerUtils::GetVPNIPAddress();
-        if (!vpnIP.IsEmpty())
+        if (!m_prereq.vpnIP.IsEmpty())
         {
             CString status;
-            status.Format(_T("Installed & Connected (IP: %s)"), (LPCTSTR)vpnIP);
+            status.Format(_T("Installed & Connected (IP: %s)"), (LPCTSTR)m_prereq.vpnIP);
             m_staticVPNStatus.SetWindowText(status);
         }
         else
@@ -182,7 +273,7 @@ void CSetupTestDlg::DetectVPNStatus()
         }
         GetDlgItem(IDC_BUTTON_INSTALL_VPN)->EnableWindow(FALSE);
     }
-    else if (CTeamViewerUtils::IsTeamViewerInstalled())
+    else if (m_prereq.teamViewerInstalled)
     {
         m_staticVPNStatus.SetWindowText(_T("Not installed (TeamViewer found)"));
         GetDlgItem(IDC_BUTTON_INSTALL_VPN)->EnableWindow(TRUE);
@@ -194,9 +285,9 @@ void CSetupTestDlg::DetectVPNStatus()
     }
 }
 
-void CSetupTestDlg::DetectDebuggerStatus()
+void CSetupTestDlg::ShowDebuggerStatus()
 {
-    CString debuggerPath = CTeamViewerUtils::GetRemoteDebuggerPath();
+    const CString& debuggerPath = m_prereq.debuggerPath;
     if (!debuggerPath.IsEmpty())
     {
         CString status;
@@ -278,7 +369,8 @@ void CSetupTestDlg::OnBnClickedInstallVPN()
 {
     CTeamViewerUtils::InstallVPNDriver();
     // Re-check after user returns
-    DetectVPNStatus();
+    m_staticVPNStatus.SetWindowText(_T("Checking..."));
+    CPrereqCache::DetectAsync(GetSafeHwnd(), PREREQ_VPN);
 }
 
 void CSetupTestDlg::OnBnClickedInstallDebugger()
@@ -291,7 +383,8 @@ void CSetupTestDlg::OnBnClickedInstallDebugger()
         MB_OK | MB_ICONINFORMATION);
 
     // Re-check
-    DetectDebuggerStatus();
+    m_staticDebuggerStatus.SetWindowText(_T("Checking..."));
+    CPrereqCache::DetectAsync(GetSafeHwnd(), PREREQ_DEBUGGER);
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -302,18 +395,33 @@ bool CSetupTestDlg::ValidateInputs()
 {
     UpdateData(TRUE);
 
-    if (m_strDevHostname.IsEmpty())
+    CWnd* pField = nullptr;
+    CString error = GetInputError(&pField);
+    if (!error.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the Dev PC hostname."), MB_OK | MB_ICONWARNING);
-        m_editDevHostname.SetFocus();
+        AfxMessageBox(error, MB_OK | MB_ICONWARNING);
+        if (pField)
+            pField->SetFocus();
         return false;
     }
+    return true;
+}
+
+CString CSetupTestDlg::GetInputError(CWnd** ppField)
+{
+    CWnd* pDummy = nullptr;
+    CWnd*& pField = ppField ? *ppField : pDummy;
+
+    if (m_strDevHostname.IsEmpty())
+    {
+        pField = &m_editDevHostname;
+        return _T("Please enter the Dev PC hostname.");
+    }
 
     if (m_strDevVPNIP.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the Dev PC VPN IP address."), MB_OK | MB_ICONWARNING);
-        m_editDevVPNIP.SetFocus();
-        return false;
+        pField = &m_editDevVPNIP;
+        return _T("Please enter the Dev PC VPN IP address.");
     }
 
     // Basic IP validation (must have 3 dots)
@@ -325,54 +433,36 @@ bool CSetupTestDlg::ValidateInputs()
     }
     if (dotCount != 3)
     {
-        AfxMessageBox(_T("Please enter a valid IPv4 address for the Dev PC VPN IP."), MB_OK | MB_ICONWARNING);
-        m_editDevVPNIP.SetFocus();
-        return false;
+        pField = &m_editDevVPNIP;
+        return _T("Please enter a valid IPv4 address for the Dev PC VPN IP.");
     }
 
     if (m_strShareName.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the share name from the Dev PC."), MB_OK | MB_ICONWARNING);
-        m_editShareName.SetFocus();
-        return false;
+        pField = &m_editShareName;
+        return _T("Please enter the share name from the Dev PC.");
     }
 
     if (m_strPassword.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the RD account password."), MB_OK | MB_ICONWARNING);
-        m_editPassword.SetFocus();
-        return false;
+        pField = &m_editPassword;
+        return _T("Please enter the RD account password.");
     }
 
     if (m_strDebuggerPort.IsEmpty())
     {
-        AfxMessageBox(_T("Please enter the Remote Debugger port."), MB_OK | MB_ICONWARNING);
-        m_editDebuggerPort.SetFocus();
-        return false;
+        pField = &m_editDebuggerPort;
+        return _T("Please enter the Remote Debugger port.");
     }
 
     int port = _ttoi(m_strDebuggerPort);
     if (port < 1024 || port > 65535)
     {
-        AfxMessageBox(_T("Debugger port must be between 1024 and 65535."), MB_OK | MB_ICONWARNING);
-        m_editDebuggerPort.SetFocus();
-        return false;
+        pField = &m_editDebuggerPort;
+        return _T("Debugger port must be between 1024 and 65535.");
     }
 
-    return true;
-}
-
-TCHAR CSetupTestDlg::GetSelectedDriveLetter()
-{
-    CString sel;
-    int idx = m_comboDriveLetter.GetCurSel();
-    if (idx >= 0)
-    {
-        m_comboDriveLetter.GetLBText(idx, sel);
-        if (!sel.IsEmpty())
-            return sel[0];
-    }
-    return _T('Z');
+    return CString();
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -385,25 +475,16 @@ void CSetupTestDlg::OnBnClickedSetup()
         return;
 
     // Save settings for next launch
-    {
-        std::map<CString, CString> settings;
-        settings[_T("DevHostname")] = m_strDevHostname;
-        settings[_T("DevVPNIP")] = m_strDevVPNIP;
-        settings[_T("ShareName")] = m_strShareName;
-        settings[_T("Password")] = m_strPassword;
-        settings[_T("DebuggerPort")] = m_strDebuggerPort;
-        CString driveSel;
-        int idx = m_comboDriveLetter.GetCurSel();
-        if (idx >= 0) m_comboDriveLetter.GetLBText(idx, driveSel);
-        settings[_T("DriveLetter")] = driveSel;
-        CSettingsUtils::Save(
-            CSettingsUtils::GetSettingsDir() + _T("\\SetupTest.json"), settings);
-    }
+    int driveIdx = m_comboDriveLetter.GetCurSel();
+    if (driveIdx >= 0)
+        m_comboDriveLetter.GetLBText(driveIdx, m_strDriveLetter);
+    CSettingsUtils::Save(CSettingsUtils::GetSettingsDir() + _T("\\SetupTest.json"), s_settings, *this);
 
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    BeginRun(false, BuildSetupSteps());
+}
 
-    CWaitCursor wait;
+std::vector<SetupStep> CSetupTestDlg::BuildSetupSteps()
+{
     m_log.Clear();
     m_log.SetOperation(_T("setup"));
     {
@@ -416,7 +497,8 @@ void CSetupTestDlg::OnBnClickedSetup()
     m_log.LogSeparator();
     m_log.Log(_T(""));
 
-    TCHAR driveLetter = GetSelectedDriveLetter();
+    m_driveLetter = m_strDriveLetter.IsEmpty() ? _T('Z') : m_strDriveLetter[0];
+    TCHAR driveLetter = m_driveLetter;
 
     // Log configuration
     {
@@ -434,72 +516,229 @@ void CSetupTestDlg::OnBnClickedSetup()
     CString dl;
     dl.Format(_T("%c"), driveLetter);
     m_backup.SaveState(_T("drive_letter"), dl);
+    m_backup.Commit();
+
+    // Independent steps run in parallel; dependsOn lists 0-based table indices.
+    // Connectivity, debugger lookup and summary are informational only.
+    std::vector<SetupStep> steps = {
+        /* 0 */ { _T("Creating local RD account..."),               [this] { return StepCreateRDAccount(); },             true },
+        /* 1 */ { _T("Adding RD to Administrators group..."),       [this] { return StepAddRDToAdmins(); },               true, { 0 } },
+        /* 2 */ { _T("Setting NTLMv2 authentication level..."),     [this] { return StepSetNTLMv2(); },                   true },
+        /* 3 */ { _T("Creating Remote Debugger firewall rule..."),  [this] { return StepCreateDebuggerFirewallRule(); },  true },
+        /* 4 */ { _T("Verifying VPN connectivity to Dev PC..."),    [this] { return StepVerifyConnectivity(); },          false },
+        /* 5 */ { _T("Mapping shared folder..."),                   [this] { return StepMapSharedFolder(); },            true, { 2 } },
+        /* 6 */ { _T("Verifying mapped drive..."),                  [this]
+            {
+                bool ok = StepVerifyMappedDrive();
+
+                // When running elevated, the drive mapped in step 6 is only visible in
+                // the admin session. Disconnect the elevated mapping and recreate it in
+                // the non-elevated (Explorer) session. Asks the session itself whether
+                // the share is mapped here, so a resumed run that skipped the map step
+                // (done before the kill) still moves the mapping over.
+                if (CWinUtils::IsRunningAsAdmin() && IsShareMappedHere())
+                    StepRemapForExplorer();
+                return ok;
+            },                                                                                                            true, { 5 } },
+        /* 7 */ { _T("Locating Visual Studio Remote Debugger..."),  [this] { return StepLocateRemoteDebugger(); },        false },
+        /* 8 */ { _T("Setup complete."),                            [this] { StepDisplaySummary(); return true; },        false, CStepRunner::AllBefore(8) },
+    };
+
+    // Cheap read-only checks, all run before the first step: a step already
+    // in the desired state is skipped. The account, the mapping and the
+    // informational steps always run.
+    steps[1].isInPlace = [] { return CWinUtils::IsUserInGroup(_T("RD"), _T("Administrators")); };
+    steps[2].isInPlace = [] { return CWinUtils::RegistryDwordEquals(_T("SYSTEM\\CurrentControlSet\\Control\\Lsa"),
+                                                                    _T("LmCompatibilityLevel"), 3); };
+    steps[3].isInPlace = [this] { CFirewallSession firewall; return firewall.HasRule(DebuggerFirewallRule()); };
+    return steps;
+}
 
-    int step = 0;
-    bool allOk = true;
+// ════════════════════════════════════════════════════════════════
+// Worker-Thread Run Control
+// ════════════════════════════════════════════════════════════════
 
-    // Step 1: Create RD account
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating local RD account..."));
-    if (!StepCreateRDAccount()) allOk = false;
+CString CSetupTestDlg::GetRunInputs() const
+{
+    CString inputs;
+    inputs.Format(_T("%s\n%s\n%s\n%c\n%s"), (LPCTSTR)m_strDevHostname, (LPCTSTR)m_strDevVPNIP,
+                  (LPCTSTR)m_strShareName, m_driveLetter, (LPCTSTR)m_strDebuggerPort);
+    return inputs;
+}
 
-    // Step 2: Add RD to Administrators
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Adding RD to Administrators group..."));
-    if (!StepAddRDToAdmins()) allOk = false;
+void CSetupTestDlg::BeginRun(bool restore, std::vector<SetupStep> steps)
+{
+    if (!StartRun(restore, std::move(steps), GetSafeHwnd()))
+        return;
 
-    // Step 3: Set NTLMv2 authentication
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Setting NTLMv2 authentication level..."));
-    if (!StepSetNTLMv2()) allOk = false;
+    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
+    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(TRUE);
+    SetTimer(PROGRESS_TIMER_ID, 200, nullptr);
+    UpdateProgressText();
+}
 
-    // Step 4: Create debugger firewall rule
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Creating Remote Debugger firewall rule..."));
-    if (!StepCreateDebuggerFirewallRule()) allOk = false;
+bool CSetupTestDlg::StartRun(bool restore, std::vector<SetupStep> steps, HWND hNotify)
+{
+    CSetupJournal& journal = m_backup.Journal();
+
+    // A setup that was killed or stopped continues where it left off, as
+    // long as it applies the same settings
+    CString inputs = restore ? CString() : CSetupJournal::Fingerprint(GetRunInputs());
+    bool interrupted = !restore && journal.HasInterruptedSetup();
+    bool resume = interrupted && journal.GetSetupInputs() == inputs;
+    if (resume)
+        m_log.LogInfo(_T("Resuming the interrupted setup: steps that already succeeded are skipped."));
+    else if (interrupted)
+        m_log.LogInfo(_T("Settings changed since the interrupted setup: every step runs again."));
+
+    // State written by a version without the journal: undo everything, as before
+    bool undoAll = restore && !journal.HasSetupHistory();
+    if (restore)
+    {
+        for (int step : journal.GetUnfinishedSteps())
+        {
+            CString msg;
+            msg.Format(_T("Setup step %d was interrupted before it finished; its changes are not undone."), step + 1);
+            m_log.LogWarning(msg);
+        }
+    }
 
-    // Step 5: Verify connectivity
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Verifying VPN connectivity to Dev PC..."));
-    StepVerifyConnectivity();  // Don't fail on this, just warn
+    for (int i = 0; i < static_cast<int>(steps.size()); i++)
+    {
+        auto run = std::move(steps[i].run);
+        std::vector<int> undoes = steps[i].undoes;
+        steps[i].run = [this, run, i, restore, resume, undoAll, undoes] {
+            CSetupJournal& journal = m_backup.Journal();
+            bool ok;
+            if (!restore)
+            {
+                if (resume && journal.IsStepDone(i))
+                {
+                    m_log.LogInfo(_T("Already done before the interruption, skipped."));
+                    return true;
+                }
+                journal.BeginStep(i);
+                CSetupJournal::SetCurrentStep(i);
+                ok = run();
+                CSetupJournal::SetCurrentStep(-1);
+            }
+            else
+            {
+                bool needed = undoAll || undoes.empty();
+                for (int s : undoes)
+                    needed = needed || journal.NeedsUndo(s);
+                if (!needed)
+                {
+                    m_log.LogInfo(_T("Setup never completed this change, nothing to undo."));
+                    return true;
+                }
+                ok = run();
+            }
 
-    // Step 6: Map shared folder
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Mapping shared folder..."));
-    bool mapOk = StepMapSharedFolder();
-    if (!mapOk) allOk = false;
+            // Commit the state the step recorded in one write, then mark it in the journal
+            if (!m_backup.Commit())
+                m_log.LogWarning(_T("Could not write the state file ") + m_backup.GetStateFilePath());
+            if (!restore)
+                journal.CommitStep(i, ok);
+            else
+                for (int s : undoes)
+                    journal.MarkUndone(s);
+            return ok;
+        };
+    }
 
-    // Step 7: Verify mapped drive
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Verifying mapped drive..."));
-    if (!StepVerifyMappedDrive()) allOk = false;
+    CTraceRecorder::Reset();
+    CTraceRecorder::AddSecret(m_strPassword);
 
-    // When running elevated, the drive mapped in step 5 is only visible in
-    // the admin session. Disconnect the elevated mapping and recreate it in
-    // the non-elevated (Explorer) session. Only requires that the mapping
-    // itself succeeded (step 5), regardless of other step failures.
-    if (mapOk && CWinUtils::IsRunningAsAdmin())
+    m_restoreRun = restore;
+    journal.BeginRun(restore, inputs);
+    if (!m_runner.Start(hNotify, &m_log, std::move(steps)))
     {
-        StepRemapForExplorer();
+        journal.EndRun(false);
+        m_log.LogError(_T("Could not start the worker thread."));
+        return false;
     }
+    return true;
+}
 
-    // Step 8: Locate Remote Debugger
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Locating Visual Studio Remote Debugger..."));
-    StepLocateRemoteDebugger();  // Informational only
-
-    // Step 9: Summary
-    m_log.LogStep(++step, TOTAL_SETUP_STEPS, _T("Setup complete."));
-    StepDisplaySummary();
+void CSetupTestDlg::OnBnClickedStop()
+{
+    if (!m_runner.IsRunning())
+        return;
+    m_log.LogWarning(_T("Stopping - no further steps will be started..."));
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(FALSE);
+    m_runner.Cancel();
+}
 
-    m_log.Log(_T(""));
-    if (allOk)
+void CSetupTestDlg::OnCancel()
+{
+    // Closing mid-run: stop the worker before the dialog (and its log) goes away
+    if (m_runner.IsRunning())
     {
-        m_log.LogSeparator();
-        m_log.Log(_T("  ALL STEPS COMPLETED SUCCESSFULLY"));
-        m_log.LogSeparator();
+        CWaitCursor wait;
+        m_runner.Cancel();
+        m_runner.Wait();
     }
-    else
+    CDialogEx::OnCancel();
+}
+
+void CSetupTestDlg::OnTimer(UINT_PTR nIDEvent)
+{
+    if (nIDEvent == PROGRESS_TIMER_ID)
     {
-        m_log.LogSeparator();
-        m_log.Log(_T("  SETUP COMPLETED WITH WARNINGS (see above)"));
-        m_log.LogSeparator();
+        UpdateProgressText();
+        return;
     }
+    CDialogEx::OnTimer(nIDEvent);
+}
+
+void CSetupTestDlg::UpdateProgressText()
+{
+    SetDlgItemText(IDC_STATIC_PROGRESS,
+                   m_runner.FormatProgress(m_restoreRun ? _T("Restore") : _T("Setup")));
+}
 
+LRESULT CSetupTestDlg::OnStepProgress(WPARAM /*wParam*/, LPARAM /*lParam*/)
+{
+    UpdateProgressText();
+    return 0;
+}
+
+LRESULT CSetupTestDlg::OnStepComplete(WPARAM wParam, LPARAM lParam)
+{
+    KillTimer(PROGRESS_TIMER_ID);
+    FinishRun(wParam != 0, lParam != 0);
+    UpdateProgressText();
+
+    GetDlgItem(IDC_BUTTON_STOP)->EnableWindow(FALSE);
     GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(TRUE);
     GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(m_backup.HasSavedState());
+    return 0;
+}
+
+void CSetupTestDlg::FinishRun(bool allOk, bool cancelled)
+{
+    m_runner.Wait();
+    m_backup.Journal().EndRun(!cancelled);
+
+    CString tracePath = CTraceRecorder::WriteNextTo(m_log.GetLogFilePath(),
+                                                    m_restoreRun ? _T("restore") : _T("setup"));
+    if (!tracePath.IsEmpty())
+        m_log.LogInfo(_T("Trace written to ") + tracePath);
+
+    m_log.Log(_T(""));
+    m_log.LogSeparator();
+    if (m_restoreRun)
+        m_log.Log(cancelled ? _T("  RESTORE STOPPED - run Restore again to finish")
+                            : _T("  RESTORE COMPLETE"));
+    else if (cancelled)
+        m_log.Log(_T("  SETUP STOPPED - run Restore to undo completed steps"));
+    else if (allOk)
+        m_log.Log(_T("  ALL STEPS COMPLETED SUCCESSFULLY"));
+    else
+        m_log.Log(_T("  SETUP COMPLETED WITH WARNINGS (see above)"));
+    m_log.LogSeparator();
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -607,15 +846,21 @@ bool CSetupTestDlg::StepSetNTLMv2()
     return false;
 }
 
+FirewallRule CSetupTestDlg::DebuggerFirewallRule() const
+{
+    return CFirewallSession::InboundTcpRule(_T("VS Remote Debugger Inbound"),
+        _T("Allow incoming Visual Studio Remote Debugger connections"),
+        _T("4022-4026"), _T("*"));
+}
+
 bool CSetupTestDlg::StepCreateDebuggerFirewallRule()
 {
-    LPCTSTR ruleName = _T("VS Remote Debugger Inbound");
-    bool existed = CWinUtils::FirewallRuleExists(ruleName);
+    FirewallRule rule = DebuggerFirewallRule();
+    CFirewallSession firewall;
+    bool existed = firewall.RuleExists(rule.name);
     m_backup.SaveState(_T("debugger_firewall_rule_existed"), existed);
 
-    if (CWinUtils::CreateFirewallRule(ruleName,
-            _T("Allow incoming Visual Studio Remote Debugger connections"),
-            _T("4022-4026"), _T("*")))
+    if (firewall.ApplyRule(rule))
     {
         m_log.LogSuccess(_T("Firewall rule created (ports 4022-4026, all profiles)."));
         return true;
@@ -627,11 +872,23 @@ bool CSetupTestDlg::StepCreateDebuggerFirewallRule()
 
 bool CSetupTestDlg::StepVerifyConnectivity()
 {
-    m_log.LogInfo(_T("Pinging Dev PC..."));
+    m_log.LogInfo(_T("Probing Dev PC (ping, SMB 445, debugger 4022-4026)..."));
+
+    // One concurrent probe: the step waits for the slowest target, not the sum
+    std::vector<ProbeTarget> targets;
+    targets.push_back(CConnectivityProbe::Icmp(m_strDevVPNIP));
+    targets.push_back(CConnectivityProbe::Tcp(m_strDevVPNIP, 445));
+    for (int port = 4022; port <= 4026; port++)
+        targets.push_back(CConnectivityProbe::Tcp(m_strDevVPNIP, port));
+
+    auto results = CConnectivityProbe::Run(targets, 3000);
 
-    if (CWinUtils::PingHost(m_strDevVPNIP))
+    const ProbeResult& ping = results[0];
+    if (ping.status == PROBE_OPEN)
     {
-        m_log.LogSuccess(_T("Ping successful."));
+        CString msg;
+        msg.Format(_T("Ping successful (%.0f ms)."), ping.rttMs);
+        m_log.LogSuccess(msg);
     }
     else
     {
@@ -639,16 +896,28 @@ bool CSetupTestDlg::StepVerifyConnectivity()
         m_log.LogInfo(_T("Continuing anyway (some networks block ICMP)..."));
     }
 
-    // Test SMB port
-    m_log.LogInfo(_T("Testing SMB port 445..."));
-    if (CWinUtils::TestTcpPort(m_strDevVPNIP, 445))
+    // Debugger ports only answer while something listens on them; informational
+    CString debugPorts;
+    for (size_t i = 2; i < results.size(); i++)
+    {
+        CString item;
+        item.Format(_T("%s%d %s"), debugPorts.IsEmpty() ? _T("") : _T(", "),
+                    results[i].target.port, (LPCTSTR)CConnectivityProbe::Describe(results[i]));
+        debugPorts += item;
+    }
+    m_log.LogInfo(_T("Debugger ports: ") + debugPorts);
+
+    const ProbeResult& smb = results[1];
+    if (smb.status == PROBE_OPEN)
     {
-        m_log.LogSuccess(_T("Port 445 is open on Dev PC."));
+        CString msg;
+        msg.Format(_T("Port 445 is open on Dev PC (%.1f ms)."), smb.rttMs);
+        m_log.LogSuccess(msg);
         return true;
     }
     else
     {
-        m_log.LogWarning(_T("Port 445 is not reachable on Dev PC."));
+        m_log.LogWarning(_T("Port 445 is not reachable on Dev PC: ") + CConnectivityProbe::Describe(smb) + _T("."));
         m_log.LogInfo(_T("Make sure SetupDevelop has been run on the Dev PC."));
         return false;
     }
@@ -656,7 +925,7 @@ bool CSetupTestDlg::StepVerifyConnectivity()
 
 bool CSetupTestDlg::StepMapSharedFolder()
 {
-    TCHAR driveLetter = GetSelectedDriveLetter();
+    TCHAR driveLetter = m_driveLetter;
 
     // Check if drive is already mapped
     bool wasAlreadyMapped = CWinUtils::IsDriveMapped(driveLetter);
@@ -693,7 +962,7 @@ bool CSetupTestDlg::StepMapSharedFolder()
 
 bool CSetupTestDlg::StepVerifyMappedDrive()
 {
-    TCHAR driveLetter = GetSelectedDriveLetter();
+    TCHAR driveLetter = m_driveLetter;
     CString drivePath;
     drivePath.Format(_T("%c:\\"), driveLetter);
 
@@ -737,9 +1006,16 @@ bool CSetupTestDlg::StepVerifyMappedDrive()
     return false;
 }
 
+bool CSetupTestDlg::IsShareMappedHere() const
+{
+    CString uncPath;
+    uncPath.Format(_T("\\\\%s\\%s"), (LPCTSTR)m_strDevVPNIP, (LPCTSTR)m_strShareName);
+    return CWinUtils::IsDriveMapped(m_driveLetter, uncPath);
+}
+
 void CSetupTestDlg::StepRemapForExplorer()
 {
-    TCHAR driveLetter = GetSelectedDriveLetter();
+    TCHAR driveLetter = m_driveLetter;
     CString uncPath;
     uncPath.Format(_T("\\\\%s\\%s"), (LPCTSTR)m_strDevVPNIP, (LPCTSTR)m_strShareName);
     CString userName;
@@ -760,8 +1036,23 @@ void CSetupTestDlg::StepRemapForExplorer()
     delCmd.Format(_T("net.exe use \\\\%s /del /y"), (LPCTSTR)m_strDevVPNIP);
     CWinUtils::RunHiddenCommand(delCmd);
 
-    // Brief pause to let the SMB session close
-    Sleep(1000);
+    // Wait for the SMB connections to this server to close
+    DWORD waitMs = 0;
+    if (!CWinUtils::WaitUntil([this] { return !CWinUtils::IsServerConnected(m_strDevVPNIP); }, 5000, &waitMs))
+    {
+        if (CWinUtils::IsCancelRequested())
+            return;
+        CString msg;
+        msg.Format(_T("Connections to %s still open after %lu ms; remapping anyway."),
+                   (LPCTSTR)m_strDevVPNIP, waitMs);
+        m_log.LogWarning(msg);
+    }
+    else
+    {
+        CString msg;
+        msg.Format(_T("Elevated SMB connections closed (%lu ms)."), waitMs);
+        m_log.LogInfo(msg);
+    }
 
     // Write batch file for the non-elevated net use
     TCHAR tempPath[MAX_PATH];
@@ -794,16 +1085,29 @@ void CSetupTestDlg::StepRemapForExplorer()
     TCHAR shortBat[MAX_PATH];
     GetShortPathName(batPath, shortBat, MAX_PATH);
 
-    CString cmd;
-    cmd.Format(
-        _T("schtasks.exe /create /tn \"RDS_MapDrive\" /tr \"cmd.exe /c %s\" /sc once /st 00:00 /f /rl limited /it"),
-        shortBat);
-    CWinUtils::RunHiddenCommand(cmd);
-    CWinUtils::RunHiddenCommand(_T("schtasks.exe /run /tn \"RDS_MapDrive\""));
-
-    Sleep(5000);
+    DeleteFile(logPath);
 
-    CWinUtils::RunHiddenCommand(_T("schtasks.exe /delete /tn \"RDS_MapDrive\" /f"));
+    CString cmd;
+    cmd.Format(_T("cmd.exe /c %s"), shortBat);
+    DWORD taskResult = 0;
+    if (CWinUtils::RunInteractiveTask(_T("RDS_MapDrive"), cmd, 30000, &taskResult, &waitMs))
+    {
+        CString msg;
+        msg.Format(_T("Explorer-session mapping task finished in %lu ms (exit code %lu)."), waitMs, taskResult);
+        m_log.LogInfo(msg);
+    }
+    else
+    {
+        if (CWinUtils::IsCancelRequested())
+        {
+            DeleteFile(batPath);    // holds the password
+            DeleteFile(logPath);
+            return;
+        }
+        CString msg;
+        msg.Format(_T("Explorer-session mapping task did not finish within %lu ms."), waitMs);
+        m_log.LogWarning(msg);
+    }
 
     // Check result
     CStdioFile logFile;
@@ -866,7 +1170,7 @@ bool CSetupTestDlg::StepLocateRemoteDebugger()
 void CSetupTestDlg::StepDisplaySummary()
 {
     CString hostname = CWinUtils::GetComputerHostName();
-    TCHAR driveLetter = GetSelectedDriveLetter();
+    TCHAR driveLetter = m_driveLetter;
 
     m_log.Log(_T(""));
     m_log.LogSeparator();
@@ -914,10 +1218,11 @@ void CSetupTestDlg::OnBnClickedRestore()
                       MB_YESNO | MB_ICONQUESTION) != IDYES)
         return;
 
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(FALSE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    BeginRun(true, BuildRestoreSteps());
+}
 
-    CWaitCursor wait;
+std::vector<SetupStep> CSetupTestDlg::BuildRestoreSteps()
+{
     m_log.Clear();
     m_log.SetOperation(_T("restore"));
     {
@@ -930,36 +1235,24 @@ void CSetupTestDlg::OnBnClickedRestore()
     m_log.LogSeparator();
     m_log.Log(_T(""));
 
-    int step = 0;
-
-    // Restore in reverse order
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Unmapping network drive..."));
-    RestoreMappedDrive();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing Remote Debugger firewall rule..."));
-    RestoreDebuggerFirewallRule();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Restoring NTLMv2 authentication level..."));
-    RestoreNTLMv2();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing RD from Administrators..."));
-    RestoreRDFromAdmins();
-
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Removing RD account..."));
-    RestoreRDAccount();
-
-    // Step 5: Clear state
-    m_log.LogStep(++step, TOTAL_RESTORE_STEPS, _T("Clearing saved state..."));
-    m_backup.ClearState();
-    m_log.LogSuccess(_T("Saved state cleared."));
-
-    m_log.Log(_T(""));
-    m_log.LogSeparator();
-    m_log.Log(_T("  RESTORE COMPLETE"));
-    m_log.LogSeparator();
-
-    GetDlgItem(IDC_BUTTON_SETUP)->EnableWindow(TRUE);
-    GetDlgItem(IDC_BUTTON_RESTORE)->EnableWindow(FALSE);
+    // Reverse of the setup graph: an undo waits for the undo of every setup step
+    // that depended on it. The last list is the setup steps each row reverts; a
+    // row is skipped when the journal shows none of them finished.
+    // The state is only cleared once every other step ran.
+    std::vector<SetupStep> steps = {
+        /* 0 */ { _T("Unmapping network drive..."),                [this] { RestoreMappedDrive(); return true; },          true, {},    { 5, 6 } },
+        /* 1 */ { _T("Removing Remote Debugger firewall rule..."), [this] { RestoreDebuggerFirewallRule(); return true; }, true, {},    { 3 } },
+        /* 2 */ { _T("Restoring NTLMv2 authentication level..."),  [this] { RestoreNTLMv2(); return true; },               true, { 0 }, { 2 } },
+        /* 3 */ { _T("Removing RD from Administrators..."),        [this] { RestoreRDFromAdmins(); return true; },         true, {},    { 1 } },
+        /* 4 */ { _T("Removing RD account..."),                    [this] { RestoreRDAccount(); return true; },            true, { 3 }, { 0 } },
+        /* 5 */ { _T("Clearing saved state..."),                   [this]
+            {
+                m_backup.ClearState();
+                m_log.LogSuccess(_T("Saved state cleared."));
+                return true;
+            },                                                                                                             true, CStepRunner::AllBefore(5) },
+    };
+    return steps;
 }
 
 // ════════════════════════════════════════════════════════════════
@@ -974,10 +1267,26 @@ void CSetupTestDlg::RestoreMappedDrive()
     if (!wasMapped && !dl.IsEmpty())
     {
         TCHAR letter = dl[0];
-        CWinUtils::UnmapNetworkDrive(letter);
+        DWORD taskWaitMs = 0;
+        bool taskDone = false;
+        bool unmapped = CWinUtils::UnmapNetworkDrive(letter, &taskWaitMs, &taskDone);
         CString msg;
-        msg.Format(_T("Drive %c: unmapped."), letter);
-        m_log.LogSuccess(msg);
+        if (!unmapped)
+        {
+            msg.Format(_T("Drive %c: could not be unmapped."), letter);
+            m_log.LogWarning(msg);
+        }
+        else if (!taskDone)
+        {
+            msg.Format(_T("Drive %c: unmapped here, but the Explorer-session unmap did not finish (%lu ms)."),
+                       letter, taskWaitMs);
+            m_log.LogWarning(msg);
+        }
+        else
+        {
+            msg.Format(_T("Drive %c: unmapped (Explorer session: %lu ms)."), letter, taskWaitMs);
+            m_log.LogSuccess(msg);
+        }
     }
     else if (wasMapped)
     {
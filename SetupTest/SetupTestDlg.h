@@ -1,13 +1,22 @@
 #pragma once
 
+#include "../Common/FirewallSession.h"
+#include "../Common/Headless.h"
 #include "../Common/LogUtils.h"
+#include "../Common/PrereqCache.h"
 #include "../Common/RegistryBackup.h"
+#include "../Common/SettingsUtils.h"
+#include "../Common/StepRunner.h"
 
 class CSetupTestDlg : public CDialogEx
 {
 public:
     CSetupTestDlg(CWnd* pParent = nullptr);
 
+    // Run Setup or Restore without creating the window (command line, see
+    // Headless.h). Log output is echoed to hOut; returns the exit code.
+    int RunHeadless(const HeadlessOptions& options, HANDLE hOut);
+
 #ifdef AFX_DESIGN_TIME
     enum { IDD = IDD_SETUPTEST_DIALOG };
 #endif
@@ -15,6 +24,7 @@ public:
 protected:
     virtual void DoDataExchange(CDataExchange* pDX);
     virtual BOOL OnInitDialog();
+    virtual void OnCancel();
 
     HICON m_hIcon;
 
@@ -35,14 +45,21 @@ protected:
     CString m_strShareName;
     CString m_strPassword;
     CString m_strDebuggerPort;
+    CString m_strDriveLetter;     // combo text ("Z:"), synced on load / save
+
+    // Persisted settings: one entry per field, see the .cpp
+    static const SettingField<CSetupTestDlg> s_settings[];
 
     // Utility objects
     CLogUtils       m_log;
     CRegistryBackup m_backup;
+    CStepRunner     m_runner;     // declared after m_log: stopped before the log goes away
 
     // Internal state
-    static const int TOTAL_SETUP_STEPS = 9;
-    static const int TOTAL_RESTORE_STEPS = 6;
+    static const UINT_PTR PROGRESS_TIMER_ID = 1;
+    bool  m_restoreRun;           // true while the runner is executing the restore sequence
+    TCHAR m_driveLetter;          // combo selection captured before the run (steps run off the UI thread)
+    PrereqStatus m_prereq;        // last shown prerequisite status (cached, then refreshed)
 
     // Event handlers
     afx_msg void OnPaint();
@@ -51,16 +68,30 @@ protected:
     afx_msg void OnBnClickedInstallDebugger();
     afx_msg void OnBnClickedSetup();
     afx_msg void OnBnClickedRestore();
+    afx_msg void OnBnClickedStop();
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
+    afx_msg LRESULT OnStepProgress(WPARAM wParam, LPARAM lParam);
+    afx_msg LRESULT OnStepComplete(WPARAM wParam, LPARAM lParam);
+    afx_msg LRESULT OnPrereqStatus(WPARAM wParam, LPARAM lParam);
+
+    // Worker-thread run control
+    std::vector<SetupStep> BuildSetupSteps();       // logs the run header and records the configuration
+    std::vector<SetupStep> BuildRestoreSteps();
+    void BeginRun(bool restore, std::vector<SetupStep> steps);
+    bool StartRun(bool restore, std::vector<SetupStep> steps, HWND hNotify);
+    CString GetRunInputs() const;                   // settings a setup applies; resume needs the same ones
+    void FinishRun(bool allOk, bool cancelled);     // after the worker finished: journal, trace, banner
+    void UpdateProgressText();
 
     // Prerequisite checks
     void CheckPrerequisites();
-    void DetectVPNStatus();
-    void DetectDebuggerStatus();
+    void ShowVPNStatus();
+    void ShowDebuggerStatus();
     void PromptForDevVPNIP();
 
     // Validation
     bool ValidateInputs();
-    TCHAR GetSelectedDriveLetter();
+    CString GetInputError(CWnd** ppField = nullptr);   // empty when the inputs are usable
 
     // Setup steps
     bool StepCreateRDAccount();
@@ -74,6 +105,11 @@ protected:
     bool StepLocateRemoteDebugger();
     void StepDisplaySummary();
 
+    // Desired state shared by the step and its isInPlace check
+    FirewallRule DebuggerFirewallRule() const;
+    // The Dev PC share is mapped on the chosen letter in this (possibly elevated) session
+    bool IsShareMappedHere() const;
+
     // Restore steps
     void RestoreMappedDrive();
     void RestoreDebuggerFirewallRule();
@@ -17,6 +17,8 @@
 #define IDC_EDIT_LOG                    1010
 #define IDC_BUTTON_SETUP                1011
 #define IDC_BUTTON_RESTORE              1012
+#define IDC_BUTTON_STOP                 1013
+#define IDC_STATIC_PROGRESS             1014
 
 // Next default values for new objects
 //
@@ -24,7 +26,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        130
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1013
+#define _APS_NEXT_CONTROL_VALUE         1015
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
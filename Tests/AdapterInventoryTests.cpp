@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/AdapterInventory.h"
+
+// ════════════════════════════════════════════════════════════════
+// Recorded snapshots and matching
+// ════════════════════════════════════════════════════════════════
+
+static const TCHAR RECORDED[] =
+    _T("12|Ethernet|corp.local|DomainAuthenticated|10.1.2.3|Intel(R) Ethernet Connection\r\n")
+    _T("  \r\n")
+    _T("7|Ethernet 2|||169.254.1.1\r\n")
+    _T("21|Local Area Connection 3|Network 4|Public|7.12.34.56|TeamViewer VPN Adapter\r\n")
+    _T("|no index|||\r\n");
+
+TEST_CASE(AdapterInventory_ParsesRecordedSnapshot)
+{
+    std::vector<AdapterInfo> adapters = CAdapterInventory::ParseRecorded(RECORDED);
+    REQUIRE(adapters.size() == 3);     // the blank line and the one without an index are dropped
+
+    CHECK(adapters[0].interfaceIndex == 12);
+    CHECK(adapters[0].alias == _T("Ethernet"));
+    CHECK(adapters[0].name == _T("corp.local"));
+    CHECK(adapters[0].networkCategory == _T("DomainAuthenticated"));
+    CHECK(adapters[0].ipAddress == _T("10.1.2.3"));
+    CHECK(adapters[0].description == _T("Intel(R) Ethernet Connection"));
+
+    // Empty fields stay empty; a missing description is allowed
+    CHECK(adapters[1].interfaceIndex == 7);
+    CHECK(adapters[1].name.IsEmpty());
+    CHECK(adapters[1].networkCategory.IsEmpty());
+    CHECK(adapters[1].ipAddress == _T("169.254.1.1"));
+    CHECK(adapters[1].description.IsEmpty());
+}
+
+TEST_CASE(AdapterInventory_FindsTheTeamViewerAdapter)
+{
+    std::vector<AdapterInfo> adapters = CAdapterInventory::ParseRecorded(RECORDED);
+
+    AdapterInfo vpn = CAdapterInventory::FindTeamViewerVPN(adapters);
+    CHECK(vpn.interfaceIndex == 21);
+    CHECK(CAdapterInventory::HasTeamViewerAdapter(adapters));
+    CHECK(CAdapterInventory::FindIPv4WithPrefix(adapters, _T("7.")) == _T("7.12.34.56"));
+    CHECK(CAdapterInventory::FindIPv4WithPrefix(adapters, _T("192.168.")).IsEmpty());
+    CHECK(CAdapterInventory::FindByIndex(adapters, 7).alias == _T("Ethernet 2"));
+    CHECK(CAdapterInventory::FindByIndex(adapters, 99).interfaceIndex == -1);
+}
+
+TEST_CASE(AdapterInventory_VPNNeedsAConnectionProfile)
+{
+    // Installed but disconnected: the driver is there, the VPN is not up
+    std::vector<AdapterInfo> adapters = CAdapterInventory::ParseRecorded(
+        _T("12|Ethernet|corp.local|DomainAuthenticated|10.1.2.3\r\n")
+        _T("21|Ethernet 3|||7.12.34.56|TeamViewer VPN Adapter\r\n"));
+
+    CHECK(CAdapterInventory::FindTeamViewerVPN(adapters).interfaceIndex == -1);
+    CHECK(CAdapterInventory::HasTeamViewerAdapter(adapters));
+
+    adapters = CAdapterInventory::ParseRecorded(_T("12|Ethernet|corp.local|DomainAuthenticated|10.1.2.3\r\n"));
+    CHECK(!CAdapterInventory::HasTeamViewerAdapter(adapters));
+}
+
+// ════════════════════════════════════════════════════════════════
+// Live snapshot cache
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(AdapterInventory_SnapshotIsCachedUntilInvalidated)
+{
+    CAdapterInventory& inventory = CAdapterInventory::Instance();
+    std::shared_ptr<const AdapterSnapshot> first = inventory.GetSnapshot();
+    REQUIRE(first != nullptr);
+
+    // Holds unless an adapter or address changes while the test runs
+    CHECK(inventory.GetSnapshot() == first);
+
+    inventory.Invalidate();
+    std::shared_ptr<const AdapterSnapshot> rebuilt = inventory.GetSnapshot();
+    REQUIRE(rebuilt != nullptr);
+    CHECK(rebuilt != first);
+    CHECK(rebuilt->takenTick >= first->takenTick);
+    CHECK(rebuilt->adapters.size() == first->adapters.size());
+}
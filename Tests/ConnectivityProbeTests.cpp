@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/ConnectivityProbe.h"
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <memory>
+
+// Loopback TCP socket on a free port; listening unless listen = false
+class CLoopbackSocket
+{
+public:
+    explicit CLoopbackSocket(bool listen)
+        : m_sock(INVALID_SOCKET), m_port(0)
+    {
+        WSADATA wsaData;
+        m_started = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+
+        m_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int length = sizeof(addr);
+        if (m_sock == INVALID_SOCKET ||
+            bind(m_sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            getsockname(m_sock, reinterpret_cast<sockaddr*>(&addr), &length) != 0 ||
+            (listen && ::listen(m_sock, SOMAXCONN) != 0))
+            return;
+        m_port = ntohs(addr.sin_port);
+    }
+
+    ~CLoopbackSocket()
+    {
+        if (m_sock != INVALID_SOCKET)
+            closesocket(m_sock);
+        if (m_started)
+            WSACleanup();
+    }
+
+    int Port() const { return m_port; }     // 0 if the socket could not be set up
+
+private:
+    bool   m_started;
+    SOCKET m_sock;
+    int    m_port;
+};
+
+// ════════════════════════════════════════════════════════════════
+// CConnectivityProbe
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(ConnectivityProbe_ReportsOpenAndRefusedPortsInOrder)
+{
+    CLoopbackSocket listener(true);
+    CLoopbackSocket bound(false);       // bound but not listening: the connect is reset
+    REQUIRE(listener.Port() != 0);
+    REQUIRE(bound.Port() != 0);
+
+    std::vector<ProbeTarget> targets;
+    targets.push_back(CConnectivityProbe::Tcp(_T("127.0.0.1"), bound.Port()));
+    targets.push_back(CConnectivityProbe::Tcp(_T("127.0.0.1"), listener.Port()));
+    targets.push_back(CConnectivityProbe::Icmp(_T("127.0.0.1")));
+
+    // Windows retries a refused connect for about a second, even on loopback
+    std::vector<ProbeResult> results = CConnectivityProbe::Run(targets, 5000);
+    REQUIRE(results.size() == 3);
+
+    CHECK(results[0].target.port == bound.Port());
+    CHECK(results[0].status == PROBE_REFUSED);
+    CHECK(results[0].rttMs == 0);
+
+    CHECK(results[1].target.port == listener.Port());
+    CHECK(results[1].status == PROBE_OPEN);
+    CHECK(results[1].error == 0);
+    CHECK(results[1].rttMs >= 0 && results[1].rttMs < 5000);
+
+    CHECK(results[2].target.port == 0);
+    CHECK(results[2].status == PROBE_OPEN);
+}
+
+TEST_CASE(ConnectivityProbe_RejectsAHostThatIsNotAnAddress)
+{
+    std::vector<ProbeTarget> targets;
+    targets.push_back(CConnectivityProbe::Tcp(_T("dev-pc"), 445));
+    targets.push_back(CConnectivityProbe::Icmp(_T("dev-pc")));
+
+    ULONGLONG start = GetTickCount64();
+    std::vector<ProbeResult> results = CConnectivityProbe::Run(targets, 3000);
+    REQUIRE(results.size() == 2);
+    CHECK(results[0].status == PROBE_ERROR);
+    CHECK(results[0].error == WSAEINVAL);
+    CHECK(results[1].status == PROBE_ERROR);
+    CHECK(GetTickCount64() - start < 3000);     // nothing to wait for
+}
+
+TEST_CASE(ConnectivityProbe_ProbesRunConcurrently)
+{
+    CLoopbackSocket listener(true);
+    REQUIRE(listener.Port() != 0);
+
+    // Several refused connects together take about as long as one
+    std::vector<std::unique_ptr<CLoopbackSocket>> closed;
+    std::vector<ProbeTarget> targets;
+    for (int i = 0; i < 4; i++)
+    {
+        closed.emplace_back(new CLoopbackSocket(false));
+        targets.push_back(CConnectivityProbe::Tcp(_T("127.0.0.1"), closed.back()->Port()));
+    }
+    targets.push_back(CConnectivityProbe::Tcp(_T("127.0.0.1"), listener.Port()));
+
+    ULONGLONG start = GetTickCount64();
+    CConnectivityProbe::Run(targets, 5000);
+    ULONGLONG together = GetTickCount64() - start;
+
+    start = GetTickCount64();
+    CConnectivityProbe::Run(std::vector<ProbeTarget>(1, targets[0]), 5000);
+    ULONGLONG single = GetTickCount64() - start;
+
+    CHECK(together < single * 2 + 500);
+}
+
+TEST_CASE(ConnectivityProbe_DescribesResults)
+{
+    ProbeResult result = { CConnectivityProbe::Tcp(_T("10.0.0.1"), 4026), PROBE_OPEN, 1.84, 0 };
+    CHECK(CConnectivityProbe::Describe(result) == _T("open (1.8 ms)"));
+    result.status = PROBE_REFUSED;
+    CHECK(CConnectivityProbe::Describe(result) == _T("refused"));
+    result.status = PROBE_TIMEOUT;
+    CHECK(CConnectivityProbe::Describe(result) == _T("timed out"));
+    result.status = PROBE_ERROR;
+    result.error = 10065;
+    CHECK(CConnectivityProbe::Describe(result) == _T("error 10065"));
+}
@@ -0,0 +1,62 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/DebuggerLocator.h"
+#include <ShlObj.h>
+
+// Create root\relative (folders included) as an empty file; returns its path
+static CString CreateFileAt(const CString& root, LPCTSTR relative)
+{
+    CString path = root + _T("\\") + relative;
+    CString dir = path.Left(path.ReverseFind(_T('\\')));
+    SHCreateDirectoryEx(nullptr, dir, nullptr);
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    return path;
+}
+
+static const TCHAR REMOTE_DEBUGGER[] = _T("2022\\Community\\Common7\\IDE\\Remote Debugger\\");
+
+// ════════════════════════════════════════════════════════════════
+// CDebuggerLocator::Search
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(DebuggerLocator_PrefersTheRequestedArchitecture)
+{
+    CString root = TestTempDir() + _T("\\Microsoft Visual Studio");
+    CreateFileAt(root, CString(REMOTE_DEBUGGER) + _T("x86\\msvsmon.exe"));
+    CString x64 = CreateFileAt(root, CString(REMOTE_DEBUGGER) + _T("x64\\msvsmon.exe"));
+    CreateFileAt(root, _T("2022\\Community\\Common7\\IDE\\devenv.exe"));
+
+    CHECK(CDebuggerLocator::Search({ root }, CDebuggerLocator::MAX_SEARCH_DEPTH, _T("x64")).CompareNoCase(x64) == 0);
+}
+
+TEST_CASE(DebuggerLocator_FallsBackToAnotherArchitecture)
+{
+    CString root = TestTempDir() + _T("\\Microsoft Visual Studio");
+    CString x86 = CreateFileAt(root, CString(REMOTE_DEBUGGER) + _T("x86\\MSVSMON.EXE"));
+
+    CHECK(CDebuggerLocator::Search({ root }, CDebuggerLocator::MAX_SEARCH_DEPTH, _T("arm64")).CompareNoCase(x86) == 0);
+}
+
+TEST_CASE(DebuggerLocator_StopsAtTheDepthLimit)
+{
+    CString root = TestTempDir();
+    CString path = CreateFileAt(root, _T("a\\b\\x64\\msvsmon.exe"));    // x64 is depth 3
+
+    CHECK(CDebuggerLocator::Search({ root }, 2, _T("x64")).IsEmpty());
+    CHECK(CDebuggerLocator::Search({ root }, 3, _T("x64")).CompareNoCase(path) == 0);
+}
+
+TEST_CASE(DebuggerLocator_SearchesEveryRoot)
+{
+    CString temp = TestTempDir();
+    CString empty = temp + _T("\\Empty");
+    SHCreateDirectoryEx(nullptr, empty, nullptr);
+    CString tools = temp + _T("\\Microsoft Visual Studio 17.0");
+    CString path = CreateFileAt(tools, _T("Common7\\IDE\\Remote Debugger\\x64\\msvsmon.exe"));
+
+    std::vector<CString> roots = { temp + _T("\\Missing"), empty, tools };
+    CHECK(CDebuggerLocator::Search(roots, CDebuggerLocator::MAX_SEARCH_DEPTH, _T("x64")).CompareNoCase(path) == 0);
+    CHECK(CDebuggerLocator::Search({ empty }, CDebuggerLocator::MAX_SEARCH_DEPTH, _T("x64")).IsEmpty());
+}
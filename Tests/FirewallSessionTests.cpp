@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/FirewallSession.h"
+
+// ════════════════════════════════════════════════════════════════
+// Rules
+// ════════════════════════════════════════════════════════════════
+
+static FirewallRule DebuggerRule()
+{
+    return CFirewallSession::InboundTcpRule(_T("Remote Debugger"), _T("VS remote debugging"),
+                                            _T("4026"), _T("7.0.0.0/8"));
+}
+
+static size_t CountNamed(const CMemoryFirewallBackend& backend, LPCTSTR name)
+{
+    size_t count = 0;
+    for (const FirewallRule& rule : backend.rules)
+        count += rule.name.CompareNoCase(name) == 0 ? 1 : 0;
+    return count;
+}
+
+TEST_CASE(FirewallSession_EnumeratesOncePerSession)
+{
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(DebuggerRule());
+
+    CFirewallSession session(&backend);
+    REQUIRE(session.IsOpen());
+    CHECK(session.RuleExists(_T("remote debugger")));    // names compare case-insensitively
+    CHECK(!session.RuleExists(_T("Other")));
+    CHECK(session.HasRule(DebuggerRule()));
+    FirewallRule found;
+    CHECK(session.FindRule(_T("Remote Debugger"), found) && found.localPorts == _T("4026"));
+    CHECK(session.ApplyRules({ DebuggerRule(), CFirewallSession::InboundTcpRule(_T("SMB"), _T(""), _T("445"), _T("")) }));
+
+    CHECK(backend.enumerateCalls == 1);
+}
+
+TEST_CASE(FirewallSession_IdenticalRuleIsLeftAlone)
+{
+    CMemoryFirewallBackend backend;
+    FirewallRule existing = DebuggerRule();
+    existing.remoteAddresses = _T("7.0.0.0/255.0.0.0");     // how the firewall reports "/8"
+    backend.rules.push_back(existing);
+
+    CFirewallSession session(&backend);
+    bool changed = true;
+    CHECK(session.ApplyRule(DebuggerRule(), &changed));
+    CHECK(!changed);
+    CHECK(backend.addCalls == 0);
+    CHECK(backend.removeCalls == 0);
+}
+
+TEST_CASE(FirewallSession_ChangedRuleIsReplaced)
+{
+    CMemoryFirewallBackend backend;
+    FirewallRule existing = DebuggerRule();
+    existing.localPorts = _T("4024");
+    backend.rules.push_back(existing);
+
+    CFirewallSession session(&backend);
+    bool changed = false;
+    CHECK(session.ApplyRule(DebuggerRule(), &changed));
+    CHECK(changed);
+    CHECK(backend.removeCalls == 1);
+    CHECK(backend.addCalls == 1);
+    REQUIRE(backend.rules.size() == 1);
+    CHECK(backend.rules[0].localPorts == _T("4026"));
+
+    // The index follows the change without a second enumeration
+    CHECK(session.HasRule(DebuggerRule()));
+    CHECK(backend.enumerateCalls == 1);
+}
+
+TEST_CASE(FirewallSession_DuplicateNamesCollapseToOneRule)
+{
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(DebuggerRule());
+    FirewallRule twin = DebuggerRule();
+    twin.name = _T("REMOTE DEBUGGER");
+    backend.rules.push_back(twin);
+
+    CFirewallSession session(&backend);
+    CHECK(!session.HasRule(DebuggerRule()));        // two rules are not "exactly one"
+    CHECK(session.ApplyRule(DebuggerRule()));
+    CHECK(CountNamed(backend, _T("Remote Debugger")) == 1);
+    CHECK(backend.removeCalls == 2);
+}
+
+TEST_CASE(FirewallSession_RemovingAbsentRuleSkipsBackend)
+{
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(DebuggerRule());
+    backend.rules.push_back(DebuggerRule());
+
+    CFirewallSession session(&backend);
+    CHECK(session.RemoveRule(_T("Not There")));
+    CHECK(backend.removeCalls == 0);
+
+    CHECK(session.RemoveRule(_T("Remote Debugger")));
+    CHECK(backend.rules.empty());
+    CHECK(!session.RuleExists(_T("Remote Debugger")));
+}
+
+// ════════════════════════════════════════════════════════════════
+// Rule groups
+// ════════════════════════════════════════════════════════════════
+
+static FirewallRule GroupRule(LPCTSTR name, LPCTSTR grouping, long profiles, bool enabled)
+{
+    FirewallRule rule = CFirewallSession::InboundTcpRule(name, _T(""), _T("445"), _T(""));
+    rule.grouping = grouping;
+    rule.profiles = profiles;
+    rule.enabled = enabled;
+    return rule;
+}
+
+TEST_CASE(FirewallSession_GroupDisplayNamesResolveToIndirectStrings)
+{
+    const long PRIVATE = 0x2, PUBLIC = 0x4, DOMAIN = 0x1;
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(GroupRule(_T("FPS-SMB-In-Private"), _T("@FirewallAPI.dll,-28502"), PRIVATE, false));
+    backend.rules.push_back(GroupRule(_T("FPS-SMB-In-Public"), _T("@FirewallAPI.dll,-28502"), PUBLIC, false));
+    backend.rules.push_back(GroupRule(_T("FPS-SMB-In-Domain"), _T("@FirewallAPI.dll,-28502"), DOMAIN, false));
+
+    CFirewallSession session(&backend);
+    CHECK(session.RuleExists(_T("FPS-SMB-In-Private")));
+    CHECK(!session.IsRuleGroupEnabled(_T("File and Printer Sharing")));
+    CHECK(session.EnableRuleGroup(_T("file and printer sharing"), true));
+    CHECK(session.IsRuleGroupEnabled(_T("File and Printer Sharing")));
+    CHECK(session.IsRuleGroupEnabled(_T("@FirewallAPI.dll,-28502"), PUBLIC));
+    CHECK(!backend.rules[2].enabled);                // domain profile not asked for
+
+    // Enabling changed rules behind the index: the next lookup re-reads
+    FirewallRule rule;
+    CHECK(session.FindRule(_T("FPS-SMB-In-Private"), rule) && rule.enabled);
+    CHECK(backend.enumerateCalls == 2);
+}
+
+TEST_CASE(FirewallSession_EnableRuleGroupsTriesEveryGroup)
+{
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(GroupRule(_T("ND-In"), _T("@FirewallAPI.dll,-32752"), 0x2, false));
+
+    CFirewallSession session(&backend);
+    CHECK(!session.EnableRuleGroups({ _T("Unknown Group"), _T("Network Discovery") }, true));
+    CHECK(backend.groupCalls == 2);
+    CHECK(session.IsRuleGroupEnabled(_T("Network Discovery")));
+}
+
+TEST_CASE(FirewallSession_DefaultBackendIsUsedWhenNoneIsGiven)
+{
+    CMemoryFirewallBackend backend;
+    backend.rules.push_back(DebuggerRule());
+    CFirewallSession::SetDefaultBackend(&backend);
+    {
+        CFirewallSession session;
+        CHECK(session.RuleExists(_T("Remote Debugger")));
+    }
+    CFirewallSession::SetDefaultBackend(nullptr);
+    CHECK(backend.enumerateCalls == 1);
+}
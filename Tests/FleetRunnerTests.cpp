@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/FleetRunner.h"
+#include "../Common/Headless.h"
+#include "../Common/PowerShellHost.h"
+
+// ════════════════════════════════════════════════════════════════
+// CFleetRunner::JudgeAttempt
+// ════════════════════════════════════════════════════════════════
+
+static ProcessResult Finished(const char* output, DWORD exitCode = 0)
+{
+    ProcessResult run;
+    run.status = ProcessStatus::Ok;
+    run.exitCode = exitCode;
+    run.output = output;
+    return run;
+}
+
+TEST_CASE(FleetRunner_ResultRecordDecidesSuccess)
+{
+    FleetTargetResult result;
+    ProcessResult run = Finished("{\"Level\":\"INFO\",\"Message\":\"step 1\"}\r\n"
+                                 "{\"Level\":\"RESULT\",\"ExitCode\":0,\"Steps\":[]}\r\n"
+                                 "launcher noise\r\n");
+    CHECK(!CFleetRunner::JudgeAttempt(run, 900000, result));
+    CHECK(result.exitCode == EXIT_SUCCEEDED);
+    CHECK(result.failure.IsEmpty());
+    CHECK(result.resultRecord == "{\"Level\":\"RESULT\",\"ExitCode\":0,\"Steps\":[]}");
+}
+
+TEST_CASE(FleetRunner_LastResultRecordWins)
+{
+    FleetTargetResult result;
+    ProcessResult run = Finished("{\"Level\":\"RESULT\",\"ExitCode\":4}\n"
+                                 "{\"Level\":\"RESULT\",\"ExitCode\":1}\n");
+    CHECK(!CFleetRunner::JudgeAttempt(run, 900000, result));     // a failed step is not retried
+    CHECK(result.exitCode == EXIT_STEPS_FAILED);
+}
+
+TEST_CASE(FleetRunner_RetriesOnlyWhatAnotherAttemptCanFix)
+{
+    struct Case { int exitCode; bool retry; };
+    const Case cases[] = {
+        { EXIT_USAGE, false }, { EXIT_NOT_ADMIN, false }, { EXIT_CANCELLED, true }, { EXIT_START_FAILED, true },
+    };
+    for (const Case& c : cases)
+    {
+        char output[64];
+        sprintf_s(output, "{\"Level\":\"RESULT\",\"ExitCode\":%d}\n", c.exitCode);
+        FleetTargetResult result;
+        CHECK(CFleetRunner::JudgeAttempt(Finished(output), 900000, result) == c.retry);
+        CHECK(result.exitCode == c.exitCode);
+        CHECK(!result.failure.IsEmpty());
+    }
+}
+
+TEST_CASE(FleetRunner_NoResultRecordIsRetriedWithLauncherMessage)
+{
+    FleetTargetResult result;
+    CHECK(CFleetRunner::JudgeAttempt(Finished("Connecting to remote server LAB-07 failed\r\n\r\n", 1), 900000, result));
+    CHECK(result.exitCode == -1);
+    CHECK(result.failure == _T("no result from the target: Connecting to remote server LAB-07 failed"));
+
+    CHECK(CFleetRunner::JudgeAttempt(Finished("", 5), 900000, result));
+    CHECK(result.failure == _T("no result from the target: exit code 5"));
+
+    // A RESULT line that is not a complete record does not count
+    CHECK(CFleetRunner::JudgeAttempt(Finished("{\"Level\":\"RESULT\",\"ExitCode\":\n"), 900000, result));
+    CHECK(result.exitCode == -1);
+}
+
+TEST_CASE(FleetRunner_LaunchStatusesBeforeOutput)
+{
+    FleetTargetResult result;
+    ProcessResult run;
+
+    run.status = ProcessStatus::TimedOut;
+    CHECK(CFleetRunner::JudgeAttempt(run, 900000, result));
+    CHECK(result.failure == _T("no result within 900 s"));
+
+    run.status = ProcessStatus::Cancelled;
+    CHECK(!CFleetRunner::JudgeAttempt(run, 900000, result));
+    CHECK(result.failure == _T("cancelled"));
+
+    run.status = ProcessStatus::StartFailed;
+    CHECK(!CFleetRunner::JudgeAttempt(run, 900000, result));
+}
+
+// ════════════════════════════════════════════════════════════════
+// Stand-in agent
+// ════════════════════════════════════════════════════════════════
+// The fleet file's Command replaces PowerShell remoting with cmd.exe: it reads
+// the settings line from stdin and answers with a RESULT record echoing it.
+
+static CString WriteFleetFile(LPCSTR json)
+{
+    CString path = TestTempDir() + _T("\\fleet.json");
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD written = 0;
+    WriteFile(hFile, json, static_cast<DWORD>(strlen(json)), &written, nullptr);
+    CloseHandle(hFile);
+    return path;
+}
+
+TEST_CASE(FleetRunner_StandInAgentGetsSettingsOnStdin)
+{
+    CString path = WriteFleetFile(
+        "{ \"RetryDelaySeconds\": 0, \"TimeoutSeconds\": 30,"
+        "  \"Command\": \"cmd.exe /v:on /c set /p CFG=& echo {\\\"Level\\\":\\\"RESULT\\\",\\\"ExitCode\\\":0,\\\"Host\\\":\\\"{host}\\\",\\\"Config\\\":\\\"!CFG!\\\"}\","
+        "  \"Targets\": [ { \"Host\": \"LAB-08\", \"DriveLetter\": \"Y:\" } ] }");
+
+    CLogUtils log;
+    CFleetRunner fleet(&log);
+    fleet.SetDefault(KEY_PASSWORD, _T("s3cret \"pw\""));
+    CString error;
+    REQUIRE(fleet.Load(path, error));
+
+    std::vector<SetupStep> steps = fleet.BuildSteps();
+    REQUIRE(steps.size() == 1);
+    CHECK(steps[0].run());
+
+    const FleetTargetResult& result = fleet.GetResult(0);
+    CHECK(result.attempts == 1);
+    CHECK(result.exitCode == EXIT_SUCCEEDED);
+
+    const char json[] = "{\"Password\":\"s3cret \\\"pw\\\"\",\"DriveLetter\":\"Y:\"}";
+    std::string config = CPowerShellHost::Base64Encode(json, sizeof(json) - 1);
+    CHECK(result.resultRecord.find("\"Host\":\"LAB-08\"") != std::string::npos);
+    CHECK(result.resultRecord.find("\"Config\":\"" + config + "\"") != std::string::npos);
+}
+
+TEST_CASE(FleetRunner_StandInWithoutResultIsRetried)
+{
+    CString path = WriteFleetFile(
+        "{ \"RetryDelaySeconds\": 0, \"Retries\": 2,"
+        "  \"Command\": \"cmd.exe /c echo WinRM cannot reach {host}& exit 1\","
+        "  \"Targets\": [ \"LAB-09\" ] }");
+
+    CLogUtils log;
+    CFleetRunner fleet(&log);
+    CString error;
+    REQUIRE(fleet.Load(path, error));
+    CHECK(!fleet.BuildSteps()[0].run());
+
+    const FleetTargetResult& result = fleet.GetResult(0);
+    CHECK(result.attempts == 3);
+    CHECK(result.failure == _T("no result from the target: WinRM cannot reach LAB-09"));
+}
+
+TEST_CASE(FleetRunner_LoadRejectsBadFleetFiles)
+{
+    CLogUtils log;
+    CFleetRunner fleet(&log);
+    CString error;
+
+    CHECK(!fleet.Load(WriteFleetFile("{ \"Targets\": [] }"), error));
+    CHECK(error == _T("Targets must list at least one Test PC"));
+    CHECK(!fleet.Load(WriteFleetFile("{ \"Targets\": [ \"LAB-07\", \"lab-07\" ] }"), error));
+    CHECK(error == _T("Targets: lab-07 is listed twice"));
+    CHECK(!fleet.Load(WriteFleetFile("{ \"Targets\": [ \"a b\" ] }"), error));
+    CHECK(!fleet.Load(WriteFleetFile("{ \"Defaults\": { \"Pasword\": \"x\" }, \"Targets\": [ \"LAB-07\" ] }"), error));
+    CHECK(error == _T("Defaults: unknown setting Pasword"));
+    CHECK(!fleet.Load(WriteFleetFile("{ \"Command\": \"agent {config}\", \"Targets\": [ \"LAB-07\" ] }"), error));
+    CHECK(!fleet.Load(WriteFleetFile("{ \"MaxParallel\": 99, \"Targets\": [ \"LAB-07\" ] }"), error));
+    CHECK(error == _T("MaxParallel must be a number from 1 to 32"));
+}
@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/JsonEscape.h"
+#include <random>
+
+// ════════════════════════════════════════════════════════════════
+// CJsonEscape
+// ════════════════════════════════════════════════════════════════
+
+static std::string Escape(const std::wstring& text, JsonEscapeKernel kernel = JsonEscapeKernel::Auto)
+{
+    std::string out(CJsonEscape::MaxUtf8Size(text.size()), '\0');
+    out.resize(CJsonEscape::ToUtf8(text.data(), text.size(), out.empty() ? nullptr : &out[0], kernel));
+    return out;
+}
+
+TEST_CASE(JsonEscape_EscapesQuotesBackslashesAndControls)
+{
+    CHECK(Escape(L"plain text") == "plain text");
+    CHECK(Escape(L"a\"b\\c/d") == "a\\\"b\\\\c/d");
+    CHECK(Escape(L"\n\r\t\b\f") == "\\n\\r\\t\\b\\f");
+    CHECK(Escape(std::wstring(L"\x01\x1f\x7f", 3)) == "\\u0001\\u001f\x7f");
+    CHECK(Escape(std::wstring(1, L'\0')) == "\\u0000");
+    CHECK(Escape(L"").empty());
+}
+
+TEST_CASE(JsonEscape_EncodesUtf8)
+{
+    CHECK(Escape(L"\x00e9") == "\xC3\xA9");                 // 2 bytes
+    CHECK(Escape(L"\x20ac") == "\xE2\x82\xAC");             // 3 bytes
+    CHECK(Escape(L"\xd83d\xde00") == "\xF0\x9F\x98\x80");   // surrogate pair, 4 bytes
+}
+
+TEST_CASE(JsonEscape_UnpairedSurrogateBecomesReplacement)
+{
+    const char* replacement = "\xEF\xBF\xBD";
+    CHECK(Escape(L"\xd83d") == replacement);                                // high at the end
+    CHECK(Escape(L"\xd83dx") == std::string(replacement) + "x");            // high before non-low
+    CHECK(Escape(L"\xde00") == replacement);                                // lone low
+    CHECK(Escape(L"\xde00\xd83d") == std::string(replacement) + replacement); // reversed pair
+}
+
+TEST_CASE(JsonEscape_MatchesSystemUtf8WhenNothingNeedsEscaping)
+{
+    std::wstring text = L"Caf\x00e9 \x20ac \xd83d\xde00 \xd83d end, long enough to use the block scanners";
+    char expected[512] = {};
+    int size = WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                   expected, sizeof(expected), nullptr, nullptr);
+    REQUIRE(size > 0);
+    CHECK(Escape(text) == std::string(expected, size));
+}
+
+// Random mixes of plain runs and every kind of unit that stops a scanner,
+// at lengths that end on, before and after the 8- and 16-unit blocks
+TEST_CASE(JsonEscape_KernelsAgreeWithScalar)
+{
+    const JsonEscapeKernel kernels[] = { JsonEscapeKernel::SSE2, JsonEscapeKernel::AVX2, JsonEscapeKernel::Auto };
+    const wchar_t special[] = { L'"', L'\\', L'\n', 0x01, 0x1f, 0x20, 0x7e, 0x7f, 0x80, 0xe9, 0x7ff,
+                                0x800, 0x8020, 0xd83d, 0xde00, 0xffe0, 0xffff };
+
+    std::mt19937 random(12345);
+    int compared = 0, mismatched = 0;
+    for (int run = 0; run < 20000; run++)
+    {
+        std::wstring text;
+        size_t length = random() % 70;
+        for (size_t k = 0; k < length; k++)
+            text += (random() % 4) ? static_cast<wchar_t>(L'a' + random() % 26) : special[random() % _countof(special)];
+
+        std::string expected = Escape(text, JsonEscapeKernel::Scalar);
+        for (JsonEscapeKernel kernel : kernels)
+        {
+            if (!CJsonEscape::HasKernel(kernel))
+                continue;
+            compared++;
+            if (Escape(text, kernel) != expected)
+                mismatched++;
+        }
+    }
+    CHECK(compared > 0);
+    CHECK(mismatched == 0);
+}
+
+TEST_CASE(JsonEscape_AppendKeepsExistingText)
+{
+    std::string out("{\"k\":\"");
+    CJsonEscape::Append(out, L"v\"");
+    CJsonEscape::Append(out, nullptr);
+    out += "\"}";
+    CHECK(out == "{\"k\":\"v\\\"\"}");
+}
@@ -0,0 +1,162 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/JsonReader.h"
+
+// ════════════════════════════════════════════════════════════════
+// CJsonReader::Parse
+// ════════════════════════════════════════════════════════════════
+
+static bool ParseText(LPCWSTR text, JsonValue& root, JsonError& error)
+{
+    return CJsonReader::Parse(text, wcslen(text), root, error);
+}
+
+static JsonError ParseError(LPCWSTR text)
+{
+    JsonValue root;
+    JsonError error;
+    if (ParseText(text, root, error))
+        error.message = _T("(parsed)");
+    return error;
+}
+
+TEST_CASE(JsonReader_ParsesEveryType)
+{
+    JsonValue root;
+    JsonError error;
+    REQUIRE(ParseText(L"{ \"s\": \"text\", \"n\": -12.5e1, \"t\": true, \"f\": false,"
+                      L"  \"z\": null, \"a\": [1, [], {}], \"o\": { \"k\": \"v\" } }", root, error));
+    REQUIRE(root.type == JSON_OBJECT);
+    REQUIRE(root.members.size() == 7);
+    CHECK(root.members[0].first == _T("s"));    // file order is kept
+
+    const JsonValue* n = root.Find(_T("n"));
+    REQUIRE(n && n->type == JSON_NUMBER);
+    CHECK(n->number == -125.0);
+    CHECK(n->text == _T("-12.5e1"));            // as written, for settings read as text
+
+    CHECK(root.Find(_T("s"))->text == _T("text"));
+    CHECK(root.Find(_T("t"))->type == JSON_BOOL && root.Find(_T("t"))->boolean);
+    CHECK(root.Find(_T("f"))->type == JSON_BOOL && !root.Find(_T("f"))->boolean);
+    CHECK(root.Find(_T("z"))->type == JSON_NULL);
+
+    const JsonValue* a = root.Find(_T("a"));
+    REQUIRE(a && a->type == JSON_ARRAY && a->items.size() == 3);
+    CHECK(a->items[1].type == JSON_ARRAY && a->items[1].items.empty());
+    CHECK(a->items[2].type == JSON_OBJECT && a->items[2].members.empty());
+
+    CHECK(root.Find(_T("o"))->Find(_T("k"))->text == _T("v"));
+    CHECK(root.Find(_T("missing")) == nullptr);
+}
+
+TEST_CASE(JsonReader_LastDuplicateMemberWins)
+{
+    JsonValue root;
+    JsonError error;
+    REQUIRE(ParseText(L"{\"k\":\"first\",\"k\":\"second\"}", root, error));
+    CHECK(root.members.size() == 2);
+    CHECK(root.Find(_T("k"))->text == _T("second"));
+}
+
+TEST_CASE(JsonReader_UnescapesStrings)
+{
+    JsonValue root;
+    JsonError error;
+    REQUIRE(ParseText(L"\"q\\\" b\\\\ s\\/ \\b\\f\\n\\r\\t \\u00e9 \\ud83d\\ude00\"", root, error));
+    CHECK(root.text == _T("q\" b\\ s/ \b\f\n\r\t \x00e9 \xd83d\xde00"));
+
+    REQUIRE(ParseText(L"\"\"", root, error));
+    CHECK(root.type == JSON_STRING && root.text.IsEmpty());
+}
+
+TEST_CASE(JsonReader_ReportsLineAndColumn)
+{
+    JsonError error = ParseError(L"{\n  \"a\": 1,\n  \"b\" 2\n}");
+    CHECK(error.line == 3);
+    CHECK(error.column == 7);
+    CHECK(error.message == _T("expected ':'"));
+    CHECK(error.Format() == _T("line 3, column 7: expected ':'"));
+}
+
+TEST_CASE(JsonReader_RejectsMalformedInput)
+{
+    CHECK(ParseError(L"").message == _T("unexpected end of document"));
+    CHECK(ParseError(L"{\"a\":1,}").message == _T("expected a member name"));
+    CHECK(ParseError(L"[1 2]").message == _T("expected ',' or ']'"));
+    CHECK(ParseError(L"{\"a\":1 \"b\":2}").message == _T("expected ',' or '}'"));
+    CHECK(ParseError(L"\"open").message == _T("unterminated string"));
+    CHECK(ParseError(L"\"tab\there\"").message == _T("control character in string"));
+    CHECK(ParseError(L"\"\\x\"").message == _T("invalid escape sequence"));
+    CHECK(ParseError(L"\"\\u12g4\"").message == _T("invalid \\u escape"));
+    CHECK(ParseError(L"\"\\u12\"").message == _T("invalid \\u escape"));
+    CHECK(ParseError(L"-").message == _T("invalid number"));
+    CHECK(ParseError(L"1.").message == _T("invalid number"));
+    CHECK(ParseError(L"tru").message == _T("expected a value"));
+    CHECK(ParseError(L"{} x").message == _T("unexpected text after the end of the document"));
+}
+
+TEST_CASE(JsonReader_LimitsNestingDepth)
+{
+    CStringW deep = CStringW(L'[', 64) + CStringW(L']', 64);
+    JsonValue root;
+    JsonError error;
+    CHECK(ParseText(deep, root, error));
+
+    CStringW tooDeep = CStringW(L'[', 65) + CStringW(L']', 65);
+    CHECK(ParseError(tooDeep).message == _T("nested too deeply"));
+
+    // Deep enough to overflow the stack if the limit were missing
+    CStringW hostile(L'[', 100000);
+    CHECK(ParseError(hostile).message == _T("nested too deeply"));
+}
+
+// ════════════════════════════════════════════════════════════════
+// CJsonReader::ParseFile
+// ════════════════════════════════════════════════════════════════
+
+static CString WriteBytes(LPCTSTR name, const void* data, size_t size)
+{
+    CString path = TestTempDir() + _T("\\") + name;
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD written = 0;
+    WriteFile(hFile, data, static_cast<DWORD>(size), &written, nullptr);
+    CloseHandle(hFile);
+    return path;
+}
+
+static CString ParseFileText(const CString& path)
+{
+    JsonValue root;
+    JsonError error;
+    if (!CJsonReader::ParseFile(path, root, error))
+        return _T("error: ") + error.Format();
+    const JsonValue* value = root.Find(_T("k"));
+    return value ? value->text : CString(_T("(no k)"));
+}
+
+TEST_CASE(JsonReader_ParseFileHandlesEncodings)
+{
+    const char utf8[] = "{\"k\":\"caf\xC3\xA9\"}";
+    CHECK(ParseFileText(WriteBytes(_T("plain.json"), utf8, sizeof(utf8) - 1)) == _T("caf\x00e9"));
+
+    const char bom8[] = "\xEF\xBB\xBF{\"k\":\"caf\xC3\xA9\"}";
+    CHECK(ParseFileText(WriteBytes(_T("bom8.json"), bom8, sizeof(bom8) - 1)) == _T("caf\x00e9"));
+
+    const wchar_t utf16[] = L"\xFEFF{\"k\":\"caf\x00e9\"}";
+    CHECK(ParseFileText(WriteBytes(_T("utf16.json"), utf16, sizeof(utf16) - sizeof(wchar_t))) == _T("caf\x00e9"));
+
+    // Not valid UTF-8: read in the ANSI code page, as the old writer produced it
+    const char ansi[] = "{\"k\":\"caf\xE9\"}";
+    CString expected = CA2W("caf\xE9", CP_ACP);
+    CHECK(ParseFileText(WriteBytes(_T("ansi.json"), ansi, sizeof(ansi) - 1)) == expected);
+}
+
+TEST_CASE(JsonReader_ParseFileReportsMissingAndEmpty)
+{
+    JsonValue root;
+    JsonError error;
+    CHECK(!CJsonReader::ParseFile(TestTempDir() + _T("\\absent.json"), root, error));
+    CHECK(error.message == _T("cannot open file"));
+
+    CHECK(ParseFileText(WriteBytes(_T("empty.json"), "", 0)) == _T("error: line 1, column 1: unexpected end of document"));
+}
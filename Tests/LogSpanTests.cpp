@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/LogSpan.h"
+#include "../Common/LogUtils.h"
+#include <functional>
+#include <thread>
+
+// Run body with a logger whose JSON records go to a file; returns its lines
+static std::vector<std::string> CaptureSpans(const std::function<void(CLogUtils&)>& body)
+{
+    CString path = TestTempDir() + _T("\\spans.jsonl");
+    HANDLE hOut = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hOut == INVALID_HANDLE_VALUE)
+        return std::vector<std::string>();
+    {
+        CLogUtils log;
+        log.SetConsoleOutput(hOut, true);
+        body(log);
+        log.SetConsoleOutput(nullptr, false);
+    }
+    CloseHandle(hOut);
+    return ReadFileLines(path);
+}
+
+static bool Has(const std::string& line, const char* text)
+{
+    return line.find(text) != std::string::npos;
+}
+
+// ════════════════════════════════════════════════════════════════
+// CLogSpan
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(LogSpan_NestedCountersRollUpIntoTheParent)
+{
+    std::vector<std::string> lines = CaptureSpans([](CLogUtils& log) {
+        CLogSpan outer(&log, _T("outer"));
+        CLogSpan::Count(SPAN_PROCESSES);
+        {
+            CLogSpan inner(&log, _T("inner"), 2, 5);
+            CLogSpan::Count(SPAN_POWERSHELL, 2);
+            CLogSpan::Count(SPAN_BYTES_READ, 100);
+            inner.End("ok");
+        }
+        CLogSpan::Count(SPAN_COM_CALLS);    // back in the outer span
+        outer.End("failed");
+    });
+    REQUIRE(lines.size() == 4);
+
+    CHECK(Has(lines[0], "\"Message\":\"outer\"") && Has(lines[0], "\"Span\":\"begin\""));
+    CHECK(Has(lines[1], "\"Message\":\"inner\"") && Has(lines[1], "\"Step\":2,\"TotalSteps\":5"));
+
+    CHECK(Has(lines[2], "\"Message\":\"inner\"") && Has(lines[2], "\"Span\":\"end\""));
+    CHECK(Has(lines[2], "\"Outcome\":\"ok\",\"Processes\":0,\"PowerShell\":2,\"ComCalls\":0,\"BytesRead\":100"));
+
+    CHECK(Has(lines[3], "\"Message\":\"outer\""));
+    CHECK(Has(lines[3], "\"Outcome\":\"failed\",\"Processes\":1,\"PowerShell\":2,\"ComCalls\":1,\"BytesRead\":100"));
+}
+
+TEST_CASE(LogSpan_EndIsWrittenOnce)
+{
+    std::vector<std::string> lines = CaptureSpans([](CLogUtils& log) {
+        CLogSpan span(&log, _T("step"));
+        span.End("cancelled");
+        span.End("ok");
+    });
+    REQUIRE(lines.size() == 2);
+    CHECK(Has(lines[1], "\"Outcome\":\"cancelled\""));
+}
+
+TEST_CASE(LogSpan_DestructorEndsAsAbandoned)
+{
+    std::vector<std::string> lines = CaptureSpans([](CLogUtils& log) {
+        CLogSpan span(&log, _T("step"));
+        CLogSpan::Count(SPAN_PROCESSES, 3);
+    });
+    REQUIRE(lines.size() == 2);
+    CHECK(Has(lines[1], "\"Span\":\"end\""));
+    CHECK(Has(lines[1], "\"Outcome\":\"abandoned\",\"Processes\":3"));
+}
+
+TEST_CASE(LogSpan_CountsStayOnTheirThread)
+{
+    std::vector<std::string> lines = CaptureSpans([](CLogUtils& log) {
+        CLogSpan span(&log, _T("main"));
+        std::thread([] { CLogSpan::Count(SPAN_PROCESSES, 7); }).join();    // no span open there
+        span.End("ok");
+    });
+    REQUIRE(lines.size() == 2);
+    CHECK(Has(lines[1], "\"Processes\":0"));
+
+    CLogSpan::Count(SPAN_PROCESSES);    // no span at all: nothing to count into
+}
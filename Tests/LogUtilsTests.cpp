@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/LogUtils.h"
+#include <thread>
+
+// Console output goes to a file so the test can read back what was written
+static HANDLE CreateCapture(const CString& path)
+{
+    return CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Step attribution
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(LogUtils_TextLinesCarryTheThreadStep)
+{
+    CString path = TestTempDir() + _T("\\console.txt");
+    HANDLE hOut = CreateCapture(path);
+    REQUIRE(hOut != INVALID_HANDLE_VALUE);
+    {
+        CLogUtils log;
+        log.SetConsoleOutput(hOut, false);
+        std::thread([&log] {
+            CLogUtils::SetThreadStep(3, 9);
+            log.LogSuccess(_T("mapped"));
+            CLogUtils::SetThreadStep(0, 0);
+            log.LogSuccess(_T("after"));
+        }).join();
+        log.LogInfo(_T("main"));
+        log.SetConsoleOutput(nullptr, false);
+    }
+    CloseHandle(hOut);
+
+    CHECK(ReadFileBytes(path) == "[3] OK: mapped\r\n  OK: after\r\n  main\r\n");
+}
+
+TEST_CASE(LogUtils_JsonRecordsCarryTheThreadStep)
+{
+    CString path = TestTempDir() + _T("\\console.jsonl");
+    HANDLE hOut = CreateCapture(path);
+    REQUIRE(hOut != INVALID_HANDLE_VALUE);
+    {
+        CLogUtils log;
+        log.SetConsoleOutput(hOut, true);
+        std::thread([&log] {
+            CLogUtils::SetThreadStep(3, 9);
+            log.LogWarning(_T("in step"));
+            log.LogStep(5, 9, _T("explicit"));
+        }).join();
+        log.LogWarning(_T("outside"));
+        log.SetConsoleOutput(nullptr, false);
+    }
+    CloseHandle(hOut);
+
+    std::vector<std::string> lines = ReadFileLines(path);
+    REQUIRE(lines.size() == 3);
+    CHECK(lines[0].find("\"Step\":3,\"TotalSteps\":9") != std::string::npos);
+    CHECK(lines[1].find("\"Step\":5,\"TotalSteps\":9") != std::string::npos);     // an explicit step wins
+    CHECK(lines[2].find("\"Step\"") == std::string::npos);
+}
+
+TEST_CASE(LogUtils_ThreadStepIsPerThread)
+{
+    CString path = TestTempDir() + _T("\\console.txt");
+    HANDLE hOut = CreateCapture(path);
+    REQUIRE(hOut != INVALID_HANDLE_VALUE);
+    {
+        CLogUtils log;
+        log.SetConsoleOutput(hOut, false);
+        CLogUtils::SetThreadStep(0, 0);
+        std::thread([] { CLogUtils::SetThreadStep(4, 4); }).join();
+        log.LogError(_T("main"));
+        log.SetConsoleOutput(nullptr, false);
+    }
+    CloseHandle(hOut);
+
+    CHECK(ReadFileBytes(path) == "  ERROR: main\r\n");
+}
@@ -0,0 +1,239 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/LogWriter.h"
+#include <atomic>
+#include <thread>
+
+// ════════════════════════════════════════════════════════════════
+// CAsyncLogWriter
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(LogWriter_SingleRecordArrivesWithinMaxDelay)
+{
+    CString path = TestTempDir() + _T("\\log.jsonl");
+    LogFlushPolicy policy;
+    policy.maxRecords = 64;     // one record never fills the batch
+    policy.maxDelayMs = 100;
+
+    CAsyncLogWriter writer;
+    REQUIRE(writer.Open(path, policy));
+    ULONGLONG start = GetTickCount64();
+    writer.Write(std::string("{\"Message\":\"one\"}\n"));
+
+    // Only the delay may write it: no sync, no Flush, no Close. Allow for the
+    // scheduler, but far less than "never" (which is what a lost wake-up gives).
+    std::string data;
+    while (data.empty() && GetTickCount64() - start < policy.maxDelayMs + 400)
+    {
+        Sleep(10);
+        data = ReadFileBytes(path);
+    }
+    CHECK(data == "{\"Message\":\"one\"}\n");
+    CHECK(GetTickCount64() - start < policy.maxDelayMs + 400);
+}
+
+TEST_CASE(LogWriter_SyncRecordIsWrittenAtOnce)
+{
+    CString path = TestTempDir() + _T("\\log.jsonl");
+    LogFlushPolicy policy;
+    policy.maxDelayMs = 60 * 1000;
+
+    CAsyncLogWriter writer;
+    REQUIRE(writer.Open(path, policy));
+    writer.Write(std::string("{\"Level\":\"ERROR\"}\n"), true);
+
+    std::string data;
+    for (int i = 0; i < 100 && data.empty(); i++)
+    {
+        Sleep(10);
+        data = ReadFileBytes(path);
+    }
+    CHECK(data == "{\"Level\":\"ERROR\"}\n");
+}
+
+TEST_CASE(LogWriter_FlushWritesEverythingQueued)
+{
+    CString path = TestTempDir() + _T("\\log.jsonl");
+    LogFlushPolicy policy;
+    policy.maxRecords = 0;
+    policy.maxDelayMs = 60 * 1000;
+
+    CAsyncLogWriter writer;
+    REQUIRE(writer.Open(path, policy));
+    for (int i = 0; i < 10; i++)
+        writer.Write(std::string("{}\n"));
+    writer.Flush();
+
+    CHECK(ReadFileLines(path).size() == 10);
+}
+
+TEST_CASE(LogWriter_ConcurrentProducersLoseNothingOnClose)
+{
+    CString path = TestTempDir() + _T("\\log.jsonl");
+    const int THREADS = 4;
+    const int PER_THREAD = 2000;
+
+    {
+        CAsyncLogWriter writer;
+        LogFlushPolicy policy;
+        REQUIRE(writer.Open(path, policy, 16));     // small queue: producers hit back-pressure
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < THREADS; t++)
+        {
+            producers.emplace_back([&writer, t] {
+                char line[64];
+                for (int i = 0; i < PER_THREAD; i++)
+                {
+                    int n = sprintf_s(line, "{\"Thread\":%d,\"Seq\":%d}\n", t, i);
+                    writer.Write(line, static_cast<size_t>(n));
+                }
+            });
+        }
+        for (std::thread& producer : producers)
+            producer.join();
+        // Destructor closes: whatever is still queued must reach the file
+    }
+
+    std::vector<std::string> lines = ReadFileLines(path);
+    CHECK(lines.size() == THREADS * PER_THREAD);
+
+    // Lines stay whole and each producer's records keep their order
+    std::vector<int> next(THREADS, 0);
+    bool wellFormed = true, ordered = true;
+    for (const std::string& line : lines)
+    {
+        int thread = -1, seq = -1;
+        if (sscanf_s(line.c_str(), "{\"Thread\":%d,\"Seq\":%d}", &thread, &seq) != 2 ||
+            thread < 0 || thread >= THREADS)
+        {
+            wellFormed = false;
+            continue;
+        }
+        ordered = ordered && seq == next[thread];
+        next[thread] = seq + 1;
+    }
+    CHECK(wellFormed);
+    CHECK(ordered);
+}
+
+// ════════════════════════════════════════════════════════════════
+// CLogRecordEncoder
+// ════════════════════════════════════════════════════════════════
+
+static SYSTEMTIME TestTime(WORD day, WORD hour)
+{
+    SYSTEMTIME st = {};
+    st.wYear = 2024;
+    st.wMonth = 3;
+    st.wDay = day;
+    st.wHour = hour;
+    st.wMinute = 5;
+    st.wSecond = 9;
+    st.wMilliseconds = 7;
+    return st;
+}
+
+TEST_CASE(LogEncoder_WritesTheFullRecord)
+{
+    CLogRecordEncoder encoder;
+    encoder.SetSource(_T("SetupTest"), _T("PC-1"));
+    encoder.SetOperation(_T("setup"));
+
+    std::string out;
+    encoder.Encode(out, TestTime(1, 14), "STEP", _T("Map \"Z:\""), 8, 2, 9, ",\"Span\":\"begin\"");
+    CHECK(out == "{\"Timestamp\":\"2024-03-01T14:05:09.007\",\"Level\":\"STEP\",\"Message\":\"Map \\\"Z:\\\"\""
+                 ",\"Logger\":\"SetupTest\",\"Hostname\":\"PC-1\",\"Operation\":\"setup\""
+                 ",\"Step\":2,\"TotalSteps\":9,\"Span\":\"begin\"}\n");
+}
+
+TEST_CASE(LogEncoder_OmitsUnsetFields)
+{
+    CLogRecordEncoder encoder;
+    encoder.SetSource(_T("SetupTest"), _T("PC-1"));
+    encoder.SetOperation(_T("setup"));
+    encoder.SetOperation(nullptr);
+
+    std::string out;
+    encoder.Encode(out, TestTime(1, 14), "INFO", _T("hello"), 5);
+    CHECK(out.find("\"Operation\"") == std::string::npos);
+    CHECK(out.find("\"Step\"") == std::string::npos);
+    CHECK(out.find("\"Message\":\"hello\",\"Logger\"") != std::string::npos);
+
+    encoder.Encode(out, TestTime(1, 14), "INFO", _T("hello"), 5, 0, 0);    // no total: no step
+    CHECK(out.find("\"Step\"") == std::string::npos);
+}
+
+TEST_CASE(LogEncoder_ReusesTheBufferAndFollowsTheDate)
+{
+    CLogRecordEncoder encoder;
+    std::string out;
+    encoder.Encode(out, TestTime(1, 23), "INFO", _T("a fairly long first message"), 27);
+    size_t capacity = out.capacity();
+    const char* data = out.data();
+
+    // The cached date must change with the day; a shorter record fits the old buffer
+    encoder.Encode(out, TestTime(2, 0), "INFO", _T("b"), 1);
+    CHECK(out.find("\"Timestamp\":\"2024-03-02T00:05:09.007\"") != std::string::npos);
+    CHECK(out.find("first") == std::string::npos);
+    CHECK(out.capacity() == capacity);
+    CHECK(out.data() == data);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Steady-state allocations
+// ════════════════════════════════════════════════════════════════
+// The CRT allocation hook only exists in debug builds
+
+#ifdef _DEBUG
+
+static std::atomic<long> s_allocations(0);
+
+static int __cdecl CountAllocations(int allocType, void*, size_t, int blockType, long,
+                                    const unsigned char*, int)
+{
+    if (blockType != _CRT_BLOCK && (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC))
+        s_allocations++;
+    return TRUE;
+}
+
+TEST_CASE(LogWriter_SteadyStateEncodeAndWriteDoNotAllocate)
+{
+    const size_t BATCH = 32;
+    CString path = TestTempDir() + _T("\\log.jsonl");
+    LogFlushPolicy policy;
+    policy.maxRecords = 0;              // only Flush takes a batch, so neither
+    policy.maxDelayMs = 60 * 1000;      // buffer ever holds more than BATCH records
+
+    CAsyncLogWriter writer;
+    REQUIRE(writer.Open(path, policy, BATCH));
+    CLogRecordEncoder encoder;
+    encoder.SetSource(_T("SetupTest"), _T("PC-1"));
+    std::string record;
+    SYSTEMTIME time = TestTime(1, 14);
+
+    auto writeBatch = [&] {
+        for (size_t i = 0; i < BATCH; i++)
+        {
+            encoder.Encode(record, time, "INFO", _T("Drive Z: mapped"), 15, 3, 9);
+            writer.Write(record);
+        }
+        writer.Flush();
+    };
+
+    // Two rounds grow both the pending buffer and the writer's batch buffer
+    writeBatch();
+    writeBatch();
+
+    s_allocations = 0;
+    _CRT_ALLOC_HOOK previous = _CrtSetAllocHook(CountAllocations);
+    for (int round = 0; round < 10; round++)
+        writeBatch();
+    _CrtSetAllocHook(previous);
+
+    CHECK(s_allocations == 0);
+    writer.Close();
+    CHECK(ReadFileLines(path).size() == BATCH * 12);
+}
+
+#endif
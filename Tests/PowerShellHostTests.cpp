@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/PowerShellHost.h"
+#include "../Common/WinUtils.h"
+#include <thread>
+
+// ════════════════════════════════════════════════════════════════
+// CPowerShellHost with the real interpreter
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(PowerShellHost_ExecuteReturnsOutputAndKeepsHost)
+{
+    CPowerShellHost host;
+    CString output;
+    REQUIRE(host.Execute(_T("Write-Output 'hello'"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == _T("hello"));
+
+    // Non-ASCII survives the UTF-8 framing in both directions
+    REQUIRE(host.Execute(_T("'caf\x00e9' + (1 + 1)"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == _T("caf\x00e9") _T("2"));
+    CHECK(host.IsRunning());
+}
+
+TEST_CASE(PowerShellHost_TimeoutKillsHostAndNextCallRestarts)
+{
+    CPowerShellHost host;
+    REQUIRE(host.Warmup());
+
+    CString output;
+    ULONGLONG start = GetTickCount64();
+    CHECK(host.Execute(_T("Start-Sleep -Seconds 30"), output, 300) == PowerShellStatus::TimedOut);
+    CHECK(GetTickCount64() - start < 5000);
+    CHECK(!host.IsRunning());
+
+    CHECK(host.Execute(_T("Write-Output 'again'"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == _T("again"));
+}
+
+TEST_CASE(PowerShellHost_HostExitMidCommandFailsAtOnce)
+{
+    CPowerShellHost host;
+    CString output;
+    ULONGLONG start = GetTickCount64();
+    CHECK(host.Execute(_T("[Environment]::Exit(3)"), output, 30000) == PowerShellStatus::HostDied);
+    CHECK(GetTickCount64() - start < 10000);
+
+    CHECK(host.Execute(_T("Write-Output 'restarted'"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == _T("restarted"));
+}
+
+TEST_CASE(PowerShellHost_ExitStatementIsRefused)
+{
+    CPowerShellHost host;
+    CString output;
+    REQUIRE(host.Execute(_T("if ($true) { exit 2 }"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == CPowerShellHost::EXIT_REFUSED);
+    CHECK(host.IsRunning());
+
+    // "exit" as a plain word is not an exit statement
+    REQUIRE(host.Execute(_T("Write-Output 'exit'"), output, 30000) == PowerShellStatus::Ok);
+    CHECK(output == _T("exit"));
+}
+
+TEST_CASE(PowerShellHost_CancelEventStopsWaiting)
+{
+    CPowerShellHost host;
+    REQUIRE(host.Warmup());
+
+    HANDLE hCancel = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    CWinUtils::SetCancelEvent(hCancel);
+    std::thread canceller([hCancel] {
+        Sleep(300);
+        SetEvent(hCancel);
+    });
+
+    CString output;
+    ULONGLONG start = GetTickCount64();
+    PowerShellStatus status = host.Execute(_T("Start-Sleep -Seconds 30"), output, 30000);
+    canceller.join();
+    CWinUtils::SetCancelEvent(nullptr);
+    CloseHandle(hCancel);
+
+    CHECK(status == PowerShellStatus::Cancelled);
+    CHECK(GetTickCount64() - start < 5000);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Scripted stand-ins for the interpreter
+// ════════════════════════════════════════════════════════════════
+// SetInterpreter appends "-EncodedCommand <script>"; a trailing "& rem"
+// makes cmd.exe ignore it, so these run without PowerShell at all.
+
+TEST_CASE(PowerShellHost_StubThatNeverRepliesTimesOut)
+{
+    CPowerShellHost host;
+    host.SetInterpreter(_T("cmd.exe /c ping -n 30 127.0.0.1 >nul & rem"));
+
+    CString output;
+    ULONGLONG start = GetTickCount64();
+    CHECK(host.Execute(_T("anything"), output, 300) == PowerShellStatus::TimedOut);
+    CHECK(GetTickCount64() - start < 5000);
+}
+
+TEST_CASE(PowerShellHost_StubThatDiesMidCommandReportsHostDied)
+{
+    // set /p takes the request line, so the host dies after accepting it
+    CPowerShellHost host;
+    host.SetInterpreter(_T("cmd.exe /c set /p request=& echo partial output& exit 3 & rem"));
+
+    CString output;
+    ULONGLONG start = GetTickCount64();
+    CHECK(host.Execute(_T("anything"), output, 30000) == PowerShellStatus::HostDied);
+    CHECK(GetTickCount64() - start < 5000);
+    CHECK(output.IsEmpty());
+}
+
+TEST_CASE(PowerShellHost_MissingInterpreterReportsStartFailed)
+{
+    CPowerShellHost host;
+    host.SetInterpreter(_T("rds-no-such-interpreter.exe"));
+
+    CString output;
+    CHECK(host.Execute(_T("anything"), output, 30000) == PowerShellStatus::StartFailed);
+    CHECK(!host.IsRunning());
+}
+
+// ════════════════════════════════════════════════════════════════
+// CWinUtils::RunPowerShellCommand fallback
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(RunPowerShellCommand_FallsBackOnlyWhenTheHostCannotStart)
+{
+    CPowerShellHost& host = CPowerShellHost::Instance();
+
+    host.SetInterpreter(_T("rds-no-such-interpreter.exe"));
+    CHECK(CWinUtils::RunPowerShellCommand(_T("Write-Output 'one-shot'")) == _T("one-shot"));
+
+    // The dying stub took the command: running it again in a new process
+    // would repeat whatever part of it had already happened
+    CString marker = TestTempDir() + _T("\\ran.txt");
+    host.SetInterpreter(_T("cmd.exe /c set /p request=& exit 3 & rem"));
+    CHECK(CWinUtils::RunPowerShellCommand(_T("Set-Content -Path '") + marker + _T("' -Value x")).IsEmpty());
+    CHECK(GetFileAttributes(marker) == INVALID_FILE_ATTRIBUTES);
+
+    host.SetInterpreter(CPowerShellHost::DEFAULT_INTERPRETER);
+}
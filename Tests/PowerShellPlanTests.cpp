@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/PowerShellHost.h"
+#include "../Common/PowerShellPlan.h"
+#include "../Common/WinUtils.h"
+
+// ════════════════════════════════════════════════════════════════
+// CPowerShellPlan::Compile
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(PowerShellPlan_CompilesItemsInOrderWithoutDoubleQuotes)
+{
+    CPowerShellPlan plan;
+    CHECK(plan.Add(_T("first"), _T("Get-Date")) == 0);
+    CHECK(plan.Add(_T("second"), _T("Get-Location")) == 1);
+
+    CString script = plan.Compile();
+    CHECK(script.Find(_T("& { $ErrorActionPreference = 'Stop'")) == 0);
+    int first = script.Find(_T("Get-Date"));
+    int second = script.Find(_T("Get-Location"));
+    CHECK(first > 0 && second > first);
+    CHECK(script.Find(_T('"')) < 0);        // would end the one-shot -Command "..."
+}
+
+// ════════════════════════════════════════════════════════════════
+// CPowerShellPlan::ParseResults
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(PowerShellPlan_ParsesOneResultPerItem)
+{
+    CPowerShellPlan plan;
+    plan.Add(_T("a"), _T("a"));
+    plan.Add(_T("b"), _T("b"));
+
+    // Host output written before the array is not part of it
+    REQUIRE(plan.ParseResults(_T("WARNING: something\r\n")
+                              _T("[{\"ok\":true,\"out\":\"one\\r\\n\"},{\"ok\":false,\"err\":\"denied\"}]")));
+    CHECK(plan.GetResult(0).ok);
+    CHECK(plan.GetResult(0).output == _T("one"));
+    CHECK(!plan.GetResult(1).ok);
+    CHECK(plan.GetResult(1).error == _T("denied"));
+    CHECK(plan.GetResult(1).output.IsEmpty());
+}
+
+TEST_CASE(PowerShellPlan_MissingOutIsEmptyOutput)
+{
+    CPowerShellPlan plan;
+    plan.Add(_T("a"), _T("a"));
+    REQUIRE(plan.ParseResults(_T("[{\"ok\":true}]")));
+    CHECK(plan.GetResult(0).ok);
+    CHECK(plan.GetResult(0).output.IsEmpty());
+}
+
+TEST_CASE(PowerShellPlan_RejectsAnItemCountMismatch)
+{
+    CPowerShellPlan plan;
+    plan.Add(_T("a"), _T("a"));
+    plan.Add(_T("b"), _T("b"));
+    CHECK(!plan.ParseResults(_T("[{\"ok\":true,\"out\":\"one\"}]")));
+    CHECK(!plan.ParseResults(_T("[{\"ok\":true},{\"ok\":true}]\r\ntrailing text")));
+    CHECK(!plan.ParseResults(_T("")));
+}
+
+// ════════════════════════════════════════════════════════════════
+// CPowerShellPlan::Run
+// ════════════════════════════════════════════════════════════════
+
+static void RunFailingPlan()
+{
+    CPowerShellPlan plan;
+    plan.Add(_T("works"), _T("Write-Output 'a'"));
+    plan.Add(_T("throws"), _T("throw 'boom'"));
+    plan.Add(_T("after"), _T("Write-Output 'b'"));
+    REQUIRE(plan.Run());
+
+    CHECK(plan.GetResult(0).ok);
+    CHECK(plan.GetResult(0).output == _T("a"));
+    CHECK(!plan.GetResult(1).ok);
+    CHECK(plan.GetResult(1).error == _T("boom"));
+    CHECK(plan.GetResult(2).ok);
+    CHECK(plan.GetResult(2).output == _T("b"));
+}
+
+TEST_CASE(PowerShellPlan_FailureDoesNotStopLaterItems)
+{
+    RunFailingPlan();
+}
+
+TEST_CASE(PowerShellPlan_RunsThroughTheOneShotFallback)
+{
+    CPowerShellHost& host = CPowerShellHost::Instance();
+    host.SetInterpreter(_T("rds-no-such-interpreter.exe"));
+    RunFailingPlan();
+    host.SetInterpreter(CPowerShellHost::DEFAULT_INTERPRETER);
+}
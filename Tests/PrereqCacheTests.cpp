@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/PrereqCache.h"
+
+// Replace the string value of name in a saved cache file
+static bool SetField(const CString& path, const char* name, const std::string& value)
+{
+    std::string text = ReadFileBytes(path);
+    std::string key = std::string("\"") + name + "\": \"";
+    size_t start = text.find(key);
+    if (start == std::string::npos)
+        return false;
+    start += key.size();
+    size_t end = text.find('"', start);
+    text.replace(start, end - start, value);
+
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD written = 0;
+    bool ok = WriteFile(hFile, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) != FALSE;
+    CloseHandle(hFile);
+    return ok;
+}
+
+// FILETIME now, plus offset seconds, as the cache writes it
+static std::string SavedAt(LONGLONG offsetSeconds)
+{
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG now = (static_cast<ULONGLONG>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return std::to_string(now + offsetSeconds * 10000000);
+}
+
+static PrereqStatus SampleStatus(const CString& debuggerPath)
+{
+    PrereqStatus status;
+    status.teamViewerInstalled = true;
+    status.vpnDriverInstalled = true;
+    status.vpnIP = _T("7.12.34.56");
+    status.debuggerPath = debuggerPath;
+    return status;
+}
+
+// ════════════════════════════════════════════════════════════════
+// CPrereqCache::Load
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(PrereqCache_FreshStatusLoadsBack)
+{
+    CString dir = TestTempDir();
+    CString debugger = dir + _T("\\msvsmon.exe");
+    HANDLE hFile = CreateFile(debugger, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    REQUIRE(hFile != INVALID_HANDLE_VALUE);
+    CloseHandle(hFile);
+
+    CString path = dir + _T("\\SetupTest.prereq.json");
+    REQUIRE(CPrereqCache::Save(path, SampleStatus(debugger)));
+
+    PrereqStatus loaded;
+    REQUIRE(CPrereqCache::Load(path, loaded));
+    CHECK(loaded.teamViewerInstalled);
+    CHECK(loaded.vpnDriverInstalled);
+    CHECK(loaded.vpnIP == _T("7.12.34.56"));
+    CHECK(loaded.debuggerPath == debugger);
+
+    // The debugger has been uninstalled since
+    CHECK(DeleteFile(debugger));
+    CHECK(!CPrereqCache::Load(path, loaded));
+}
+
+TEST_CASE(PrereqCache_ExpiresAfterTheTTL)
+{
+    CString path = TestTempDir() + _T("\\SetupTest.prereq.json");
+    REQUIRE(CPrereqCache::Save(path, SampleStatus(CString())));
+
+    PrereqStatus loaded;
+    REQUIRE(SetField(path, "SavedAt", SavedAt(-static_cast<LONGLONG>(CPrereqCache::TTL_SECONDS) + 60)));
+    CHECK(CPrereqCache::Load(path, loaded));
+
+    REQUIRE(SetField(path, "SavedAt", SavedAt(-static_cast<LONGLONG>(CPrereqCache::TTL_SECONDS) - 60)));
+    CHECK(!CPrereqCache::Load(path, loaded));
+}
+
+TEST_CASE(PrereqCache_RejectsASaveTimeInTheFuture)
+{
+    // The clock was set back since the save
+    CString path = TestTempDir() + _T("\\SetupTest.prereq.json");
+    REQUIRE(CPrereqCache::Save(path, SampleStatus(CString())));
+    REQUIRE(SetField(path, "SavedAt", SavedAt(3600)));
+
+    PrereqStatus loaded;
+    CHECK(!CPrereqCache::Load(path, loaded));
+
+    REQUIRE(SetField(path, "SavedAt", "0"));
+    CHECK(!CPrereqCache::Load(path, loaded));
+}
+
+TEST_CASE(PrereqCache_RejectsAFingerprintMismatch)
+{
+    CString path = TestTempDir() + _T("\\SetupTest.prereq.json");
+    REQUIRE(CPrereqCache::Save(path, SampleStatus(CString())));
+    REQUIRE(SetField(path, "Fingerprint", "tv:0;net:00000000;dbg:0"));
+
+    PrereqStatus loaded;
+    CHECK(!CPrereqCache::Load(path, loaded));
+}
+
+TEST_CASE(PrereqCache_RejectsAnInvalidRecord)
+{
+    CString dir = TestTempDir();
+    CString path = dir + _T("\\SetupTest.prereq.json");
+    REQUIRE(CPrereqCache::Save(path, SampleStatus(CString())));
+    REQUIRE(SetField(path, "VPNIP", "7.12.34"));
+
+    PrereqStatus loaded;
+    CHECK(!CPrereqCache::Load(path, loaded));
+    CHECK(!CPrereqCache::Load(dir + _T("\\absent.prereq.json"), loaded));
+}
@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/ProcessRunner.h"
+#include "../Common/PowerShellHost.h"
+#include <AclAPI.h>
+#include <thread>
+#include <vector>
+
+// ════════════════════════════════════════════════════════════════
+// CProcessRunner::Run
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(ProcessRunner_CapturesStdoutAndStderr)
+{
+    ProcessResult result = CProcessRunner::Run(_T("cmd.exe /c echo hello& echo oops 1>&2& exit 7"), 10000);
+    REQUIRE(result.status == ProcessStatus::Ok);
+    CHECK(result.exitCode == 7);
+    CHECK(result.output.find("hello") != std::string::npos);
+    CHECK(result.output.find("oops") != std::string::npos);
+    CHECK(!result.truncated);
+}
+
+TEST_CASE(ProcessRunner_CapsOutput)
+{
+    ProcessResult result = CProcessRunner::Run(_T("cmd.exe /c for /l %i in (1,1,200) do @echo 0123456789"),
+                                               10000, nullptr, 16);
+    REQUIRE(result.status == ProcessStatus::Ok);
+    CHECK(result.output.size() == 16);
+    CHECK(result.truncated);
+}
+
+TEST_CASE(ProcessRunner_KillsOnTimeout)
+{
+    ULONGLONG start = GetTickCount64();
+    ProcessResult result = CProcessRunner::Run(_T("cmd.exe /c ping -n 30 127.0.0.1 >nul"), 300);
+    CHECK(result.status == ProcessStatus::TimedOut);
+    CHECK(GetTickCount64() - start < 5000);
+}
+
+TEST_CASE(ProcessRunner_StopsOnCancel)
+{
+    HANDLE hCancel = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    std::thread canceller([hCancel] {
+        Sleep(200);
+        SetEvent(hCancel);
+    });
+
+    ULONGLONG start = GetTickCount64();
+    ProcessResult result = CProcessRunner::Run(_T("cmd.exe /c ping -n 30 127.0.0.1 >nul"), 30000, hCancel);
+    canceller.join();
+    CloseHandle(hCancel);
+
+    CHECK(result.status == ProcessStatus::Cancelled);
+    CHECK(GetTickCount64() - start < 5000);
+}
+
+TEST_CASE(ProcessRunner_PipesInputLargerThanThePipeBuffer)
+{
+    // sort reads all of stdin before it writes anything; the input must not
+    // have to fit in the pipe before the child starts
+    std::string input;
+    for (int i = 0; i < 100000; i++)
+        input += "0123456789\r\n";
+
+    ProcessResult result = CProcessRunner::Run(_T("sort.exe"), 30000, nullptr,
+                                               CProcessRunner::DEFAULT_MAX_OUTPUT, &input);
+    REQUIRE(result.status == ProcessStatus::Ok);
+    CHECK(result.exitCode == 0);
+    CHECK(result.output == input);
+}
+
+TEST_CASE(ProcessRunner_OutputPipeAdmitsOnlyTheCurrentUser)
+{
+    HANDLE hRead = nullptr, hWrite = nullptr;
+    REQUIRE(CProcessRunner::CreateOutputPipe(hRead, hWrite));
+
+    PACL dacl = nullptr;
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    DWORD error = GetSecurityInfo(hRead, SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION,
+                                  nullptr, nullptr, &dacl, nullptr, &descriptor);
+    CHECK(error == ERROR_SUCCESS);
+
+    HANDLE hToken = nullptr;
+    DWORD size = 0;
+    OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken);
+    GetTokenInformation(hToken, TokenUser, nullptr, 0, &size);
+    std::vector<BYTE> user(size);
+    bool gotUser = size > 0 && GetTokenInformation(hToken, TokenUser, user.data(), size, &size);
+    CHECK(gotUser);
+
+    CHECK(dacl != nullptr);
+    if (dacl && gotUser)
+    {
+        CHECK(dacl->AceCount == 1);
+        ACCESS_ALLOWED_ACE* ace = nullptr;
+        if (GetAce(dacl, 0, reinterpret_cast<void**>(&ace)))
+        {
+            CHECK(ace->Header.AceType == ACCESS_ALLOWED_ACE_TYPE);
+            CHECK(EqualSid(&ace->SidStart, reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid));
+        }
+    }
+
+    if (descriptor)
+        LocalFree(descriptor);
+    if (hToken)
+        CloseHandle(hToken);
+    CloseHandle(hWrite);
+    CloseHandle(hRead);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Handle inheritance
+// ════════════════════════════════════════════════════════════════
+// A pipe whose inheritable write end exists while some other child is
+// started stands in for a run in flight on another step thread. Once we
+// close our write end the pipe must report EOF at once; if the child had
+// inherited a copy, it would stay open until that child exits.
+
+static bool IsPipeClosed(HANDLE hRead)
+{
+    DWORD available = 0;
+    return !PeekNamedPipe(hRead, nullptr, 0, nullptr, &available, nullptr) &&
+           GetLastError() == ERROR_BROKEN_PIPE;
+}
+
+TEST_CASE(ProcessRunner_ChildInheritsOnlyItsOwnPipe)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE hOtherRead = nullptr, hOtherWrite = nullptr;
+    REQUIRE(CreatePipe(&hOtherRead, &hOtherWrite, &sa, 0));
+
+    HANDLE hRead = nullptr, hWrite = nullptr;
+    REQUIRE(CProcessRunner::CreateOutputPipe(hRead, hWrite));
+    PROCESS_INFORMATION pi = {};
+    bool started = CProcessRunner::StartHidden(_T("cmd.exe /c ping -n 30 127.0.0.1 >nul"), nullptr, hWrite, pi);
+    CloseHandle(hWrite);
+    CHECK(started);
+
+    CloseHandle(hOtherWrite);
+    CHECK(IsPipeClosed(hOtherRead));
+
+    if (started)
+    {
+        ResumeThread(pi.hThread);
+        TerminateProcess(pi.hProcess, 1);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+    }
+    CloseHandle(hRead);
+    CloseHandle(hOtherRead);
+}
+
+TEST_CASE(PowerShellHost_StartInheritsNoOtherPipe)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE hOtherRead = nullptr, hOtherWrite = nullptr;
+    REQUIRE(CreatePipe(&hOtherRead, &hOtherWrite, &sa, 0));
+
+    CPowerShellHost host;
+    bool started = host.Warmup();
+    CloseHandle(hOtherWrite);
+    CHECK(started);
+    CHECK(IsPipeClosed(hOtherRead));
+
+    host.Shutdown();
+    CloseHandle(hOtherRead);
+}
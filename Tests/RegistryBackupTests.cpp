@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/RegistryBackup.h"
+
+static void WriteBytes(LPCTSTR path, const char* bytes)
+{
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD written = 0;
+    WriteFile(hFile, bytes, static_cast<DWORD>(strlen(bytes)), &written, nullptr);
+    CloseHandle(hFile);
+}
+
+// ════════════════════════════════════════════════════════════════
+// In-memory state and Commit
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(RegistryBackup_SaveIsBufferedUntilCommit)
+{
+    CString path = TestTempDir() + _T("\\state.ini");
+    CRegistryBackup backup;
+    backup.InitializeFile(path);
+
+    CHECK(!backup.HasSavedState());
+    backup.SaveState(_T("share_existed"), true);
+    backup.SaveState(_T("debugger_port"), 4026);
+    CHECK(backup.LoadStateBool(_T("SHARE_EXISTED")));         // keys are case-insensitive
+    CHECK(backup.LoadStateInt(_T("debugger_port")) == 4026);
+    CHECK(backup.HasSavedState());
+    CHECK(GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES);
+
+    REQUIRE(backup.Commit());
+    CHECK(GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES);
+    CHECK(GetFileAttributes(path + _T(".tmp")) == INVALID_FILE_ATTRIBUTES);
+
+    // UTF-16 with a BOM, sorted by key
+    std::string bytes = ReadFileBytes(path);
+    REQUIRE(bytes.size() > 2);
+    CHECK(static_cast<BYTE>(bytes[0]) == 0xFF && static_cast<BYTE>(bytes[1]) == 0xFE);
+    std::wstring text(reinterpret_cast<const wchar_t*>(bytes.data() + 2), (bytes.size() - 2) / 2);
+    CHECK(text == L"[State]\r\ndebugger_port=4026\r\nshare_existed=1\r\n");
+
+    // Nothing changed: the file is not rewritten
+    DeleteFile(path);
+    CHECK(backup.Commit());
+    CHECK(GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES);
+}
+
+TEST_CASE(RegistryBackup_CommittedStateLoadsInANewInstance)
+{
+    CString path = TestTempDir() + _T("\\state.ini");
+    CString longValue(_T('v'), 5000);       // well past GetPrivateProfileString's usual 1024 buffer
+    {
+        CRegistryBackup backup;
+        backup.InitializeFile(path);
+        backup.SaveState(_T("original_path"), _T("C:\\Program Files\\caf\x00e9"));
+        backup.SaveState(_T("firewall_rules"), longValue);
+        REQUIRE(backup.Commit());
+    }
+
+    CRegistryBackup reloaded;
+    reloaded.InitializeFile(path);
+    CHECK(reloaded.LoadState(_T("original_path")) == _T("C:\\Program Files\\caf\x00e9"));
+    CHECK(reloaded.LoadState(_T("firewall_rules")) == longValue);
+    CHECK(reloaded.LoadState(_T("missing"), _T("fallback")) == _T("fallback"));
+
+    // The file stays readable by the profile API
+    TCHAR buffer[8192] = {};
+    GetPrivateProfileString(_T("State"), _T("firewall_rules"), _T(""), buffer, _countof(buffer), path);
+    CHECK(longValue == buffer);
+}
+
+TEST_CASE(RegistryBackup_ClearStateDeletesTheFile)
+{
+    CString path = TestTempDir() + _T("\\state.ini");
+    CRegistryBackup backup;
+    backup.InitializeFile(path);
+    backup.SaveState(_T("drive_letter"), _T("Z"));
+    REQUIRE(backup.Commit());
+
+    backup.ClearState();
+    CHECK(!backup.HasSavedState());
+    CHECK(backup.LoadState(_T("drive_letter")).IsEmpty());
+    CHECK(GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Files written before Commit existed
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(RegistryBackup_ImportsLegacyProfileFile)
+{
+    CString path = TestTempDir() + _T("\\state.ini");
+    WritePrivateProfileString(_T("State"), _T("share_existed"), _T("1"), path);
+    WritePrivateProfileString(_T("State"), _T("share_path"), _T("\"C:\\Shared Folder\""), path);
+    WritePrivateProfileString(_T("Other"), _T("ignored"), _T("x"), path);
+
+    CRegistryBackup backup;
+    backup.InitializeFile(path);
+    CHECK(backup.HasSavedState());
+    CHECK(backup.LoadStateBool(_T("share_existed")));
+    CHECK(backup.LoadState(_T("share_path")) == _T("C:\\Shared Folder"));     // quotes stripped
+    CHECK(backup.LoadState(_T("ignored")).IsEmpty());
+}
+
+TEST_CASE(RegistryBackup_FirstDuplicateKeyWins)
+{
+    CString path = TestTempDir() + _T("\\state.ini");
+    WriteBytes(path, "\xEF\xBB\xBF; comment\r\n[State]\r\nKey = first\r\n\r\nkey=second\r\n[Later]\r\nkey=third\r\n");
+
+    CRegistryBackup backup;
+    backup.InitializeFile(path);
+    CHECK(backup.LoadState(_T("KEY")) == _T("first"));
+}
@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/SettingsUtils.h"
+
+// ════════════════════════════════════════════════════════════════
+// CSettingsUtils
+// ════════════════════════════════════════════════════════════════
+
+struct TestSettings
+{
+    CString password;
+    CString port;
+    CString drive;
+
+    TestSettings();
+};
+
+static const SettingField<TestSettings> s_schema[] =
+{
+    { SettingName(KEY_PASSWORD),      &TestSettings::password, SETTING_TEXT,         _T("default") },
+    { SettingName(KEY_DEBUGGER_PORT), &TestSettings::port,     SETTING_PORT,         _T("4026") },
+    { SettingName(KEY_DRIVE_LETTER),  &TestSettings::drive,    SETTING_DRIVE_LETTER, _T("Z:") },
+};
+
+TestSettings::TestSettings()
+{
+    CSettingsUtils::ApplyDefaults(s_schema, *this);
+}
+
+static void WriteText(LPCTSTR path, const char* text)
+{
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD written = 0;
+    WriteFile(hFile, text, static_cast<DWORD>(strlen(text)), &written, nullptr);
+    CloseHandle(hFile);
+}
+
+TEST_CASE(Settings_KeyNamesRoundTrip)
+{
+    for (int i = 0; i < SETTING_KEY_COUNT; i++)
+    {
+        SettingKey key = static_cast<SettingKey>(i);
+        SettingKey found = SETTING_KEY_COUNT;
+        CHECK(CSettingsUtils::FindKey(CSettingsUtils::KeyName(key), found));
+        CHECK(found == key);
+    }
+
+    SettingKey key;
+    CHECK(!CSettingsUtils::FindKey(_T("password"), key));      // names are case-sensitive
+    CHECK(!CSettingsUtils::FindKey(_T("Passwrd"), key));
+    CHECK(CString(CSettingsUtils::KeyName(KEY_DEV_VPN_IP)) == _T("DevVPNIP"));
+    CHECK(CString(SettingName(KEY_DEBUGGER_PORT)) == CSettingsUtils::KeyName(KEY_DEBUGGER_PORT));
+}
+
+TEST_CASE(Settings_DefaultsComeFromTheSchema)
+{
+    TestSettings settings;
+    CHECK(settings.password == _T("default"));
+    CHECK(settings.port == _T("4026"));
+    CHECK(settings.drive == _T("Z:"));
+
+    settings.port = _T("5000");
+    CSettingsUtils::ApplyDefaults(s_schema, settings);
+    CHECK(settings.port == _T("4026"));
+}
+
+TEST_CASE(Settings_TypeDecidesValidation)
+{
+    CHECK(CSettingsUtils::IsValid(SETTING_TEXT, _T("anything")));
+    CHECK(CSettingsUtils::IsValid(SETTING_PORT, _T("4026")));
+    CHECK(!CSettingsUtils::IsValid(SETTING_PORT, _T("80")));
+    CHECK(!CSettingsUtils::IsValid(SETTING_PORT, _T("4026x")));
+    CHECK(CSettingsUtils::IsValid(SETTING_IPV4, _T("7.12.34.56")));
+    CHECK(CSettingsUtils::IsValid(SETTING_IPV4, _T("")));
+    CHECK(!CSettingsUtils::IsValid(SETTING_IPV4, _T("7.12.34.256")));
+    CHECK(CSettingsUtils::IsValid(SETTING_DRIVE_LETTER, _T("Y:")));
+    CHECK(!CSettingsUtils::IsValid(SETTING_DRIVE_LETTER, _T("YY")));
+}
+
+TEST_CASE(Settings_PortIsWrittenAsANumber)
+{
+    CString path = TestTempDir() + _T("\\settings.json");
+    TestSettings saved;
+    REQUIRE(CSettingsUtils::Save(path, s_schema, saved));
+
+    std::string text = ReadFileBytes(path);
+    CHECK(text.find("\"DebuggerPort\": 4026") != std::string::npos);
+    CHECK(text.find("\"DriveLetter\": \"Z:\"") != std::string::npos);
+}
+
+TEST_CASE(Settings_SaveThenLoadRestoresEveryField)
+{
+    CString path = TestTempDir() + _T("\\nested\\settings.json");
+    TestSettings saved;
+    saved.password = _T("p\"a\\ss \x00e9");
+    saved.port = _T("4030");
+    saved.drive = _T("Y:");
+    REQUIRE(CSettingsUtils::Save(path, s_schema, saved));
+
+    TestSettings loaded;
+    CString error;
+    REQUIRE(CSettingsUtils::Load(path, s_schema, loaded, &error));
+    CHECK(error.IsEmpty());
+    CHECK(loaded.password == saved.password);
+    CHECK(loaded.port == _T("4030"));
+    CHECK(loaded.drive == _T("Y:"));
+}
+
+TEST_CASE(Settings_LoadIgnoresUnknownAndRejectsInvalid)
+{
+    CString path = TestTempDir() + _T("\\settings.json");
+    WriteText(path, "{ \"Password\": \"x\", \"SomethingElse\": 1, \"ShareName\": \"s\","
+                    "  \"DebuggerPort\": 80, \"DriveLetter\": \"Y:\" }");
+
+    TestSettings loaded;
+    CString error;
+    REQUIRE(CSettingsUtils::Load(path, s_schema, loaded, &error));
+    CHECK(loaded.password == _T("x"));
+    CHECK(loaded.port == _T("4026"));           // 80 is below 1024: default kept
+    CHECK(loaded.drive == _T("Y:"));
+    CHECK(error == _T("invalid value for DebuggerPort"));
+}
+
+TEST_CASE(Settings_LoadReportsSyntaxErrorPosition)
+{
+    CString path = TestTempDir() + _T("\\settings.json");
+    WriteText(path, "{\n  \"Password\": \"x\"\n  \"DriveLetter\": \"Y:\"\n}");
+
+    TestSettings loaded;
+    CString error;
+    CHECK(!CSettingsUtils::Load(path, s_schema, loaded, &error));
+    CHECK(error.Find(_T("line 3")) == 0);
+    CHECK(loaded.password == _T("default"));
+}
+
+TEST_CASE(Settings_MissingFileIsNotAnError)
+{
+    TestSettings loaded;
+    CString error;
+    CHECK(!CSettingsUtils::Load(TestTempDir() + _T("\\absent.json"), s_schema, loaded, &error));
+    CHECK(error.IsEmpty());
+}
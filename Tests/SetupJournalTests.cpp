@@ -0,0 +1,267 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/SetupJournal.h"
+
+// ════════════════════════════════════════════════════════════════
+// Helpers
+// ════════════════════════════════════════════════════════════════
+
+static void WriteFileBytes(LPCTSTR path, const std::string& data)
+{
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD written = 0;
+    WriteFile(hFile, data.data(), static_cast<DWORD>(data.size()), &written, nullptr);
+    CloseHandle(hFile);
+}
+
+// Offsets where each frame starts, walking the length fields
+static std::vector<size_t> FrameOffsets(const std::string& data)
+{
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+    while (offset + 8 <= data.size())
+    {
+        offsets.push_back(offset);
+        DWORD length = 0;
+        memcpy(&length, data.data() + offset, sizeof(length));
+        offset += 8 + length;
+    }
+    return offsets;
+}
+
+// A setup run killed while step 1 was in flight
+static void WriteKilledRun(CSetupJournal& journal)
+{
+    journal.BeginRun(false);
+    journal.BeginStep(0);
+    journal.RecordOriginal(0, _T("FirewallRule"), _T("absent"));
+    journal.CommitStep(0, true);
+    journal.BeginStep(1);
+    journal.RecordOriginal(1, _T("Share"), _T("none"));
+}
+
+// ════════════════════════════════════════════════════════════════
+// Framing
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(SetupJournal_Crc32MatchesStandardCheckValue)
+{
+    const char check[] = "123456789";
+    CHECK(CSetupJournal::Crc32(reinterpret_cast<const BYTE*>(check), 9) == 0xCBF43926);
+    CHECK(CSetupJournal::Crc32(nullptr, 0) == 0);
+}
+
+TEST_CASE(SetupJournal_EachRecordIsLengthAndCrcFramed)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        journal.BeginRun(false);
+        journal.RecordOriginal(0, _T("Key"), _T("Value"));
+    }
+
+    std::string data = ReadFileBytes(path);
+    std::vector<size_t> offsets = FrameOffsets(data);
+    REQUIRE(offsets.size() == 2);
+
+    size_t end = 0;
+    for (size_t offset : offsets)
+    {
+        DWORD length = 0, crc = 0;
+        memcpy(&length, data.data() + offset, sizeof(length));
+        memcpy(&crc, data.data() + offset + 4, sizeof(crc));
+        CHECK(CSetupJournal::Crc32(reinterpret_cast<const BYTE*>(data.data() + offset + 8), length) == crc);
+        end = offset + 8 + length;
+    }
+    CHECK(end == data.size());
+
+    // type, ok, step, then the key and value as counted UTF-16
+    const BYTE* payload = reinterpret_cast<const BYTE*>(data.data() + offsets[1] + 8);
+    CHECK(payload[0] == JOURNAL_ORIGINAL);
+    CHECK(payload[6] == 3 && payload[7] == 0);
+    CHECK(memcmp(payload + 8, L"Key", 3 * sizeof(WCHAR)) == 0);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Replay
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(SetupJournal_ReplayRestoresKilledRun)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        WriteKilledRun(journal);
+        // No EndRun: the process "dies" here
+    }
+
+    CSetupJournal journal;
+    REQUIRE(journal.Open(path));
+    CHECK(journal.HasInterruptedSetup());
+    CHECK(journal.HasSetupHistory());
+    CHECK(journal.IsStepDone(0));
+    CHECK(!journal.IsStepDone(1));
+    CHECK(journal.NeedsUndo(0));
+    CHECK(!journal.NeedsUndo(1));
+    CHECK(journal.GetUnfinishedSteps() == std::vector<int>{ 1 });
+
+    CString value;
+    CHECK(journal.FindOriginal(_T("share"), value) && value == _T("none"));   // keys compare case-insensitively
+}
+
+TEST_CASE(SetupJournal_TornTailIsCutAndAppendsFollowLastGoodRecord)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        WriteKilledRun(journal);
+    }
+    std::string good = ReadFileBytes(path);
+
+    // A kill mid-WriteFile leaves the head of the next frame
+    std::vector<size_t> offsets = FrameOffsets(good);
+    std::string torn = good + good.substr(offsets[1], 11);
+    WriteFileBytes(path, torn);
+
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        CHECK(journal.IsStepDone(0));
+        CHECK(journal.GetUnfinishedSteps() == std::vector<int>{ 1 });
+        CHECK(ReadFileBytes(path) == good);
+
+        journal.BeginRun(false);
+        journal.CommitStep(1, true);
+        journal.EndRun(true);
+    }
+
+    CSetupJournal journal;
+    REQUIRE(journal.Open(path));
+    CHECK(FrameOffsets(ReadFileBytes(path)).size() == offsets.size() + 3);
+    CHECK(journal.IsStepDone(0));
+    CHECK(journal.IsStepDone(1));
+    CHECK(!journal.HasInterruptedSetup());
+}
+
+TEST_CASE(SetupJournal_CorruptRecordEndsReplay)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        WriteKilledRun(journal);
+    }
+
+    // Flip one payload byte of the step 0 commit: it and everything after is dropped
+    std::string data = ReadFileBytes(path);
+    std::vector<size_t> offsets = FrameOffsets(data);
+    REQUIRE(offsets.size() == 6);
+    data[offsets[3] + 8 + 1] ^= 0x01;
+    WriteFileBytes(path, data);
+
+    CSetupJournal journal;
+    REQUIRE(journal.Open(path));
+    CHECK(!journal.IsStepDone(0));
+    CHECK(journal.GetUnfinishedSteps() == std::vector<int>{ 0 });
+    CString value;
+    CHECK(!journal.FindOriginal(_T("Share"), value));
+    CHECK(ReadFileBytes(path).size() == offsets[3]);
+}
+
+// ════════════════════════════════════════════════════════════════
+// View
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(SetupJournal_FirstOriginalWins)
+{
+    CSetupJournal journal;
+    REQUIRE(journal.Open(TestTempDir() + _T("\\journal.bin")));
+    journal.BeginRun(false);
+    journal.RecordOriginal(0, _T("Key"), _T("before"));
+    journal.RecordOriginal(0, _T("KEY"), _T("after first change"));
+
+    std::map<CString, CString> originals = journal.GetOriginals();
+    REQUIRE(originals.size() == 1);
+    CHECK(originals.begin()->first == _T("Key"));
+    CHECK(originals.begin()->second == _T("before"));
+}
+
+TEST_CASE(SetupJournal_RestoreEndsResumeAndResetDeletes)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    CSetupJournal journal;
+    REQUIRE(journal.Open(path));
+    WriteKilledRun(journal);
+
+    journal.BeginRun(true);
+    journal.MarkUndone(0);
+    CHECK(!journal.IsStepDone(0));
+    CHECK(!journal.NeedsUndo(0));
+    journal.EndRun(true);
+    CHECK(!journal.HasInterruptedSetup());
+
+    journal.Reset();
+    CHECK(GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES);
+    CHECK(!journal.HasSetupHistory());
+    CHECK(journal.EndRun(true));     // nothing open after a reset
+}
+
+TEST_CASE(SetupJournal_ResumeNeedsTheSameInputs)
+{
+    CString path = TestTempDir() + _T("\\journal.bin");
+    CString before = CSetupJournal::Fingerprint(_T("Share\nC:\\Share\n7.0.0.0/8"));
+    CString after  = CSetupJournal::Fingerprint(_T("Other\nC:\\Share\n7.0.0.0/8"));
+    CHECK(before != after);
+    CHECK(before == CSetupJournal::Fingerprint(_T("Share\nC:\\Share\n7.0.0.0/8")));
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        journal.BeginRun(false, before);
+        journal.BeginStep(0);
+        journal.CommitStep(0, true);
+    }
+
+    // Same settings: the killed run is continued
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        CHECK(journal.HasInterruptedSetup());
+        CHECK(journal.GetSetupInputs() == before);
+        journal.BeginRun(false, before);
+        CHECK(journal.IsStepDone(0));
+    }
+
+    // Different settings: nothing counts as done, also after a replay
+    {
+        CSetupJournal journal;
+        REQUIRE(journal.Open(path));
+        journal.BeginRun(false, after);
+        CHECK(!journal.IsStepDone(0));
+        CHECK(journal.NeedsUndo(0));     // what the first run changed is still undone by Restore
+    }
+    CSetupJournal journal;
+    REQUIRE(journal.Open(path));
+    CHECK(journal.GetSetupInputs() == after);
+    CHECK(!journal.IsStepDone(0));
+}
+
+TEST_CASE(SetupJournal_FailedAppendLeavesTheViewUnchanged)
+{
+    // The folder does not exist, so no record can be written
+    CSetupJournal journal;
+    CHECK(!journal.Open(TestTempDir() + _T("\\missing\\journal.bin")));
+    CHECK(!journal.BeginRun(false));
+    CHECK(!journal.BeginStep(0));
+    CHECK(!journal.CommitStep(0, true));
+    CHECK(!journal.RecordOriginal(0, _T("Key"), _T("value")));
+
+    CString value;
+    CHECK(!journal.HasInterruptedSetup());
+    CHECK(!journal.IsStepDone(0));
+    CHECK(!journal.NeedsUndo(0));
+    CHECK(!journal.HasSetupHistory());
+    CHECK(!journal.FindOriginal(_T("Key"), value));
+}
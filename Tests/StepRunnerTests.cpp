@@ -0,0 +1,353 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/Headless.h"
+#include "../Common/StepRunner.h"
+#include "../Common/WinUtils.h"
+#include <algorithm>
+#include <stdexcept>
+
+// A step that records its number and returns ok
+static SetupStep FakeStep(std::vector<int>& order, std::mutex& mutex, int number, bool ok,
+                          bool affectsResult = true, std::vector<int> dependsOn = {})
+{
+    SetupStep step;
+    step.title.Format(_T("Step %d"), number);
+    step.run = [&order, &mutex, number, ok] {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back(number);
+        return ok;
+    };
+    step.affectsResult = affectsResult;
+    step.dependsOn = dependsOn;
+    return step;
+}
+
+// Observer that counts what the runner reported
+struct ObservedRun
+{
+    std::atomic<int>  progress{ 0 };
+    std::atomic<int>  completions{ 0 };
+    std::atomic<bool> allOk{ false };
+    std::atomic<bool> cancelled{ false };
+
+    StepObserver Observer()
+    {
+        StepObserver observer;
+        observer.onProgress = [this](int, StepState) { progress++; };
+        observer.onComplete = [this](bool ok, bool wasCancelled) {
+            allOk = ok;
+            cancelled = wasCancelled;
+            completions++;
+        };
+        return observer;
+    }
+};
+
+// Run the steps without a window and return the headless exit code; the
+// RESULT record goes to resultPath
+static int RunHeadless(CStepRunner& runner, ObservedRun& observed, std::vector<SetupStep> steps,
+                       const CString& resultPath)
+{
+    HANDLE hOut = CreateFile(resultPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hOut == INVALID_HANDLE_VALUE)
+        return -1;
+
+    CLogUtils log;
+    log.SetConsoleOutput(hOut, true);
+    int exitCode = -1;
+    if (runner.Start(observed.Observer(), &log, std::move(steps)))
+    {
+        CHeadless::WaitForRun(runner);
+        exitCode = CHeadless::Finish(runner, log, _T("Test"));
+    }
+    log.SetConsoleOutput(nullptr, false);
+    CloseHandle(hOut);
+    return exitCode;
+}
+
+static std::string LastLine(const CString& path)
+{
+    std::vector<std::string> lines = ReadFileLines(path);
+    return lines.empty() ? std::string() : lines.back();
+}
+
+// ════════════════════════════════════════════════════════════════
+// CStepRunner without a window
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(StepRunner_RunsDependentsAfterTheirDependencies)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps.push_back(FakeStep(order, mutex, 2, true, true, { 0 }));
+    steps.push_back(FakeStep(order, mutex, 3, true, true, { 1 }));
+    steps.push_back(FakeStep(order, mutex, 4, true, true, CStepRunner::AllBefore(3)));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_SUCCEEDED);
+
+    CHECK(order == std::vector<int>({ 1, 2, 3, 4 }));
+    CHECK(!runner.IsRunning());
+    CHECK(runner.GetFinishedSteps() == 4);
+    CHECK(observed.progress == 8);          // running, then finished, for each step
+    CHECK(observed.completions == 1);
+    CHECK(observed.allOk);
+    CHECK(!observed.cancelled);
+
+    std::string result = LastLine(path);
+    CHECK(result.find("\"Level\":\"RESULT\"") != std::string::npos);
+    CHECK(result.find("\"ExitCode\":0") != std::string::npos);
+    CHECK(result.find("{\"Step\":4,\"State\":\"succeeded\"") != std::string::npos);
+}
+
+TEST_CASE(StepRunner_FailedStepFailsTheRunButReleasesDependents)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, false));
+    steps.push_back(FakeStep(order, mutex, 2, true, true, { 0 }));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_STEPS_FAILED);
+
+    CHECK(order == std::vector<int>({ 1, 2 }));
+    CHECK(!observed.allOk);
+    CHECK(runner.GetStepResult(1).state == STEP_FAILED);
+    CHECK(runner.GetStepResult(2).state == STEP_SUCCEEDED);
+    CHECK(LastLine(path).find("{\"Step\":1,\"State\":\"failed\"") != std::string::npos);
+}
+
+TEST_CASE(StepRunner_InformationalFailureKeepsTheRunGreen)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps.push_back(FakeStep(order, mutex, 2, false, false));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CHECK(RunHeadless(runner, observed, std::move(steps), TestTempDir() + _T("\\run.jsonl")) == EXIT_SUCCEEDED);
+    CHECK(runner.AllSucceeded());
+    CHECK(runner.GetStepResult(2).state == STEP_FAILED);
+}
+
+TEST_CASE(StepRunner_SkipsStepsAlreadyInPlace)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps[0].isInPlace = [] { return true; };
+    steps.push_back(FakeStep(order, mutex, 2, true, true, { 0 }));
+    steps[1].isInPlace = [] { return false; };
+    // In place, but runs anyway: step 2 had to be corrected first
+    steps.push_back(FakeStep(order, mutex, 3, true, true, { 1 }));
+    steps[2].isInPlace = [] { return true; };
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CHECK(RunHeadless(runner, observed, std::move(steps), TestTempDir() + _T("\\run.jsonl")) == EXIT_SUCCEEDED);
+    CHECK(order == std::vector<int>({ 2, 3 }));
+    CHECK(runner.GetStepResult(1).state == STEP_SUCCEEDED);
+}
+
+TEST_CASE(StepRunner_CancelStopsTheRun)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::atomic<bool> blocking(false);
+    std::vector<SetupStep> steps;
+
+    // Waits on the run's cancel event the way child processes do
+    SetupStep wait;
+    wait.title = _T("Wait for cancel");
+    wait.run = [&blocking] {
+        blocking = true;
+        return WaitForSingleObject(CWinUtils::GetCancelEvent(), 10000) != WAIT_OBJECT_0;
+    };
+    wait.affectsResult = true;
+    steps.push_back(wait);
+    steps.push_back(FakeStep(order, mutex, 2, true, true, { 0 }));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    std::thread canceller([&runner, &blocking] {
+        for (int i = 0; i < 500 && !blocking; i++)
+            Sleep(10);
+        runner.Cancel();
+    });
+    ULONGLONG start = GetTickCount64();
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    int exitCode = RunHeadless(runner, observed, std::move(steps), path);
+    canceller.join();
+
+    CHECK(exitCode == EXIT_CANCELLED);
+    CHECK(GetTickCount64() - start < 5000);
+    CHECK(order.empty());                   // no step starts after Cancel
+    CHECK(observed.cancelled);
+    CHECK(runner.GetStepResult(2).state == STEP_PENDING);
+    CHECK(LastLine(path).find("\"Cancelled\":true") != std::string::npos);
+}
+
+TEST_CASE(StepRunner_RefusesASecondStartWhileRunning)
+{
+    HANDLE hRelease = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    REQUIRE(hRelease != nullptr);
+    std::vector<SetupStep> steps(1);
+    steps[0].title = _T("Hold");
+    steps[0].run = [hRelease] { return WaitForSingleObject(hRelease, 10000) == WAIT_OBJECT_0; };
+    steps[0].affectsResult = true;
+
+    CLogUtils log;
+    CStepRunner runner;
+    REQUIRE(runner.Start(StepObserver(), &log, steps));
+    CHECK(!runner.Start(StepObserver(), &log, steps));
+    SetEvent(hRelease);
+    runner.Wait();
+    CHECK(runner.AllSucceeded());
+    CloseHandle(hRelease);
+}
+
+TEST_CASE(StepRunner_ThrowingStepFailsAndTheRunCompletes)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps[0].run = []() -> bool { throw std::runtime_error("disk full"); };
+    steps.push_back(FakeStep(order, mutex, 2, true));
+    steps[1].run = []() -> bool { throw 42; };
+    steps.push_back(FakeStep(order, mutex, 3, true, true, { 0, 1 }));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_STEPS_FAILED);
+
+    CHECK(runner.GetStepResult(1).state == STEP_FAILED);
+    CHECK(runner.GetStepResult(2).state == STEP_FAILED);
+    CHECK(order == std::vector<int>({ 3 }));
+    CHECK(observed.completions == 1);
+
+    std::string log = ReadFileBytes(path);
+    CHECK(log.find("Unexpected error: disk full") != std::string::npos);
+    CHECK(log.find("Unexpected error.") != std::string::npos);
+}
+
+// ════════════════════════════════════════════════════════════════
+// isInPlace checks
+// ════════════════════════════════════════════════════════════════
+
+// Some record's message starts with prefix
+static bool HasMessage(const std::vector<std::string>& lines, const char* prefix)
+{
+    std::string field = std::string("\"Message\":\"") + prefix;
+    for (const std::string& line : lines)
+    {
+        if (line.find(field) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+TEST_CASE(StepRunner_InPlaceStepIsSkippedAndLogged)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps[0].isInPlace = [] { return true; };
+    steps.push_back(FakeStep(order, mutex, 2, true));
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_SUCCEEDED);
+
+    CHECK(order == std::vector<int>({ 2 }));
+    CHECK(runner.GetStepResult(1).state == STEP_SUCCEEDED);     // skipped counts as done
+    CHECK(observed.progress == 4);
+
+    std::vector<std::string> lines = ReadFileLines(path);
+    CHECK(HasMessage(lines, "State check: 1 of 1 checked steps already in place"));
+    CHECK(HasMessage(lines, "Already in place, skipped."));
+    CHECK(HasMessage(lines, "Nothing had drifted."));
+    CHECK(HasMessage(lines, "[1/2] skipped in "));
+}
+
+TEST_CASE(StepRunner_DriftedStepRunsAndIsReportedCorrected)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps[0].isInPlace = [] { return false; };
+    steps.push_back(FakeStep(order, mutex, 2, true));
+    steps[1].isInPlace = [] { return true; };
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_SUCCEEDED);
+
+    CHECK(order == std::vector<int>({ 1 }));
+    std::vector<std::string> lines = ReadFileLines(path);
+    CHECK(HasMessage(lines, "Corrected: Step 1"));
+    CHECK(!HasMessage(lines, "Nothing had drifted."));
+}
+
+TEST_CASE(StepRunner_ThrowingCheckCountsAsDrifted)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    steps.push_back(FakeStep(order, mutex, 1, true));
+    steps[0].isInPlace = []() -> bool { throw new CUserException(); };
+    steps.push_back(FakeStep(order, mutex, 2, true));
+    steps[1].isInPlace = []() -> bool { throw std::runtime_error("no answer"); };
+
+    CStepRunner runner;
+    ObservedRun observed;
+    CString path = TestTempDir() + _T("\\run.jsonl");
+    CHECK(RunHeadless(runner, observed, std::move(steps), path) == EXIT_SUCCEEDED);
+
+    std::sort(order.begin(), order.end());
+    CHECK(order == std::vector<int>({ 1, 2 }));
+    CHECK(HasMessage(ReadFileLines(path), "State check: 0 of 2 checked steps already in place"));
+}
+
+TEST_CASE(StepRunner_ChecksRunOnTheBoundedPool)
+{
+    std::atomic<int> active(0), peak(0);
+    std::vector<int> order;
+    std::mutex mutex;
+    std::vector<SetupStep> steps;
+    for (int i = 1; i <= 8; i++)
+    {
+        steps.push_back(FakeStep(order, mutex, i, true));
+        steps.back().isInPlace = [&active, &peak] {
+            int now = ++active;
+            for (int seen = peak; now > seen && !peak.compare_exchange_weak(seen, now); )
+                ;
+            Sleep(30);
+            active--;
+            return true;
+        };
+    }
+
+    CStepRunner runner;
+    runner.SetMaxParallel(2);
+    ObservedRun observed;
+    CHECK(RunHeadless(runner, observed, std::move(steps), TestTempDir() + _T("\\run.jsonl")) == EXIT_SUCCEEDED);
+    CHECK(peak >= 1 && peak <= 2);
+    CHECK(order.empty());
+}
@@ -0,0 +1,52 @@
+#pragma once
+// TestFramework.h - Self-registering test cases for the console test runner
+
+#include <afxwin.h>
+#include <string>
+#include <vector>
+
+typedef void (*TestFn)();
+
+struct TestCase
+{
+    LPCSTR name;
+    TestFn run;
+};
+
+class CTestRegistry
+{
+public:
+    static bool Register(LPCSTR name, TestFn run);
+
+    // Run every test whose name contains filter (nullptr = all); returns the number that failed
+    static int RunAll(LPCSTR filter);
+
+    // Record a failed check in the running test
+    static void Fail(LPCSTR file, int line, LPCSTR expression);
+
+private:
+    static std::vector<TestCase>& Cases();
+};
+
+// Empty scratch folder for the running test under %TEMP%, removed when the run ends
+CString TestTempDir();
+
+// Whole file as bytes; empty if it cannot be read
+std::string ReadFileBytes(LPCTSTR path);
+
+// Whole file as UTF-8 lines without the '\n'
+std::vector<std::string> ReadFileLines(LPCTSTR path);
+
+// Define a test case: TEST_CASE(Journal_ReplaysAfterTornTail) { ... }
+#define TEST_CASE(name) \
+    static void name(); \
+    static const bool name##_registered = CTestRegistry::Register(#name, &name); \
+    static void name()
+
+// Record a failure and carry on
+#define CHECK(expr) \
+    do { if (!(expr)) CTestRegistry::Fail(__FILE__, __LINE__, #expr); } while (0)
+
+// Record a failure and leave the test (later checks depend on this one)
+#define REQUIRE(expr) \
+    do { if (!(expr)) { CTestRegistry::Fail(__FILE__, __LINE__, #expr); return; } } while (0)
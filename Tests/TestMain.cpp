@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include <ShlObj.h>
+
+// Tests.exe [filter]: runs every test (or those whose name contains filter)
+// and exits with the number of failed tests, so a build step can gate on it.
+
+CWinApp theApp;
+
+static LPCSTR s_currentTest = nullptr;
+static int    s_currentFailures = 0;
+static CString s_runDir;           // %TEMP%\RemoteDebugSetupTests-<pid>
+
+// ════════════════════════════════════════════════════════════════
+// Registry
+// ════════════════════════════════════════════════════════════════
+
+std::vector<TestCase>& CTestRegistry::Cases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+bool CTestRegistry::Register(LPCSTR name, TestFn run)
+{
+    Cases().push_back(TestCase{ name, run });
+    return true;
+}
+
+void CTestRegistry::Fail(LPCSTR file, int line, LPCSTR expression)
+{
+    s_currentFailures++;
+    LPCSTR slash = strrchr(file, '\\');
+    printf("  %s(%d): CHECK(%s) failed\n", slash ? slash + 1 : file, line, expression);
+}
+
+int CTestRegistry::RunAll(LPCSTR filter)
+{
+    int run = 0, failed = 0;
+    for (const TestCase& test : Cases())
+    {
+        if (filter && !strstr(test.name, filter))
+            continue;
+
+        s_currentTest = test.name;
+        s_currentFailures = 0;
+        printf("%s\n", test.name);
+        ULONGLONG start = GetTickCount64();
+        try
+        {
+            test.run();
+        }
+        catch (CException* e)
+        {
+            TCHAR msg[512] = {};
+            e->GetErrorMessage(msg, _countof(msg));
+            e->Delete();
+            printf("  exception: %S\n", msg);
+            s_currentFailures++;
+        }
+
+        run++;
+        if (s_currentFailures > 0)
+        {
+            failed++;
+            printf("  FAILED (%llu ms)\n", GetTickCount64() - start);
+        }
+    }
+    s_currentTest = nullptr;
+
+    printf("\n%d test(s) run, %d failed\n", run, failed);
+    return failed;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Helpers
+// ════════════════════════════════════════════════════════════════
+
+static void RemoveTree(const CString& dir)
+{
+    WIN32_FIND_DATA fd;
+    HANDLE hFind = FindFirstFile(dir + _T("\\*"), &fd);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            CString name(fd.cFileName);
+            if (name == _T(".") || name == _T(".."))
+                continue;
+            CString path = dir + _T("\\") + name;
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                RemoveTree(path);
+            else
+                DeleteFile(path);
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+    RemoveDirectory(dir);
+}
+
+CString TestTempDir()
+{
+    CString dir;
+    dir.Format(_T("%s\\%S"), (LPCTSTR)s_runDir, s_currentTest ? s_currentTest : "test");
+    RemoveTree(dir);
+    SHCreateDirectoryEx(nullptr, dir, nullptr);
+    return dir;
+}
+
+std::string ReadFileBytes(LPCTSTR path)
+{
+    std::string data;
+    HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return data;
+
+    char chunk[16 * 1024];
+    DWORD read = 0;
+    while (ReadFile(hFile, chunk, sizeof(chunk), &read, nullptr) && read > 0)
+        data.append(chunk, read);
+    CloseHandle(hFile);
+    return data;
+}
+
+std::vector<std::string> ReadFileLines(LPCTSTR path)
+{
+    std::vector<std::string> lines;
+    std::string data = ReadFileBytes(path);
+    size_t start = 0;
+    while (start < data.size())
+    {
+        size_t end = data.find('\n', start);
+        if (end == std::string::npos)
+            end = data.size();
+        lines.push_back(data.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Entry point
+// ════════════════════════════════════════════════════════════════
+
+int main(int argc, char* argv[])
+{
+    if (!AfxWinInit(::GetModuleHandle(nullptr), nullptr, ::GetCommandLine(), 0))
+    {
+        printf("MFC failed to initialize\n");
+        return 1;
+    }
+
+    TCHAR temp[MAX_PATH] = {};
+    GetTempPath(MAX_PATH, temp);
+    s_runDir.Format(_T("%sRemoteDebugSetupTests-%lu"), temp, GetCurrentProcessId());
+    SHCreateDirectoryEx(nullptr, s_runDir, nullptr);
+
+    int failed = CTestRegistry::RunAll(argc > 1 ? argv[1] : nullptr);
+
+    RemoveTree(s_runDir);
+    return failed;
+}
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/TraceRecorder.h"
+
+// Start each test from an empty, enabled recorder
+static void StartRecording()
+{
+    CTraceRecorder::Enable();
+    CTraceRecorder::Reset();
+}
+
+static std::string ExportTrace()
+{
+    CString path = TestTempDir() + _T("\\run.trace.json");
+    if (!CTraceRecorder::WriteChromeTrace(path))
+        return std::string();
+    return ReadFileBytes(path);
+}
+
+static void RecordDetail(LPCSTR category, LPCTSTR detail, LPCTSTR detail2 = nullptr,
+                         LONGLONG exitCode = -1, ULONGLONG outputBytes = 0)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    CTraceRecorder::Record(category, detail, detail2, now.QuadPart, now.QuadPart + 1000, exitCode, outputBytes);
+}
+
+static size_t CountOf(const std::string& text, const char* needle)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+        count++;
+    return count;
+}
+
+// ════════════════════════════════════════════════════════════════
+// Event JSON
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(TraceRecorder_WritesCompleteEvents)
+{
+    StartRecording();
+    RecordDetail("process", _T("C:\\Windows\\System32\\net.exe use Z:"), nullptr, 2, 10);
+    RecordDetail("step", _T("Map drive"));
+
+    std::string json = ExportTrace();
+    REQUIRE(!json.empty());
+    CHECK(json.find("{\"name\":\"net.exe\",\"cat\":\"process\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"detail\":\"C:\\\\Windows\\\\System32\\\\net.exe use Z:\",\"exitCode\":2,\"outputBytes\":10}}") != std::string::npos);
+
+    // Steps are named by their title; no exit code was given
+    CHECK(json.find("{\"name\":\"Map drive\",\"cat\":\"step\"") != std::string::npos);
+    CHECK(json.find("\"detail\":\"Map drive\",\"outputBytes\":0}}") != std::string::npos);
+    CHECK(json.find("\"droppedEvents\":0") != std::string::npos);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Secrets
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(TraceRecorder_RedactsSecretTokens)
+{
+    StartRecording();
+    CTraceRecorder::AddSecret(_T("Qx7pass"));
+    RecordDetail("process", _T("net.exe use \\\\dev\\share"), _T("/user:test Qx7pass"));
+    RecordDetail("process", _T("echo aQx7passb"));        // part of a longer word: left alone
+
+    std::string json = ExportTrace();
+    CHECK(json.find("/user:test ***\"") != std::string::npos);
+    CHECK(json.find("echo aQx7passb") != std::string::npos);
+    CHECK(CountOf(json, "Qx7pass") == 1);
+}
+
+TEST_CASE(TraceRecorder_RedactsASecretCutByTruncation)
+{
+    StartRecording();
+    CTraceRecorder::AddSecret(_T("Vb3secret"));
+
+    // The secret starts four characters before the cut
+    CString padding(_T('x'), static_cast<int>(CTraceRecorder::MAX_DETAIL) - 5);
+    RecordDetail("process", padding, _T("Vb3secret"));
+
+    std::string json = ExportTrace();
+    CHECK(json.find("Vb3s") == std::string::npos);
+    CHECK(json.find("x ***\"") != std::string::npos);
+}
+
+// ════════════════════════════════════════════════════════════════
+// Capacity
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(TraceRecorder_CountsEventsPastTheCapacity)
+{
+    StartRecording();
+    for (size_t i = 0; i < CTraceRecorder::CAPACITY + 5; i++)
+        RecordDetail("com", _T("ITaskService::GetTask"));
+
+    std::string json = ExportTrace();
+    CHECK(CountOf(json, "\"ph\":\"X\"") == CTraceRecorder::CAPACITY);
+    CHECK(json.find("\"droppedEvents\":5") != std::string::npos);
+
+    CTraceRecorder::Reset();
+    json = ExportTrace();
+    CHECK(CountOf(json, "\"ph\":\"X\"") == 0);
+    CHECK(json.find("\"droppedEvents\":0") != std::string::npos);
+}
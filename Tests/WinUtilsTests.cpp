@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "../Common/WinUtils.h"
+#include <thread>
+
+// ════════════════════════════════════════════════════════════════
+// CWinUtils::WaitUntil
+// ════════════════════════════════════════════════════════════════
+
+TEST_CASE(WaitUntil_ReturnsAtOnceWhenAlreadyDone)
+{
+    int polls = 0;
+    DWORD waitMs = 12345;
+    CHECK(CWinUtils::WaitUntil([&polls] { polls++; return true; }, 10000, &waitMs));
+    CHECK(polls == 1);
+    CHECK(waitMs < 100);
+}
+
+TEST_CASE(WaitUntil_TimesOutWithBackedOffPolls)
+{
+    int polls = 0;
+    DWORD waitMs = 0;
+    CHECK(!CWinUtils::WaitUntil([&polls] { polls++; return false; }, 600, &waitMs));
+    CHECK(waitMs >= 600 && waitMs < 2000);
+
+    // 10, 20, 40, 80, 160, 250 ms...: a handful of polls, not one per 10 ms
+    CHECK(polls >= 4 && polls <= 12);
+}
+
+TEST_CASE(WaitUntil_StopsWhenCancelled)
+{
+    HANDLE hCancel = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    REQUIRE(hCancel != nullptr);
+    CWinUtils::SetCancelEvent(hCancel);
+    std::thread canceller([hCancel] {
+        Sleep(200);
+        SetEvent(hCancel);
+    });
+
+    DWORD waitMs = 0;
+    bool done = CWinUtils::WaitUntil([] { return false; }, 30000, &waitMs);
+    canceller.join();
+    CWinUtils::SetCancelEvent(nullptr);
+    CloseHandle(hCancel);
+
+    CHECK(!done);
+    CHECK(waitMs >= 150 && waitMs < 5000);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#ifndef PCH_H
+#define PCH_H
+
+#include "framework.h"
+
+#endif // PCH_H